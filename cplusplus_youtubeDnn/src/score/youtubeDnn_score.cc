@@ -266,29 +266,17 @@ void YOUTUBEDNNScore::calc_grad_sgd(
       for(index_t in_i=0; in_i < input_num; in_i++){
           real_t* w   = model.GetFulllayer_w(layer_j,in_i,aligned_k);
           real_t in_v = *(input+in_i);
-          // calc weight change
-          real_t w_change_tmp[pass_g_num]={0.0};
-          for(index_t out_i=0; out_i < pass_g_num; out_i++){
-              w_change_tmp[out_i]=learning_rate_ * in_v * *(pass_g+out_i);
-
-              // debug
-//              real_t tmp= *(w+out_i) - w_change_tmp[out_i];
-//              if(std::isnan(tmp) == 1){
-//                  std::cout<<"isnan:"<< tmp << std::endl;
-//              }
-
-          }
-          // calc 局部梯度(激活函数前的梯度) g
+          // calc 局部梯度(激活函数前的梯度) g with the old weight, and then
+          // update the weight in place. This avoids a VLA for the weight
+          // change of each neuron.
           real_t g_sum_tmp=0.0;
           for(index_t out_i=0; out_i < pass_g_num; out_i++){
-              g_sum_tmp += *(w+out_i) * *(pass_g+out_i);
+              real_t g_out = *(pass_g+out_i);
+              g_sum_tmp += *(w+out_i) * g_out;
+              *(w+out_i) -= learning_rate_ * in_v * g_out;
           }
           // 把 局部梯度(激活函数前的梯度) g   , 使用 GetmidScore[即input] 来存储
           *(input+in_i) = ( in_v > 0.0) ? g_sum_tmp : 0.0;   // active function
-          // update
-          for(index_t out_i=0; out_i < pass_g_num; out_i++){
-              *(w+out_i) -= w_change_tmp[out_i];
-          }
       }
 
       // update b
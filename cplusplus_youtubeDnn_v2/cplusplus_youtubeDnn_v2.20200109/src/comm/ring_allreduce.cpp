@@ -0,0 +1,284 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of RingAllreduce.
+*/
+
+#include "src/comm/ring_allreduce.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+
+namespace youtubDnn {
+
+    static std::string socket_path(const std::string& comm_dir, index_t rank) {
+        return comm_dir + "/rank" + std::to_string(rank) + ".sock";
+    }
+
+    static bool fill_addr(const std::string& path, sockaddr_un* addr) {
+        if (path.size() >= sizeof(addr->sun_path)) {
+            std::cout << "Socket path is too long: " << path << "\n";
+            return false;
+        }
+        memset(addr, 0, sizeof(sockaddr_un));
+        addr->sun_family = AF_UNIX;
+        strncpy(addr->sun_path, path.c_str(), sizeof(addr->sun_path) - 1);
+        return true;
+    }
+
+    // Blocking write and read used in the handshake.
+    static bool write_all(int fd, const char* buf, size_t bytes) {
+        while (bytes > 0) {
+            ssize_t ret = send(fd, buf, bytes, MSG_NOSIGNAL);
+            if (ret < 0 && errno == EINTR) { continue; }
+            if (ret <= 0) { return false; }
+            buf += ret;
+            bytes -= ret;
+        }
+        return true;
+    }
+
+    static bool read_all(int fd, char* buf, size_t bytes) {
+        while (bytes > 0) {
+            ssize_t ret = recv(fd, buf, bytes, 0);
+            if (ret < 0 && errno == EINTR) { continue; }
+            if (ret <= 0) { return false; }
+            buf += ret;
+            bytes -= ret;
+        }
+        return true;
+    }
+
+    bool RingAllreduce::connect_right(const std::string& path) {
+        sockaddr_un addr;
+        if (!fill_addr(path, &addr)) { return false; }
+        // The neighbor may not be listening yet
+        for (int i = 0; i < kConnectTimeout * 100; ++i) {
+            int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd < 0) { return false; }
+            if (connect(fd, (sockaddr*)&addr, sizeof(addr)) == 0) {
+                right_fd_ = fd;
+                return true;
+            }
+            close(fd);
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        std::cout << "Cannot connect to " << path << "\n";
+        return false;
+    }
+
+    bool RingAllreduce::Initialize(index_t rank,
+                                   index_t world,
+                                   const std::string& comm_dir) {
+        rank_ = rank;
+        world_ = world;
+        bytes_ = 0;
+        comm_pool_ = new ThreadPool(1);
+        if (world_ <= 1) { return true; }
+        if (rank_ >= world_) {
+            std::cout << "Rank " << rank_ << " is out of world size "
+                      << world_ << "\n";
+            return false;
+        }
+        mkdir(comm_dir.c_str(), 0700);
+        /*********************************************************
+         *  Listen on our own socket                             *
+         *********************************************************/
+        listen_path_ = socket_path(comm_dir, rank_);
+        sockaddr_un addr;
+        if (!fill_addr(listen_path_, &addr)) { return false; }
+        listen_fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (listen_fd_ < 0) { return false; }
+        unlink(listen_path_.c_str());  // left by a crashed run
+        if (bind(listen_fd_, (sockaddr*)&addr, sizeof(addr)) != 0 ||
+            listen(listen_fd_, 1) != 0) {
+            std::cout << "Cannot listen on " << listen_path_ << ": "
+                      << strerror(errno) << "\n";
+            return false;
+        }
+        /*********************************************************
+         *  Connect to the right and accept the left             *
+         *********************************************************/
+        if (!connect_right(socket_path(comm_dir, (rank_ + 1) % world_))) {
+            return false;
+        }
+        pollfd pfd;
+        pfd.fd = listen_fd_;
+        pfd.events = POLLIN;
+        if (poll(&pfd, 1, kConnectTimeout * 1000) != 1) {
+            std::cout << "Rank " << (rank_ + world_ - 1) % world_
+                      << " did not connect to " << listen_path_ << "\n";
+            return false;
+        }
+        left_fd_ = accept(listen_fd_, nullptr, nullptr);
+        if (left_fd_ < 0) { return false; }
+        // Make sure that all of the ranks agree on the ring
+        index_t hello[2] = {rank_, world_};
+        index_t peer[2] = {0, 0};
+        if (!write_all(right_fd_, (char*)hello, sizeof(hello)) ||
+            !read_all(left_fd_, (char*)peer, sizeof(peer))) {
+            return false;
+        }
+        if (peer[0] != (rank_ + world_ - 1) % world_ || peer[1] != world_) {
+            std::cout << "Ring mismatch: rank " << rank_ << " of " << world_
+                      << " is connected by rank " << peer[0] << " of "
+                      << peer[1] << "\n";
+            return false;
+        }
+        // send_recv() polls both sides
+        fcntl(left_fd_, F_SETFL, fcntl(left_fd_, F_GETFL) | O_NONBLOCK);
+        fcntl(right_fd_, F_SETFL, fcntl(right_fd_, F_GETFL) | O_NONBLOCK);
+        return true;
+    }
+
+    void RingAllreduce::Finalize() {
+        // Wait for the queued buckets
+        delete comm_pool_;
+        comm_pool_ = nullptr;
+        if (left_fd_ >= 0) { close(left_fd_); }
+        if (right_fd_ >= 0) { close(right_fd_); }
+        if (listen_fd_ >= 0) {
+            close(listen_fd_);
+            unlink(listen_path_.c_str());
+        }
+        left_fd_ = right_fd_ = listen_fd_ = -1;
+    }
+
+    void RingAllreduce::send_recv(const char* sbuf, size_t sbytes,
+                                  char* rbuf, size_t rbytes) {
+        bytes_ += sbytes;
+        while (sbytes > 0 || rbytes > 0) {
+            pollfd pfd[2];
+            pfd[0].fd = right_fd_;
+            pfd[0].events = sbytes > 0 ? POLLOUT : 0;
+            pfd[1].fd = left_fd_;
+            pfd[1].events = rbytes > 0 ? POLLIN : 0;
+            if (poll(pfd, 2, -1) < 0) {
+                if (errno == EINTR) { continue; }
+                std::cout << "poll() failed: " << strerror(errno) << "\n";
+                exit(0);
+            }
+            if (sbytes > 0 && (pfd[0].revents & (POLLOUT | POLLERR | POLLHUP))) {
+                ssize_t ret = send(right_fd_, sbuf, sbytes, MSG_NOSIGNAL);
+                if (ret < 0 && errno != EAGAIN && errno != EINTR) {
+                    std::cout << "Rank " << rank_ << " lost its right neighbor\n";
+                    exit(0);
+                }
+                if (ret > 0) { sbuf += ret; sbytes -= ret; }
+            }
+            if (rbytes > 0 && (pfd[1].revents & (POLLIN | POLLERR | POLLHUP))) {
+                ssize_t ret = recv(left_fd_, rbuf, rbytes, 0);
+                if (ret == 0 || (ret < 0 && errno != EAGAIN && errno != EINTR)) {
+                    std::cout << "Rank " << rank_ << " lost its left neighbor\n";
+                    exit(0);
+                }
+                if (ret > 0) { rbuf += ret; rbytes -= ret; }
+            }
+        }
+    }
+
+    //------------------------------------------------------------------------------
+    // Ring allreduce. data is split into world_ chunks. In step s of the
+    // reduce-scatter, rank r sends chunk (r-s) and adds the received chunk
+    // (r-s-1) into its own copy, so that after world_-1 steps rank r owns
+    // the total of chunk (r+1). The all-gather then passes the totals
+    // around the ring in world_-1 steps.
+    //------------------------------------------------------------------------------
+    void RingAllreduce::allreduce(real_t* data, size_t n) {
+        if (world_ <= 1 || n == 0) { return; }
+        size_t max_chunk = getEnd(n, world_, world_ - 1) -
+                           getStart(n, world_, world_ - 1);
+        if (recv_buf_.size() < max_chunk) { recv_buf_.resize(max_chunk); }
+        for (index_t s = 0; s < world_ - 1; ++s) {
+            index_t send_c = (rank_ + world_ - s) % world_;
+            index_t recv_c = (rank_ + world_ - s - 1) % world_;
+            size_t s_start = getStart(n, world_, send_c);
+            size_t s_end = getEnd(n, world_, send_c);
+            size_t r_start = getStart(n, world_, recv_c);
+            size_t r_end = getEnd(n, world_, recv_c);
+            send_recv((char*)(data + s_start), (s_end - s_start) * sizeof(real_t),
+                      (char*)recv_buf_.data(), (r_end - r_start) * sizeof(real_t));
+            real_t* dst = data + r_start;
+            for (size_t i = 0; i < r_end - r_start; ++i) {
+                dst[i] += recv_buf_[i];
+            }
+        }
+        for (index_t s = 0; s < world_ - 1; ++s) {
+            index_t send_c = (rank_ + 1 + world_ - s) % world_;
+            index_t recv_c = (rank_ + world_ - s) % world_;
+            size_t s_start = getStart(n, world_, send_c);
+            size_t s_end = getEnd(n, world_, send_c);
+            size_t r_start = getStart(n, world_, recv_c);
+            size_t r_end = getEnd(n, world_, recv_c);
+            send_recv((char*)(data + s_start), (s_end - s_start) * sizeof(real_t),
+                      (char*)(data + r_start), (r_end - r_start) * sizeof(real_t));
+        }
+    }
+
+    // Ring all-gather: in step s rank r forwards the block of rank (r-s).
+    void RingAllreduce::allgather(const void* in, size_t bytes, void* out) {
+        char* buf = (char*)out;
+        memcpy(buf + rank_ * bytes, in, bytes);
+        for (index_t s = 0; s < world_ - 1; ++s) {
+            index_t send_b = (rank_ + world_ - s) % world_;
+            index_t recv_b = (rank_ + world_ - s - 1) % world_;
+            send_recv(buf + send_b * bytes, bytes, buf + recv_b * bytes, bytes);
+        }
+    }
+
+    void RingAllreduce::Allreduce(real_t* data, size_t n) {
+        AllreduceAsync(data, n).get();
+    }
+
+    std::future<void> RingAllreduce::AllreduceAsync(real_t* data, size_t n) {
+        return comm_pool_->enqueue([this, data, n]() {
+            this->allreduce(data, n);
+        });
+    }
+
+    void RingAllreduce::Allgather(const void* in, size_t bytes, void* out) {
+        comm_pool_->enqueue([this, in, bytes, out]() {
+            this->allgather(in, bytes, out);
+        }).get();
+    }
+
+    index_t RingAllreduce::AllreduceMax(index_t value) {
+        std::vector<index_t> all(world_, 0);
+        Allgather(&value, sizeof(index_t), all.data());
+        return *std::max_element(all.begin(), all.end());
+    }
+
+    // Summed in rank order, so every rank gets the same value.
+    double RingAllreduce::AllreduceSum(double value) {
+        std::vector<double> all(world_, 0);
+        Allgather(&value, sizeof(double), all.data());
+        double sum = 0;
+        for (index_t i = 0; i < world_; ++i) { sum += all[i]; }
+        return sum;
+    }
+
+}  // namespace youtubDnn
@@ -0,0 +1,138 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the RingAllreduce class, which is used to
+combine the dense gradients of several training processes.
+*/
+
+#ifndef YOUTUBEDNN_COMM_RING_ALLREDUCE_H_
+#define YOUTUBEDNN_COMM_RING_ALLREDUCE_H_
+
+#include <string>
+#include <vector>
+#include <future>
+#include <atomic>
+
+#include "src/base/util.h"
+#include "src/base/thread_pool.h"
+
+namespace youtubDnn {
+
+// Number of real_t in one allreduce bucket (256 KB)
+const size_t kBucketSize = 64 * 1024;
+
+// How long a rank waits for its neighbor to come up (sec)
+const int kConnectTimeout = 60;
+
+//------------------------------------------------------------------------------
+// RingAllreduce connects N processes on one host into a ring over
+// Unix domain sockets. Rank r listens on <comm_dir>/rank<r>.sock,
+// connects to rank (r+1)%N and accepts rank (r-1)%N, so the ranks can
+// be forked by train_main or started by hand (e.g., one per NUMA node
+// or per container sharing comm_dir).
+//
+// Allreduce() uses the bandwidth-optimal ring algorithm: N-1 steps of
+// reduce-scatter followed by N-1 steps of all-gather. Every chunk is
+// reduced in the same order and then broadcast, and hence all of the
+// ranks get bit-identical results. We can use the class like this:
+//
+//    RingAllreduce comm;
+//    if (!comm.Initialize(rank, world, "/tmp/youtubeDnn_comm")) { ... }
+//    /* blocking */
+//    comm.Allreduce(grad, n);
+//    /* overlap: buckets are reduced in FIFO order on one comm thread */
+//    std::future<void> f = comm.AllreduceAsync(grad + off, kBucketSize);
+//    ... /* compute the next bucket */
+//    f.get();
+//
+// Every collective call runs on the comm thread, so the calls are
+// ordered and all of the ranks must issue the same sequence of them.
+//------------------------------------------------------------------------------
+class RingAllreduce {
+public:
+    // Constructor and Desstructor
+    RingAllreduce()
+            : rank_(0),
+              world_(1),
+              listen_fd_(-1),
+              left_fd_(-1),
+              right_fd_(-1),
+              comm_pool_(nullptr),
+              bytes_(0) { }
+    ~RingAllreduce() { Finalize(); }
+
+    // Join the ring. Return false if the neighbors cannot be reached.
+    bool Initialize(index_t rank,
+                    index_t world,
+                    const std::string& comm_dir);
+
+    // Close the sockets and stop the comm thread.
+    void Finalize();
+
+    // Sum data over all of the ranks in place.
+    void Allreduce(real_t* data, size_t n);
+
+    // Queue Allreduce(data, n) on the comm thread.
+    std::future<void> AllreduceAsync(real_t* data, size_t n);
+
+    // Gather 'bytes' bytes from every rank into out[rank*bytes].
+    void Allgather(const void* in, size_t bytes, void* out);
+
+    // Return the max value and the sum over all of the ranks.
+    index_t AllreduceMax(index_t value);
+    double AllreduceSum(double value);
+
+    inline index_t Rank() const { return rank_; }
+    inline index_t World() const { return world_; }
+
+    // Bytes sent by this rank.
+    inline uint64 Bytes() const { return bytes_; }
+
+protected:
+    /* Rank of current process */
+    index_t rank_;
+    /* Number of processes */
+    index_t world_;
+    /* Socket of <comm_dir>/rank<r>.sock */
+    int listen_fd_;
+    std::string listen_path_;
+    /* Receive from rank-1 and send to rank+1 */
+    int left_fd_;
+    int right_fd_;
+    /* One thread runs the queued buckets in order */
+    ThreadPool* comm_pool_;
+    /* Receive buffer for reduce-scatter */
+    std::vector<real_t> recv_buf_;
+    /* Bytes sent by this rank */
+    std::atomic<uint64> bytes_;
+
+    // Send sbuf to the right and receive rbuf from the left at
+    // the same time, so that a full ring never blocks.
+    void send_recv(const char* sbuf, size_t sbytes,
+                   char* rbuf, size_t rbytes);
+
+    // Run on the comm thread.
+    void allreduce(real_t* data, size_t n);
+    void allgather(const void* in, size_t bytes, void* out);
+
+    // Connect to rank (rank_+1)%world_.
+    bool connect_right(const std::string& path);
+};
+
+}  // namespace youtubDnn
+
+#endif  // YOUTUBEDNN_COMM_RING_ALLREDUCE_H_
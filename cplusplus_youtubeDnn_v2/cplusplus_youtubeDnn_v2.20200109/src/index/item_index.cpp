@@ -0,0 +1,373 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the ItemIndex class.
+*/
+
+#include "src/index/item_index.h"
+
+#include <string.h>
+#include <xmmintrin.h>  // for SSE
+
+#include <algorithm>
+#include <functional>
+#include <random>
+
+#include "src/base/file_util.h"
+
+namespace youtubDnn {
+
+// Header of the index file.
+static const uint64 kIndexMagic = 0x31584449564e4459ULL;  // "YDNVIDX1"
+
+// Inner product of two vectors. Four lanes are summed by
+// SSE, and the rest (len is not aligned) one by one.
+static inline real_t dot(const real_t* a, const real_t* b, index_t len) {
+    __m128 sum = _mm_setzero_ps();
+    index_t d = 0;
+    for (; d + 8 <= len; d += 8) {
+        __m128 x = _mm_mul_ps(_mm_loadu_ps(a + d), _mm_loadu_ps(b + d));
+        __m128 y = _mm_mul_ps(_mm_loadu_ps(a + d + 4), _mm_loadu_ps(b + d + 4));
+        sum = _mm_add_ps(sum, _mm_add_ps(x, y));
+    }
+    for (; d + 4 <= len; d += 4) {
+        sum = _mm_add_ps(sum, _mm_mul_ps(_mm_loadu_ps(a + d), _mm_loadu_ps(b + d)));
+    }
+    sum = _mm_add_ps(sum, _mm_movehl_ps(sum, sum));
+    sum = _mm_add_ss(sum, _mm_shuffle_ps(sum, sum, 1));
+    real_t result = _mm_cvtss_f32(sum);
+    for (; d < len; ++d) {
+        result += a[d] * b[d];
+    }
+    return result;
+}
+
+// The candidate with the lowest score is at the front of the heap.
+static inline bool heap_cmp(const Candidate& a, const Candidate& b) {
+    return a.score > b.score;
+}
+
+// Build the index over the target embedding of the items.
+void ItemIndex::Build(Model& model,
+                      const std::vector<index_t>& items,
+                      index_t nlist,
+                      ThreadPool* pool) {
+    dim_ = model.get_aligned_k();
+    // The unseen and duplicated items are removed
+    std::vector<index_t> uniq;
+    uniq.reserve(items.size());
+    for (size_t i = 0; i < items.size(); ++i) {
+        if (items[i] < model.GetNumFeature()) {
+            uniq.push_back(items[i]);
+        }
+    }
+    std::sort(uniq.begin(), uniq.end());
+    uniq.erase(std::unique(uniq.begin(), uniq.end()), uniq.end());
+    if (uniq.size() < items.size()) {
+        std::cout<< items.size() - uniq.size() << " of the items are duplicated "
+                 << "or not in the model, and they are ignored." << "\n";
+    }
+    size_t num = uniq.size();
+    std::vector<real_t> vec(num * dim_);
+    for (size_t i = 0; i < num; ++i) {
+        memcpy(vec.data() + i * dim_,
+               model.GetEmbedding_v(uniq[i]),
+               dim_ * sizeof(real_t));
+    }
+    nlist_ = std::max((size_t)1, std::min((size_t)nlist, num));
+    id_.clear();
+    vec_.clear();
+    start_.assign(nlist_ + 1, 0);
+    if (num == 0) {
+        centroid_.assign(nlist_ * dim_, 0);
+        return;
+    }
+    train(vec, num, pool);
+    // Store the items list by list
+    std::vector<index_t> list(num);
+    assign(vec, num, &list, pool);
+    for (size_t i = 0; i < num; ++i) {
+        start_[list[i]+1]++;
+    }
+    for (index_t l = 0; l < nlist_; ++l) {
+        start_[l+1] += start_[l];
+    }
+    std::vector<uint64> pos(start_.begin(), start_.end() - 1);
+    id_.resize(num);
+    vec_.resize(num * dim_);
+    for (size_t i = 0; i < num; ++i) {
+        uint64 p = pos[list[i]]++;
+        id_[p] = uniq[i];
+        memcpy(vec_.data() + p * dim_,
+               vec.data() + i * dim_,
+               dim_ * sizeof(real_t));
+    }
+}
+
+// Run k-means over the vectors and set centroid_.
+void ItemIndex::train(const std::vector<real_t>& vec,
+                      size_t num,
+                      ThreadPool* pool) {
+    // Sample the training vectors
+    std::vector<size_t> order(num);
+    for (size_t i = 0; i < num; ++i) { order[i] = i; }
+    std::default_random_engine generator(1);
+    std::shuffle(order.begin(), order.end(), generator);
+    size_t num_train = std::min(num, (size_t)nlist_ * kIndexTrainPerList);
+    std::vector<real_t> sample(num_train * dim_);
+    for (size_t i = 0; i < num_train; ++i) {
+        memcpy(sample.data() + i * dim_,
+               vec.data() + order[i] * dim_,
+               dim_ * sizeof(real_t));
+    }
+    // The first nlist_ samples are the initial centroids
+    centroid_.assign(sample.begin(), sample.begin() + nlist_ * dim_);
+    std::vector<index_t> list(num_train);
+    std::vector<real_t> sum(nlist_ * dim_);
+    std::vector<size_t> count(nlist_);
+    for (index_t iter = 0; iter < kIndexIter; ++iter) {
+        assign(sample, num_train, &list, pool);
+        std::fill(sum.begin(), sum.end(), 0);
+        std::fill(count.begin(), count.end(), 0);
+        for (size_t i = 0; i < num_train; ++i) {
+            real_t* s = sum.data() + list[i] * dim_;
+            const real_t* x = sample.data() + i * dim_;
+            for (index_t d = 0; d < dim_; ++d) { s[d] += x[d]; }
+            count[list[i]]++;
+        }
+        for (index_t l = 0; l < nlist_; ++l) {
+            real_t* c = centroid_.data() + l * dim_;
+            if (count[l] == 0) {
+                // Restart the empty list from a random sample
+                size_t i = generator() % num_train;
+                memcpy(c, sample.data() + i * dim_, dim_ * sizeof(real_t));
+                continue;
+            }
+            real_t* s = sum.data() + l * dim_;
+            for (index_t d = 0; d < dim_; ++d) { c[d] = s[d] / count[l]; }
+        }
+    }
+}
+
+// Assign the vectors in [start, end) to the nearest centroids.
+static void assign_thread(const real_t* vec,
+                          const real_t* centroid,
+                          const real_t* norm,
+                          index_t nlist,
+                          index_t dim,
+                          std::vector<index_t>* list,
+                          size_t start,
+                          size_t end) {
+    for (size_t i = start; i < end; ++i) {
+        // |x - c|^2 = |x|^2 - 2 * <x, c> + |c|^2
+        const real_t* x = vec + i * dim;
+        index_t best = 0;
+        real_t best_dist = 0;
+        for (index_t l = 0; l < nlist; ++l) {
+            real_t dist = norm[l] - 2 * dot(x, centroid + l * dim, dim);
+            if (l == 0 || dist < best_dist) {
+                best = l;
+                best_dist = dist;
+            }
+        }
+        (*list)[i] = best;
+    }
+}
+
+// Assign the vectors to the nearest centroids.
+void ItemIndex::assign(const std::vector<real_t>& vec,
+                       size_t num,
+                       std::vector<index_t>* list,
+                       ThreadPool* pool) {
+    std::vector<real_t> norm(nlist_);
+    for (index_t l = 0; l < nlist_; ++l) {
+        const real_t* c = centroid_.data() + l * dim_;
+        norm[l] = dot(c, c, dim_);
+    }
+    if (pool == nullptr || num < pool->ThreadNumber()) {
+        assign_thread(vec.data(), centroid_.data(), norm.data(),
+                      nlist_, dim_, list, 0, num);
+        return;
+    }
+    size_t count = pool->ThreadNumber();
+    for (size_t i = 0; i < count; ++i) {
+        pool->enqueue(std::bind(assign_thread,
+                                vec.data(),
+                                centroid_.data(),
+                                norm.data(),
+                                nlist_,
+                                dim_,
+                                list,
+                                getStart(num, count, i),
+                                getEnd(num, count, i)));
+    }
+    pool->Sync(count);
+}
+
+// Scan the items in [start, end) and keep the top-k.
+void ItemIndex::scan(const real_t* query,
+                     uint64 start,
+                     uint64 end,
+                     index_t k,
+                     std::vector<Candidate>* heap) const {
+    for (uint64 i = start; i < end; ++i) {
+        real_t score = dot(query, vec_.data() + i * dim_, dim_);
+        if (heap->size() < k) {
+            heap->push_back(Candidate{id_[i], score});
+            std::push_heap(heap->begin(), heap->end(), heap_cmp);
+        } else if (score > heap->front().score) {
+            std::pop_heap(heap->begin(), heap->end(), heap_cmp);
+            heap->back() = Candidate{id_[i], score};
+            std::push_heap(heap->begin(), heap->end(), heap_cmp);
+        }
+    }
+}
+
+// Get the top-k items by scanning the nprobe lists.
+void ItemIndex::Search(const real_t* query,
+                       index_t k,
+                       index_t nprobe,
+                       std::vector<Candidate>* result) const {
+    result->clear();
+    if (nlist_ == 0 || k == 0) { return; }
+    nprobe = std::max((index_t)1, std::min(nprobe, nlist_));
+    std::vector<Candidate> list(nlist_);
+    for (index_t l = 0; l < nlist_; ++l) {
+        list[l].id = l;
+        list[l].score = dot(query, centroid_.data() + l * dim_, dim_);
+    }
+    std::partial_sort(list.begin(), list.begin() + nprobe,
+                      list.end(), heap_cmp);
+    result->reserve(k);
+    for (index_t p = 0; p < nprobe; ++p) {
+        index_t l = list[p].id;
+        scan(query, start_[l], start_[l+1], k, result);
+    }
+    std::sort(result->begin(), result->end(), heap_cmp);
+}
+
+// Get the exact top-k items by scanning all of the items.
+void ItemIndex::SearchExact(const real_t* query,
+                            index_t k,
+                            std::vector<Candidate>* result) const {
+    result->clear();
+    if (k == 0) { return; }
+    result->reserve(k);
+    scan(query, 0, id_.size(), k, result);
+    std::sort(result->begin(), result->end(), heap_cmp);
+}
+
+// Write the index to a binary file.
+template <typename T>
+static bool write_vector(FILE* file, const std::vector<T>& vec) {
+    uint64 size = vec.size();
+    if (fwrite(&size, sizeof(size), 1, file) != 1) { return false; }
+    return size == 0 || fwrite(vec.data(), sizeof(T), size, file) == size;
+}
+
+// Read a vector of at most max_size elements.
+template <typename T>
+static bool read_vector(FILE* file, uint64 max_size, std::vector<T>* vec) {
+    uint64 size = 0;
+    if (fread(&size, sizeof(size), 1, file) != 1 || size > max_size) {
+        return false;
+    }
+    vec->resize(size);
+    return size == 0 || fread(vec->data(), sizeof(T), size, file) == size;
+}
+
+bool ItemIndex::Serialize(const std::string& filename) const {
+    FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+    if (file == nullptr) { return false; }
+    bool ok = fwrite(&kIndexMagic, sizeof(kIndexMagic), 1, file) == 1 &&
+              fwrite(&dim_, sizeof(dim_), 1, file) == 1 &&
+              fwrite(&nlist_, sizeof(nlist_), 1, file) == 1 &&
+              write_vector(file, centroid_) &&
+              write_vector(file, start_) &&
+              write_vector(file, id_) &&
+              write_vector(file, vec_);
+    Close(file);
+    return ok;
+}
+
+// Load the index written by Serialize(). The sizes of the
+// sections are checked, so that a broken file is rejected.
+bool ItemIndex::Deserialize(const std::string& filename) {
+    FILE* file = OpenFileOrDie(filename.c_str(), "rb");
+    if (file == nullptr) { return false; }
+    uint64 file_size = GetFileSize(file);
+    uint64 magic = 0;
+    bool ok = fread(&magic, sizeof(magic), 1, file) == 1 &&
+              magic == kIndexMagic &&
+              fread(&dim_, sizeof(dim_), 1, file) == 1 &&
+              fread(&nlist_, sizeof(nlist_), 1, file) == 1 &&
+              dim_ > 0 && nlist_ > 0 &&
+              read_vector(file, file_size / sizeof(real_t), &centroid_) &&
+              read_vector(file, file_size / sizeof(uint64), &start_) &&
+              read_vector(file, file_size / sizeof(index_t), &id_) &&
+              read_vector(file, file_size / sizeof(real_t), &vec_);
+    Close(file);
+    if (ok) {
+        ok = centroid_.size() == (uint64)nlist_ * dim_ &&
+             start_.size() == (uint64)nlist_ + 1 &&
+             vec_.size() == (uint64)id_.size() * dim_ &&
+             start_[0] == 0 &&
+             start_[nlist_] == id_.size();
+        for (index_t l = 0; ok && l < nlist_; ++l) {
+            ok = start_[l] <= start_[l+1];
+        }
+    }
+    if (!ok) {
+        std::cout<< "The item index file is broken: " << filename.c_str() << "\n";
+        dim_ = 0;
+        nlist_ = 0;
+        centroid_.clear();
+        start_.clear();
+        id_.clear();
+        vec_.clear();
+    }
+    return ok;
+}
+
+// Return true if the index fits the target embedding of the model.
+bool ItemIndex::Match(Model& model) const {
+    if (dim_ != model.get_aligned_k()) { return false; }
+    for (size_t i = 0; i < id_.size(); ++i) {
+        if (id_[i] >= model.GetNumFeature()) { return false; }
+    }
+    return true;
+}
+
+// Fraction of the exact top-K items found in result.
+real_t ItemIndex::Recall(const std::vector<Candidate>& result,
+                         const std::vector<Candidate>& exact) {
+    if (exact.empty()) { return 1.0; }
+    std::vector<index_t> ids(exact.size());
+    for (size_t i = 0; i < exact.size(); ++i) {
+        ids[i] = exact[i].id;
+    }
+    std::sort(ids.begin(), ids.end());
+    size_t hit = 0;
+    for (size_t i = 0; i < result.size(); ++i) {
+        if (std::binary_search(ids.begin(), ids.end(), result[i].id)) {
+            hit++;
+        }
+    }
+    return (real_t)hit / exact.size();
+}
+
+}  // namespace youtubDnn
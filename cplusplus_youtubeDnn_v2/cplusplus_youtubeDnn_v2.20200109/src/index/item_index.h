@@ -0,0 +1,166 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the ItemIndex class, which retrieves the top-K
+target items of a user from the target embedding table (field 0).
+*/
+
+#ifndef YOUTUBEDNN_INDEX_ITEM_INDEX_H_
+#define YOUTUBEDNN_INDEX_ITEM_INDEX_H_
+
+#include <string>
+#include <vector>
+
+#include "src/base/util.h"
+#include "src/base/thread_pool.h"
+#include "src/modelParameter/parameters.h"
+
+namespace youtubDnn {
+
+// Number of k-means iterations used to build the lists.
+const index_t kIndexIter = 10;
+
+// At most kIndexTrainPerList sampled items for each
+// list are used by k-means, and then all of the items
+// are assigned to the nearest centroid.
+const index_t kIndexTrainPerList = 256;
+
+// One retrieved item.
+struct Candidate {
+    /* Feature id of the item */
+    index_t id;
+    /* Score of the item */
+    real_t score;
+};
+
+//------------------------------------------------------------------------------
+// Network::CalcScore() is the inner product of the target embedding
+// (field 0) and the output of the last fulllayer, which only depends
+// on the other fields (the user). With one target item i of value 1:
+//
+//   score(u, i) = < norm * fulllayer_last(u), E_i >
+//
+// where E_i = GetEmbedding_v(i) and norm is the norm of the row with
+// the item. Hence, the user tower is computed once for each user
+// (Network::CalcQuery), and the top-K items are the top-K inner
+// products over the target embedding table, which is a maximum inner
+// product search.
+//
+// The ItemIndex is an inverted file (IVF) over the embedding of the
+// items. The items are clustered by k-means into nlist lists, and the
+// vectors of a list are stored together. Search() ranks the centroids
+// by the inner product with the query, and then scans the nprobe best
+// lists. SearchExact() scans all of the items, and is used to measure
+// the recall@K. We can use the ItemIndex like this:
+//
+//    ItemIndex index;
+//    index.Build(model, items, 1024, pool);  /* nlist */
+//    std::vector<real_t> query(index.GetDim());
+//    network.CalcQuery(row, model, thread_i, norm, query.data());
+//    index.Search(query.data(), 100, 16, &result);  /* top-K, nprobe */
+//    /* result[n].score == network.CalcScore(row with result[n].id) */
+//
+// The index keeps a copy of the embedding, and hence it does not need
+// the model after it is built. Serialize() saves it to a binary file,
+// which is loaded by Deserialize() to serve the retrieval without
+// building the index again.
+//------------------------------------------------------------------------------
+class ItemIndex {
+public:
+    // Constructor and Desstructor
+    ItemIndex() : dim_(0), nlist_(0) { }
+    ~ItemIndex() { }
+
+    // Build the index over the target embedding of the items.
+    // The nlist is clipped to the number of items. The k-means
+    // runs in the given pool.
+    void Build(Model& model,
+               const std::vector<index_t>& items,
+               index_t nlist,
+               ThreadPool* pool = nullptr);
+
+    // Get the top-k items by scanning the nprobe lists whose
+    // centroids have the largest inner product with the query.
+    // The result is sorted by the score in descending order.
+    void Search(const real_t* query,
+                index_t k,
+                index_t nprobe,
+                std::vector<Candidate>* result) const;
+
+    // Get the exact top-k items by scanning all of the items.
+    void SearchExact(const real_t* query,
+                     index_t k,
+                     std::vector<Candidate>* result) const;
+
+    // Save the index to a binary file. Return false on error.
+    bool Serialize(const std::string& filename) const;
+
+    // Load the index saved by Serialize(). Return false if
+    // the file cannot be read or it is broken.
+    bool Deserialize(const std::string& filename);
+
+    // Return true if the index fits the target embedding
+    // of the model (the same K, and the items are in it).
+    bool Match(Model& model) const;
+
+    // Fraction of the exact top-K items found in result.
+    static real_t Recall(const std::vector<Candidate>& result,
+                         const std::vector<Candidate>& exact);
+
+    // Number of real_t of the query and item vectors.
+    inline index_t GetDim() const { return dim_; }
+
+    // Number of items and lists.
+    inline size_t GetNumItem() const { return id_.size(); }
+    inline index_t GetNumList() const { return nlist_; }
+
+protected:
+    /* Length of the target embedding (aligned K) */
+    index_t dim_;
+    /* Number of lists */
+    index_t nlist_;
+    /* Centroids of the lists (nlist_ * dim_) */
+    std::vector<real_t> centroid_;
+    /* The items of list l are in [start_[l], start_[l+1]) */
+    std::vector<uint64> start_;
+    /* Feature id of the items in list order */
+    std::vector<index_t> id_;
+    /* Embedding of the items in list order */
+    std::vector<real_t> vec_;
+
+    // Run k-means over the vectors and set centroid_.
+    void train(const std::vector<real_t>& vec,
+               size_t num,
+               ThreadPool* pool);
+
+    // Assign the vectors to the nearest centroids.
+    void assign(const std::vector<real_t>& vec,
+                size_t num,
+                std::vector<index_t>* list,
+                ThreadPool* pool);
+
+    // Scan the items in [start, end) and keep the top-k.
+    void scan(const real_t* query,
+              uint64 start,
+              uint64 end,
+              index_t k,
+              std::vector<Candidate>* heap) const;
+};
+
+}  // namespace youtubDnn
+
+#endif  // YOUTUBEDNN_INDEX_ITEM_INDEX_H_
@@ -335,9 +335,78 @@ namespace youtubDnn {
     }
 
 
+    // Calculate gradient in one thread without updating the model.
+    // The model is updated by the master thread after every mini-batch,
+    // and the backprop of the last row posts the layers to the ring.
+    static void ce_gradient_dist_thread(const DMatrix* matrix,
+                                        Model* model,
+                                        index_t thread_i,
+                                        Network* network_,
+                                        real_t* sum,
+                                        size_t start_idx,
+                                        size_t end_idx) {
+        for (size_t i = start_idx; i < end_idx; ++i) {
+            SparseRow* row = matrix->row[i];
+            real_t norm = matrix->norm[i];
+            real_t pred = network_->CalcScore(row, *model, thread_i,norm);
+            pred = cli_value(sigmod(pred));
+            real_t label = (matrix->Y[i] > 0.5) ? 1.0 : 0.0;
+            *sum += -1.0 * ( (label > 0.5) ? log(pred) : log(1.0-pred) );
+            network_->CalcGrad(row, *model, thread_i, pred - label, norm,
+                               i + 1 == end_idx);
+        }
+        // No row in this step: the layers of this thread are done
+        if (start_idx == end_idx) {
+            for (int layer_j = model->GetNumFullLayerCell()-1; layer_j >= 0; --layer_j) {
+                network_->FinishLayer(*model, layer_j);
+            }
+        }
+    }
 
 
+    //------------------------------------------------------------------------------
+// Calculate gradient in multi-process
+//
+//        process_0                  process_1
+//     thread_1 thread_2          thread_1 thread_2     <- batch_size rows
+//          \    /                     \    /
+//        UpDate_AllProcesses <--ring--> UpDate_AllProcesses
+//                   (next mini-batch)
+//------------------------------------------------------------------------------
+    void CrossEntropyLoss::CalcGradDist(const DMatrix* matrix,
+                                        Model& model,
+                                        RingAllreduce* comm) {
+        size_t row_len = (matrix == nullptr) ? 0 : matrix->row_length;
+        total_example_ += row_len;
+        index_t count = threadNumber_ ;
+        // The process with the most data decides the number of steps
+        index_t steps = (row_len + batch_size_ - 1) / batch_size_;
+        steps = comm->AllreduceMax(steps);
 
-
+        std::vector<real_t> sum(count, 0);
+        for (index_t step = 0; step < steps; ++step) {
+            size_t batch_start = std::min(row_len, (size_t)step * batch_size_);
+            size_t batch_len = std::min(row_len - batch_start, (size_t)batch_size_);
+            // Empty steps still post their (zero) layers
+            network_->BeginStep(model, comm);
+            for (int i = 0; i < count; ++i) {
+                pool_->enqueue(std::bind(ce_gradient_dist_thread,
+                                         matrix,
+                                         &model,
+                                         i,
+                                         network_,
+                                         &(sum[i]),
+                                         batch_start + getStart(batch_len, count, i),
+                                         batch_start + getEnd(batch_len, count, i)));
+            }
+            // Wait all of the threads finish their job
+            pool_->Sync(count);
+            network_->UpDate_AllProcesses(model, comm);
+        }
+        // Accumulate loss
+        for (int i = 0; i < sum.size(); ++i) {
+            loss_sum_ += sum[i];
+        }
+    }
 
 }
@@ -13,6 +13,7 @@
 #include "src/base/util.h"
 #include "src/base/thread_pool.h"
 #include "src/network/network.h"
+#include "src/comm/ring_allreduce.h"
 #include "src/modelParameter/parameters.h"
 
 namespace youtubDnn {
@@ -47,6 +48,20 @@ namespace youtubDnn {
         // This function will also acummulate loss value.
         void CalcGrad(const DMatrix* data_matrix,Model& model);
 
+        // Data-parallel version of CalcGrad. Each process passes its own
+        // shard (nullptr if it has no more data) and all of them walk
+        // through the same number of mini-batches of batch_size_ rows,
+        // summing the changes of the fulllayers over comm at each step.
+        void CalcGradDist(const DMatrix* data_matrix,
+                          Model& model,
+                          RingAllreduce* comm);
+
+        // Sum loss_sum_ and total_example_ over all of the processes.
+        void AllreduceLoss(RingAllreduce* comm) {
+            loss_sum_ = comm->AllreduceSum(loss_sum_);
+            total_example_ = comm->AllreduceSum(total_example_);
+        }
+
         // Return the calculated loss value
         real_t GetLoss() {
             return loss_sum_ / total_example_;
@@ -20,6 +20,15 @@ namespace youtubDnn {
         /* Number of thread existing in the thread pool */
         int thread_number = 1;
 //------------------------------------------------------------------------------
+// Parameters for data-parallel training
+//------------------------------------------------------------------------------
+        /* Number of training processes on this host */
+        index_t world_size = 1;
+        /* Rank of current process, in [0, world_size) */
+        index_t rank = 0;
+        /* Directory of the Unix sockets used by the processes */
+        std::string comm_dir = "/tmp/youtubeDnn_comm";
+//------------------------------------------------------------------------------
 // Parameters for optimization method
 //------------------------------------------------------------------------------
         /* Hyper param for init model parameters */
@@ -75,6 +84,25 @@ namespace youtubDnn {
         /* If generate prediction file */
         //bool res_out = true;
 //------------------------------------------------------------------------------
+// Parameters for top-K retrieval
+//------------------------------------------------------------------------------
+        /* Feature ids of the target items (field 0), one id in each line.
+        After training, the top-K items of each test row are retrieved
+        if this file is given. */
+        std::string item_file;
+        /* Filename of the item index. A training run builds the index
+        from item_file and saves it to this file. A run without the
+        training file loads this index (or builds and saves it if the
+        file does not exist) and the model from pre_model_file, and it
+        only retrieves the items of the test rows. */
+        std::string index_file;
+        /* Number of the retrieved items */
+        index_t top_k = 100;
+        /* Number of k-means lists of the item index */
+        index_t nlist = 1024;
+        /* Number of lists scanned by a query */
+        index_t nprobe = 16;
+//------------------------------------------------------------------------------
 // Parameters for validation
 //------------------------------------------------------------------------------
         /* Convert predition output to 0 and 1 */
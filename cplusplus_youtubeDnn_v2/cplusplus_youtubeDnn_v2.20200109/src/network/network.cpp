@@ -12,6 +12,53 @@ namespace youtubDnn {
             index_t thread_i,
             real_t norm) {
         index_t aligned_k = model.get_aligned_k();
+        index_t num_fullLayer =model.GetNumFullLayerCell();
+        this->calc_tower(row, model, thread_i, norm);
+
+
+        /*********************************************************
+         *                                               out
+         *                                               /\
+         *                                               ||
+         *                                  / ---------- * -----------\
+         *                                 /                           \
+         *                                /                             \
+         *               filed0:element_mean[aligned_k]     fulllayer(laster):element_mean[aligned_k]
+         *********************************************************/
+        real_t t_all=0.0;
+        for(index_t _d = 0; _d < aligned_k; _d += kAlign) {
+            real_t tmp_targitrid = *(model.GetmidScore_TargitRidEmbedding(thread_i)+ _d);
+            real_t tmp_fulllayer = *(model.GetmidScore_fulllayer(thread_i,num_fullLayer-1)+_d);
+            t_all +=  tmp_targitrid * tmp_fulllayer;
+        }
+
+        return t_all;
+    }
+
+// Write the query of a user row: the output of the last fulllayer
+// scaled by norm, as the target embedding is scaled by norm.
+    void Network::CalcQuery(
+            const SparseRow* row,
+            Model& model,
+            index_t thread_i,
+            real_t norm,
+            real_t* query) {
+        index_t aligned_k = model.get_aligned_k();
+        index_t num_fullLayer =model.GetNumFullLayerCell();
+        this->calc_tower(row, model, thread_i, norm);
+        real_t* output = model.GetmidScore_fulllayer(thread_i,num_fullLayer-1);
+        for(index_t _d = 0; _d < aligned_k; _d += kAlign) {
+            query[_d] = norm * output[_d];
+        }
+    }
+
+// Calculate the embedding of each filed and the fulllayers (the user tower)
+    void Network::calc_tower(
+            const SparseRow* row,
+            Model& model,
+            index_t thread_i,
+            real_t norm) {
+        index_t aligned_k = model.get_aligned_k();
         index_t num_feat = model.GetNumFeature();
         index_t num_fullLayer =model.GetNumFullLayerCell();
 
@@ -110,25 +157,6 @@ namespace youtubDnn {
             input     = output;
             input_num = output_num;
         }
-
-
-        /*********************************************************
-         *                                               out
-         *                                               /\
-         *                                               ||
-         *                                  / ---------- * -----------\
-         *                                 /                           \
-         *                                /                             \
-         *               filed0:element_mean[aligned_k]     fulllayer(laster):element_mean[aligned_k]
-         *********************************************************/
-        real_t t_all=0.0;
-        for(index_t _d = 0; _d < aligned_k; _d += kAlign) {
-            real_t tmp_targitrid = *(model.GetmidScore_TargitRidEmbedding(thread_i)+ _d);
-            real_t tmp_fulllayer = *(model.GetmidScore_fulllayer(thread_i,num_fullLayer-1)+_d);
-            t_all +=  tmp_targitrid * tmp_fulllayer;
-        }
-
-        return t_all;
     }
 
 // Calculate gradient and update current modelParameter parameters.
@@ -137,8 +165,9 @@ namespace youtubDnn {
             Model& model,
             index_t thread_i,
             real_t pg,
-            real_t norm) {
-        this->calc_grad_sgd(row, model, thread_i,pg, norm);
+            real_t norm,
+            bool last_row) {
+        this->calc_grad_sgd(row, model, thread_i,pg, norm, last_row);
     }
 
 // Calculate gradient using sgd
@@ -148,7 +177,8 @@ namespace youtubDnn {
             Model& model,
             index_t thread_i,
             real_t pg,
-            real_t norm) {
+            real_t norm,
+            bool last_row) {
         index_t aligned_k     = model.get_aligned_k();
         index_t num_fullLayer = model.GetNumFullLayerCell();
 
@@ -227,6 +257,10 @@ namespace youtubDnn {
             for(index_t out_i=0; out_i < pass_g_num; out_i++){
                 *(b_change+out_i) += learning_rate_  * *(pass_g+out_i);  // 累加w的变化量
             }
+            // the changes of layer_j are done in this step
+            if (last_row) {
+                FinishLayer(model, layer_j);
+            }
         }
         *(model.GetFulllayer_change_num()+thread_i) = (*(model.GetFulllayer_change_num()+thread_i))+1.0;
     }
@@ -312,5 +346,106 @@ void youtubeDnn_network::UpDate(
     }
 
 
-}
+// 开始一个多进程的 mini-batch
+//
+// The buffer of each layer is posted by FinishLayer() from the backprop
+// of the last rows, so the ring sends the last layer while the threads
+// are still computing the earlier ones.
+    void Network::BeginStep(Model& model, RingAllreduce* comm){
+        index_t num_fullLayer = model.GetNumFullLayerCell();
+        comm_ = comm;
+        // size of the buffer
+        layer_offset_.resize(num_fullLayer);
+        size_t total = 0;
+        for (int layer_j = num_fullLayer-1; layer_j >= 0; --layer_j) {
+            index_t input_num = (layer_j != 0) ? model.GetNum_midScore_fulllayer(layer_j-1)
+                                               : model.GetNum_midScore_OthersEmbedding(0);
+            layer_offset_[layer_j] = total;
+            total += (input_num + 1) * model.GetNum_midScore_fulllayer(layer_j);
+        }
+        grad_buffer_.resize(total + 1);
+        if (layer_done_.size() != num_fullLayer) {
+            std::vector<std::atomic<index_t>> tmp(num_fullLayer);
+            layer_done_.swap(tmp);
+        }
+        for (index_t layer_j = 0; layer_j < num_fullLayer; layer_j++) {
+            layer_done_[layer_j] = 0;
+        }
+        layer_bucket_.clear();
+        layer_bucket_.resize(num_fullLayer);
+    }
 
+// 最后一个完成 layer_j 的线程把所有线程的变化量求和并发送
+    void Network::FinishLayer(Model& model, index_t layer_j){
+        index_t threadNumber = model.GetthreadNumber();
+        if (layer_done_[layer_j].fetch_add(1) + 1 < threadNumber) { return; }
+        // Layers finish in the order L-1, ..., 0 in every thread, and hence
+        // they are posted in the same order on every process.
+        index_t input_num = (layer_j != 0) ? model.GetNum_midScore_fulllayer(layer_j-1)
+                                           : model.GetNum_midScore_OthersEmbedding(0);
+        index_t pass_g_num = model.GetNum_midScore_fulllayer(layer_j);
+        index_t num_w = input_num * pass_g_num;
+        // weights (one continuous block for each thread)
+        real_t* dst = grad_buffer_.data() + layer_offset_[layer_j];
+        memset(dst, 0, (num_w + pass_g_num) * sizeof(real_t));
+        for(index_t thread_i=0; thread_i< threadNumber; thread_i++){
+            real_t* w_change = model.GetFulllayer_w_change(thread_i,layer_j,0);
+            for(index_t i=0; i < num_w; i++){
+                dst[i] += w_change[i];
+                w_change[i] = 0.0;// reset
+            }
+            real_t* b_change = model.GetFulllayer_b_change(thread_i,layer_j);
+            for(index_t out_i=0; out_i < pass_g_num; out_i++){
+                dst[num_w+out_i] += b_change[out_i];
+                b_change[out_i] = 0.0;// reset
+            }
+        }
+        // send the layer in buckets
+        size_t size = num_w + pass_g_num;
+        for (size_t posted = 0; posted < size; posted += kBucketSize) {
+            layer_bucket_[layer_j].push_back(
+                comm_->AllreduceAsync(dst + posted, std::min(kBucketSize, size - posted)));
+        }
+    }
+
+// 把所有线程和所有进程的w变化量求和后一次性更新,并清空  --- AllProcesses
+    void Network::UpDate_AllProcesses(Model& model, RingAllreduce* comm){
+        index_t num_fullLayer = model.GetNumFullLayerCell();
+        index_t threadNumber  = model.GetthreadNumber();
+        real_t* buf = grad_buffer_.data();
+        // change_num
+        size_t last = grad_buffer_.size() - 1;
+        buf[last] = 0.0;
+        for(index_t thread_i=0; thread_i< threadNumber; thread_i++) {
+            buf[last] += *(model.GetFulllayer_change_num() + thread_i);
+            *(model.GetFulllayer_change_num() + thread_i) = 0.0; //reset
+        }
+        comm->Allreduce(buf + last, 1);
+        for (index_t layer_j = 0; layer_j < num_fullLayer; layer_j++) {
+            for (size_t i = 0; i < layer_bucket_[layer_j].size(); ++i) {
+                layer_bucket_[layer_j][i].get();
+            }
+        }
+
+        // update
+        real_t change_num_total = buf[last];
+        if (change_num_total < 0.5) { return; }
+        for (int layer_j = num_fullLayer-1; layer_j >= 0; --layer_j) {
+            index_t input_num = (layer_j != 0) ? model.GetNum_midScore_fulllayer(layer_j-1)
+                                               : model.GetNum_midScore_OthersEmbedding(0);
+            index_t pass_g_num = model.GetNum_midScore_fulllayer(layer_j);
+            index_t num_w = input_num * pass_g_num;
+            const real_t* src = buf + layer_offset_[layer_j];
+            real_t* w = model.GetFulllayer_w(layer_j,0);
+            for(index_t i=0; i < num_w; i++){
+                w[i] -= src[i]/change_num_total;
+            }
+            real_t* b = model.GetFulllayer_b(layer_j);
+            for(index_t out_i=0; out_i < pass_g_num; out_i++){
+                b[out_i] -= src[num_w+out_i]/change_num_total;
+            }
+        }
+    }
+
+
+}
@@ -6,17 +6,20 @@
 #define YOUTUBEDNN_NETWORK_YOUTUBEDNN_NETWORK_H_
 
 
+#include <atomic>
+#include <future>
 #include <vector>
 
 #include "src/modelParameter/parameters.h"
 #include "src/base/util.h"
 #include "src/reader/DMatrix.h"
+#include "src/comm/ring_allreduce.h"
 
 namespace youtubDnn {
 class Network {
 public:
     // Constructor and Desstructor
-    Network() { }
+    Network() : comm_(nullptr) { }
     ~Network() { }
 
     void Initialize(real_t learning_rate) {
@@ -30,27 +33,65 @@ public:
                      index_t thread_i,
                      real_t norm = 1.0);
 
+    // Write the query of a user row (get_aligned_k() real_t). The
+    // inner product of the query and GetEmbedding_v(i) is the
+    // CalcScore() of the row with the target item i of value 1 in
+    // field 0, where norm is the norm of the row with the item.
+    void CalcQuery(const SparseRow* row,
+                   Model& model,
+                   index_t thread_i,
+                   real_t norm,
+                   real_t* query);
+
     // Calculate gradient
     // modelParameter parameters.
+    // If last_row is true (the last row of thread_i in a step started
+    // by BeginStep), every layer is handed to FinishLayer as soon as
+    // its backprop is done.
     void CalcGrad(const SparseRow* row,
                   Model& model,
                   index_t thread_i,
                   real_t pg,
-                  real_t norm = 1.0);
+                  real_t norm = 1.0,
+                  bool last_row = false);
 
     // update
     // void UpDate(Model& modelParameter,index_t thread_i);
     void UpDate_AllThreads(Model& model);
 
+    // Start a mini-batch of data-parallel training over comm.
+    void BeginStep(Model& model, RingAllreduce* comm);
+
+    // Thread thread_i has finished the backprop of layer_j for its
+    // last row. The last thread to finish the layer sums the changes
+    // of all threads and posts them to comm, so the last layer is
+    // sent while the earlier layers are still in backprop.
+    void FinishLayer(Model& model, index_t layer_j);
+
+    // Same as UpDate_AllThreads, but the changes are also summed over
+    // all of the processes in comm. It waits for the layers posted in
+    // this step, and hence every process must call it at the same step
+    // after all of the threads finished. Then all of them keep the same
+    // dense layers.
+    void UpDate_AllProcesses(Model& model, RingAllreduce* comm);
+
 
 
 protected:
+    // Calculate the embedding of each field and the fulllayers,
+    // whose last output is in GetmidScore_fulllayer(thread_i, L-1).
+    void calc_tower(const SparseRow* row,
+                    Model& model,
+                    index_t thread_i,
+                    real_t norm);
+
     // Calculate gradient and update modelParameter using sgd
     void calc_grad_sgd(const SparseRow* row,
                        Model& model,
                        index_t thread_i,
                        real_t pg,
-                       real_t norm = 1.0);
+                       real_t norm = 1.0,
+                       bool last_row = false);
 
     inline real_t relu(real_t input){
         return (input>0.0) ? input:0.0;
@@ -58,6 +99,19 @@ protected:
 
     real_t learning_rate_;
 
+    /* Thread-summed changes of the fulllayers, in the order that
+     * backprop produces them (last layer first):
+     * | w(L-1) b(L-1) | ... | w(0) b(0) | change_num |
+     * where each layer is posted in buckets of kBucketSize */
+    std::vector<real_t> grad_buffer_;
+    /* Offset of each layer in grad_buffer_ */
+    std::vector<size_t> layer_offset_;
+    /* Number of threads that finished each layer in this step */
+    std::vector<std::atomic<index_t>> layer_done_;
+    /* Allreduce of the posted buckets of each layer */
+    std::vector<std::vector<std::future<void>>> layer_bucket_;
+    /* Ring of the current step */
+    RingAllreduce* comm_;
 
 };
 }
@@ -54,6 +54,8 @@ namespace youtubDnn {
             uint64 rd_size = get_line_from_buffer(line_buf, buf, pos, size);
             if (rd_size == 0) break;
             pos += rd_size;
+            // The line belongs to another shard
+            if (line_num_++ % shard_world_ != shard_rank_) continue;
             matrix.AddRow();
             int i = matrix.row_length - 1;
             // Add Y
@@ -19,7 +19,7 @@ namespace youtubDnn {
 //------------------------------------------------------------------------------
 class FFMParser {
     public:
-        FFMParser() { }
+        FFMParser() : shard_rank_(0), shard_world_(1), line_num_(0) { }
         ~FFMParser() {  }
 
         // Wether this dataset contains label y ?
@@ -32,6 +32,13 @@ class FFMParser {
             splitor_ = splitor;
         }
 
+        // Keep only the lines i with (i % world == rank) of the file,
+        // and skip the others without parsing them.
+        inline void setShard(index_t rank, index_t world) {
+            shard_rank_ = rank;
+            shard_world_ = world;
+        }
+
         // The real parse function invoked by users.
         // If reset == true, Parser will invoke matrix.Reset();
         void Parse(char* buf,
@@ -51,6 +58,11 @@ class FFMParser {
         bool has_label_;
         /* Split string for data items */
         std::string splitor_;
+        /* Shard of current process */
+        index_t shard_rank_;
+        index_t shard_world_;
+        /* Number of lines seen in all of the blocks */
+        uint64 line_num_;
 };
 }
 
@@ -122,6 +122,8 @@ void InmemReader::init_from_txt() {
   else parser_->setLabel(false);
   // Set splitor
   parser_->setSplitor(this->splitor_);
+  // Skip the lines of the other shards
+  parser_->setShard(shard_rank_, shard_world_);
   // Convert MB to Byte
   uint64 read_byte = block_size_ * 1024 * 1024;
   // Open file
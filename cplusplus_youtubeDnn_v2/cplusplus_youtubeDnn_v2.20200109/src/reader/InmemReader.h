@@ -29,7 +29,9 @@ class InmemReader {
             shuffle_(false),
             bin_out_(true),
             block_size_(kDefautBlockSize),
-            pos_(0) {
+            pos_(0),
+            shard_rank_(0),
+            shard_world_(1) {
     }
   ~InmemReader() {  }
 
@@ -63,6 +65,13 @@ class InmemReader {
     seed_ = seed;
   }
 
+  // Keep only the rows i with (i % world == rank), which is used by
+  // data-parallel training. Must be called before Initialize().
+  inline void SetShard(index_t rank, index_t world) {
+    shard_rank_ = rank;
+    shard_world_ = world;
+  }
+
   // If shuffle data ?
   inline void SetShuffle(bool shuffle) {
     shuffle_ = shuffle;
@@ -107,6 +116,9 @@ class InmemReader {
   int seed_ = 1;
   /* For random shuffle */
   std::vector<index_t> order_;
+  /* Shard of current process */
+  index_t shard_rank_;
+  index_t shard_world_;
 
 
   // Check current file format and return
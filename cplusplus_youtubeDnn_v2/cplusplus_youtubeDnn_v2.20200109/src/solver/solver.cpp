@@ -5,12 +5,20 @@
 #include "src/solver/solver.h"
 #include "src/base/timer.h"
 
+#include <unistd.h>
+
+#include <fstream>
+
 namespace youtubDnn {
     
     void Solver::Initialize(HyperParam& hyper_param){
         hyper_param_=hyper_param;
         // you can add checker for hyper_param code
-        init_train();
+        if (hyper_param_.is_train) {
+            init_train();
+        } else {
+            init_retrieve();
+        }
     }
 
     /******************************************************************************
@@ -29,6 +37,22 @@ namespace youtubDnn {
         pool_ = new ThreadPool(threadNumber);
         std::cout<< "youtubeDnn uses "<< threadNumber <<"threads for training task." << "\n";
 
+        /*********************************************************
+         *  Join the other training processes                    *
+         *********************************************************/
+        if (hyper_param_.world_size > 1) {
+            comm_ = new RingAllreduce();
+            if (!comm_->Initialize(hyper_param_.rank,
+                                   hyper_param_.world_size,
+                                   hyper_param_.comm_dir)) {
+                std::cout<< "Cannot join the ring of "<< hyper_param_.world_size
+                         <<" processes in "<< hyper_param_.comm_dir.c_str() <<"\n";
+                exit(0);
+            }
+            std::cout<< "Rank "<< comm_->Rank() <<" of "<< comm_->World()
+                     <<" processes." << "\n";
+        }
+
         /*********************************************************
          *  Initialize Reader                                    *
          *********************************************************/
@@ -39,6 +63,9 @@ namespace youtubDnn {
         train_reader_= new InmemReader();
         train_reader_->SetBlockSize(hyper_param_.block_size);
         train_reader_->SetSeed(hyper_param_.seed);
+        if (comm_ != nullptr) {
+            train_reader_->SetShard(comm_->Rank(), comm_->World());
+        }
         train_reader_->Initialize(hyper_param_.train_set_file);
         if(train_reader_ == nullptr){
             std::cout<< "Cannot open the file "<< hyper_param_.train_set_file.c_str() <<"\n";
@@ -70,6 +97,11 @@ namespace youtubDnn {
         }
         // Return to the begining of target file.
         train_reader_->Reset();
+        // Every process reads a shard, but all of them need the same model
+        if (comm_ != nullptr) {
+            max_feat = comm_->AllreduceMax(max_feat);
+            max_field = comm_->AllreduceMax(max_field);
+        }
 
         hyper_param_.num_feature = max_feat + 1;
         if (hyper_param_.num_feature == 0) {
@@ -138,10 +170,53 @@ namespace youtubDnn {
 
 
 
+    /******************************************************************************
+     * Initialize retrieval task                                                  *
+     *****************************************************************************/
+    void Solver::init_retrieve() {
+        Timer timer;
+        timer.tic();
+        size_t threadNumber = std::thread::hardware_concurrency();
+        if (hyper_param_.thread_number != 0) {
+            threadNumber = hyper_param_.thread_number;
+        }
+        pool_ = new ThreadPool(threadNumber);
+        std::cout<< "youtubeDnn uses "<< threadNumber <<"threads for retrieval task." << "\n";
+        if (hyper_param_.item_file.empty() && hyper_param_.index_file.empty()) {
+            std::cout<< "Retrieval without training needs the item file (-items) "
+                     << "or the item index (-index)." << "\n";
+            exit(0);
+        }
+        if (hyper_param_.pre_model_file.empty()) {
+            std::cout<< "Retrieval without training needs the model (-premodel)." << "\n";
+            exit(0);
+        }
+        // Get the Test Reader
+        if(hyper_param_.test_set_file.empty()) exit(0);
+        test_reader_= new InmemReader();
+        test_reader_->SetBlockSize(hyper_param_.block_size);
+        test_reader_->SetSeed(hyper_param_.seed);
+        test_reader_->Initialize(hyper_param_.test_set_file);
+        std::cout<< "Init Reader: " << hyper_param_.test_set_file.c_str() <<"\n";
+        // The sizes of the model are read from the file
+        model_ = new Model(hyper_param_.pre_model_file,hyper_param_);
+        std::cout << "Number of feature:" << hyper_param_.num_feature <<"\n";
+        std::cout << "Number of field: " << hyper_param_.num_field <<"\n";
+        network_ = new Network();
+        network_->Initialize(hyper_param_.learning_rate);
+        std::cout << "Time cost for loading model: " << timer.toc() <<" (sec)" << "\n";
+    }
+
+
+
     /******************************************************************************
      * Functions for start work                                            *
      ******************************************************************************/
     void Solver::StartWork() {
+        if (!hyper_param_.is_train) {
+            retrieve();
+            return;
+        }
         std::cout << "Start training work." << "\n";
         bool save_txt_model = true;
         std::string txt_model_file=hyper_param_.train_set_file+".model";
@@ -155,7 +230,7 @@ namespace youtubDnn {
         std::cout<<"Time cost for saving txt model: "<< timer.toc() <<" (sec)"<<"\n";
         std::cout<<"Finish training"<<"\n";
         // Save TXT model
-        if (save_txt_model) {
+        if (save_txt_model && is_master()) {
             Timer timer;
             timer.tic();
             std::cout<<"Start to save txt model ..."<<"\n";
@@ -164,6 +239,10 @@ namespace youtubDnn {
             std::cout<<"Time cost for saving txt model: "<<timer.toc() <<"(sec)"<<"\n";
         }
         std::cout<<"Finish training"<<"\n";
+        // Top-K retrieval
+        if (!hyper_param_.item_file.empty() && is_master()) {
+            retrieve();
+        }
 
     }
 
@@ -195,7 +274,7 @@ namespace youtubDnn {
         int stop_window_tmp=0;
 
         MetricInfo te_info;
-        show_average_metric();
+        if (is_master()) { show_average_metric(); }
         for (int n = 1; n <= hyper_param_.num_epoch; ++n) {
             Timer timer;
             timer.tic();
@@ -220,13 +299,15 @@ namespace youtubDnn {
                 }
             }
             // show evaludation metric info
-            show_train_info(tr_loss,
-                            te_info.loss_val,
-                            te_info.metric_val,
-                            timer.toc(),
-                            n,
-                            best_epoch,
-                            hyper_param_.num_epoch);
+            if (is_master()) {
+                show_train_info(tr_loss,
+                                te_info.loss_val,
+                                te_info.metric_val,
+                                timer.toc(),
+                                n,
+                                best_epoch,
+                                hyper_param_.num_epoch);
+            }
             if((stop_window_tmp>=hyper_param_.stop_window)&(hyper_param_.early_stop)){
                 break;
             }
@@ -241,6 +322,7 @@ namespace youtubDnn {
      *  Calc gradient and update model                       *
      *********************************************************/
     real_t Solver::calc_gradient() {
+        if (comm_ != nullptr) { return calc_gradient_dist(); }
         loss_->Reset();
         train_reader_->Reset();
         DMatrix* matrix = nullptr;
@@ -252,6 +334,23 @@ namespace youtubDnn {
         return loss_->GetLoss();
     }
 
+    /*********************************************************
+     *  Calc gradient with the other processes               *
+     *********************************************************/
+    real_t Solver::calc_gradient_dist() {
+        loss_->Reset();
+        train_reader_->Reset();
+        DMatrix* matrix = nullptr;
+        for (;;) {
+            index_t tmp = train_reader_->Samples(matrix);
+            // Go on until every process reaches the end of its shard
+            if (comm_->AllreduceMax(tmp) == 0) { break; }
+            loss_->CalcGradDist(tmp == 0 ? nullptr : matrix, *model_, comm_);
+        }
+        loss_->AllreduceLoss(comm_);
+        return loss_->GetLoss();
+    }
+
     /*********************************************************
      *  Calc evaluation metric                               *
      *********************************************************/
@@ -282,6 +381,180 @@ namespace youtubDnn {
 
 
 
+    /*********************************************************
+     *  Top-K retrieval                                      *
+     *********************************************************/
+    // Compute the query of each row and search the index in one thread.
+    static void retrieve_thread(const DMatrix* matrix,
+                                Model* model,
+                                Network* network,
+                                const ItemIndex* index,
+                                index_t thread_i,
+                                const HyperParam* hyper_param,
+                                std::vector<real_t>* query,
+                                std::vector<std::vector<Candidate>>* result,
+                                size_t start_idx,
+                                size_t end_idx) {
+        index_t dim = index->GetDim();
+        for (size_t i = start_idx; i < end_idx; ++i) {
+            real_t* q = query->data() + i * dim;
+            // The user tower is computed once for all of the items
+            network->CalcQuery(matrix->row[i], *model, thread_i, matrix->norm[i], q);
+            index->Search(q, hyper_param->top_k, hyper_param->nprobe, &(*result)[i]);
+        }
+    }
+
+    // Scan all of the items in one thread.
+    static void retrieve_exact_thread(const ItemIndex* index,
+                                      const HyperParam* hyper_param,
+                                      const std::vector<real_t>* query,
+                                      std::vector<std::vector<Candidate>>* exact,
+                                      size_t start_idx,
+                                      size_t end_idx) {
+        index_t dim = index->GetDim();
+        for (size_t i = start_idx; i < end_idx; ++i) {
+            index->SearchExact(query->data() + i * dim, hyper_param->top_k, &(*exact)[i]);
+        }
+    }
+
+    void Solver::load_index(ItemIndex* index) {
+        Timer timer;
+        timer.tic();
+        // A training run always builds the index, because the
+        // embedding of the model in the file is out of date.
+        if (!hyper_param_.is_train && !hyper_param_.index_file.empty() &&
+            (hyper_param_.item_file.empty() ||
+             access(hyper_param_.index_file.c_str(), F_OK) == 0)) {
+            std::cout<< "Start to load the item index ..." << "\n";
+            if (!index->Deserialize(hyper_param_.index_file)) { exit(0); }
+            if (!index->Match(*model_)) {
+                std::cout<< "The item index " << hyper_param_.index_file.c_str()
+                         << " is not built for this model." << "\n";
+                exit(0);
+            }
+            std::cout<< "Number of item: " << index->GetNumItem()
+                     << ", number of list: " << index->GetNumList() << "\n";
+            std::cout<< "Time cost for loading the index: " << timer.toc() <<" (sec)" << "\n";
+            return;
+        }
+        std::cout<< "Start to build the item index ..." << "\n";
+        std::ifstream item_file(hyper_param_.item_file.c_str());
+        if (!item_file.is_open()) {
+            std::cout<< "Cannot open the file "<< hyper_param_.item_file.c_str() <<"\n";
+            exit(0);
+        }
+        std::vector<index_t> items;
+        index_t item = 0;
+        while (item_file >> item) {
+            items.push_back(item);
+        }
+        index->Build(*model_, items, hyper_param_.nlist, pool_);
+        std::cout<< "Number of item: " << index->GetNumItem()
+                 << ", number of list: " << index->GetNumList() << "\n";
+        std::cout<< "Time cost for building the index: " << timer.toc() <<" (sec)" << "\n";
+        if (!hyper_param_.index_file.empty()) {
+            if (!index->Serialize(hyper_param_.index_file)) {
+                std::cout<< "Cannot save the item index to "
+                         << hyper_param_.index_file.c_str() << "\n";
+                exit(0);
+            }
+            std::cout<< "Item index file: " << hyper_param_.index_file.c_str() << "\n";
+        }
+    }
+
+    void Solver::retrieve() {
+        Timer timer;
+        ItemIndex index;
+        load_index(&index);
+
+        std::string out_file = hyper_param_.test_set_file + ".topk";
+        std::ofstream out(out_file.c_str());
+        index_t count = pool_->ThreadNumber();
+        DMatrix* matrix = nullptr;
+        std::vector<real_t> query;
+        std::vector<std::vector<Candidate>> result, exact;
+        real_t search_time = 0.0, exact_time = 0.0, recall = 0.0;
+        uint64 num_query = 0, num_pos = 0, num_hit = 0;
+        test_reader_->Reset();
+        for (;;) {
+            index_t tmp = test_reader_->Samples(matrix);
+            if (tmp == 0) { break; }
+            query.resize((size_t)tmp * index.GetDim());
+            result.resize(tmp);
+            exact.resize(tmp);
+            // Search the lists
+            timer.reset();
+            timer.tic();
+            for (index_t i = 0; i < count; ++i) {
+                pool_->enqueue(std::bind(retrieve_thread,
+                                         matrix,
+                                         model_,
+                                         network_,
+                                         &index,
+                                         i,
+                                         &hyper_param_,
+                                         &query,
+                                         &result,
+                                         getStart(tmp, count, i),
+                                         getEnd(tmp, count, i)));
+            }
+            pool_->Sync(count);
+            search_time += timer.toc();
+            // Scan all of the items
+            timer.reset();
+            timer.tic();
+            for (index_t i = 0; i < count; ++i) {
+                pool_->enqueue(std::bind(retrieve_exact_thread,
+                                         &index,
+                                         &hyper_param_,
+                                         &query,
+                                         &exact,
+                                         getStart(tmp, count, i),
+                                         getEnd(tmp, count, i)));
+            }
+            pool_->Sync(count);
+            exact_time += timer.toc();
+            for (index_t i = 0; i < tmp; ++i) {
+                recall += ItemIndex::Recall(result[i], exact[i]);
+                // The target item (field 0) of a positive row
+                if (matrix->Y[i] > 0.5) {
+                    SparseRow* row = matrix->row[i];
+                    for (SparseRow::const_iterator iter = row->begin(); iter != row->end(); ++iter) {
+                        if (iter->field_id != 0) { continue; }
+                        num_pos++;
+                        for (size_t n = 0; n < result[i].size(); ++n) {
+                            if (result[i][n].id == iter->feat_id) {
+                                num_hit++;
+                                break;
+                            }
+                        }
+                        break;
+                    }
+                }
+                for (size_t n = 0; n < result[i].size(); ++n) {
+                    out << (n == 0 ? "" : " ") << result[i][n].id << ":" << result[i][n].score;
+                }
+                out << "\n";
+            }
+            num_query += tmp;
+        }
+        out.close();
+        std::cout<< "Top-" << hyper_param_.top_k << " items: " << out_file.c_str() << "\n";
+        if (num_query > 0) {
+            std::cout<< "recall@" << hyper_param_.top_k << " of the index: "
+                     << recall / num_query << "\n";
+            std::cout<< "queries per second: " << num_query / std::max(search_time, (real_t)1e-6)
+                     << " (index), " << num_query / std::max(exact_time, (real_t)1e-6)
+                     << " (brute force)" << "\n";
+        }
+        if (num_pos > 0) {
+            std::cout<< "hit@" << hyper_param_.top_k << " of the positive targets: "
+                     << (real_t)num_hit / num_pos << "\n";
+        }
+    }
+
+
+
     /******************************************************************************
      * Functions for xlearn finalization                                          *
      ******************************************************************************/
@@ -292,6 +565,8 @@ namespace youtubDnn {
         delete this->model_;
         // Clear Reader
         delete train_reader_;
+        // Leave the ring
+        delete comm_;
     }
 
 }
\ No newline at end of file
@@ -10,6 +10,8 @@
 #include "src/reader/InmemReader.h"
 #include "src/network/network.h"
 #include "src/loss/cross_entropy_loss.h"
+#include "src/comm/ring_allreduce.h"
+#include "src/index/item_index.h"
 #include "src/modelParameter/hyperparameters.h"
 #include "src/modelParameter/parameters.h"
 
@@ -18,9 +20,13 @@ namespace youtubDnn {
     public:
         // Constructor and Destructor
         Solver()
-                : network_(nullptr),
+                : model_(nullptr),
+                  train_reader_(nullptr),
+                  test_reader_(nullptr),
+                  network_(nullptr),
                   loss_(nullptr),
-                  metric_(nullptr){ }
+                  metric_(nullptr),
+                  comm_(nullptr){ }
         ~Solver() { }
 
         // Initialize the xLearn environment through the
@@ -59,6 +65,8 @@ namespace youtubDnn {
         AccMetric* metric_;
         /* ThreadPool for multi-thread training */
         ThreadPool* pool_;
+        /* Ring of the training processes (nullptr for one process) */
+        RingAllreduce* comm_;
         /* predict results */
         std::vector<real_t> out_;
 
@@ -67,13 +75,29 @@ namespace youtubDnn {
 
         void init_train();
 
+        // Initialize a retrieval task without training: the
+        // model is loaded from pre_model_file.
+        void init_retrieve();
+
         // Caculate gradient and update model.
         // Return training loss.
         real_t calc_gradient();
+        real_t calc_gradient_dist();
+
+        // Only rank 0 prints the training info and saves the model.
+        bool is_master() { return comm_ == nullptr || comm_->Rank() == 0; }
 
         // Calculate loss value and evaluation metric.
         MetricInfo calc_metric();
 
+        // Retrieve the top-K items of each test row from the
+        // target embedding, and report the recall@K of the index.
+        void retrieve();
+
+        // Load the item index of index_file, or build it from
+        // item_file (and save it to index_file).
+        void load_index(ItemIndex* index);
+
         // Calculate average metric for cross-validation
         void show_average_metric();
 
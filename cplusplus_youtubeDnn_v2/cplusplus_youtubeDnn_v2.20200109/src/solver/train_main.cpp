@@ -3,12 +3,16 @@
 //
 
 
+#include <unistd.h>
+#include <sys/wait.h>
+
 #include "src/solver/solver.h"
 #include "src/modelParameter/hyperparameters.h"
 int main(int argc, char* argv[]) {
     youtubDnn::HyperParam hyper_param;
 
     hyper_param.model_scale = 0.66;
+    bool rank_given = false;
 
     std::string arg_name;
     for (int i = 1; i < argc; i++){
@@ -70,18 +74,74 @@ int main(int argc, char* argv[]) {
                 hyper_param.stop_window = std::stoi(arg_value_str);   // 2
                 std::cout << "hyper_param.stop_window:" << hyper_param.stop_window << "\n";
 
+            }else if(arg_name=="-world"){
+                hyper_param.world_size = std::stoi(arg_value_str);   // 4
+                std::cout << "hyper_param.world_size:" << hyper_param.world_size << "\n";
+
+            }else if(arg_name=="-rank"){
+                hyper_param.rank = std::stoi(arg_value_str);   // 0
+                rank_given = true;
+                std::cout << "hyper_param.rank:" << hyper_param.rank << "\n";
+
+            }else if(arg_name=="-comm_dir"){
+                hyper_param.comm_dir = arg_value_str;   // /tmp/youtubeDnn_comm
+                std::cout << "hyper_param.comm_dir:" << hyper_param.comm_dir << "\n";
+
+            }else if(arg_name=="-items"){
+                hyper_param.item_file = arg_value_str;
+                std::cout << "hyper_param.item_file:" << hyper_param.item_file << "\n";
+
+            }else if(arg_name=="-index"){
+                hyper_param.index_file = arg_value_str;
+                std::cout << "hyper_param.index_file:" << hyper_param.index_file << "\n";
+
+            }else if(arg_name=="-top_k"){
+                hyper_param.top_k = std::stoi(arg_value_str);   // 100
+                std::cout << "hyper_param.top_k:" << hyper_param.top_k << "\n";
+
+            }else if(arg_name=="-nlist"){
+                hyper_param.nlist = std::stoi(arg_value_str);   // 1024
+                std::cout << "hyper_param.nlist:" << hyper_param.nlist << "\n";
+
+            }else if(arg_name=="-nprobe"){
+                hyper_param.nprobe = std::stoi(arg_value_str);   // 16
+                std::cout << "hyper_param.nprobe:" << hyper_param.nprobe << "\n";
+
             }else{
                 std::cout<<arg_name<<" is error"<<"\n";
             }
         }
     }
 
+    // Without -tr, the items are retrieved by the model
+    // of -premodel and the index of -index in one process.
+    hyper_param.is_train = !hyper_param.train_set_file.empty();
+
+    // Without -rank, fork all of the processes on this host.
+    // With -rank, every process is started by hand (e.g., by numactl).
+    std::vector<pid_t> children;
+    if (hyper_param.is_train && hyper_param.world_size > 1 && !rank_given) {
+        std::cout.flush();
+        for (index_t r = 1; r < hyper_param.world_size; ++r) {
+            pid_t pid = fork();
+            if (pid == 0) {
+                hyper_param.rank = r;
+                children.clear();
+                break;
+            }
+            children.push_back(pid);
+        }
+    }
+
     youtubDnn::Solver sol=youtubDnn::Solver();
     sol.Initialize(hyper_param);
-    sol.SetTrain();
     sol.StartWork();
     sol.Clear();
 
+    for (size_t i = 0; i < children.size(); ++i) {
+        waitpid(children[i], nullptr, 0);
+    }
+
     return 0;
 
 
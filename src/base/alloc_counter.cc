@@ -0,0 +1,79 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of the allocation counter.
+*/
+
+#include "src/base/alloc_counter.h"
+
+#include <new>
+#include <atomic>
+
+#ifdef XLEARN_ALLOC_COUNTER
+
+namespace {
+
+std::atomic<uint64> process_alloc_count(0);
+// Plain integer, so that access it will not allocate memory
+thread_local uint64 thread_alloc_count = 0;
+
+inline void* counted_alloc(size_t size) {
+  process_alloc_count.fetch_add(1, std::memory_order_relaxed);
+  thread_alloc_count++;
+  void* ptr = malloc(size == 0 ? 1 : size);
+  if (ptr == nullptr) {
+    throw std::bad_alloc();
+  }
+  return ptr;
+}
+
+}  // namespace
+
+void* operator new(size_t size) {
+  return counted_alloc(size);
+}
+
+void* operator new[](size_t size) {
+  return counted_alloc(size);
+}
+
+void operator delete(void* ptr) noexcept {
+  free(ptr);
+}
+
+void operator delete[](void* ptr) noexcept {
+  free(ptr);
+}
+
+bool AllocCounterEnabled() { return true; }
+
+uint64 ThreadAllocCount() { return thread_alloc_count; }
+
+uint64 ProcessAllocCount() {
+  return process_alloc_count.load(std::memory_order_relaxed);
+}
+
+#else
+
+bool AllocCounterEnabled() { return false; }
+
+uint64 ThreadAllocCount() { return 0; }
+
+uint64 ProcessAllocCount() { return 0; }
+
+#endif  // XLEARN_ALLOC_COUNTER
@@ -0,0 +1,51 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file provides the allocation counter, which is used to check
+that the training and prediction hot path does not touch the heap.
+*/
+
+#ifndef XLEARN_BASE_ALLOC_COUNTER_H_
+#define XLEARN_BASE_ALLOC_COUNTER_H_
+
+#include "src/base/common.h"
+
+//------------------------------------------------------------------------------
+// When XLEARN_ALLOC_COUNTER is defined we replace the global operator new
+// and count every heap allocation. It is only defined for the alloc_counter
+// library, which is linked into the tests, so the xLearn binaries keep the
+// default operator new. Otherwise the counters are always 0. We can use it
+// like this:
+//
+//   uint64 before = ThreadAllocCount();
+//
+//     .... /* code we want to check */
+//
+//   CHECK_EQ(ThreadAllocCount(), before);
+//------------------------------------------------------------------------------
+
+// Return true if the allocation counter is compiled in.
+bool AllocCounterEnabled();
+
+// Number of allocations made by the calling thread.
+uint64 ThreadAllocCount();
+
+// Number of allocations made by all of the threads.
+uint64 ProcessAllocCount();
+
+#endif  // XLEARN_BASE_ALLOC_COUNTER_H_
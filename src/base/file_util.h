@@ -227,6 +227,21 @@ inline void RemoveFile(const char *filename) {
   }
 }
 
+// Rename a file. The target file will be replaced if it exists,
+// and this operation is atomic on POSIX systems.
+inline void RenameFile(const char *old_name, const char *new_name) {
+  CHECK_NOTNULL(old_name);
+  CHECK_NOTNULL(new_name);
+#ifdef _MSC_VER
+  // rename() on Windows fails if the target file exists
+  remove(new_name);
+#endif
+  if (rename(old_name, new_name) != 0) {
+    LOG(FATAL) << "Error: invoke rename() from " << old_name
+               << " to " << new_name;
+  }
+}
+
 // Format the file size by GB, MB, and KB
 inline std::string PrintSize(uint64 file_size) {
   std::string res;
@@ -0,0 +1,163 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of the MemoryTracker.
+*/
+
+#include "src/base/memory_tracker.h"
+
+#include <stdio.h>
+
+#include <atomic>
+#include <string>
+#include <vector>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#endif
+
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+
+namespace {
+
+std::atomic<int64> current_bytes[kNumMemoryPart];
+std::atomic<int64> peak_bytes[kNumMemoryPart];
+std::atomic<int64> total_bytes(0);
+std::atomic<int64> peak_total_bytes(0);
+
+// Raise the peak to value
+void update_peak(std::atomic<int64>* peak, int64 value) {
+  int64 old = peak->load();
+  while (value > old && !peak->compare_exchange_weak(old, value)) { }
+}
+
+}  // namespace
+
+// Add bytes to a part, and the bytes can be negative.
+void MemoryTracker::Add(MemoryPart part, int64 bytes) {
+  int64 now = current_bytes[part].fetch_add(bytes) + bytes;
+  update_peak(&peak_bytes[part], now);
+  int64 total = total_bytes.fetch_add(bytes) + bytes;
+  update_peak(&peak_total_bytes, total);
+}
+
+// Set the bytes of a part.
+void MemoryTracker::Set(MemoryPart part, uint64 bytes) {
+  int64 old = current_bytes[part].exchange((int64)bytes);
+  update_peak(&peak_bytes[part], (int64)bytes);
+  int64 total = total_bytes.fetch_add((int64)bytes - old) + 
+                (int64)bytes - old;
+  update_peak(&peak_total_bytes, total);
+}
+
+// Current bytes of a part.
+uint64 MemoryTracker::Current(MemoryPart part) {
+  int64 bytes = current_bytes[part].load();
+  return bytes > 0 ? bytes : 0;
+}
+
+// Peak bytes of a part.
+uint64 MemoryTracker::Peak(MemoryPart part) {
+  return peak_bytes[part].load();
+}
+
+// Current bytes of all parts.
+uint64 MemoryTracker::Total() {
+  int64 bytes = total_bytes.load();
+  return bytes > 0 ? bytes : 0;
+}
+
+// Peak bytes of all parts.
+uint64 MemoryTracker::PeakTotal() {
+  return peak_total_bytes.load();
+}
+
+// Name of the part.
+const char* MemoryTracker::PartName(int part) {
+  static const char* name[kNumMemoryPart] = {
+    "model", "best_model", "sparse_model", "data", "buffer", "metric"
+  };
+  return name[part];
+}
+
+// Clear all of the counters.
+void MemoryTracker::Reset() {
+  for (int i = 0; i < kNumMemoryPart; ++i) {
+    current_bytes[i].store(0);
+    peak_bytes[i].store(0);
+  }
+  total_bytes.store(0);
+  peak_total_bytes.store(0);
+}
+
+// Return a line of the parts that have been used.
+std::string MemoryTracker::Report() {
+  std::string str;
+  for (int i = 0; i < kNumMemoryPart; ++i) {
+    MemoryPart part = static_cast<MemoryPart>(i);
+    if (Peak(part) == 0) { continue; }
+    StringAppendF(&str, "%s: %s, ", PartName(i),
+                  PrintSize(Current(part)).c_str());
+  }
+  StringAppendF(&str, "total: %s (peak: %s)",
+                PrintSize(Total()).c_str(),
+                PrintSize(PeakTotal()).c_str());
+  return str;
+}
+
+// Return the bytes of each part in JSON.
+std::string MemoryTracker::ToJSON() {
+  std::string str = "{";
+  for (int i = 0; i < kNumMemoryPart; ++i) {
+    StringAppendF(&str, "\"%s\":%llu,", PartName(i),
+        (unsigned long long)Current(static_cast<MemoryPart>(i)));
+  }
+  StringAppendF(&str, "\"total\":%llu,\"peak\":%llu}",
+                (unsigned long long)Total(),
+                (unsigned long long)PeakTotal());
+  return str;
+}
+
+// Memory available for a new allocation.
+uint64 MemoryTracker::AvailableBytes() {
+#ifdef __linux__
+  FILE* file = fopen("/proc/meminfo", "r");
+  if (file == nullptr) { return 0; }
+  char line[256];
+  unsigned long long kb = 0;
+  while (fgets(line, sizeof(line), file) != nullptr) {
+    if (sscanf(line, "MemAvailable: %llu kB", &kb) == 1) { break; }
+  }
+  fclose(file);
+  return kb * 1024;
+#else
+  return 0;
+#endif
+}
+
+// Peak resident memory of current process.
+uint64 MemoryTracker::PeakRSS() {
+#ifdef __linux__
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) { return 0; }
+  return (uint64)usage.ru_maxrss * 1024;
+#else
+  return 0;
+#endif
+}
@@ -0,0 +1,95 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the MemoryTracker, which counts the bytes
+of the model, the data and the buffers allocated by xLearn.
+*/
+
+#ifndef XLEARN_BASE_MEMORY_TRACKER_H_
+#define XLEARN_BASE_MEMORY_TRACKER_H_
+
+#include <string>
+
+#include "src/base/common.h"
+
+// Subsystems counted by the MemoryTracker.
+enum MemoryPart {
+  kMemModel = 0,     /* Dense model parameters, including snapshots */
+  kMemBestModel,     /* Copy of the best model for early-stopping */
+  kMemSparseModel,   /* Rows of the sparse model */
+  kMemData,          /* In-memory data sets */
+  kMemBuffer,        /* Block buffers of the readers */
+  kMemMetric,        /* Buckets of AUC */
+  kNumMemoryPart
+};
+
+//------------------------------------------------------------------------------
+// MemoryTracker keeps the current and the peak bytes of each subsystem,
+// which tell us which part is responsible for the memory cost of a job.
+// The large allocations report themselves by Add() and release by a
+// negative Add(), and the parts that grow by themselves (e.g., the sparse
+// model) are updated by Set(). The counters are atomic and global. We
+// can use the MemoryTracker like this:
+//
+//   real_t* w = (real_t*)malloc(len * sizeof(real_t));
+//   MemoryTracker::Add(kMemModel, len * sizeof(real_t));
+//   ...
+//   free(w);
+//   MemoryTracker::Add(kMemModel, -(int64)(len * sizeof(real_t)));
+//
+//   printf("%s\n", MemoryTracker::Report().c_str());
+//
+//------------------------------------------------------------------------------
+class MemoryTracker {
+ public:
+  // Add bytes to a part, and the bytes can be negative.
+  static void Add(MemoryPart part, int64 bytes);
+
+  // Set the bytes of a part.
+  static void Set(MemoryPart part, uint64 bytes);
+
+  // Current and peak bytes of a part.
+  static uint64 Current(MemoryPart part);
+  static uint64 Peak(MemoryPart part);
+
+  // Current and peak bytes of all parts.
+  static uint64 Total();
+  static uint64 PeakTotal();
+
+  // Name of the part, e.g., "model".
+  static const char* PartName(int part);
+
+  // Clear all of the counters.
+  static void Reset();
+
+  // Return a line like "model: 1.20 GB, ..., total: 1.50 GB
+  // (peak: 1.60 GB)" for the parts that have been used.
+  static std::string Report();
+
+  // Return {"model":123,...,"total":456,"peak":789} in bytes.
+  static std::string ToJSON();
+
+  // Memory available for a new allocation (MemAvailable on Linux).
+  // Return 0 if it is unknown on current platform.
+  static uint64 AvailableBytes();
+
+  // Peak resident memory of current process. Return 0 if unknown.
+  static uint64 PeakRSS();
+};
+
+#endif  // XLEARN_BASE_MEMORY_TRACKER_H_
@@ -0,0 +1,87 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests the MemoryTracker.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/memory_tracker.h"
+
+TEST(MEMORY_TRACKER_TEST, Add_and_peak) {
+  MemoryTracker::Reset();
+  MemoryTracker::Add(kMemModel, 1000);
+  MemoryTracker::Add(kMemData, 500);
+  EXPECT_EQ(MemoryTracker::Current(kMemModel), 1000);
+  EXPECT_EQ(MemoryTracker::Total(), 1500);
+  MemoryTracker::Add(kMemModel, -1000);
+  MemoryTracker::Add(kMemBuffer, 200);
+  EXPECT_EQ(MemoryTracker::Current(kMemModel), 0);
+  EXPECT_EQ(MemoryTracker::Peak(kMemModel), 1000);
+  EXPECT_EQ(MemoryTracker::Total(), 700);
+  EXPECT_EQ(MemoryTracker::PeakTotal(), 1500);
+  // Set() replaces the bytes of a part
+  MemoryTracker::Set(kMemSparseModel, 3000);
+  MemoryTracker::Set(kMemSparseModel, 2000);
+  EXPECT_EQ(MemoryTracker::Current(kMemSparseModel), 2000);
+  EXPECT_EQ(MemoryTracker::Peak(kMemSparseModel), 3000);
+  EXPECT_EQ(MemoryTracker::Total(), 2700);
+  EXPECT_EQ(MemoryTracker::PeakTotal(), 3700);
+  EXPECT_EQ(MemoryTracker::ToJSON(),
+    "{\"model\":0,\"best_model\":0,\"sparse_model\":2000,"
+    "\"data\":500,\"buffer\":200,\"metric\":0,"
+    "\"total\":2700,\"peak\":3700}");
+  // The unused parts are not reported
+  std::string report = MemoryTracker::Report();
+  EXPECT_NE(report.find("model: 0.00 KB"), std::string::npos);
+  EXPECT_EQ(report.find("metric"), std::string::npos);
+  EXPECT_NE(report.find("total: 2.64 KB"), std::string::npos);
+  MemoryTracker::Reset();
+  EXPECT_EQ(MemoryTracker::Total(), 0);
+}
+
+TEST(MEMORY_TRACKER_TEST, Add_from_threads) {
+  MemoryTracker::Reset();
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.push_back(std::thread([]() {
+      for (int i = 0; i < 10000; ++i) {
+        MemoryTracker::Add(kMemMetric, 8);
+        MemoryTracker::Add(kMemMetric, -4);
+      }
+    }));
+  }
+  for (size_t t = 0; t < threads.size(); ++t) {
+    threads[t].join();
+  }
+  EXPECT_EQ(MemoryTracker::Current(kMemMetric), 4 * 10000 * 4);
+  EXPECT_EQ(MemoryTracker::Total(), 4 * 10000 * 4);
+  EXPECT_GE(MemoryTracker::PeakTotal(), MemoryTracker::Total());
+  MemoryTracker::Reset();
+}
+
+TEST(MEMORY_TRACKER_TEST, System_memory) {
+#ifdef __linux__
+  EXPECT_GT(MemoryTracker::AvailableBytes(), 0);
+  EXPECT_GT(MemoryTracker::PeakRSS(), 0);
+#endif
+}
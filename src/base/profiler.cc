@@ -0,0 +1,155 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of the Profiler.
+*/
+
+#include "src/base/profiler.h"
+
+#include <mutex>
+#include <vector>
+
+#include "src/base/stringprintf.h"
+
+std::atomic<bool> Profiler::enabled_(false);
+
+namespace {
+
+// Records of one thread. The owner thread is the only writer,
+// and the atomics let Collect() read them at any time.
+struct ProfileSlot {
+  std::atomic<uint64> ns[kNumPhase];
+  std::atomic<uint64> calls[kNumPhase];
+  std::atomic<uint64> count[kNumCounter];
+  std::atomic<bool> in_use;
+};
+
+// All of the slots. A slot is never freed, and it is re-used
+// by a new thread after its owner exits, so the short-lived
+// threads (e.g., the pipelined validation) do not leak.
+std::mutex slot_mutex;
+std::vector<ProfileSlot*> slot_list;
+
+// Release the slot when the owner thread exits.
+struct SlotHolder {
+  ProfileSlot* slot = nullptr;
+  ~SlotHolder() {
+    if (slot != nullptr) { slot->in_use.store(false); }
+  }
+};
+
+thread_local SlotHolder local_slot;
+
+// Return the slot of the calling thread.
+ProfileSlot* get_slot() {
+  if (local_slot.slot != nullptr) { return local_slot.slot; }
+  std::lock_guard<std::mutex> lock(slot_mutex);
+  for (size_t i = 0; i < slot_list.size(); ++i) {
+    if (!slot_list[i]->in_use.load()) {
+      slot_list[i]->in_use.store(true);
+      local_slot.slot = slot_list[i];
+      return local_slot.slot;
+    }
+  }
+  ProfileSlot* slot = new ProfileSlot;
+  for (int i = 0; i < kNumPhase; ++i) {
+    slot->ns[i].store(0);
+    slot->calls[i].store(0);
+  }
+  for (int i = 0; i < kNumCounter; ++i) {
+    slot->count[i].store(0);
+  }
+  slot->in_use.store(true);
+  slot_list.push_back(slot);
+  local_slot.slot = slot;
+  return slot;
+}
+
+}  // namespace
+
+// Add time (nanosecond) to a phase of the calling thread.
+void Profiler::AddTime(ProfilePhase phase, uint64 ns) {
+  ProfileSlot* slot = get_slot();
+  slot->ns[phase].fetch_add(ns, std::memory_order_relaxed);
+  slot->calls[phase].fetch_add(1, std::memory_order_relaxed);
+}
+
+// Add n to a counter of the calling thread.
+void Profiler::AddCount(ProfileCounter counter, uint64 n) {
+  if (!Enabled()) { return; }
+  get_slot()->count[counter].fetch_add(n, std::memory_order_relaxed);
+}
+
+// Sum the records of all threads, and clear them.
+ProfileStat Profiler::Collect() {
+  ProfileStat stat;
+  for (int i = 0; i < kNumPhase; ++i) {
+    stat.sec[i] = 0;
+    stat.calls[i] = 0;
+  }
+  for (int i = 0; i < kNumCounter; ++i) {
+    stat.count[i] = 0;
+  }
+  std::lock_guard<std::mutex> lock(slot_mutex);
+  for (size_t s = 0; s < slot_list.size(); ++s) {
+    ProfileSlot* slot = slot_list[s];
+    for (int i = 0; i < kNumPhase; ++i) {
+      stat.sec[i] += slot->ns[i].exchange(0) * 1e-9;
+      stat.calls[i] += slot->calls[i].exchange(0);
+    }
+    for (int i = 0; i < kNumCounter; ++i) {
+      stat.count[i] += slot->count[i].exchange(0);
+    }
+  }
+  return stat;
+}
+
+// Name of the phase used by ToJSON().
+const char* Profiler::PhaseName(int phase) {
+  static const char* name[kNumPhase] = {
+    "read", "parse", "grad", "sync", "eval", "checkpoint"
+  };
+  return name[phase];
+}
+
+// Name of the counter used by ToJSON().
+const char* Profiler::CounterName(int counter) {
+  static const char* name[kNumCounter] = { "rows", "bytes" };
+  return name[counter];
+}
+
+// Format the records as a JSON object.
+std::string Profiler::ToJSON(const ProfileStat& stat) {
+  std::string str = "{\"phases\":{";
+  for (int i = 0; i < kNumPhase; ++i) {
+    StringAppendF(&str, "%s\"%s\":{\"sec\":%.6f,\"calls\":%llu}",
+                  i > 0 ? "," : "",
+                  PhaseName(i),
+                  stat.sec[i],
+                  (unsigned long long)stat.calls[i]);
+  }
+  str += "},\"counters\":{";
+  for (int i = 0; i < kNumCounter; ++i) {
+    StringAppendF(&str, "%s\"%s\":%llu",
+                  i > 0 ? "," : "",
+                  CounterName(i),
+                  (unsigned long long)stat.count[i]);
+  }
+  str += "}}";
+  return str;
+}
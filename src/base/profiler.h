@@ -0,0 +1,136 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the Profiler, which times the phases of
+the training and counts the rows and bytes in each epoch.
+*/
+
+#ifndef XLEARN_BASE_PROFILER_H_
+#define XLEARN_BASE_PROFILER_H_
+
+#include <atomic>
+#include <chrono>
+#include <string>
+
+#include "src/base/common.h"
+
+// Phases of the training timed by the Profiler.
+enum ProfilePhase {
+  kPhaseRead = 0,    /* Reader::Samples(), including the parsing */
+  kPhaseParse,       /* Parser::Parse() called by the readers */
+  kPhaseGrad,        /* Gradient computation in the worker threads */
+  kPhaseSync,        /* Waiting in ThreadPool::Sync() */
+  kPhaseEval,        /* Loss and metric on the validation set */
+  kPhaseCheckpoint,  /* Snapshot and serialization of checkpoints */
+  kNumPhase
+};
+
+// Counters of the Profiler.
+enum ProfileCounter {
+  kCountRow = 0,     /* Rows used for training */
+  kCountByte,        /* Bytes of text parsed by the readers */
+  kNumCounter
+};
+
+// Sum of the records of all threads.
+struct ProfileStat {
+  double sec[kNumPhase];
+  uint64 calls[kNumPhase];
+  uint64 count[kNumCounter];
+};
+
+//------------------------------------------------------------------------------
+// Profiler collects the time of each phase and the counters. Each thread
+// adds its records to its own slot without any lock, and Collect() sums
+// and clears the slots of all threads. The time of a phase is the sum
+// over all threads (thread-seconds), and the phases can be nested, e.g.,
+// kPhaseEval includes the reading and the sync of the validation. The
+// Profiler is disabled by default, and then a ProfileScope costs one
+// relaxed atomic load. We can use the Profiler like this:
+//
+//   Profiler::Enable(true);
+//   {
+//     ProfileScope scope(kPhaseRead);
+//     .... /* code we want to time */
+//   }
+//   Profiler::AddCount(kCountRow, num_row);
+//   ProfileStat stat = Profiler::Collect();
+//   printf("%s\n", Profiler::ToJSON(stat).c_str());
+//
+//------------------------------------------------------------------------------
+class Profiler {
+ public:
+  // Turn on or turn off the profiling.
+  static void Enable(bool enable) {
+    enabled_.store(enable, std::memory_order_relaxed);
+  }
+
+  // Return true if the profiling is turned on.
+  static inline bool Enabled() {
+    return enabled_.load(std::memory_order_relaxed);
+  }
+
+  // Add time (nanosecond) to a phase of the calling thread.
+  static void AddTime(ProfilePhase phase, uint64 ns);
+
+  // Add n to a counter of the calling thread.
+  static void AddCount(ProfileCounter counter, uint64 n);
+
+  // Sum the records of all threads, and clear them.
+  static ProfileStat Collect();
+
+  // Format the records as a JSON object:
+  // {"phases":{"read":{"sec":0.1,"calls":2},...},"counters":{...}}
+  static std::string ToJSON(const ProfileStat& stat);
+
+  // Name of the phase and the counter used by ToJSON().
+  static const char* PhaseName(int phase);
+  static const char* CounterName(int counter);
+
+ private:
+  static std::atomic<bool> enabled_;
+};
+
+//------------------------------------------------------------------------------
+// ProfileScope adds the time from its construction to its destruction
+// to the given phase, if the Profiler is enabled at the construction.
+//------------------------------------------------------------------------------
+class ProfileScope {
+ public:
+  // Constructor and Destructor
+  explicit ProfileScope(ProfilePhase phase)
+   : phase_(phase), enabled_(Profiler::Enabled()) {
+    if (enabled_) { begin_ = std::chrono::steady_clock::now(); }
+  }
+  ~ProfileScope() {
+    if (enabled_) {
+      Profiler::AddTime(phase_,
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - begin_).count());
+    }
+  }
+
+ private:
+  ProfilePhase phase_;
+  bool enabled_;
+  std::chrono::steady_clock::time_point begin_;
+
+  DISALLOW_COPY_AND_ASSIGN(ProfileScope);
+};
+
+#endif  // XLEARN_BASE_PROFILER_H_
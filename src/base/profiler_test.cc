@@ -0,0 +1,92 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests the Profiler.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/profiler.h"
+
+TEST(PROFILER_TEST, Disabled) {
+  Profiler::Enable(false);
+  Profiler::Collect();
+  {
+    ProfileScope scope(kPhaseGrad);
+  }
+  Profiler::AddCount(kCountRow, 10);
+  ProfileStat stat = Profiler::Collect();
+  EXPECT_EQ(stat.calls[kPhaseGrad], 0);
+  EXPECT_EQ(stat.count[kCountRow], 0);
+}
+
+TEST(PROFILER_TEST, Collect_from_threads) {
+  Profiler::Enable(true);
+  Profiler::Collect();
+  const int kThread = 4;
+  const int kLoop = 1000;
+  for (int round = 0; round < 2; ++round) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < kThread; ++t) {
+      threads.push_back(std::thread([]() {
+        for (int i = 0; i < kLoop; ++i) {
+          ProfileScope scope(kPhaseRead);
+          Profiler::AddCount(kCountByte, 3);
+        }
+        Profiler::AddTime(kPhaseSync, 2000000000ULL);
+      }));
+    }
+    for (int t = 0; t < kThread; ++t) {
+      threads[t].join();
+    }
+    // The slots of the exited threads are re-used
+    ProfileStat stat = Profiler::Collect();
+    EXPECT_EQ(stat.calls[kPhaseRead], kThread * kLoop);
+    EXPECT_EQ(stat.count[kCountByte], kThread * kLoop * 3);
+    EXPECT_EQ(stat.calls[kPhaseSync], kThread);
+    EXPECT_DOUBLE_EQ(stat.sec[kPhaseSync], kThread * 2.0);
+    EXPECT_EQ(stat.calls[kPhaseGrad], 0);
+  }
+  // Cleared by Collect()
+  ProfileStat stat = Profiler::Collect();
+  EXPECT_EQ(stat.calls[kPhaseRead], 0);
+  EXPECT_EQ(stat.count[kCountByte], 0);
+  Profiler::Enable(false);
+}
+
+TEST(PROFILER_TEST, ToJSON) {
+  ProfileStat stat;
+  for (int i = 0; i < kNumPhase; ++i) {
+    stat.sec[i] = i * 0.5;
+    stat.calls[i] = i;
+  }
+  stat.count[kCountRow] = 100;
+  stat.count[kCountByte] = 2048;
+  EXPECT_EQ(Profiler::ToJSON(stat),
+    "{\"phases\":{\"read\":{\"sec\":0.000000,\"calls\":0},"
+    "\"parse\":{\"sec\":0.500000,\"calls\":1},"
+    "\"grad\":{\"sec\":1.000000,\"calls\":2},"
+    "\"sync\":{\"sec\":1.500000,\"calls\":3},"
+    "\"eval\":{\"sec\":2.000000,\"calls\":4},"
+    "\"checkpoint\":{\"sec\":2.500000,\"calls\":5}},"
+    "\"counters\":{\"rows\":100,\"bytes\":2048}}");
+}
@@ -0,0 +1,153 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the ResultWriter class.
+*/
+
+#include "src/base/result_writer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "src/base/file_util.h"
+#include "src/base/logging.h"
+
+// Powers of 10 from 1e-5 to 1e6. No float lies between
+// 10^x and its double, so the comparisons are exact.
+static const double kPow10[] = {
+  1e-5, 1e-4, 1e-3, 1e-2, 1e-1, 1e0,
+  1e1, 1e2, 1e3, 1e4, 1e5, 1e6
+};
+
+// Powers of 10 from 1e0 to 1e10, which are exact.
+static const double kScale[] = {
+  1e0, 1e1, 1e2, 1e3, 1e4, 1e5,
+  1e6, 1e7, 1e8, 1e9, 1e10
+};
+
+// Format a float in the same way as printf("%g\n"). The common
+// values in [1e-4, 1e6) are rounded to 6 significant digits by
+// one multiplication, which is exact for a float and 10^k (k <= 10),
+// and the rounding is half-to-even as printf. The other values
+// use snprintf.
+size_t FormatResult(float value, char* buf) {
+  double a = fabs((double)value);
+  if (!(a >= 1e-4 && a < 1e6)) {
+    return snprintf(buf, kResultTextSize, "%g\n", value);
+  }
+  // 10^x <= a < 10^(x+1)
+  int x = -5;
+  while (a >= kPow10[x + 6]) { ++x; }
+  // 6 significant digits
+  double m = nearbyint(a * kScale[5 - x]);
+  if (m >= 1e6) {
+    m /= 10;
+    ++x;
+    if (x >= 6) {
+      return snprintf(buf, kResultTextSize, "%g\n", value);
+    }
+  }
+  char digit[6];
+  uint32 n = (uint32)m;
+  for (int i = 5; i >= 0; --i) {
+    digit[i] = '0' + n % 10;
+    n /= 10;
+  }
+  char* p = buf;
+  if (value < 0) { *p++ = '-'; }
+  int pos = 0;
+  if (x >= 0) {
+    for (; pos <= x; ++pos) { *p++ = digit[pos]; }
+  } else {
+    *p++ = '0';
+  }
+  // Strip the trailing zeros of the fraction
+  int last = 5;
+  while (last >= pos && digit[last] == '0') { --last; }
+  if (last >= pos || x < 0) {
+    *p++ = '.';
+    for (int i = x + 1; i < 0; ++i) { *p++ = '0'; }
+    for (; pos <= last; ++pos) { *p++ = digit[pos]; }
+  }
+  *p++ = '\n';
+  return p - buf;
+}
+
+// Create (or truncate) the output file.
+void ResultWriter::Open(const std::string& filename, bool binary) {
+  Close();
+  file_ = OpenFileOrDie(filename.c_str(), binary ? "wb" : "w");
+  binary_ = binary;
+  current_ = 0;
+  count_ = 0;
+  for (int i = 0; i < 2; ++i) {
+    buffer_[i].clear();
+    buffer_[i].reserve(kResultBufferSize);
+  }
+}
+
+// Append len results to the file.
+void ResultWriter::Write(const float* data, size_t len) {
+  CHECK_NOTNULL(file_);
+  count_ += len;
+  while (len > 0) {
+    std::vector<float>& buffer = buffer_[current_];
+    size_t n = std::min(len, kResultBufferSize - buffer.size());
+    buffer.insert(buffer.end(), data, data + n);
+    data += n;
+    len -= n;
+    if (buffer.size() == kResultBufferSize) { flush(); }
+  }
+}
+
+// Hand the current buffer to the background thread. The
+// last buffer must be written before we reuse it.
+void ResultWriter::flush() {
+  if (writer_.joinable()) { writer_.join(); }
+  int id = current_;
+  current_ = 1 - current_;
+  buffer_[current_].clear();
+  writer_ = std::thread(&ResultWriter::write_buffer, this, id);
+}
+
+// Format and write one buffer in the background thread.
+void ResultWriter::write_buffer(int id) {
+  const std::vector<float>& buffer = buffer_[id];
+  if (binary_) {
+    WriteDataToDisk(file_,
+                    (const char*)buffer.data(),
+                    buffer.size() * sizeof(float));
+    return;
+  }
+  text_.resize(buffer.size() * kResultTextSize);
+  char* p = text_.data();
+  for (size_t i = 0; i < buffer.size(); ++i) {
+    p += FormatResult(buffer[i], p);
+  }
+  WriteDataToDisk(file_, text_.data(), p - text_.data());
+}
+
+// Write the remaining results and close the file.
+void ResultWriter::Close() {
+  if (file_ == nullptr) { return; }
+  if (!buffer_[current_].empty()) { flush(); }
+  if (writer_.joinable()) { writer_.join(); }
+  ::Close(file_);
+  file_ = nullptr;
+}
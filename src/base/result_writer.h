@@ -0,0 +1,109 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the ResultWriter class, which writes
+the prediction results to disk in a background thread.
+*/
+
+#ifndef XLEARN_BASE_RESULT_WRITER_H_
+#define XLEARN_BASE_RESULT_WRITER_H_
+
+#include <stdio.h>
+
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+
+// Number of results in one buffer (4 MB).
+const size_t kResultBufferSize = 1 << 20;
+
+// Max length of one formatted result, including '\n'.
+const size_t kResultTextSize = 32;
+
+// Format a float in the same way as printf("%g\n"), and
+// return the number of chars written to buf.
+size_t FormatResult(float value, char* buf);
+
+//------------------------------------------------------------------------------
+// ResultWriter appends the prediction results to a file. The results are
+// copied to a large buffer, and a full buffer is formatted and written by
+// a background thread while the caller fills the other buffer. Hence, the
+// file is opened once and the caller does not wait for the disk. The text
+// output has one result in each line, the same as std::ostream (6
+// significant digits). The binary output is a raw array of little-endian
+// float32. We can use the ResultWriter like this:
+//
+//   ResultWriter writer;
+//   writer.Open("./out.txt", false);  /* text */
+//   for (...) {
+//     writer.Write(out.data(), out.size());
+//   }
+//   writer.Close();
+//
+//------------------------------------------------------------------------------
+class ResultWriter {
+ public:
+  // Constructor and Destructor
+  ResultWriter()
+   : file_(nullptr),
+     binary_(false),
+     current_(0),
+     count_(0) { }
+  ~ResultWriter() { Close(); }
+
+  // Create (or truncate) the output file.
+  void Open(const std::string& filename, bool binary = false);
+
+  // Append len results to the file.
+  void Write(const float* data, size_t len);
+
+  // Write the remaining results and close the file.
+  void Close();
+
+  // Number of results written so far.
+  inline uint64 Count() const { return count_; }
+
+ protected:
+  /* Output file */
+  FILE* file_;
+  /* Write raw float32 instead of text */
+  bool binary_;
+  /* Two buffers, one is filled by the caller and
+  the other one is written by the background thread */
+  std::vector<float> buffer_[2];
+  /* The buffer filled by the caller */
+  int current_;
+  /* Text of the buffer being written */
+  std::vector<char> text_;
+  /* Background thread for writing */
+  std::thread writer_;
+  /* Number of results */
+  uint64 count_;
+
+  // Hand the current buffer to the background thread.
+  void flush();
+
+  // Format and write one buffer in the background thread.
+  void write_buffer(int id);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ResultWriter);
+};
+
+#endif  // XLEARN_BASE_RESULT_WRITER_H_
@@ -0,0 +1,98 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the ResultWriter class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <random>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#include "src/base/result_writer.h"
+#include "src/base/file_util.h"
+
+void check_format(float value) {
+  char buf[kResultTextSize];
+  char expect[kResultTextSize];
+  size_t len = FormatResult(value, buf);
+  snprintf(expect, kResultTextSize, "%g\n", value);
+  EXPECT_EQ(std::string(buf, len), std::string(expect));
+}
+
+TEST(RESULT_WRITER_TEST, FormatResult) {
+  float special[] = {
+    0.0, -0.0, 1.0, -1.0, 0.5, 0.1, 1e-4, 9.99999e-5, 1e-5,
+    999999.0, 999999.5, 1e6, 131072.5, 131073.5, 0.00012345675,
+    123456.5, 12345.65, 3.14159265, -2.71828183, 1e30, -1e-30
+  };
+  for (size_t i = 0; i < sizeof(special) / sizeof(float); ++i) {
+    check_format(special[i]);
+  }
+  // All of the magnitudes of the prediction results
+  std::default_random_engine generator(1);
+  std::uniform_int_distribution<uint32> bits(0x30000000, 0x4a000000);
+  for (int i = 0; i < 1000000; ++i) {
+    uint32 b = bits(generator) | (i % 2 ? 0x80000000 : 0);
+    float value;
+    memcpy(&value, &b, sizeof(value));
+    check_format(value);
+  }
+}
+
+TEST(RESULT_WRITER_TEST, Write_text_and_binary) {
+  std::vector<float> data(kResultBufferSize * 2 + 12345);
+  for (size_t i = 0; i < data.size(); ++i) {
+    data[i] = (float)i / 7 - 1000;
+  }
+  std::string filename = "./test_result_writer.out";
+  // Text in small and large writes
+  ResultWriter writer;
+  writer.Open(filename, false);
+  writer.Write(data.data(), 10);
+  writer.Write(data.data() + 10, data.size() - 10);
+  EXPECT_EQ(writer.Count(), data.size());
+  writer.Close();
+  std::ostringstream expect;
+  for (size_t i = 0; i < data.size(); ++i) {
+    expect << data[i] << "\n";
+  }
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buf);
+  EXPECT_EQ(std::string(buf, size), expect.str());
+  delete [] buf;
+  // Binary
+  writer.Open(filename, true);
+  writer.Write(data.data(), data.size());
+  writer.Close();
+  size = ReadFileToMemory(filename, &buf);
+  ASSERT_EQ(size, data.size() * sizeof(float));
+  EXPECT_EQ(memcmp(buf, data.data(), size), 0);
+  delete [] buf;
+  // Empty output
+  writer.Open(filename, false);
+  writer.Close();
+  FILE* file = OpenFileOrDie(filename.c_str(), "r");
+  EXPECT_EQ(GetFileSize(file), 0);
+  Close(file);
+  RemoveFile(filename.c_str());
+}
@@ -0,0 +1,252 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the ScratchArena class, which provides
+per-thread temporary memory for the training and prediction
+hot path.
+*/
+
+#ifndef XLEARN_BASE_SCRATCH_ARENA_H_
+#define XLEARN_BASE_SCRATCH_ARENA_H_
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+#include <algorithm>
+
+#include "src/base/common.h"
+
+// All of the buffers returned by ScratchArena are aligned to
+// the cache line, which also satisfies the SSE requirement.
+const size_t kScratchAlignByte = 64;
+
+// The first block allocated by an empty arena
+const size_t kScratchMinBlock = 4096;
+
+//------------------------------------------------------------------------------
+// ScratchArena is a bump allocator used to store temporary buffers,
+// such as the sum vector in FMScore. The arena keeps one big block and
+// re-uses it for every example, and hence it will not touch the heap
+// once the block becomes large enough (steady state). Each thread in
+// ThreadPool owns one arena, and the kernels get it by ScratchArena::Current().
+// We can use the ScratchArena like this:
+//
+//    {
+//      ScratchScope scope;  /* Use the arena of current thread */
+//      real_t* s = scope.AllocZero<real_t>(aligned_k);
+//      ... /* use s */
+//    }  /* The buffer is released here */
+//
+// Note that the ScratchArena is not thread-safe, and one arena can only
+// be used by one thread at the same time.
+//------------------------------------------------------------------------------
+class ScratchArena {
+ public:
+  // Position of the arena, which is used to release
+  // all the buffers that allocated after it.
+  struct Mark {
+    size_t offset;
+    uint64 generation;
+  };
+
+  // Constructor and Destructor
+  ScratchArena()
+   : data_(nullptr),
+     capacity_(0),
+     offset_(0),
+     generation_(0) { }
+  ~ScratchArena() {
+    free_retired();
+    free_block(data_);
+  }
+
+  // Allocate an uninitialized buffer for n objects of type T.
+  template <typename T>
+  T* Alloc(size_t n) {
+    return reinterpret_cast<T*>(alloc_bytes(n * sizeof(T)));
+  }
+
+  // Allocate a buffer for n objects of type T and set it to zero.
+  template <typename T>
+  T* AllocZero(size_t n) {
+    T* ptr = Alloc<T>(n);
+    memset(ptr, 0, n * sizeof(T));
+    return ptr;
+  }
+
+  // Get current position of the arena.
+  Mark GetMark() const {
+    Mark mark;
+    mark.offset = offset_;
+    mark.generation = generation_;
+    return mark;
+  }
+
+  // Release all of the buffers allocated after the mark.
+  void Release(const Mark& mark) {
+    if (mark.generation == generation_) {
+      offset_ = mark.offset;
+      return;
+    }
+    // A new block has been allocated after the mark, and hence
+    // everything in current block is allocated after the mark.
+    offset_ = 0;
+    // Nothing was alive when the mark was taken, and
+    // the old blocks can be freed safely.
+    if (mark.offset == 0) {
+      free_retired();
+    }
+  }
+
+  // Release all of the buffers.
+  void Reset() {
+    offset_ = 0;
+    free_retired();
+  }
+
+  // Size of current block (bytes).
+  size_t Capacity() const { return capacity_; }
+
+  // Bytes that are in use in current block.
+  size_t Used() const { return offset_; }
+
+  // Return the arena bound to the calling thread. The threads created
+  // by ThreadPool use the arena owned by the pool, and other threads
+  // (e.g., the master thread) lazily get their own arena.
+  static ScratchArena* Current() {
+    ScratchArena*& arena = bound_arena();
+    if (arena == nullptr) {
+      static thread_local ScratchArena local_arena;
+      arena = &local_arena;
+    }
+    return arena;
+  }
+
+  // Bind an arena to the calling thread.
+  static void Bind(ScratchArena* arena) {
+    bound_arena() = arena;
+  }
+
+ protected:
+  /* Current memory block */
+  char* data_;
+  /* Size of current block */
+  size_t capacity_;
+  /* Bytes used in current block */
+  size_t offset_;
+  /* Increased when we switch to a new block */
+  uint64 generation_;
+  /* Old blocks that may still be used by the caller */
+  std::vector<char*> retired_;
+
+  static ScratchArena*& bound_arena() {
+    static thread_local ScratchArena* arena = nullptr;
+    return arena;
+  }
+
+  void* alloc_bytes(size_t bytes) {
+    size_t need = (bytes + kScratchAlignByte - 1) &
+                  ~(kScratchAlignByte - 1);
+    if (offset_ + need > capacity_) {
+      grow(need);
+    }
+    void* ptr = data_ + offset_;
+    offset_ += need;
+    return ptr;
+  }
+
+  // Switch to a bigger block. The new block is large enough to
+  // hold everything in the old block, so that the arena will
+  // need only one block after the current iteration.
+  void grow(size_t need) {
+    size_t new_capacity = std::max(capacity_ * 2, offset_ + need);
+    new_capacity = std::max(new_capacity, kScratchMinBlock);
+    if (data_ != nullptr) {
+      if (offset_ == 0) {
+        free_block(data_);
+      } else {
+        retired_.push_back(data_);
+      }
+    }
+    data_ = alloc_block(new_capacity);
+    capacity_ = new_capacity;
+    offset_ = 0;
+    generation_++;
+  }
+
+  void free_retired() {
+    for (size_t i = 0; i < retired_.size(); ++i) {
+      free_block(retired_[i]);
+    }
+    retired_.clear();
+  }
+
+  static char* alloc_block(size_t size) {
+    char* ptr = nullptr;
+#ifdef _MSC_VER
+    ptr = (char*)_aligned_malloc(size, kScratchAlignByte);
+    CHECK_NOTNULL(ptr);
+#else
+    int ret = posix_memalign((void**)&ptr, kScratchAlignByte, size);
+    CHECK_EQ(ret, 0);
+#endif
+    return ptr;
+  }
+
+  static void free_block(char* ptr) {
+    if (ptr == nullptr) { return; }
+#ifdef _MSC_VER
+    _aligned_free(ptr);
+#else
+    free(ptr);
+#endif
+  }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScratchArena);
+};
+
+//------------------------------------------------------------------------------
+// ScratchScope releases all of the buffers it allocated when it
+// goes out of scope. By default it uses the arena of current thread.
+//------------------------------------------------------------------------------
+class ScratchScope {
+ public:
+  // Constructor and Destructor
+  explicit ScratchScope(ScratchArena* arena = ScratchArena::Current())
+   : arena_(arena),
+     mark_(arena->GetMark()) { }
+  ~ScratchScope() { arena_->Release(mark_); }
+
+  template <typename T>
+  T* Alloc(size_t n) { return arena_->Alloc<T>(n); }
+
+  template <typename T>
+  T* AllocZero(size_t n) { return arena_->AllocZero<T>(n); }
+
+  ScratchArena* arena() { return arena_; }
+
+ protected:
+  ScratchArena* arena_;
+  ScratchArena::Mark mark_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ScratchScope);
+};
+
+#endif  // XLEARN_BASE_SCRATCH_ARENA_H_
@@ -0,0 +1,110 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests scratch_arena.h and alloc_counter.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include "src/base/scratch_arena.h"
+#include "src/base/alloc_counter.h"
+#include "src/base/thread_pool.h"
+
+TEST(ScratchArenaTest, Alloc_and_release) {
+  ScratchArena arena;
+  ScratchArena::Mark mark = arena.GetMark();
+  float* a = arena.AllocZero<float>(10);
+  for (int i = 0; i < 10; ++i) {
+    EXPECT_FLOAT_EQ(a[i], 0.0);
+  }
+  EXPECT_EQ((size_t)a % kScratchAlignByte, 0);
+  int* b = arena.Alloc<int>(3);
+  EXPECT_EQ((size_t)b % kScratchAlignByte, 0);
+  EXPECT_GT(arena.Used(), 0);
+  arena.Release(mark);
+  EXPECT_EQ(arena.Used(), 0);
+  // The same memory will be re-used
+  float* c = arena.Alloc<float>(10);
+  EXPECT_EQ(a, c);
+}
+
+TEST(ScratchArenaTest, Grow) {
+  ScratchArena arena;
+  ScratchArena::Mark outer = arena.GetMark();
+  char* a = arena.Alloc<char>(kScratchMinBlock);
+  a[0] = 'x';
+  ScratchArena::Mark inner = arena.GetMark();
+  // Switch to a new block, and the old one is still alive
+  char* b = arena.Alloc<char>(kScratchMinBlock);
+  b[0] = 'y';
+  EXPECT_EQ(a[0], 'x');
+  arena.Release(inner);
+  EXPECT_EQ(a[0], 'x');
+  arena.Release(outer);
+  // The new block can hold both buffers
+  EXPECT_GE(arena.Capacity(), 2 * kScratchMinBlock);
+  size_t capacity = arena.Capacity();
+  for (int i = 0; i < 10; ++i) {
+    ScratchScope scope(&arena);
+    scope.Alloc<char>(kScratchMinBlock);
+    scope.Alloc<char>(kScratchMinBlock);
+  }
+  EXPECT_EQ(arena.Capacity(), capacity);
+  EXPECT_EQ(arena.Used(), 0);
+}
+
+TEST(ScratchArenaTest, Steady_state_without_allocation) {
+  ScratchArena arena;
+  // Warm up
+  {
+    ScratchScope scope(&arena);
+    scope.AllocZero<float>(1024);
+  }
+  uint64 before = ThreadAllocCount();
+  for (int i = 0; i < 1000; ++i) {
+    ScratchScope scope(&arena);
+    float* s = scope.AllocZero<float>(1024);
+    s[i] = 1.0;
+  }
+  EXPECT_EQ(ThreadAllocCount(), before);
+  // The test is linked with the alloc_counter library
+  ASSERT_TRUE(AllocCounterEnabled());
+  std::vector<int>* vec = new std::vector<int>(10);
+  EXPECT_EQ(ThreadAllocCount(), before + 2);
+  delete vec;
+}
+
+void use_arena(ScratchArena** arena) {
+  *arena = ScratchArena::Current();
+}
+
+TEST(ScratchArenaTest, Owned_by_thread_pool) {
+  ThreadPool pool(3);
+  ScratchArena* arena[3] = { nullptr, nullptr, nullptr };
+  for (int i = 0; i < 3; ++i) {
+    pool.enqueue(std::bind(use_arena, &arena[i]));
+  }
+  pool.Sync(3);
+  for (int i = 0; i < 3; ++i) {
+    bool found = false;
+    for (int j = 0; j < 3; ++j) {
+      if (arena[i] == pool.Arena(j)) { found = true; }
+    }
+    EXPECT_TRUE(found);
+    EXPECT_NE(arena[i], ScratchArena::Current());
+  }
+}
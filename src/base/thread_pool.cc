@@ -0,0 +1,260 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of the profiling
+and the timeline of the ThreadPool.
+*/
+
+#include "src/base/thread_pool.h"
+
+#include <algorithm>
+
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+
+std::atomic<bool> ThreadPool::tracing_(false);
+
+namespace {
+
+// All of the live pools, and the id of next pool
+std::mutex pool_mutex;
+std::vector<ThreadPool*> pool_list;
+int next_pool_id = 0;
+
+// The timestamps of the trace start from here
+std::atomic<uint64> trace_base_ns(0);
+
+// Bucket of the task-duration histogram
+int task_bucket(uint64 ns) {
+  uint64 us = ns / 1000;
+  int bucket = 0;
+  while (us > 0 && bucket < kNumTaskBucket - 1) {
+    us >>= 1;
+    bucket++;
+  }
+  return bucket;
+}
+
+// Raise the max to value
+void update_max(std::atomic<uint64>* max, uint64 value) {
+  uint64 old = max->load(std::memory_order_relaxed);
+  while (value > old && !max->compare_exchange_weak(old, value)) { }
+}
+
+}  // namespace
+
+// Busy time over busy and idle time of all workers.
+double PoolStat::Utilization() const {
+  double busy = 0, total = 0;
+  for (size_t i = 0; i < busy_sec.size(); ++i) {
+    busy += busy_sec[i];
+    total += busy_sec[i] + idle_sec[i];
+  }
+  return total > 0 ? busy / total : 0;
+}
+
+// Max busy time over the mean busy time of the workers.
+double PoolStat::Imbalance() const {
+  if (busy_sec.empty()) { return 0; }
+  double sum = 0, max = 0;
+  for (size_t i = 0; i < busy_sec.size(); ++i) {
+    sum += busy_sec[i];
+    max = std::max(max, busy_sec[i]);
+  }
+  return sum > 0 ? max * busy_sec.size() / sum : 0;
+}
+
+// Add the pool to the list of live pools.
+void ThreadPool::add_pool(ThreadPool* pool) {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  pool->id = next_pool_id++;
+  pool_list.push_back(pool);
+}
+
+// Remove the pool from the list of live pools.
+void ThreadPool::remove_pool(ThreadPool* pool) {
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  pool_list.erase(std::remove(pool_list.begin(), pool_list.end(), pool),
+                  pool_list.end());
+}
+
+// Turn on or turn off the timeline of all pools.
+void ThreadPool::EnableTrace(bool enable) {
+  if (enable && !tracing_.load()) {
+    trace_base_ns.store(now_ns());
+  }
+  tracing_.store(enable);
+}
+
+// Add the records of a task to the i-th WorkerStat. The Sync()
+// is only on the timeline, since its time has been counted
+// as kPhaseSync by the Profiler.
+void ThreadPool::record(size_t i, uint64 idle_begin, uint64 begin,
+                        uint64 end, uint64 enqueue_ns) {
+  WorkerStat* stat = stats[i].get();
+  uint64 wait = (enqueue_ns > 0 && begin > enqueue_ns) ?
+                 begin - enqueue_ns : 0;
+  if (i < workers.size()) {
+    stat->busy_ns.fetch_add(end - begin, std::memory_order_relaxed);
+    stat->idle_ns.fetch_add(begin - idle_begin, std::memory_order_relaxed);
+    stat->wait_ns.fetch_add(wait, std::memory_order_relaxed);
+    update_max(&stat->max_wait_ns, wait);
+    stat->num_task.fetch_add(1, std::memory_order_relaxed);
+    stat->hist[task_bucket(end - begin)].fetch_add(
+        1, std::memory_order_relaxed);
+  }
+  if (tracing_.load(std::memory_order_relaxed)) {
+    uint64 base = trace_base_ns.load(std::memory_order_relaxed);
+    TraceEvent event;
+    event.start_us = begin > base ? (begin - base) / 1000 : 0;
+    event.dur_us = (end - begin) / 1000;
+    event.wait_us = wait / 1000;
+    std::lock_guard<std::mutex> lock(stat->trace_mutex);
+    stat->trace.push_back(event);
+  }
+}
+
+// Sum the records of each live pool, and clear them.
+std::vector<PoolStat> ThreadPool::CollectStat() {
+  std::vector<PoolStat> stat_list;
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  for (size_t p = 0; p < pool_list.size(); ++p) {
+    ThreadPool* pool = pool_list[p];
+    PoolStat stat;
+    stat.id = pool->id;
+    stat.num_task = 0;
+    stat.wait_sec = 0;
+    stat.max_wait_sec = 0;
+    stat.contention = pool->contention.exchange(0);
+    for (int b = 0; b < kNumTaskBucket; ++b) {
+      stat.hist[b] = 0;
+    }
+    for (size_t i = 0; i < pool->workers.size(); ++i) {
+      WorkerStat* worker = pool->stats[i].get();
+      stat.busy_sec.push_back(worker->busy_ns.exchange(0) * 1e-9);
+      stat.idle_sec.push_back(worker->idle_ns.exchange(0) * 1e-9);
+      stat.wait_sec += worker->wait_ns.exchange(0) * 1e-9;
+      stat.max_wait_sec = std::max(stat.max_wait_sec,
+                                   worker->max_wait_ns.exchange(0) * 1e-9);
+      stat.num_task += worker->num_task.exchange(0);
+      for (int b = 0; b < kNumTaskBucket; ++b) {
+        stat.hist[b] += worker->hist[b].exchange(0);
+      }
+    }
+    stat_list.push_back(stat);
+  }
+  return stat_list;
+}
+
+// Format the records as a JSON array.
+std::string ThreadPool::StatToJSON(const std::vector<PoolStat>& stat_list) {
+  std::string str = "[";
+  for (size_t p = 0; p < stat_list.size(); ++p) {
+    const PoolStat& stat = stat_list[p];
+    StringAppendF(&str, "%s{\"pool\":%d,\"threads\":%zu,\"tasks\":%llu,"
+                  "\"utilization\":%.4f,\"imbalance\":%.4f,",
+                  p > 0 ? "," : "",
+                  stat.id,
+                  stat.busy_sec.size(),
+                  (unsigned long long)stat.num_task,
+                  stat.Utilization(),
+                  stat.Imbalance());
+    str += "\"busy_sec\":[";
+    for (size_t i = 0; i < stat.busy_sec.size(); ++i) {
+      StringAppendF(&str, "%s%.6f", i > 0 ? "," : "", stat.busy_sec[i]);
+    }
+    str += "],\"idle_sec\":[";
+    for (size_t i = 0; i < stat.idle_sec.size(); ++i) {
+      StringAppendF(&str, "%s%.6f", i > 0 ? "," : "", stat.idle_sec[i]);
+    }
+    StringAppendF(&str, "],\"queue_wait_sec\":{\"avg\":%.6f,\"max\":%.6f},"
+                  "\"lock_contention\":%llu,\"task_us_hist\":[",
+                  stat.num_task > 0 ? stat.wait_sec / stat.num_task : 0,
+                  stat.max_wait_sec,
+                  (unsigned long long)stat.contention);
+    // The empty buckets at the end are omitted
+    int last = kNumTaskBucket - 1;
+    while (last >= 0 && stat.hist[last] == 0) { last--; }
+    for (int b = 0; b <= last; ++b) {
+      StringAppendF(&str, "%s%llu", b > 0 ? "," : "",
+                    (unsigned long long)stat.hist[b]);
+    }
+    str += "]}";
+  }
+  str += "]";
+  return str;
+}
+
+// Write the events of all live pools to a Chrome-trace file. The
+// workers of pool p are the threads p*1000+i of the process, and
+// the caller of Sync() is the thread p*1000+999.
+void ThreadPool::WriteTrace(FILE* file) {
+  CHECK_NOTNULL(file);
+  std::string str;
+  std::vector<TraceEvent> trace;
+  std::lock_guard<std::mutex> lock(pool_mutex);
+  for (size_t p = 0; p < pool_list.size(); ++p) {
+    ThreadPool* pool = pool_list[p];
+    size_t num_worker = pool->workers.size();
+    if (!pool->trace_named) {
+      for (size_t i = 0; i <= num_worker; ++i) {
+        std::string name = i < num_worker ?
+          StringPrintf("pool %d / worker %zu", pool->id, i) :
+          StringPrintf("pool %d / sync", pool->id);
+        StringAppendF(&str, "{\"name\":\"thread_name\",\"ph\":\"M\","
+                      "\"pid\":1,\"tid\":%zu,\"args\":{\"name\":\"%s\"}},\n",
+                      pool->id * 1000 + (i < num_worker ? i : 999),
+                      name.c_str());
+      }
+      pool->trace_named = true;
+    }
+    for (size_t i = 0; i <= num_worker; ++i) {
+      WorkerStat* stat = pool->stats[i].get();
+      {
+        std::lock_guard<std::mutex> trace_lock(stat->trace_mutex);
+        trace.swap(stat->trace);
+      }
+      bool is_sync = i == num_worker;
+      for (size_t e = 0; e < trace.size(); ++e) {
+        StringAppendF(&str, "{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,"
+                      "\"tid\":%zu,\"ts\":%llu,\"dur\":%llu",
+                      is_sync ? "sync" : "task",
+                      pool->id * 1000 + (is_sync ? 999 : i),
+                      (unsigned long long)trace[e].start_us,
+                      (unsigned long long)trace[e].dur_us);
+        if (!is_sync) {
+          StringAppendF(&str, ",\"args\":{\"queue_wait_us\":%llu}",
+                        (unsigned long long)trace[e].wait_us);
+        }
+        str += "},\n";
+      }
+      trace.clear();
+    }
+  }
+  // No new event since the last call
+  if (str.empty()) { return; }
+  WriteDataToDisk(file, str.data(), str.size());
+}
+
+// Close the JSON array of a Chrome-trace file.
+void ThreadPool::FinishTrace(FILE* file) {
+  CHECK_NOTNULL(file);
+  std::string str = "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,"
+                    "\"args\":{\"name\":\"xLearn\"}}\n]\n";
+  WriteDataToDisk(file, str.data(), str.size());
+}
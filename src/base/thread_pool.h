@@ -22,6 +22,8 @@ thread pool that used by xLearn.
 #ifndef XLEARN_BASE_THREAD_POOL_H_
 #define XLEARN_BASE_THREAD_POOL_H_
 
+#include <stdio.h>
+
 #include <vector>
 #include <queue>
 #include <memory>
@@ -32,8 +34,61 @@ thread pool that used by xLearn.
 #include <functional>
 #include <stdexcept>
 #include <atomic>
+#include <chrono>
+#include <string>
 
 #include "src/base/common.h"
+#include "src/base/profiler.h"
+#include "src/base/scratch_arena.h"
+
+// Number of buckets of the task-duration histogram. Bucket 0
+// counts the tasks shorter than 1 us, and bucket i counts the
+// tasks in [2^(i-1), 2^i) us. The last bucket has the rest.
+const int kNumTaskBucket = 24;
+
+// One task (or one Sync) on the Chrome-trace timeline.
+struct TraceEvent {
+  uint64 start_us;   /* Start time since the trace is turned on */
+  uint64 dur_us;     /* Duration */
+  uint64 wait_us;    /* Time in the queue before the task starts */
+};
+
+// Records of one worker thread. The worker is the only writer,
+// and the atomics let CollectStat() read them at any time.
+struct WorkerStat {
+  std::atomic<uint64> busy_ns { 0 };      /* Running the tasks */
+  std::atomic<uint64> idle_ns { 0 };      /* Waiting for a task */
+  std::atomic<uint64> wait_ns { 0 };      /* Queue wait of the tasks */
+  std::atomic<uint64> max_wait_ns { 0 };  /* Max queue wait */
+  std::atomic<uint64> num_task { 0 };
+  std::atomic<uint64> hist[kNumTaskBucket];
+  /* Timeline of the worker, guarded by trace_mutex */
+  std::mutex trace_mutex;
+  std::vector<TraceEvent> trace;
+
+  WorkerStat() {
+    for (int i = 0; i < kNumTaskBucket; ++i) { hist[i].store(0); }
+  }
+};
+
+// Summary of the workers of one pool since the last CollectStat().
+struct PoolStat {
+  int id;
+  uint64 num_task;
+  std::vector<double> busy_sec;   /* One for each worker */
+  std::vector<double> idle_sec;   /* One for each worker */
+  double wait_sec;                /* Sum of the queue wait */
+  double max_wait_sec;
+  uint64 contention;              /* Lock acquisitions that blocked */
+  uint64 hist[kNumTaskBucket];
+
+  // Busy time over busy and idle time of all workers.
+  double Utilization() const;
+
+  // Max busy time over the mean busy time of the workers, and 1.0
+  // means the static partition of the work is perfectly balanced.
+  double Imbalance() const;
+};
 
 //------------------------------------------------------------------------------
 // Simple ThreadPool that creates N threads upon its creation,
@@ -47,6 +102,17 @@ thread pool that used by xLearn.
 //   /* Get result from future*/
 //   std::cout << result.get() << std::endl;
 //  
+// Each worker thread owns a ScratchArena, which can be accessed by
+// ScratchArena::Current() in the jobs running on that thread.
+//
+// When the Profiler is enabled, each worker records its busy and idle
+// time, the queue wait and the duration of its tasks, and the pool counts
+// the blocked acquisitions of its locks. CollectStat() sums the records
+// of all live pools. When the trace is turned on by EnableTrace(), each
+// task and each Sync() is also kept as an event, and WriteTrace() writes
+// them in the Chrome-trace format (chrome://tracing or Perfetto), where
+// a slow worker stands out as a long task before a long Sync().
+//
 // This class requires a number of c++11 features be present in your compiler.
 //------------------------------------------------------------------------------
 class ThreadPool {
@@ -66,11 +132,46 @@ class ThreadPool {
   // Return the number of threads
   size_t ThreadNumber();
 
+  // Return the scratch arena owned by the i-th thread
+  ScratchArena* Arena(size_t i);
+
+  // Turn on or turn off the timeline of all pools.
+  static void EnableTrace(bool enable);
+
+  // Return true if the workers keep their records.
+  static inline bool Profiling() {
+    return Profiler::Enabled() || tracing_.load(std::memory_order_relaxed);
+  }
+
+  // Sum the records of each live pool, and clear them.
+  static std::vector<PoolStat> CollectStat();
+
+  // Format the records as a JSON array:
+  // [{"pool":0,"tasks":8,"utilization":0.9,...},...]
+  static std::string StatToJSON(const std::vector<PoolStat>& stat);
+
+  // Write the events of all live pools to a Chrome-trace file and
+  // clear them. Each event is followed by ",\n", so the caller
+  // writes "[\n" before the first call and FinishTrace() at last.
+  static void WriteTrace(FILE* file);
+
+  // Close the JSON array of a Chrome-trace file.
+  static void FinishTrace(FILE* file);
+
 private:
+    // a task and the time it is enqueued
+    struct Task {
+      std::function<void()> func;
+      uint64 enqueue_ns;
+    };
     // need to keep track of threads so we can join them
     std::vector<std::thread> workers;
+    // per-thread scratch memory
+    std::vector<std::unique_ptr<ScratchArena>> arenas;
+    // per-thread records, and the last one is the caller of Sync()
+    std::vector<std::unique_ptr<WorkerStat>> stats;
     // the task queue
-    std::queue<std::function<void()>> tasks;
+    std::queue<Task> tasks;
     // synchronization
     std::mutex queue_mutex;
     std::condition_variable condition;
@@ -78,19 +179,60 @@ private:
     std::condition_variable sync_condition;
     bool stop;
     std::atomic_int sync { 0 };
+    // id of the pool, and whether the names of its threads
+    // have been written to the trace
+    int id;
+    bool trace_named;
+    // blocked acquisitions of queue_mutex and sync_mutex
+    std::atomic<uint64> contention { 0 };
+    // the timeline is turned on
+    static std::atomic<bool> tracing_;
+
+    // current time in nanoseconds
+    static inline uint64 now_ns() {
+      return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // lock the mutex, and count it if we have to wait
+    inline void lock(std::unique_lock<std::mutex>* lock) {
+      if (!lock->try_lock()) {
+        if (Profiling()) {
+          contention.fetch_add(1, std::memory_order_relaxed);
+        }
+        lock->lock();
+      }
+    }
+
+    // add the records of a task (or a Sync) to the i-th WorkerStat
+    void record(size_t i, uint64 idle_begin, uint64 begin,
+                uint64 end, uint64 enqueue_ns);
+
+    // add or remove the pool from the list of live pools
+    static void add_pool(ThreadPool* pool);
+    static void remove_pool(ThreadPool* pool);
 };
 
 // The constructor just launches some amount of workers
 inline ThreadPool::ThreadPool(size_t threads)
-    : stop(false) {
+    : stop(false), trace_named(false) {
+  for(size_t i = 0; i<threads; ++i)
+    arenas.emplace_back(new ScratchArena());
+  for(size_t i = 0; i<=threads; ++i)
+    stats.emplace_back(new WorkerStat());
+  add_pool(this);
   for(size_t i = 0; i<threads; ++i)
     workers.emplace_back(
-      [this]
+      [this, i]
       {
+        ScratchArena::Bind(this->arenas[i].get());
         for(;;) {
-          std::function<void()> task;
+          Task task;
+          uint64 idle_begin = Profiling() ? now_ns() : 0;
           {
-            std::unique_lock<std::mutex> lock(this->queue_mutex);
+            std::unique_lock<std::mutex> lock(this->queue_mutex,
+                                              std::defer_lock);
+            this->lock(&lock);
             this->condition.wait(lock,
               [this]{ return this->stop || !this->tasks.empty(); });
             if (this->stop && this->tasks.empty()) {
@@ -99,9 +241,18 @@ inline ThreadPool::ThreadPool(size_t threads)
             task = std::move(this->tasks.front());
             this->tasks.pop();
           }
-          task();
+          // The profiling may be turned on while we are waiting
+          bool profiling = Profiling();
+          uint64 begin = profiling ? now_ns() : 0;
+          if (idle_begin == 0) { idle_begin = begin; }
+          task.func();
+          if (profiling) {
+            record(i, idle_begin, begin, now_ns(), task.enqueue_ns);
+          }
           {
-            std::unique_lock<std::mutex> lock(this->sync_mutex);
+            std::unique_lock<std::mutex> lock(this->sync_mutex,
+                                              std::defer_lock);
+            this->lock(&lock);
             sync++;
             sync_condition.notify_one();
           }
@@ -119,13 +270,15 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
     std::bind(std::forward<F>(f), std::forward<Args>(args)...)
   );
   std::future<return_type> res = task->get_future();
+  uint64 enqueue_ns = Profiling() ? now_ns() : 0;
   {
-    std::unique_lock<std::mutex> lock(queue_mutex);
+    std::unique_lock<std::mutex> lock(queue_mutex, std::defer_lock);
+    this->lock(&lock);
     // don't allow enqueueing after stopping the pool
     if (stop) {
       throw std::runtime_error("enqueue on stopped ThreadPool");
     }
-    tasks.emplace([task](){ (*task)(); });
+    tasks.push(Task{ [task](){ (*task)(); }, enqueue_ns });
   }
   condition.notify_one();
   return res;
@@ -133,11 +286,20 @@ auto ThreadPool::enqueue(F&& f, Args&&... args)
 
 // Wait all thread to finish their jobs
 inline void ThreadPool::Sync(int wait_count) {
-  std::unique_lock<std::mutex> lock(sync_mutex);
-  this->sync_condition.wait(lock, [&]() {
-    return sync == wait_count;
-  });
-  sync = 0;
+  ProfileScope scope(kPhaseSync);
+  bool tracing = tracing_.load(std::memory_order_relaxed);
+  uint64 begin = tracing ? now_ns() : 0;
+  {
+    std::unique_lock<std::mutex> lock(sync_mutex);
+    this->sync_condition.wait(lock, [&]() {
+      return sync == wait_count;
+    });
+    sync = 0;
+  }
+  // The wait of the caller is on its own timeline
+  if (tracing) {
+    record(workers.size(), begin, begin, now_ns(), 0);
+  }
 }
 
 // Return the number of threads
@@ -145,6 +307,11 @@ inline size_t ThreadPool::ThreadNumber() {
   return workers.size();
 }
 
+// Return the scratch arena owned by the i-th thread
+inline ScratchArena* ThreadPool::Arena(size_t i) {
+  return arenas.at(i).get();
+}
+
 // the destructor joins all threads
 inline ThreadPool::~ThreadPool() {
   {
@@ -155,6 +322,7 @@ inline ThreadPool::~ThreadPool() {
   for (std::thread &worker: workers) {
     worker.join();
   }
+  remove_pool(this);
 }
 
 // Get start and end index used in multi-thread training
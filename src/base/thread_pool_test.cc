@@ -20,7 +20,13 @@ This file tests thread_pool.h file.
 
 #include "gtest/gtest.h"
 
+#include <ctype.h>
+
+#include <string>
+#include <vector>
+
 #include "src/base/thread_pool.h"
+#include "src/base/file_util.h"
 
 void func(int id) {
   printf("Hello %i\n", id);
@@ -71,3 +77,152 @@ TEST(ThreadPoolTest, Sum_test) {
   int sum = a1 + a2 + a3 + a4 + a5;
   EXPECT_EQ(sum, 75);
 }
+
+void Sleep(int ms) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+TEST(ThreadPoolTest, Collect_stat) {
+  ThreadPool pool(2);
+  // Nothing is recorded without the Profiler
+  Profiler::Enable(false);
+  pool.enqueue(std::bind(Sleep, 1));
+  pool.Sync(1);
+  ThreadPool::CollectStat();
+  Profiler::Enable(true);
+  for (int i = 0; i < 3; ++i) {
+    pool.enqueue(std::bind(Sleep, 20));
+    pool.enqueue(std::bind(Sleep, 1));
+    pool.Sync(2);
+  }
+  Profiler::Enable(false);
+  std::vector<PoolStat> stat_list = ThreadPool::CollectStat();
+  const PoolStat* stat = nullptr;
+  for (size_t i = 0; i < stat_list.size(); ++i) {
+    if (stat_list[i].num_task > 0) { stat = &stat_list[i]; }
+  }
+  ASSERT_TRUE(stat != nullptr);
+  EXPECT_EQ(stat->num_task, 6);
+  EXPECT_EQ(stat->busy_sec.size(), 2);
+  uint64 num_hist = 0;
+  for (int b = 0; b < kNumTaskBucket; ++b) {
+    num_hist += stat->hist[b];
+  }
+  EXPECT_EQ(num_hist, 6);
+  // The 20 ms tasks are in [2^14, 2^15) us or later
+  uint64 num_long = 0;
+  for (int b = 15; b < kNumTaskBucket; ++b) {
+    num_long += stat->hist[b];
+  }
+  EXPECT_EQ(num_long, 3);
+  EXPECT_GE(stat->busy_sec[0] + stat->busy_sec[1], 0.06);
+  EXPECT_GT(stat->Utilization(), 0);
+  EXPECT_LE(stat->Utilization(), 1);
+  EXPECT_GE(stat->Imbalance(), 1.0);
+  std::string json = ThreadPool::StatToJSON(stat_list);
+  EXPECT_NE(json.find("\"tasks\":6"), std::string::npos);
+  // The records are cleared
+  stat_list = ThreadPool::CollectStat();
+  for (size_t i = 0; i < stat_list.size(); ++i) {
+    EXPECT_EQ(stat_list[i].num_task, 0);
+  }
+}
+
+// Skip a JSON value from str[pos], and return
+// false if the value is malformed.
+bool skip_json(const std::string& str, size_t& pos);
+
+void skip_space(const std::string& str, size_t& pos) {
+  while (pos < str.size() && isspace(str[pos])) { pos++; }
+}
+
+// Skip the values of an array (end = ']') or an object (end = '}')
+bool skip_json_list(const std::string& str, size_t& pos, char end) {
+  pos++;
+  skip_space(str, pos);
+  if (pos < str.size() && str[pos] == end) { pos++; return true; }
+  for (;;) {
+    if (end == '}') {
+      skip_space(str, pos);
+      if (pos >= str.size() || str[pos] != '"') { return false; }
+      if (!skip_json(str, pos)) { return false; }
+      skip_space(str, pos);
+      if (pos >= str.size() || str[pos] != ':') { return false; }
+      pos++;
+    }
+    if (!skip_json(str, pos)) { return false; }
+    skip_space(str, pos);
+    if (pos >= str.size()) { return false; }
+    if (str[pos] == end) { pos++; return true; }
+    if (str[pos] != ',') { return false; }
+    pos++;
+  }
+}
+
+bool skip_json(const std::string& str, size_t& pos) {
+  skip_space(str, pos);
+  if (pos >= str.size()) { return false; }
+  char c = str[pos];
+  if (c == '[') { return skip_json_list(str, pos, ']'); }
+  if (c == '{') { return skip_json_list(str, pos, '}'); }
+  if (c == '"') {
+    for (pos++; pos < str.size() && str[pos] != '"'; pos++) {
+      if (str[pos] == '\\') { pos++; }
+    }
+    if (pos >= str.size()) { return false; }
+    pos++;
+    return true;
+  }
+  // A number
+  size_t start = pos;
+  while (pos < str.size() && (isdigit(str[pos]) || str[pos] == '-' ||
+         str[pos] == '.' || str[pos] == 'e' || str[pos] == '+')) {
+    pos++;
+  }
+  return pos > start;
+}
+
+// Return true if str is exactly one JSON value
+bool is_json(const std::string& str) {
+  size_t pos = 0;
+  if (!skip_json(str, pos)) { return false; }
+  skip_space(str, pos);
+  return pos == str.size();
+}
+
+TEST(ThreadPoolTest, Write_trace) {
+  std::string filename = "./test_thread_pool.trace.json";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  WriteDataToDisk(file, "[\n", 2);
+  ThreadPool::EnableTrace(true);
+  {
+    ThreadPool pool(2);
+    pool.enqueue(std::bind(Sleep, 1));
+    pool.enqueue(std::bind(Sleep, 1));
+    pool.Sync(2);
+    ThreadPool::WriteTrace(file);
+    // No new event
+    ThreadPool::WriteTrace(file);
+  }
+  ThreadPool::EnableTrace(false);
+  ThreadPool::FinishTrace(file);
+  Close(file);
+  char* buf = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buf);
+  std::string str(buf, size);
+  delete [] buf;
+  RemoveFile(filename.c_str());
+  EXPECT_EQ(str.substr(0, 2), "[\n");
+  EXPECT_EQ(str.substr(str.size() - 3), "\n]\n");
+  EXPECT_TRUE(is_json(str));
+  // The array is not closed
+  EXPECT_FALSE(is_json(str.substr(0, str.size() - 3)));
+  size_t num_task = 0, pos = 0;
+  while ((pos = str.find("\"name\":\"task\"", pos)) != std::string::npos) {
+    num_task++;
+    pos++;
+  }
+  EXPECT_EQ(num_task, 2);
+  EXPECT_NE(str.find("\"name\":\"sync\""), std::string::npos);
+  EXPECT_NE(str.find("worker 1"), std::string::npos);
+}
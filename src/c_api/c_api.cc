@@ -319,6 +319,54 @@ XL_DLL int XLearnPredictForFile(XL *out, const char *model_path,
   API_END();
 }
 
+// Load the model once for online inference
+XL_DLL int XLearnPredictorCreate(XL *out, const char *model_path,
+                                 PredictorHandle *pred) {
+  API_BEGIN();
+  XLearn* xl = reinterpret_cast<XLearn*>(*out);
+  xLearn::HyperParam& param = xl->GetHyperParam();
+  std::unique_ptr<xLearn::Scorer> scorer(new xLearn::Scorer());
+  scorer->Initialize(param.thread_number,
+                     param.norm,
+                     param.sign,
+                     param.sigmoid);
+  if (!scorer->Load(std::string(model_path))) {
+    throw std::runtime_error(
+      StringPrintf("Cannot load model from the file: %s", model_path));
+  }
+  *pred = scorer.release();
+  API_END();
+}
+
+// Score the rows in CSR format
+XL_DLL int XLearnPredictorPredictRows(PredictorHandle *pred,
+                                      const uint64 *indptr,
+                                      const index_t *indices,
+                                      const index_t *fields,
+                                      const real_t *values,
+                                      index_t nrow,
+                                      real_t *out_arr) {
+  API_BEGIN();
+  if (pred == nullptr || *pred == nullptr) {
+    throw std::runtime_error("The predictor handle is NULL!");
+  }
+  if (nrow > 0 && (indptr == nullptr || out_arr == nullptr)) {
+    throw std::runtime_error("The indptr and output array must be set!");
+  }
+  reinterpret_cast<xLearn::Scorer*>(*pred)->PredictRows(
+    indptr, indices, fields, values, nrow, out_arr);
+  API_END();
+}
+
+// Free the predictor handle
+XL_DLL int XLearnPredictorFree(PredictorHandle *pred) {
+  API_BEGIN();
+  CHECK_NOTNULL(pred);
+  delete reinterpret_cast<xLearn::Scorer*>(*pred);
+  *pred = nullptr;
+  API_END();
+}
+
 XL_DLL int XLearnSetDMatrix(XL *out, const char *key, DataHandle *out_data){
   API_BEGIN()
   XLearn* xl = reinterpret_cast<XLearn*>(*out);
@@ -355,6 +403,16 @@ XL_DLL int XLearnSetStr(XL *out, const char *key, const char *value) {
     xl->GetHyperParam().loss_func = std::string(value);
   } else if (strcmp(key, "opt") == 0) {
     xl->GetHyperParam().opt_type = std::string(value);
+  } else if (strcmp(key, "push_codec") == 0) {
+    xl->GetHyperParam().push_codec = std::string(value);
+  } else if (strcmp(key, "pull_codec") == 0) {
+    xl->GetHyperParam().pull_codec = std::string(value);
+  } else if (strcmp(key, "admit_fallback") == 0) {
+    xl->GetHyperParam().admit_fallback = std::string(value);
+  } else if (strcmp(key, "infer_model") == 0) {
+    xl->GetHyperParam().infer_model_file = std::string(value);
+  } else if (strcmp(key, "prune_model") == 0) {
+    xl->GetHyperParam().prune_model_file = std::string(value);
   }
   API_END();
 }
@@ -373,6 +431,16 @@ XL_DLL int XLearnGetStr(XL *out, const char *key, std::string& value) {
     value = xl->GetHyperParam().loss_func;
   } else if (strcmp(key, "opt") == 0) {
     value = xl->GetHyperParam().opt_type;
+  } else if (strcmp(key, "push_codec") == 0) {
+    value = xl->GetHyperParam().push_codec;
+  } else if (strcmp(key, "pull_codec") == 0) {
+    value = xl->GetHyperParam().pull_codec;
+  } else if (strcmp(key, "admit_fallback") == 0) {
+    value = xl->GetHyperParam().admit_fallback;
+  } else if (strcmp(key, "infer_model") == 0) {
+    value = xl->GetHyperParam().infer_model_file;
+  } else if (strcmp(key, "prune_model") == 0) {
+    value = xl->GetHyperParam().prune_model_file;
   }
   API_END();
 }
@@ -395,6 +463,24 @@ XL_DLL int XLearnSetInt(XL *out, const char *key, const int value) {
     xl->GetHyperParam().stop_window = value;
   } else if (strcmp(key, "seed") == 0) {
     xl->GetHyperParam().seed = value;
+  } else if (strcmp(key, "auc_bucket") == 0) {
+    xl->GetHyperParam().auc_bucket = value;
+  } else if (strcmp(key, "cv_parallel") == 0) {
+    xl->GetHyperParam().cv_parallel = value;
+  } else if (strcmp(key, "ckpt_epoch") == 0) {
+    xl->GetHyperParam().checkpoint_epoch = value;
+  } else if (strcmp(key, "nworker") == 0) {
+    xl->GetHyperParam().num_worker = value;
+  } else if (strcmp(key, "nserver") == 0) {
+    xl->GetHyperParam().num_server = value;
+  } else if (strcmp(key, "batch") == 0) {
+    xl->GetHyperParam().batch_size = value;
+  } else if (strcmp(key, "hash") == 0) {
+    xl->GetHyperParam().hash_buckets = value;
+  } else if (strcmp(key, "admit") == 0) {
+    xl->GetHyperParam().admit_count = value;
+  } else if (strcmp(key, "evict_epoch") == 0) {
+    xl->GetHyperParam().evict_epoch = value;
   }
   API_END();
 }
@@ -415,6 +501,24 @@ XL_DLL int XLearnGetInt(XL *out, const char *key, int *value) {
     *value = xl->GetHyperParam().thread_number;
   } else if (strcmp(key, "stop_window") == 0) {
     *value = xl->GetHyperParam().stop_window;
+  } else if (strcmp(key, "auc_bucket") == 0) {
+    *value = xl->GetHyperParam().auc_bucket;
+  } else if (strcmp(key, "cv_parallel") == 0) {
+    *value = xl->GetHyperParam().cv_parallel;
+  } else if (strcmp(key, "ckpt_epoch") == 0) {
+    *value = xl->GetHyperParam().checkpoint_epoch;
+  } else if (strcmp(key, "nworker") == 0) {
+    *value = xl->GetHyperParam().num_worker;
+  } else if (strcmp(key, "nserver") == 0) {
+    *value = xl->GetHyperParam().num_server;
+  } else if (strcmp(key, "batch") == 0) {
+    *value = xl->GetHyperParam().batch_size;
+  } else if (strcmp(key, "hash") == 0) {
+    *value = xl->GetHyperParam().hash_buckets;
+  } else if (strcmp(key, "admit") == 0) {
+    *value = xl->GetHyperParam().admit_count;
+  } else if (strcmp(key, "evict_epoch") == 0) {
+    *value = xl->GetHyperParam().evict_epoch;
   }
   API_END();
 }
@@ -437,6 +541,10 @@ XL_DLL int XLearnSetFloat(XL *out, const char *key, const float value) {
     xl->GetHyperParam().lambda_1 = value;
   } else if (strcmp(key, "lambda_2") == 0) {
     xl->GetHyperParam().lambda_2 = value;
+  } else if (strcmp(key, "ckpt_time") == 0) {
+    xl->GetHyperParam().checkpoint_time = value;
+  } else if (strcmp(key, "topk") == 0) {
+    xl->GetHyperParam().topk_ratio = value;
   }
   API_END();
 }
@@ -459,6 +567,10 @@ XL_DLL int XLearnGetFloat(XL *out, const char *key, float *value) {
     *value = xl->GetHyperParam().lambda_1;
   } else if (strcmp(key, "lambda_2") == 0) {
     *value = xl->GetHyperParam().lambda_2;
+  } else if (strcmp(key, "ckpt_time") == 0) {
+    *value = xl->GetHyperParam().checkpoint_time;
+  } else if (strcmp(key, "topk") == 0) {
+    *value = xl->GetHyperParam().topk_ratio;
   }
   API_END();
 }
@@ -485,6 +597,20 @@ XL_DLL int XLearnSetBool(XL *out, const char *key, const bool value) {
     xl->GetHyperParam().bin_out = value;
   } else if (strcmp(key, "from_file") == 0) {
     xl->GetHyperParam().from_file = value;
+  } else if (strcmp(key, "hash_field") == 0) {
+    xl->GetHyperParam().hash_field = value;
+  } else if (strcmp(key, "sparse_model") == 0) {
+    xl->GetHyperParam().sparse_model = value;
+  } else if (strcmp(key, "quantize") == 0) {
+    xl->GetHyperParam().quantize = value;
+  } else if (strcmp(key, "binary_out") == 0) {
+    xl->GetHyperParam().binary_out = value;
+  } else if (strcmp(key, "profile") == 0) {
+    xl->GetHyperParam().profile = value;
+  } else if (strcmp(key, "trace") == 0) {
+    xl->GetHyperParam().trace = value;
+  } else if (strcmp(key, "mem_check") == 0) {
+    xl->GetHyperParam().mem_check = value;
   }
   API_END();
 }
@@ -507,6 +633,20 @@ XL_DLL int XLearnGetBool(XL *out, const char *key, bool *value) {
     *value = xl->GetHyperParam().sign = value;
   } else if (strcmp(key, "sigmoid") == 0) {
     *value = xl->GetHyperParam().sigmoid;
+  } else if (strcmp(key, "hash_field") == 0) {
+    *value = xl->GetHyperParam().hash_field;
+  } else if (strcmp(key, "sparse_model") == 0) {
+    *value = xl->GetHyperParam().sparse_model;
+  } else if (strcmp(key, "quantize") == 0) {
+    *value = xl->GetHyperParam().quantize;
+  } else if (strcmp(key, "binary_out") == 0) {
+    *value = xl->GetHyperParam().binary_out;
+  } else if (strcmp(key, "profile") == 0) {
+    *value = xl->GetHyperParam().profile;
+  } else if (strcmp(key, "trace") == 0) {
+    *value = xl->GetHyperParam().trace;
+  } else if (strcmp(key, "mem_check") == 0) {
+    *value = xl->GetHyperParam().mem_check;
   }
   API_END();
 }
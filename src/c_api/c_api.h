@@ -25,6 +25,7 @@ for interfacing to other languages.
 #include "src/base/common.h"
 #include "src/data/hyper_parameters.h"
 #include "src/solver/solver.h"
+#include "src/solver/scorer.h"
 
 #include <string>
 
@@ -46,6 +47,7 @@ for interfacing to other languages.
 /* Handle to xlearn */
 typedef void* XL;
 typedef void* DataHandle;
+typedef void* PredictorHandle;
 
 // Say hello to user
 XL_DLL int XLearnHello();
@@ -114,6 +116,28 @@ XL_DLL int XLearnPredictForMat(XL *out, const char *model_path,
 XL_DLL int XLearnPredictForFile(XL *out, const char *model_path, 
                                 const char *out_path);
 
+// Load the model once for online inference. The number of threads,
+// the normalization and the output conversion (sign or sigmoid)
+// are taken from the xLearn handle.
+XL_DLL int XLearnPredictorCreate(XL *out, const char *model_path,
+                                 PredictorHandle *pred);
+
+// Score nrow rows in CSR format into out_arr (nrow items). The row i
+// has the nodes in [indptr[i], indptr[i+1]) of indices, fields and
+// values, where fields can be NULL for linear and fm, and values can
+// be NULL for all ones. This function does no file I/O, and it can be
+// called by many threads on the same handle at the same time.
+XL_DLL int XLearnPredictorPredictRows(PredictorHandle *pred,
+                                      const uint64 *indptr,
+                                      const index_t *indices,
+                                      const index_t *fields,
+                                      const real_t *values,
+                                      index_t nrow,
+                                      real_t *out_arr);
+
+// Free the predictor handle
+XL_DLL int XLearnPredictorFree(PredictorHandle *pred);
+
 // Set DMatrix
 XL_DLL int XLearnSetDMatrix(XL *out, const char *key, DataHandle *out_data);
 
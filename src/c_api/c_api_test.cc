@@ -20,7 +20,19 @@ This file tests c_api.h file.
 
 #include "gtest/gtest.h"
 
+#include <math.h>
+#include <stdlib.h>
+
+#include <thread>
+#include <vector>
+
 #include "src/c_api/c_api.h"
+#include "src/base/file_util.h"
+#include "src/base/thread_pool.h"
+#include "src/data/sparse_table.h"
+#include "src/loss/squared_loss.h"
+#include "src/score/ffm_score.h"
+#include "src/score/fm_score.h"
 
 TEST(C_API_TEST, Initialize) {
   XL xlearn;
@@ -88,4 +100,159 @@ TEST(C_API_TEST, Initialize) {
   EXPECT_EQ(xl->GetHyperParam().sigmoid, true);
   EXPECT_EQ(xl->GetHyperParam().block_size, 256);
   EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
-}
\ No newline at end of file
+}
+// Random rows in CSR format, where the features >= num_feat are unseen
+static void random_csr(index_t nrow, index_t num_feat, index_t num_field,
+                       std::vector<uint64>& indptr,
+                       std::vector<index_t>& indices,
+                       std::vector<index_t>& fields,
+                       std::vector<real_t>& values) {
+  indptr.assign(1, 0);
+  indices.clear();
+  fields.clear();
+  values.clear();
+  for (index_t i = 0; i < nrow; ++i) {
+    index_t len = rand() % 8;
+    for (index_t n = 0; n < len; ++n) {
+      indices.push_back(rand() % (num_feat + 3));
+      fields.push_back(rand() % num_field);
+      values.push_back((rand() % 100) / 50.0);
+    }
+    indptr.push_back(indices.size());
+  }
+}
+
+TEST(C_API_TEST, Predictor_Dense) {
+  xLearn::Model model;
+  model.Initialize("ffm", "cross-entropy", 20, 3, 4, 2, 0.66);
+  model.GetParameter_b()[0] = 0.5;
+  model.Serialize("./test_predictor.model");
+  std::vector<uint64> indptr;
+  std::vector<index_t> indices;
+  std::vector<index_t> fields;
+  std::vector<real_t> values;
+  const index_t kRow = 1000;
+  random_csr(kRow, 20, 3, indptr, indices, fields, values);
+  // Reference
+  std::vector<real_t> expect(kRow);
+  xLearn::Score* score = new xLearn::FFMScore;
+  for (index_t i = 0; i < kRow; ++i) {
+    xLearn::SparseRow row;
+    real_t norm = 0;
+    for (uint64 n = indptr[i]; n < indptr[i+1]; ++n) {
+      row.push_back(xLearn::Node(fields[n], indices[n], values[n]));
+      norm += values[n] * values[n];
+    }
+    norm = norm > 0 ? 1.0 / norm : 1.0;
+    real_t t = score->CalcScore(&row, model, norm);
+    expect[i] = 1.0 / (1.0 + exp(-t));
+  }
+  delete score;
+  // Predict
+  XL xlearn;
+  PredictorHandle pred;
+  EXPECT_EQ(XLearnCreate("ffm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 4), 0);
+  EXPECT_EQ(XLearnSetBool(&xlearn, "sigmoid", true), 0);
+  EXPECT_EQ(XLearnPredictorCreate(&xlearn, "./no_such.model", &pred), -1);
+  EXPECT_EQ(XLearnPredictorCreate(&xlearn, "./test_predictor.model", &pred), 0);
+  // Reentrant calls on the same handle
+  const int kCaller = 4;
+  std::vector<std::vector<real_t>> out(kCaller);
+  std::vector<std::thread> callers;
+  for (int c = 0; c < kCaller; ++c) {
+    out[c].assign(kRow, -1);
+    callers.push_back(std::thread([&, c]() {
+      for (int k = 0; k < 10; ++k) {
+        EXPECT_EQ(XLearnPredictorPredictRows(&pred, indptr.data(),
+          indices.data(), fields.data(), values.data(), kRow,
+          out[c].data()), 0);
+      }
+    }));
+  }
+  for (int c = 0; c < kCaller; ++c) {
+    callers[c].join();
+    for (index_t i = 0; i < kRow; ++i) {
+      EXPECT_FLOAT_EQ(out[c][i], expect[i]);
+    }
+  }
+  // Small batch runs on the calling thread
+  real_t one = -1;
+  EXPECT_EQ(XLearnPredictorPredictRows(&pred, indptr.data() + 5,
+    indices.data(), fields.data(), values.data(), 1, &one), 0);
+  EXPECT_FLOAT_EQ(one, expect[5]);
+  EXPECT_EQ(XLearnPredictorPredictRows(&pred, nullptr,
+    nullptr, nullptr, nullptr, 1, &one), -1);
+  EXPECT_EQ(XLearnPredictorFree(&pred), 0);
+  // The mapped inference model gives the same output
+  model.SerializeInference("./test_predictor.infer");
+  EXPECT_EQ(XLearnPredictorCreate(&xlearn, "./test_predictor.infer", &pred), 0);
+  EXPECT_EQ(XLearnPredictorPredictRows(&pred, indptr.data(),
+    indices.data(), fields.data(), values.data(), kRow,
+    out[0].data()), 0);
+  for (index_t i = 0; i < kRow; ++i) {
+    EXPECT_FLOAT_EQ(out[0][i], expect[i]);
+  }
+  EXPECT_EQ(XLearnPredictorFree(&pred), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  RemoveFile("./test_predictor.model");
+  RemoveFile("./test_predictor.infer");
+}
+
+TEST(C_API_TEST, Predictor_Sparse) {
+  xLearn::Model model;
+  model.InitializeSparse("fm", "squared", 0, 0, 4, 1, 0.66);
+  xLearn::SparseTable* table = model.GetSparseTable();
+  const index_t kNumKey = 50;
+  for (index_t k = 0; k < kNumKey; ++k) {
+    real_t* row = table->FindOrCreate(k * 100003 + 7);
+    row[0] = k * 0.01;
+  }
+  model.GetParameter_b()[0] = -0.2;
+  model.Serialize("./test_predictor_sparse.model");
+  // Keys in the table and unseen keys
+  const index_t kRow = 300;
+  std::vector<uint64> indptr;
+  std::vector<index_t> indices;
+  std::vector<index_t> fields;
+  std::vector<real_t> values;
+  random_csr(kRow, kNumKey, 1, indptr, indices, fields, values);
+  for (size_t n = 0; n < indices.size(); ++n) {
+    indices[n] = indices[n] * 100003 + 7;
+  }
+  // Reference: the Loss stages the sparse model
+  xLearn::DMatrix matrix;
+  for (index_t i = 0; i < kRow; ++i) {
+    matrix.AddRow();
+    matrix.row[i] = new xLearn::SparseRow;
+    real_t norm = 0;
+    for (uint64 n = indptr[i]; n < indptr[i+1]; ++n) {
+      matrix.AddNode(i, indices[n], values[n]);
+      norm += values[n] * values[n];
+    }
+    matrix.norm[i] = norm > 0 ? 1.0 / norm : 1.0;
+  }
+  xLearn::Score* score = new xLearn::FMScore;
+  ThreadPool pool(2);
+  xLearn::SquaredLoss loss;
+  loss.Initialize(score, &pool, true);
+  std::vector<real_t> expect(kRow);
+  loss.Predict(&matrix, model, expect);
+  // Predict
+  XL xlearn;
+  PredictorHandle pred;
+  std::vector<real_t> out(kRow);
+  EXPECT_EQ(XLearnCreate("fm", &xlearn), 0);
+  EXPECT_EQ(XLearnSetInt(&xlearn, "nthread", 2), 0);
+  EXPECT_EQ(XLearnPredictorCreate(&xlearn,
+    "./test_predictor_sparse.model", &pred), 0);
+  EXPECT_EQ(XLearnPredictorPredictRows(&pred, indptr.data(),
+    indices.data(), nullptr, values.data(), kRow, out.data()), 0);
+  for (index_t i = 0; i < kRow; ++i) {
+    EXPECT_FLOAT_EQ(out[i], expect[i]);
+  }
+  EXPECT_EQ(XLearnPredictorFree(&pred), 0);
+  EXPECT_EQ(XLearnHandleFree(&xlearn), 0);
+  delete score;
+  RemoveFile("./test_predictor_sparse.model");
+}
@@ -0,0 +1,128 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of the CountMinSketch class.
+*/
+
+#include "src/data/count_min_sketch.h"
+
+#include <algorithm>
+
+#include "src/base/file_util.h"
+#include "src/base/logging.h"
+
+namespace xLearn {
+
+// Upper bound of the depth
+static const index_t kSketchMaxDepth = 16;
+
+// The finalizer of murmur3
+static inline uint32 fmix32(uint32 h) {
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+// Allocate the counters
+void CountMinSketch::Initialize(index_t width, index_t depth) {
+  CHECK_GT(width, 0);
+  CHECK_GT(depth, 0);
+  CHECK_LE(depth, kSketchMaxDepth);
+  width_ = 1;
+  while (width_ < width) { width_ <<= 1; }
+  depth_ = depth;
+  counter_.assign((size_t)width_ * depth_, 0);
+}
+
+// The i-th row uses the hash h1 + i * h2 (double hashing),
+// and h2 is odd so that the rows are different.
+void CountMinSketch::get_counters(index_t key, uint16** counters) {
+  uint32 h1 = fmix32(key);
+  uint32 h2 = fmix32(key ^ 0x9e3779b9) | 1;
+  index_t mask = width_ - 1;
+  for (index_t i = 0; i < depth_; ++i) {
+    counters[i] = &counter_[(size_t)i * width_ + ((h1 + i * h2) & mask)];
+  }
+}
+
+// Add count to the key by using the conservative update
+uint32 CountMinSketch::Add(index_t key, uint32 count) {
+  CHECK_GT(depth_, 0);
+  uint16* counters[kSketchMaxDepth];
+  get_counters(key, counters);
+  uint32 estimate = kSketchMaxCount;
+  for (index_t i = 0; i < depth_; ++i) {
+    estimate = std::min(estimate, (uint32)*counters[i]);
+  }
+  estimate = std::min(estimate + count, kSketchMaxCount);
+  for (index_t i = 0; i < depth_; ++i) {
+    if (*counters[i] < estimate) {
+      *counters[i] = estimate;
+    }
+  }
+  return estimate;
+}
+
+// Return the estimated count of the key
+uint32 CountMinSketch::Estimate(index_t key) {
+  CHECK_GT(depth_, 0);
+  uint16* counters[kSketchMaxDepth];
+  get_counters(key, counters);
+  uint32 estimate = kSketchMaxCount;
+  for (index_t i = 0; i < depth_; ++i) {
+    estimate = std::min(estimate, (uint32)*counters[i]);
+  }
+  return estimate;
+}
+
+// Reset all counters to zero
+void CountMinSketch::Clear() {
+  std::fill(counter_.begin(), counter_.end(), 0);
+}
+
+// Deep copy of another sketch
+void CountMinSketch::CopyFrom(CountMinSketch& sketch) {
+  width_ = sketch.width_;
+  depth_ = sketch.depth_;
+  counter_ = sketch.counter_;
+}
+
+// Serialize the sketch to a binary file
+void CountMinSketch::Serialize(FILE* file) {
+  CHECK_NOTNULL(file);
+  WriteDataToDisk(file, (char*)&width_, sizeof(width_));
+  WriteDataToDisk(file, (char*)&depth_, sizeof(depth_));
+  WriteDataToDisk(file, (char*)counter_.data(),
+                  counter_.size() * sizeof(uint16));
+}
+
+// Deserialize the sketch from a binary file
+void CountMinSketch::Deserialize(FILE* file) {
+  CHECK_NOTNULL(file);
+  ReadDataFromDisk(file, (char*)&width_, sizeof(width_));
+  ReadDataFromDisk(file, (char*)&depth_, sizeof(depth_));
+  CHECK_LE(depth_, kSketchMaxDepth);
+  counter_.resize((size_t)width_ * depth_);
+  ReadDataFromDisk(file, (char*)counter_.data(),
+                   counter_.size() * sizeof(uint16));
+}
+
+}  // namespace xLearn
@@ -0,0 +1,116 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the CountMinSketch class, which counts the
+occurrences of the feature ids in a fixed size of memory.
+*/
+
+#ifndef XLEARN_DATA_COUNT_MIN_SKETCH_H_
+#define XLEARN_DATA_COUNT_MIN_SKETCH_H_
+
+#include <stdio.h>
+
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// Default number of counters in each row of the sketch
+const index_t kSketchWidth = 1 << 20;
+
+// Default number of rows (hash functions) of the sketch
+const index_t kSketchDepth = 4;
+
+// The counters saturate at this value
+const uint32 kSketchMaxCount = 65535;
+
+//------------------------------------------------------------------------------
+// CountMinSketch estimates the number of occurrences of a key by using
+// depth rows of width counters. Each row maps the key to one counter by
+// a different hash, and the estimate is the minimum of these counters.
+// The estimate is never less than the true count, and it is more than
+// the true count only if all of the counters are shared with other keys.
+// We use the conservative update, which only increases the counters that
+// are less than the new estimate, and hence reduces the over-estimate.
+// The counters are 16-bit and saturate at kSketchMaxCount, so the default
+// sketch uses 8 MB memory for any number of keys. We can use the
+// CountMinSketch like this:
+//
+//    CountMinSketch sketch;
+//    sketch.Initialize(kSketchWidth, kSketchDepth);
+//    sketch.Add(12345, 2);
+//    uint32 count = sketch.Estimate(12345);  /* count >= 2 */
+//
+//------------------------------------------------------------------------------
+class CountMinSketch {
+ public:
+  // Constructor and Destructor
+  CountMinSketch() : width_(0), depth_(0) { }
+  ~CountMinSketch() { }
+
+  // Allocate the counters. The width is rounded
+  // up to a power of 2, and all counters are zero.
+  void Initialize(index_t width = kSketchWidth,
+                  index_t depth = kSketchDepth);
+
+  // Add count to the key, and return the new estimate.
+  uint32 Add(index_t key, uint32 count = 1);
+
+  // Return the estimated count of the key.
+  uint32 Estimate(index_t key);
+
+  // Reset all counters to zero.
+  void Clear();
+
+  // Deep copy of another sketch.
+  void CopyFrom(CountMinSketch& sketch);
+
+  // Serialize the sketch to a binary file.
+  void Serialize(FILE* file);
+
+  // Deserialize the sketch from a binary file.
+  void Deserialize(FILE* file);
+
+  // Memory used by the counters (byte).
+  inline size_t MemoryBytes() {
+    return counter_.size() * sizeof(uint16);
+  }
+
+  inline index_t GetWidth() { return width_; }
+  inline index_t GetDepth() { return depth_; }
+
+ protected:
+  /* Number of counters in each row, which is a power of 2 */
+  index_t width_;
+  /* Number of rows */
+  index_t depth_;
+  /* depth_ * width_ counters */
+  std::vector<uint16> counter_;
+
+  // Get the counter of the key in each row.
+  void get_counters(index_t key, uint16** counters);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(CountMinSketch);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_COUNT_MIN_SKETCH_H_
@@ -0,0 +1,85 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests count_min_sketch.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include "src/data/count_min_sketch.h"
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+TEST(COUNT_MIN_SKETCH_TEST, Add_and_Estimate) {
+  CountMinSketch sketch;
+  sketch.Initialize(1000, 4);
+  EXPECT_EQ(sketch.GetWidth(), 1024);
+  EXPECT_EQ(sketch.GetDepth(), 4);
+  EXPECT_EQ(sketch.MemoryBytes(), 1024 * 4 * 2);
+  EXPECT_EQ(sketch.Estimate(7), 0);
+  EXPECT_EQ(sketch.Add(7), 1);
+  EXPECT_EQ(sketch.Add(7, 3), 4);
+  EXPECT_EQ(sketch.Estimate(7), 4);
+  // The estimate is never less than the true count
+  CountMinSketch big;
+  big.Initialize(1 << 16, 4);
+  for (index_t i = 0; i < 10000; ++i) {
+    big.Add(i * 31, i % 5 + 1);
+  }
+  index_t exact = 0;
+  for (index_t i = 0; i < 10000; ++i) {
+    uint32 count = big.Estimate(i * 31);
+    EXPECT_GE(count, i % 5 + 1);
+    if (count == i % 5 + 1) { exact++; }
+  }
+  // Most of the keys are exact with the conservative update
+  EXPECT_GT(exact, 5000);
+  // Saturate
+  sketch.Add(1, 70000);
+  EXPECT_EQ(sketch.Estimate(1), kSketchMaxCount);
+  sketch.Clear();
+  EXPECT_EQ(sketch.Estimate(1), 0);
+}
+
+TEST(COUNT_MIN_SKETCH_TEST, Serialize_and_Deserialize) {
+  CountMinSketch sketch;
+  sketch.Initialize(4096, 3);
+  for (index_t i = 0; i < 100; ++i) {
+    sketch.Add(i, i);
+  }
+  std::string filename = "./test_count_min_sketch.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  sketch.Serialize(file);
+  Close(file);
+  CountMinSketch new_sketch;
+  file = OpenFileOrDie(filename.c_str(), "r");
+  new_sketch.Deserialize(file);
+  Close(file);
+  EXPECT_EQ(new_sketch.GetWidth(), 4096);
+  EXPECT_EQ(new_sketch.GetDepth(), 3);
+  CountMinSketch copy;
+  copy.CopyFrom(sketch);
+  for (index_t i = 0; i < 100; ++i) {
+    EXPECT_EQ(new_sketch.Estimate(i), sketch.Estimate(i));
+    EXPECT_EQ(copy.Estimate(i), sketch.Estimate(i));
+  }
+  RemoveFile(filename.c_str());
+}
+
+}  // namespace xLearn
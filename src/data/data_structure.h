@@ -280,8 +280,8 @@ struct DMatrix {
   void Compress(std::vector<index_t>& feature_list) {
     // Using a map to store the mapping relations
     size_t node_num {0};
-    for (auto row : this->row) {
-      node_num += row->size();
+    for (index_t i = 0; i < this->row_length; ++i) {
+      node_num += this->row[i]->size();
     }
     std::unordered_set<index_t> feat_set;
     feat_set.reserve(node_num);
@@ -311,22 +311,42 @@ struct DMatrix {
     }
   }
 
+  // Restore the feature id compressed by Compress(), where
+  // the feature_list is the output of Compress().
+  void Decompress(const std::vector<index_t>& feature_list) {
+    for (index_t i = 0; i < this->row_length; ++i) {
+      for (auto &iter: *this->row[i]) {
+        iter.feat_id = feature_list[iter.feat_id-1];
+      }
+    }
+  }
+
   // Get a mini-batch of data from curremt data matrix. 
   // This method will be used for distributed computation. 
   // Return the count of sample for each function call.
+  // Note that the mini-batch only borrows the rows of current
+  // matrix, and its buffers are re-used by the next call, so
+  // the same mini_batch object can be passed in every iteration
+  // without allocating new memory.
   index_t GetMiniBatch(index_t batch_size, DMatrix& mini_batch) {
+    if (mini_batch.row.size() < batch_size) {
+      mini_batch.row.resize(batch_size, nullptr);
+      mini_batch.Y.resize(batch_size, 0);
+      mini_batch.norm.resize(batch_size, 1.0);
+    }
     // Copy mini-batch
-    for (index_t i = 0; i < batch_size; ++i) {
+    index_t i = 0;
+    for (; i < batch_size; ++i) {
       if (this->pos >= this->row_length) {
-        return i;
+        break;
       }
-      mini_batch.AddRow();
       mini_batch.row[i] = this->row[pos];
       mini_batch.Y[i] = this->Y[pos];
       mini_batch.norm[i] = this->norm[pos];
       this->pos++;
     }
-    return batch_size;
+    mini_batch.row_length = i;
+    return i;
   }
 
   // Serialize current DMatrix to disk file.
@@ -396,6 +416,20 @@ struct DMatrix {
   // data matrix. This is used for initialize our model parameter.  
   inline index_t MaxFeat() const { return max_feat_or_field(true); }
   inline index_t MaxField() const { return max_feat_or_field(false); }
+
+  // Memory (byte) used by current matrix. The rows are not counted
+  // if with_rows is false, e.g., the rows are owned by another matrix.
+  uint64 MemoryBytes(bool with_rows = true) const {
+    uint64 bytes = row.capacity() * sizeof(SparseRow*) +
+                   (Y.capacity() + norm.capacity()) * sizeof(real_t);
+    if (!with_rows) { return bytes; }
+    for (index_t i = 0; i < row_length; ++i) {
+      if (row[i] != nullptr) {
+        bytes += sizeof(SparseRow) + row[i]->capacity() * sizeof(Node);
+      }
+    }
+    return bytes;
+  }
   inline index_t max_feat_or_field(bool is_feat) const {
     index_t max = 0;
     for (size_t i = 0; i < row_length; ++i) {
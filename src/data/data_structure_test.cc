@@ -145,6 +145,19 @@ TEST(DMATRIX_TEST, Find_Max_Feat_and_Field) {
   EXPECT_EQ(matrix.MaxField(), 9);
 }
 
+TEST(DMATRIX_TEST, MemoryBytes) {
+  DMatrix matrix;
+  matrix.ReAlloc(kLength);
+  uint64 base = kLength * (sizeof(SparseRow*) + 2 * sizeof(real_t));
+  EXPECT_EQ(matrix.MemoryBytes(), base);
+  for (size_t i = 0; i < kLength; ++i) {
+    matrix.row[i] = new SparseRow(3);
+  }
+  EXPECT_EQ(matrix.MemoryBytes(false), base);
+  EXPECT_EQ(matrix.MemoryBytes(),
+            base + kLength * (sizeof(SparseRow) + 3 * sizeof(Node)));
+}
+
 TEST(DMATRIX_TEST, CopyFrom) {
   DMatrix matrix;
   matrix.Reset();
@@ -238,6 +251,17 @@ TEST(DMATRIX_TEST, Compress) {
   EXPECT_EQ(feature_list[8], 11);
   EXPECT_EQ(feature_list[9], 12);
   EXPECT_EQ(feature_list[10], 20);
+  // Decompress
+  matrix.Decompress(feature_list);
+  row = matrix.row[0];
+  EXPECT_EQ((*row)[0].feat_id, 1);
+  EXPECT_EQ((*row)[1].feat_id, 5);
+  EXPECT_EQ((*row)[2].feat_id, 8);
+  EXPECT_EQ((*row)[3].feat_id, 10);
+  row = matrix.row[1];
+  EXPECT_EQ((*row)[0].feat_id, 3);
+  EXPECT_EQ((*row)[1].feat_id, 12);
+  EXPECT_EQ((*row)[2].feat_id, 20);
 }
 
 TEST(DMATRIX_TEST, GetMiniBatch) {
@@ -27,6 +27,12 @@ This file defines the basic hyper-parameters used by xLearn.
 
 namespace xLearn {
 
+// Upper bound of the hash buckets (-hash). The hashed feature ids
+// and the number of features fit in index_t, but the size of a fm
+// or ffm model (buckets * k, times field for ffm) may not, which is
+// checked by Solver::check_memory() before the model is allocated.
+const index_t kMaxHashBuckets = 1 << 30;
+
 //------------------------------------------------------------------------------
 // We use a single data structure - HyperParam to handle all of
 // the hyper parameters used by xLearn.
@@ -94,6 +100,24 @@ struct HyperParam {
   index_t num_K = 4;
   /* Number of field, used by ffm tasks */
   index_t num_field = 0;
+  /* Hashing trick: hash the raw feature keys into
+  hash_buckets features. 0 means using the feature ids */
+  index_t hash_buckets = 0;
+  /* Mix the field id into the hash, so that each
+  field has its own sub-space of the buckets */
+  bool hash_field = false;
+  /* Store the model in a SparseTable, which creates the
+  parameters of a feature on its first touch */
+  bool sparse_model = false;
+  /* Feature admission of sparse model: a feature gets its latent
+  factor after it is seen admit_count times. 0 means admitting all */
+  index_t admit_count = 0;
+  /* The parameters of the features which are not admitted. It can be
+  'linear' (own linear term) or 'shared' (one row shared by them) */
+  std::string admit_fallback = "linear";
+  /* Evict the rows of sparse model which are not updated
+  in the last evict_epoch epochs. 0 means disable it */
+  int evict_epoch = 0;
   /* Filename of training dataset
   We must set this value in training task. */
   std::string train_set_file;
@@ -118,6 +142,22 @@ struct HyperParam {
   /* Filename of the txt model checkpoint 
   On default, txt_model_file = none */
   std::string txt_model_file = "none";
+  /* Filename of the inference-only model, which is
+  mapped by the prediction (see Model::SerializeInference()).
+  On default, infer_model_file = none */
+  std::string infer_model_file = "none";
+  /* Filename of the pruned inference model, which has only the
+  non-zero parameters (see Model::SerializePruned()).
+  On default, prune_model_file = none */
+  std::string prune_model_file = "none";
+  /* Quantize the inference-only model to int8 */
+  bool quantize = false;
+  /* Write a checkpoint (model_file + ".ckpt") every
+  checkpoint_epoch epochs. 0 means disable it */
+  int checkpoint_epoch = 0;
+  /* Write a checkpoint every checkpoint_time 
+  seconds. 0 means disable it */
+  real_t checkpoint_time = 0;
   /* Filename of output result for prediction
   output_file = test_set_file + ".out" */
   std::string output_file;
@@ -137,6 +177,8 @@ struct HyperParam {
   bool from_file = true;
   /* If generate prediction file */
   bool res_out = true;
+  /* Write the prediction file in binary float32 instead of text */
+  bool binary_out = false;
 //------------------------------------------------------------------------------
 // Parameters for validation
 //------------------------------------------------------------------------------
@@ -145,11 +187,32 @@ struct HyperParam {
   bool cross_validation = false;
   /* Number of folds in cross-validation */
   int num_folds = 3;
+  /* Number of folds trained concurrently in cross-validation,
+  and each of them uses a subset of the threads */
+  int cv_parallel = 1;
   /* True for using early-stop and
   False for not */
   bool early_stop = true;
   /* Early stop window size */
   int stop_window = 2;
+  /* True for overlapping the validation with the
+  training of next epoch, and False for not */
+  bool pipeline_valid = false;
+  /* Number of thread used by pipelined validation.
+  0 means using a quarter of the threads */
+  int valid_thread_number = 0;
+  /* Write the time of each training phase to a JSON-lines
+  file next to the log file, one line per epoch */
+  bool profile = false;
+  /* Write the tasks of the thread pools to a
+  Chrome-trace file next to the log file */
+  bool trace = false;
+  /* Stop before training if the estimated memory of
+  the dense model exceeds the available memory */
+  bool mem_check = true;
+  /* Number of buckets used by AUC and group AUC.
+  More buckets give more accurate result */
+  index_t auc_bucket = 1000000;
   /* Convert predition output to 0 and 1 */
   bool sign = false;
   /* Convert predition output using sigmoid */
@@ -163,6 +226,12 @@ struct HyperParam {
   int num_worker = 0;
   /* Number of parameter server for store model parameters */
   int num_server = 0;
+  /* Codec of the gradient pushed to parameter server */
+  std::string push_codec = "none";
+  /* Codec of the model parameters pulled from parameter server */
+  std::string pull_codec = "none";
+  /* Fraction of the gradient kept by the 'topk' codec */
+  real_t topk_ratio = 0.01;
 };
 
 }  // namespace XLEARN
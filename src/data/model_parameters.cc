@@ -21,13 +21,29 @@ This file is the implementation of the Model class.
 #include "src/data/model_parameters.h"
 
 #include <string.h>
+#include <stdio.h>
 #include <pmmintrin.h>  // for SSE
+#ifndef _MSC_VER
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#include <vector>
+#include <algorithm>
+#include <functional>
+#include <iterator>
 
 #include "src/base/file_util.h"
 #include "src/base/format_print.h"
 #include "src/base/math.h"
+#include "src/base/memory_tracker.h"
 #include "src/base/logging.h"
 #include "src/base/stringprintf.h"
+#include "src/base/thread_pool.h"
+#include "src/data/sparse_table.h"
+#include "src/data/count_min_sketch.h"
 
 namespace xLearn {
 
@@ -52,6 +68,8 @@ void Model::Initialize(const std::string& score_func,
   // optimization method
   CHECK_GE(aux_size, 0);
   CHECK_GT(scale, 0);
+  // Release the memory of a previous Initialize()
+  free_model();
   score_func_ = score_func;
   loss_func_ = loss_func;
   num_feat_ = num_feature;
@@ -76,6 +94,172 @@ void Model::Initialize(const std::string& score_func,
   this->initial(true);
 }
 
+// Initialize a sparse model with no rows
+void Model::InitializeSparse(const std::string& score_func,
+                             const std::string& loss_func,
+                             index_t num_feature,
+                             index_t num_field,
+                             index_t num_K,
+                             index_t aux_size,
+                             real_t scale) {
+  CHECK(!score_func.empty());
+  CHECK(!loss_func.empty());
+  CHECK_GE(num_field, 0);
+  CHECK_GE(num_K, 0);
+  CHECK_GT(aux_size, 0);
+  CHECK_GT(scale, 0);
+  free_model();
+  score_func_ = score_func;
+  loss_func_ = loss_func;
+  num_feat_ = num_feature;
+  num_field_ = num_field;
+  num_K_ = num_K;
+  aux_size_ = aux_size;
+  scale_ = scale;
+  param_num_w_ = 0;
+  param_num_v_ = 0;
+  param_b_ = (real_t*)malloc(aux_size_ * sizeof(real_t));
+  init_sparse();
+  set_value();
+}
+
+// Move the dense parameters to a SparseTable
+void Model::ConvertToSparse() {
+  if (IsSparse()) { return; }
+  CHECK_NOTNULL(param_w_);
+  init_sparse();
+  index_t len_v = sparse_->GetLength_v();
+  index_t offset_v = sparse_->GetOffset_v();
+  for (index_t j = 0; j < num_feat_; ++j) {
+    real_t* row = sparse_->FindOrCreate(j);
+    memcpy(row, param_w_ + j * aux_size_, aux_size_ * sizeof(real_t));
+    if (len_v > 0) {
+      memcpy(row + offset_v, param_v_ + j * len_v, len_v * sizeof(real_t));
+    }
+  }
+  // Keep the bias, and release the dense arrays
+  real_t* bias = param_b_;
+  param_b_ = nullptr;
+  SparseTable* table = sparse_;
+  sparse_ = nullptr;
+  free_model();
+  param_b_ = bias;
+  sparse_ = table;
+  param_num_w_ = 0;
+  param_num_v_ = 0;
+  // The feature ids are no longer bounded unless they are hashed
+  if (!hash_) { num_feat_ = 0; }
+}
+
+// Create an empty SparseTable with the shape of current model
+void Model::init_sparse() {
+  delete sparse_;
+  sparse_ = new SparseTable();
+  sparse_->Initialize(score_func_, num_field_, num_K_,
+                      aux_size_, scale_);
+}
+
+// Create an empty linear-only SparseTable
+void Model::init_linear() {
+  delete linear_;
+  linear_ = new SparseTable();
+  linear_->Initialize("linear", 0, 0, aux_size_, scale_);
+}
+
+// Set the feature admission and eviction
+void Model::SetAdmission(index_t admit_count,
+                         bool shared,
+                         index_t evict_epoch) {
+  CHECK(IsSparse());
+  admit_count_ = admit_count;
+  admit_shared_ = shared;
+  evict_epoch_ = evict_epoch;
+  if (admit_count <= 1) {
+    delete sketch_;
+    delete linear_;
+    delete linear_best_;
+    sketch_ = nullptr;
+    linear_ = nullptr;
+    linear_best_ = nullptr;
+    return;
+  }
+  // The counts of a pre-trained model are kept
+  if (sketch_ == nullptr) {
+    sketch_ = new CountMinSketch();
+    sketch_->Initialize(kSketchWidth, kSketchDepth);
+  }
+  if (shared) {
+    delete linear_;
+    linear_ = nullptr;
+  } else if (linear_ == nullptr) {
+    init_linear();
+  }
+  delete linear_best_;
+  linear_best_ = nullptr;
+}
+
+// Finish an epoch of training a sparse model
+size_t Model::EndEpoch() {
+  CHECK(IsSparse());
+  counting_ = false;
+  epoch_++;
+  if (evict_epoch_ == 0 || epoch_ < evict_epoch_) {
+    return 0;
+  }
+  // Keep the rows updated in the last evict_epoch_ epochs
+  index_t min_stamp = epoch_ - evict_epoch_ + 1;
+  size_t count = sparse_->Evict(min_stamp);
+  if (linear_ != nullptr) {
+    count += linear_->Evict(min_stamp);
+  }
+  return count;
+}
+
+// Release the memory of feature admission
+void Model::free_admission() {
+  delete sketch_;
+  delete linear_;
+  delete linear_best_;
+  sketch_ = nullptr;
+  linear_ = nullptr;
+  linear_best_ = nullptr;
+  admit_count_ = 0;
+  admit_shared_ = false;
+  evict_epoch_ = 0;
+  epoch_ = 0;
+  counting_ = true;
+}
+
+// Estimate the bytes of a dense model
+uint64 Model::EstimateBytes(const std::string& score_func,
+                            index_t num_feature,
+                            index_t num_field,
+                            index_t num_K,
+                            index_t aux_size) {
+  uint64 aligned_k = (num_K + kAlign - 1) / kAlign * kAlign;
+  uint64 num_w = (uint64)num_feature * aux_size;
+  uint64 num_v = 0;
+  if (score_func == "fm") {
+    num_v = (uint64)num_feature * aligned_k * aux_size;
+  } else if (score_func == "ffm") {
+    num_v = (uint64)num_feature * aligned_k * num_field * aux_size;
+  }
+  return (num_w + num_v + aux_size) * sizeof(real_t);
+}
+
+// Get the total size of model parameters
+index_t Model::GetNumParameter() {
+  if (IsSparse()) {
+    index_t num = sparse_->Size() * (sparse_->GetLength_w() +
+                                     sparse_->GetLength_v()) + 2;
+    if (linear_ != nullptr) {
+      num += linear_->Size() * linear_->GetLength_w();
+    }
+    return num;
+  }
+  return param_num_w_ + param_num_v_ + 2;
+}
+
 // To get the best performance for SSE, we need to
 // allocate memory for the model parameters in aligned way.
 // For SSE, the align number should be 16 byte (kAlignByte).
@@ -106,6 +290,11 @@ void Model::initial(bool set_val) {
                    model parameters. Parameter size: "
                << GetNumParameter();
   }
+  // Count the memory of the parameters
+  MemoryTracker::Add(kMemModel, -(int64)model_bytes_);
+  model_bytes_ = ((uint64)param_num_w_ + param_num_v_ + aux_size_) *
+                 sizeof(real_t);
+  MemoryTracker::Add(kMemModel, model_bytes_);
   // Set value for model
   if (set_val) {
     set_value();
@@ -117,7 +306,6 @@ void Model::set_value() {
   // Use distribution to transform the random unsigned
   // int generated by gen into a float in [(0.0, 1.0) * coef]
   std::default_random_engine generator;
-  std::uniform_real_distribution<real_t> dis(0.0, 1.0);
   /*********************************************************
    *  Initialize linear and bias term                      *
    *********************************************************/
@@ -131,43 +319,68 @@ void Model::set_value() {
   for (index_t j = 1; j < aux_size_; ++j) {
     param_b_[j] = 1.0;    /* gradient cache */
   }
+  // The rows of sparse model are created on the first touch
+  if (IsSparse()) {
+    sparse_->Clear();
+    if (linear_ != nullptr) { linear_->Clear(); }
+    if (sketch_ != nullptr) { sketch_->Clear(); }
+    epoch_ = 0;
+    counting_ = true;
+    return;
+  }
   /*********************************************************
    *  Initialize latent factor for fm                      *
    *********************************************************/
   if (score_func_.compare("fm") == 0) {
-    index_t k_aligned = get_aligned_k();
-    real_t coef = 1.0f / sqrt(num_K_) * scale_;
-    real_t* w = param_v_;
+    index_t len = get_aligned_k() * aux_size_;
     for (index_t j = 0; j < num_feat_; ++j) {
-      for(index_t d = 0; d < num_K_; d++, w++) {
-        *w = coef * dis(generator);  /* model */
-      }
-      for(index_t d = num_K_; d < k_aligned; d++, w++) {
-        *w = 0;  /* Beyond aligned number */
-      }
-      for(index_t d = k_aligned; d < aux_size_*k_aligned; d++, w++) {
-        *w = 1.0;  /* gradient cache */
-      }
+      InitLatent(score_func_, num_field_, num_K_, aux_size_,
+                 scale_, generator, param_v_ + j * len);
     }
   }
   /*********************************************************
    *  Initialize latent factor for ffm                     *
    *********************************************************/
   else if (score_func_.compare("ffm") == 0) {
-    index_t k_aligned = get_aligned_k();
-    real_t* w = param_v_;
-    real_t coef = 1.0f / sqrt(num_K_) * scale_;
+    index_t len = get_aligned_k() * num_field_ * aux_size_;
     for (index_t j = 0; j < num_feat_; ++j) {
-      for (index_t f = 0; f < num_field_; ++f) {
-        for (index_t d = 0; d < k_aligned; ) {
-          for (index_t s = 0; s < kAlign; s++, w++, d++) {
-            w[0] = (d < num_K_) ? coef * dis(generator) : 0.0; /* model */
-            for (index_t j = 1; j < aux_size_; ++j) {
-              w[kAlign * j] = 1.0; /* gradient cache */
-            }
+      InitLatent(score_func_, num_field_, num_K_, aux_size_,
+                 scale_, generator, param_v_ + j * len);
+    }
+  }
+}
+
+// Initialize the latent factor of one feature
+void Model::InitLatent(const std::string& score_func,
+                       index_t num_field,
+                       index_t num_K,
+                       index_t aux_size,
+                       real_t scale,
+                       std::default_random_engine& generator,
+                       real_t* w) {
+  std::uniform_real_distribution<real_t> dis(0.0, 1.0);
+  index_t k_aligned = (index_t)ceil((real_t)num_K/kAlign)*kAlign;
+  real_t coef = 1.0f / sqrt(num_K) * scale;
+  if (score_func.compare("fm") == 0) {
+    for(index_t d = 0; d < num_K; d++, w++) {
+      *w = coef * dis(generator);  /* model */
+    }
+    for(index_t d = num_K; d < k_aligned; d++, w++) {
+      *w = 0;  /* Beyond aligned number */
+    }
+    for(index_t d = k_aligned; d < aux_size*k_aligned; d++, w++) {
+      *w = 1.0;  /* gradient cache */
+    }
+  } else if (score_func.compare("ffm") == 0) {
+    for (index_t f = 0; f < num_field; ++f) {
+      for (index_t d = 0; d < k_aligned; ) {
+        for (index_t s = 0; s < kAlign; s++, w++, d++) {
+          w[0] = (d < num_K) ? coef * dis(generator) : 0.0; /* model */
+          for (index_t j = 1; j < aux_size; ++j) {
+            w[kAlign * j] = 1.0; /* gradient cache */
           }
-          w += (aux_size_-1) * kAlign;
         }
+        w += (aux_size-1) * kAlign;
       }
     }
   }
@@ -175,6 +388,9 @@ void Model::set_value() {
 
 // Free the allocated memory
 void Model::free_model() {
+  if (IsMapped()) {
+    unmap_inference();
+  }
   free(param_w_);
 #ifndef _MSC_VER
   free(param_v_);
@@ -195,6 +411,22 @@ void Model::free_model() {
   if (param_best_b_ != nullptr) {
     free(param_best_b_);
   }
+  param_w_ = nullptr;
+  param_v_ = nullptr;
+  param_b_ = nullptr;
+  MemoryTracker::Add(kMemModel, -(int64)model_bytes_);
+  MemoryTracker::Add(kMemBestModel, -(int64)best_bytes_);
+  model_bytes_ = 0;
+  best_bytes_ = 0;
+  param_best_w_ = nullptr;
+  param_best_v_ = nullptr;
+  param_best_b_ = nullptr;
+  delete sparse_;
+  delete sparse_best_;
+  sparse_ = nullptr;
+  sparse_best_ = nullptr;
+  free_admission();
+  pruned_ = false;
 }
 
 // Initialize model from a checkpoint file
@@ -212,11 +444,14 @@ Model::Model(const std::string& filename) {
 // Serialize current model to a disk file
 void Model::Serialize(const std::string& filename) {
   CHECK_NE(filename.empty(), true);
+  std::string tmp_file = filename + ".tmp";
 #ifndef _MSC_VER
-  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  FILE* file = OpenFileOrDie(tmp_file.c_str(), "w");
 #else
-  FILE *file = OpenFileOrDie(filename.c_str(), "wb");
+  FILE *file = OpenFileOrDie(tmp_file.c_str(), "wb");
 #endif
+  // Use a big buffer for the small writes
+  setvbuf(file, nullptr, _IOFBF, kModelBufferSize);
   // Write score function
   WriteStringToFile(file, score_func_);
   // Write loss function
@@ -231,68 +466,196 @@ void Model::Serialize(const std::string& filename) {
   WriteDataToDisk(file, (char*)&aux_size_, sizeof(aux_size_));
   // Write w
   this->serialize_w_v_b(file);
+  // Write hashing trick
+  if (hash_) {
+    uint64 tag = kModelHashTag;
+    WriteDataToDisk(file, (char*)&tag, sizeof(tag));
+    WriteDataToDisk(file, (char*)&hash_field_, sizeof(hash_field_));
+  }
+  // Write the rows of sparse model
+  if (IsSparse()) {
+    uint64 tag = kModelSparseTag;
+    WriteDataToDisk(file, (char*)&tag, sizeof(tag));
+    WriteDataToDisk(file, (char*)&scale_, sizeof(scale_));
+    sparse_->Serialize(file);
+    // Write feature admission and eviction
+    tag = kModelAdmitTag;
+    WriteDataToDisk(file, (char*)&tag, sizeof(tag));
+    WriteDataToDisk(file, (char*)&admit_count_, sizeof(admit_count_));
+    WriteDataToDisk(file, (char*)&admit_shared_, sizeof(admit_shared_));
+    WriteDataToDisk(file, (char*)&evict_epoch_, sizeof(evict_epoch_));
+    WriteDataToDisk(file, (char*)&epoch_, sizeof(epoch_));
+    bool has_sketch = sketch_ != nullptr;
+    bool has_linear = linear_ != nullptr;
+    WriteDataToDisk(file, (char*)&has_sketch, sizeof(has_sketch));
+    WriteDataToDisk(file, (char*)&has_linear, sizeof(has_linear));
+    if (has_sketch) { sketch_->Serialize(file); }
+    if (has_linear) { linear_->Serialize(file); }
+  }
   Close(file);
+  RenameFile(tmp_file.c_str(), filename.c_str());
 }
 
-// Serialize current model to a TXT file.
-void Model::SerializeToTXT(const std::string& filename) {
-  CHECK_NE(filename.empty(), true);
-  std::ofstream o_file(filename);
+// Append a real number to the TXT buffer. This
+// is the same format as std::ostream << float.
+static inline void append_real(std::string* buf, real_t val) {
+  char str[32];
+  int len = snprintf(str, sizeof(str), "%g", val);
+  buf->append(str, len);
+}
+
+// Get the linear term of the j-th feature in TXT model
+real_t* Model::txt_row_w(index_t j) {
+  if (IsSparse()) {
+    real_t* row = sparse_->Find(txt_key_[j]);
+    return row != nullptr ? row : linear_->Find(txt_key_[j]);
+  }
+  return param_w_ + j * aux_size_;
+}
+
+// Get the latent factor of the j-th feature in TXT model
+real_t* Model::txt_row_v(index_t j) {
+  if (IsSparse()) {
+    real_t* row = sparse_->Find(txt_key_[j]);
+    return row != nullptr ? row + sparse_->GetOffset_v() : txt_zero_.data();
+  }
+  index_t len = get_aligned_k() * aux_size_;
+  if (score_func_.compare("ffm") == 0) {
+    len *= num_field_;
+  }
+  return param_v_ + j * len;
+}
+
+// Format the parameters of feature [start, end) to TXT.
+void Model::format_txt(int section, 
+                       index_t start, 
+                       index_t end, 
+                       std::string* buf) {
+  buf->clear();
+  char str[64];
   /*********************************************************
-   *  Write linear and bias term                      *
+   *  Linear term                                          *
    *********************************************************/
-  // bias term
-  o_file << "bias: " << param_b_[0] << "\n";
-  // linear term
-  index_t idx = 0;
-  for (index_t i = 0; i < param_num_w_; i += aux_size_) {
-    o_file << "i_" << idx << ": " << param_w_[i] << "\n";
-    idx++;
+  if (section == 0) {
+    for (index_t j = start; j < end; ++j) {
+      index_t key = IsSparse() ? txt_key_[j] : j;
+      int len = snprintf(str, sizeof(str), "i_%u: ", key);
+      buf->append(str, len);
+      append_real(buf, txt_row_w(j)[0]);
+      buf->push_back('\n');
+    }
+    return;
   }
+  index_t k_aligned = get_aligned_k();
   /*********************************************************
-   *  Write latent factor for fm                      *
+   *  Latent factor for fm                                 *
    *********************************************************/
   if (score_func_.compare("fm") == 0) {
-    index_t k_aligned = get_aligned_k();
-    real_t* w = param_v_;
-    for (index_t j = 0; j < num_feat_; ++j) {
-      o_file << "v_" << j << ": ";
-      for(index_t d = 0; d < num_K_; d++, w++) {
-        o_file << *w;
+    for (index_t j = start; j < end; ++j) {
+      real_t* w = txt_row_v(j);
+      index_t key = IsSparse() ? txt_key_[j] : j;
+      int len = snprintf(str, sizeof(str), "v_%u: ", key);
+      buf->append(str, len);
+      for (index_t d = 0; d < num_K_; ++d) {
+        append_real(buf, w[d]);
         if (d != num_K_-1) {
-          o_file << " ";
+          buf->push_back(' ');
         }
       }
-      o_file << "\n";
-      // skip the rest parameters
-      index_t skip = aux_size_*k_aligned-num_K_;
-      w += skip;
+      buf->push_back('\n');
     }
   }
   /*********************************************************
-   *  Write latent factor for ffm                     *
+   *  Latent factor for ffm                                *
    *********************************************************/
   if (score_func_.compare("ffm") == 0) {
-    index_t k_aligned = get_aligned_k();
-    real_t* w = param_v_;
-    for (index_t j = 0; j < num_feat_; ++j) {
+    for (index_t j = start; j < end; ++j) {
+      index_t key = IsSparse() ? txt_key_[j] : j;
       for (index_t f = 0; f < num_field_; ++f) {
-        o_file << "v_" << j << "_" << f << ": ";
-        for (index_t d = 0; d < k_aligned; ) {
-          for (index_t s = 0; s < kAlign; s++, w++, d++) {
-            if (d < num_K_) {
-              o_file << w[0];
-              if (d != num_K_-1) {
-                o_file << " ";
-              }
-            }
+        real_t* w = txt_row_v(j) + f * aux_size_ * k_aligned;
+        int len = snprintf(str, sizeof(str), "v_%u_%u: ", key, f);
+        buf->append(str, len);
+        // Each kAlign values are followed by the 
+        // (aux_size_-1)*kAlign gradient cache
+        for (index_t d = 0; d < num_K_; ++d) {
+          append_real(buf, w[(d/kAlign)*kAlign*aux_size_ + d%kAlign]);
+          if (d != num_K_-1) {
+            buf->push_back(' ');
           }
-          w += (aux_size_-1) * kAlign;
         }
-        o_file << "\n";
+        buf->push_back('\n');
+      }
+    }
+  }
+}
+
+// Serialize current model to a TXT file.
+void Model::SerializeToTXT(const std::string& filename, 
+                           ThreadPool* pool) {
+  CHECK_NE(filename.empty(), true);
+  std::string tmp_file = filename + ".tmp";
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(tmp_file.c_str(), "w");
+#else
+  FILE *file = OpenFileOrDie(tmp_file.c_str(), "wb");
+#endif
+  // bias term
+  std::string bias = "bias: ";
+  append_real(&bias, param_b_[0]);
+  bias.push_back('\n');
+  WriteDataToDisk(file, bias.data(), bias.size());
+  // Each round formats one chunk per thread, and then 
+  // writes the chunks in order. Hence we only keep
+  // (thread_number * kTXTChunkSize) features in memory.
+  size_t threadNumber = pool == nullptr ? 1 : pool->ThreadNumber();
+  std::vector<std::string> buf(threadNumber);
+  int num_section = score_func_.compare("linear") == 0 ? 1 : 2;
+  // The sparse model is written in ascending order of the keys
+  index_t num_feat = num_feat_;
+  if (IsSparse()) {
+    sparse_->GetKeys(&txt_key_);
+    // The linear-only rows are merged into the keys
+    if (linear_ != nullptr) {
+      std::vector<index_t> key, linear_key;
+      linear_->GetKeys(&linear_key);
+      key.swap(txt_key_);
+      std::set_union(key.begin(), key.end(),
+                     linear_key.begin(), linear_key.end(),
+                     std::back_inserter(txt_key_));
+      txt_zero_.assign(sparse_->GetLength_v(), 0);
+    }
+    num_feat = txt_key_.size();
+  }
+  for (int section = 0; section < num_section; ++section) {
+    for (index_t start = 0; start < num_feat; 
+         start += threadNumber * kTXTChunkSize) {
+      size_t count = 0;
+      for (size_t i = 0; i < threadNumber; ++i) {
+        index_t begin = start + i * kTXTChunkSize;
+        if (begin >= num_feat) { break; }
+        index_t end = std::min(begin + kTXTChunkSize, num_feat);
+        if (pool == nullptr) {
+          format_txt(section, begin, end, &buf[i]);
+        } else {
+          pool->enqueue(std::bind(&Model::format_txt, this,
+                                  section, begin, end, &buf[i]));
+        }
+        count++;
+      }
+      if (pool != nullptr) {
+        pool->Sync(count);
+      }
+      for (size_t i = 0; i < count; ++i) {
+        if (!buf[i].empty()) {
+          WriteDataToDisk(file, buf[i].data(), buf[i].size());
+        }
       }
     }
   }
+  std::vector<index_t>().swap(txt_key_);
+  std::vector<real_t>().swap(txt_zero_);
+  Close(file);
+  RenameFile(tmp_file.c_str(), filename.c_str());
 }
 
 // Deserialize model from a checkpoint file
@@ -304,6 +667,22 @@ bool Model::Deserialize(const std::string& filename) {
   FILE* file = OpenFileOrDie(filename.c_str(), "rb");
 #endif
   if (file == NULL) { return false; }
+  free_model();
+  // The inference-only file is mapped instead
+  uint64 magic = 0;
+  if (ReadDataFromDisk(file, (char*)&magic, sizeof(magic)) == sizeof(magic) &&
+      magic == kModelInferMagic) {
+    Close(file);
+    return map_inference(filename);
+  }
+  // The pruned file is loaded to a sparse model
+  if (magic == kModelPruneMagic) {
+    rewind(file);
+    bool ret = load_pruned(file, filename);
+    Close(file);
+    return ret;
+  }
+  rewind(file);
   // Read score function
   ReadStringFromFile(file, score_func_);
   // Read loss function
@@ -318,12 +697,232 @@ bool Model::Deserialize(const std::string& filename) {
   ReadDataFromDisk(file, (char*)&aux_size_, sizeof(aux_size_));
   // Read w
   this->deserialize_w_v_b(file);
+  // Read the optional sections
+  uint64 tag = 0;
+  hash_ = false;
+  hash_field_ = false;
+  while (ReadDataFromDisk(file, (char*)&tag, sizeof(tag)) == sizeof(tag)) {
+    if (tag == kModelHashTag) {
+      hash_ = true;
+      ReadDataFromDisk(file, (char*)&hash_field_, sizeof(hash_field_));
+    } else if (tag == kModelSparseTag) {
+      ReadDataFromDisk(file, (char*)&scale_, sizeof(scale_));
+      init_sparse();
+      sparse_->Deserialize(file);
+    } else if (tag == kModelAdmitTag) {
+      CHECK(IsSparse());
+      ReadDataFromDisk(file, (char*)&admit_count_, sizeof(admit_count_));
+      ReadDataFromDisk(file, (char*)&admit_shared_, sizeof(admit_shared_));
+      ReadDataFromDisk(file, (char*)&evict_epoch_, sizeof(evict_epoch_));
+      ReadDataFromDisk(file, (char*)&epoch_, sizeof(epoch_));
+      bool has_sketch = false;
+      bool has_linear = false;
+      ReadDataFromDisk(file, (char*)&has_sketch, sizeof(has_sketch));
+      ReadDataFromDisk(file, (char*)&has_linear, sizeof(has_linear));
+      if (has_sketch) {
+        sketch_ = new CountMinSketch();
+        sketch_->Deserialize(file);
+      }
+      if (has_linear) {
+        init_linear();
+        linear_->Deserialize(file);
+      }
+    } else {
+      break;
+    }
+  }
   Close(file);
   return true;
 }
 
 // Take a record of the best model during training
 void Model::SetBestModel() {
+  if (IsSparse()) {
+    set_best_sparse(*this);
+    return;
+  }
+  set_best_model(param_w_, param_v_, param_b_);
+}
+
+// Take a record of the best model from a snapshot
+void Model::SetBestModel(Model& snapshot) {
+  if (IsSparse()) {
+    CHECK(snapshot.IsSparse());
+    set_best_sparse(snapshot);
+    return;
+  }
+  if (snapshot.aux_size_ != aux_size_) {
+    // The snapshot of CopyValueFrom() has no gradient cache,
+    // and the best model keeps the cache of current epoch.
+    CHECK_EQ(snapshot.aux_size_, 1);
+    CHECK_EQ(param_num_w_, snapshot.param_num_w_ * aux_size_);
+    CHECK_EQ(param_num_v_, snapshot.param_num_v_ * aux_size_);
+    set_best_model(param_w_, param_v_, param_b_);
+    copy_value(param_best_w_, param_best_v_, param_best_b_,
+               snapshot.param_w_, snapshot.param_v_, snapshot.param_b_,
+               false);
+    return;
+  }
+  CHECK_EQ(param_num_w_, snapshot.GetNumParameter_w());
+  CHECK_EQ(param_num_v_, snapshot.GetNumParameter_v());
+  set_best_model(snapshot.GetParameter_w(),
+                 snapshot.GetParameter_v(),
+                 snapshot.GetParameter_b());
+}
+
+// Copy the model parameters from another model
+void Model::CopyFrom(Model& model) {
+  CHECK(!model.IsQuantized());
+  if (model.IsSparse()) {
+    copy_sparse(model);
+    return;
+  }
+  if (param_w_ == nullptr) {
+    score_func_ = model.GetScoreFunction();
+    loss_func_ = model.GetLossFunction();
+    num_feat_ = model.GetNumFeature();
+    num_field_ = model.GetNumField();
+    num_K_ = model.GetNumK();
+    aux_size_ = model.GetAuxiliarySize();
+    param_num_w_ = model.GetNumParameter_w();
+    param_num_v_ = model.GetNumParameter_v();
+    scale_ = model.scale_;
+    hash_ = model.hash_;
+    hash_field_ = model.hash_field_;
+    this->initial(false);
+  }
+  CHECK_EQ(param_num_w_, model.GetNumParameter_w());
+  CHECK_EQ(param_num_v_, model.GetNumParameter_v());
+  CHECK_EQ(aux_size_, model.GetAuxiliarySize());
+  memcpy(param_w_, model.GetParameter_w(), param_num_w_*sizeof(real_t));
+  if (param_num_v_ != 0) {
+    memcpy(param_v_, model.GetParameter_v(), param_num_v_*sizeof(real_t));
+  }
+  memcpy(param_b_, model.GetParameter_b(), aux_size_*sizeof(real_t));
+}
+
+// Copy w, v and b without the gradient cache
+void Model::CopyValueFrom(Model& model) {
+  CHECK(!model.IsQuantized());
+  if (model.IsSparse() || model.aux_size_ == 1) {
+    CopyFrom(model);
+    return;
+  }
+  if (param_w_ == nullptr) {
+    score_func_ = model.GetScoreFunction();
+    loss_func_ = model.GetLossFunction();
+    num_feat_ = model.GetNumFeature();
+    num_field_ = model.GetNumField();
+    num_K_ = model.GetNumK();
+    aux_size_ = 1;
+    param_num_w_ = model.param_num_w_ / model.aux_size_;
+    param_num_v_ = model.param_num_v_ / model.aux_size_;
+    scale_ = model.scale_;
+    hash_ = model.hash_;
+    hash_field_ = model.hash_field_;
+    this->initial(false);
+  }
+  CHECK_EQ(aux_size_, 1);
+  CHECK_EQ(param_num_w_ * model.aux_size_, model.param_num_w_);
+  CHECK_EQ(param_num_v_ * model.aux_size_, model.param_num_v_);
+  model.copy_value(model.param_w_, model.param_v_, model.param_b_,
+                   param_w_, param_v_, param_b_, true);
+}
+
+// Copy the values between the two layouts. The w keeps the first
+// value of each aux_size values. The fm keeps the aligned K values
+// of each feature, and the ffm keeps the first kAlign values of each
+// group of kAlign * aux_size values, which is the same layout as the
+// inference model.
+void Model::copy_value(real_t* w, real_t* v, real_t* b,
+                       real_t* w_val, real_t* v_val, real_t* b_val,
+                       bool to_value) {
+  for (index_t i = 0; i < param_num_w_ / aux_size_; ++i) {
+    real_t* src = to_value ? &w[i * aux_size_] : &w_val[i];
+    real_t* dst = to_value ? &w_val[i] : &w[i * aux_size_];
+    *dst = *src;
+  }
+  if (to_value) { b_val[0] = b[0]; } else { b[0] = b_val[0]; }
+  if (param_num_v_ == 0) { return; }
+  index_t step = score_func_.compare("fm") == 0 ? get_aligned_k() : kAlign;
+  index_t num_step = param_num_v_ / (step * aux_size_);
+  for (index_t i = 0; i < num_step; ++i) {
+    real_t* full = v + (uint64)i * step * aux_size_;
+    real_t* val = v_val + (uint64)i * step;
+    if (to_value) {
+      memcpy(val, full, step * sizeof(real_t));
+    } else {
+      memcpy(full, val, step * sizeof(real_t));
+    }
+  }
+}
+
+// Copy a sparse model. The table and the bias are
+// allocated at the first call and re-used after that.
+void Model::copy_sparse(Model& model) {
+  if (!IsSparse()) {
+    free_model();
+    score_func_ = model.GetScoreFunction();
+    loss_func_ = model.GetLossFunction();
+    num_feat_ = model.GetNumFeature();
+    num_field_ = model.GetNumField();
+    num_K_ = model.GetNumK();
+    aux_size_ = model.GetAuxiliarySize();
+    param_num_w_ = 0;
+    param_num_v_ = 0;
+    scale_ = model.scale_;
+    param_b_ = (real_t*)malloc(aux_size_ * sizeof(real_t));
+    init_sparse();
+  }
+  hash_ = model.hash_;
+  hash_field_ = model.hash_field_;
+  CHECK_EQ(aux_size_, model.GetAuxiliarySize());
+  sparse_->CopyFrom(*model.GetSparseTable());
+  memcpy(param_b_, model.GetParameter_b(), aux_size_*sizeof(real_t));
+  // Feature admission and eviction
+  admit_count_ = model.admit_count_;
+  admit_shared_ = model.admit_shared_;
+  evict_epoch_ = model.evict_epoch_;
+  epoch_ = model.epoch_;
+  counting_ = model.counting_;
+  if (model.sketch_ == nullptr) {
+    delete sketch_;
+    sketch_ = nullptr;
+  } else {
+    if (sketch_ == nullptr) { sketch_ = new CountMinSketch(); }
+    sketch_->CopyFrom(*model.sketch_);
+  }
+  if (model.linear_ == nullptr) {
+    delete linear_;
+    linear_ = nullptr;
+  } else {
+    if (linear_ == nullptr) { linear_ = new SparseTable(); }
+    linear_->CopyFrom(*model.linear_);
+  }
+}
+
+// Take a record of the best sparse model
+void Model::set_best_sparse(Model& model) {
+  if (sparse_best_ == nullptr) {
+    sparse_best_ = new SparseTable();
+  }
+  if (param_best_b_ == nullptr) {
+    param_best_b_ = (real_t*)malloc(aux_size_ * sizeof(real_t));
+  }
+  sparse_best_->CopyFrom(*model.GetSparseTable());
+  memcpy(param_best_b_, model.GetParameter_b(), aux_size_*sizeof(real_t));
+  if (model.GetLinearTable() != nullptr) {
+    if (linear_best_ == nullptr) {
+      linear_best_ = new SparseTable();
+    }
+    linear_best_->CopyFrom(*model.GetLinearTable());
+  }
+}
+
+// Copy the given parameters to the best model
+void Model::set_best_model(const real_t* w,
+                           const real_t* v,
+                           const real_t* b) {
   try {
     if (param_best_w_ == nullptr) {
         param_best_w_ = (real_t*)malloc(
@@ -353,14 +952,25 @@ void Model::SetBestModel() {
                    model parameters. Parameter size: "
                << GetNumParameter();
   }
+  if (best_bytes_ == 0) {
+    best_bytes_ = ((uint64)param_num_w_ + param_num_v_ + aux_size_) *
+                  sizeof(real_t);
+    MemoryTracker::Add(kMemBestModel, best_bytes_);
+  }
   // Copy current model parameters
-  memcpy(param_best_w_, param_w_, param_num_w_*sizeof(real_t));
-  memcpy(param_best_v_, param_v_, param_num_v_*sizeof(real_t));
-  memcpy(param_best_b_, param_b_, aux_size_*sizeof(real_t));
+  memcpy(param_best_w_, w, param_num_w_*sizeof(real_t));
+  memcpy(param_best_v_, v, param_num_v_*sizeof(real_t));
+  memcpy(param_best_b_, b, aux_size_*sizeof(real_t));
 }
 
 // Shrink back for getting the best model
 void Model::Shrink() {
+  if (sparse_best_ != nullptr) {
+    sparse_->CopyFrom(*sparse_best_);
+  }
+  if (linear_best_ != nullptr && linear_ != nullptr) {
+    linear_->CopyFrom(*linear_best_);
+  }
   // Copy best model parameters
   if (param_best_w_ != nullptr) {
     memcpy(param_w_, param_best_w_, param_num_w_*sizeof(real_t));
@@ -381,12 +991,14 @@ void Model::serialize_w_v_b(FILE* file) {
   if (score_func_.compare("linear") != 0) {
     WriteDataToDisk(file, (char*)&param_num_v_, sizeof(param_num_v_));
   }
-  // Write w
-  WriteDataToDisk(file, (char*)param_w_, sizeof(real_t)*param_num_w_);
+  // Write w (empty for sparse model)
+  if (param_num_w_ > 0) {
+    WriteDataToDisk(file, (char*)param_w_, sizeof(real_t)*param_num_w_);
+  }
   // Write b
   WriteDataToDisk(file, (char*)param_b_, sizeof(real_t)*aux_size_);
   // Write v
-  if (score_func_.compare("linear") != 0) {
+  if (score_func_.compare("linear") != 0 && param_num_v_ > 0) {
     WriteDataToDisk(file, (char*)param_v_, sizeof(real_t)*param_num_v_);
   }
 }
@@ -401,14 +1013,507 @@ void Model::deserialize_w_v_b(FILE* file) {
   }
   // Allocate memory. Don't set value here
   this->initial(false);
-  // Read w
-  ReadDataFromDisk(file, (char*)param_w_, sizeof(real_t)*param_num_w_);
+  // Read w (empty for sparse model)
+  if (param_num_w_ > 0) {
+    ReadDataFromDisk(file, (char*)param_w_, sizeof(real_t)*param_num_w_);
+  }
   // Read b
   ReadDataFromDisk(file, (char*)param_b_, sizeof(real_t)*aux_size_);
   // Read v
-  if (score_func_.compare("linear") != 0) {
+  if (score_func_.compare("linear") != 0 && param_num_v_ > 0) {
     ReadDataFromDisk(file, (char*)param_v_, sizeof(real_t)*param_num_v_);
   }
 }
 
+//------------------------------------------------------------------------------
+// The inference-only model
+//------------------------------------------------------------------------------
+
+// Round up to the page boundary
+static inline uint64 page_align(uint64 n) {
+  return (n + kModelPageSize - 1) / kModelPageSize * kModelPageSize;
+}
+
+// Write zeros until the file reaches the given offset
+static void pad_to(FILE* file, uint64 written, uint64 offset) {
+  static const char kZero[kModelPageSize] = { 0 };
+  CHECK_LE(written, offset);
+  if (offset > written) {
+    WriteDataToDisk(file, kZero, offset - written);
+  }
+}
+
+// Quantize the values to int8 with one shared scale,
+// and return the scale.
+static real_t quantize_int8(const real_t* in, index_t len, int8* out) {
+  real_t max_abs = 0;
+  for (index_t i = 0; i < len; ++i) {
+    max_abs = std::max(max_abs, (real_t)fabs(in[i]));
+  }
+  real_t scale = max_abs / 127;
+  for (index_t i = 0; i < len; ++i) {
+    out[i] = scale > 0 ? (int8)lrintf(in[i] / scale) : 0;
+  }
+  return scale;
+}
+
+// Serialize model to an inference-only file
+void Model::SerializeInference(const std::string& filename, bool quantize) {
+  CHECK_NE(filename.empty(), true);
+  CHECK(!IsSparse());
+  CHECK(!IsQuantized());
+  CHECK_LT(score_func_.size(), sizeof(InferHeader().score_func));
+  CHECK_LT(loss_func_.size(), sizeof(InferHeader().loss_func));
+  // Length of v of one feature in the dense model and the file
+  index_t len_v = 0;
+  if (score_func_.compare("fm") == 0) {
+    len_v = get_aligned_k();
+  } else if (score_func_.compare("ffm") == 0) {
+    len_v = get_aligned_k() * num_field_;
+  }
+  size_t value_size = quantize ? sizeof(int8) : sizeof(real_t);
+  index_t num_block = (num_feat_ + kQuantBlock - 1) / kQuantBlock;
+  InferHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kModelInferMagic;
+  memcpy(header.score_func, score_func_.data(), score_func_.size());
+  memcpy(header.loss_func, loss_func_.data(), loss_func_.size());
+  header.num_feat = num_feat_;
+  header.num_field = num_field_;
+  header.num_K = num_K_;
+  header.hash = hash_;
+  header.hash_field = hash_field_;
+  header.num_w = num_feat_;
+  header.num_v = num_feat_ * len_v;
+  header.quantized = quantize;
+  header.offset_w = kModelPageSize;
+  header.offset_scale_w = page_align(header.offset_w +
+                                     header.num_w * value_size);
+  header.offset_v = header.offset_scale_w;
+  if (quantize) {
+    header.offset_v = page_align(header.offset_scale_w +
+                                 num_block * sizeof(real_t));
+  }
+  header.offset_scale_v = page_align(header.offset_v +
+                                     header.num_v * value_size);
+  header.offset_b = header.offset_scale_v;
+  if (quantize && len_v > 0) {
+    header.offset_b = page_align(header.offset_scale_v +
+                                 num_feat_ * sizeof(real_t));
+  }
+  header.file_size = header.offset_b + kModelPageSize;
+  std::string tmp_file = filename + ".tmp";
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(tmp_file.c_str(), "w");
+#else
+  FILE *file = OpenFileOrDie(tmp_file.c_str(), "wb");
+#endif
+  setvbuf(file, nullptr, _IOFBF, kModelBufferSize);
+  WriteDataToDisk(file, (char*)&header, sizeof(header));
+  pad_to(file, sizeof(header), header.offset_w);
+  // Write w without the gradient cache
+  std::vector<real_t> row(std::max(len_v, kQuantBlock));
+  std::vector<int8> qrow(row.size());
+  std::vector<real_t> scale;
+  uint64 written = header.offset_w;
+  for (index_t i = 0; i < num_feat_; i += kQuantBlock) {
+    index_t len = std::min(kQuantBlock, num_feat_ - i);
+    for (index_t j = 0; j < len; ++j) {
+      row[j] = param_w_[(i + j) * aux_size_];
+    }
+    if (quantize) {
+      scale.push_back(quantize_int8(row.data(), len, qrow.data()));
+      WriteDataToDisk(file, (char*)qrow.data(), len * sizeof(int8));
+    } else {
+      WriteDataToDisk(file, (char*)row.data(), len * sizeof(real_t));
+    }
+  }
+  written += header.num_w * value_size;
+  if (quantize) {
+    pad_to(file, written, header.offset_scale_w);
+    WriteDataToDisk(file, (char*)scale.data(), num_block * sizeof(real_t));
+    written = header.offset_scale_w + num_block * sizeof(real_t);
+  }
+  pad_to(file, written, header.offset_v);
+  // Write v without the gradient cache. The fm keeps the aligned
+  // K values of a feature, and the ffm keeps the first kAlign
+  // values of each group of kAlign * aux_size values.
+  written = header.offset_v;
+  if (len_v > 0) {
+    index_t step = score_func_.compare("fm") == 0 ? len_v : kAlign;
+    real_t* v = param_v_;
+    scale.clear();
+    for (index_t i = 0; i < num_feat_; ++i) {
+      for (index_t d = 0; d < len_v; d += step) {
+        memcpy(row.data() + d, v, step * sizeof(real_t));
+        v += step * aux_size_;
+      }
+      if (quantize) {
+        scale.push_back(quantize_int8(row.data(), len_v, qrow.data()));
+        WriteDataToDisk(file, (char*)qrow.data(), len_v * sizeof(int8));
+      } else {
+        WriteDataToDisk(file, (char*)row.data(), len_v * sizeof(real_t));
+      }
+    }
+    written += header.num_v * value_size;
+    if (quantize) {
+      pad_to(file, written, header.offset_scale_v);
+      WriteDataToDisk(file, (char*)scale.data(), num_feat_ * sizeof(real_t));
+      written = header.offset_scale_v + num_feat_ * sizeof(real_t);
+    }
+  }
+  pad_to(file, written, header.offset_b);
+  // Write b, which is never quantized
+  WriteDataToDisk(file, (char*)param_b_, sizeof(real_t));
+  pad_to(file, header.offset_b + sizeof(real_t), header.file_size);
+  Close(file);
+  RenameFile(tmp_file.c_str(), filename.c_str());
+}
+
+// Return true if the section [begin, begin + bytes) lies in [0, end)
+static inline bool section_in(uint64 begin, uint64 bytes, uint64 end) {
+  return begin <= end && bytes <= end - begin;
+}
+
+// Check the layout of the inference-only file, so that every
+// parameter exposed by map_inference() lies in the mapped file.
+static bool check_inference(const InferHeader& header, size_t size) {
+  if (header.magic != kModelInferMagic || header.file_size != size) {
+    return false;
+  }
+  // The scoring reads num_feat linear terms and latent vectors
+  uint64 len_v = 0;
+  std::string score_func(header.score_func,
+                         strnlen(header.score_func, sizeof(header.score_func)));
+  uint64 aligned_k = ((uint64)header.num_K + kAlign - 1) / kAlign * kAlign;
+  if (score_func.compare("fm") == 0) {
+    len_v = aligned_k;
+  } else if (score_func.compare("ffm") == 0) {
+    len_v = aligned_k * header.num_field;
+  }
+  if (header.num_w != header.num_feat ||
+      header.num_v != (uint64)header.num_feat * len_v) {
+    return false;
+  }
+  uint64 value_size = header.quantized ? sizeof(int8) : sizeof(real_t);
+  uint64 num_block = ((uint64)header.num_w + kQuantBlock - 1) / kQuantBlock;
+  if (header.offset_w < sizeof(InferHeader) ||
+      header.offset_w % sizeof(real_t) != 0 ||
+      header.offset_v % sizeof(real_t) != 0 ||
+      header.offset_b % sizeof(real_t) != 0 ||
+      !section_in(header.offset_w, header.num_w * value_size,
+                  header.offset_v) ||
+      !section_in(header.offset_v, header.num_v * value_size,
+                  header.offset_b) ||
+      !section_in(header.offset_b, sizeof(real_t), size)) {
+    return false;
+  }
+  if (header.quantized) {
+    // The scales of w lie between w and v, and the scales of v
+    // lie between v and b
+    if (header.offset_scale_w % sizeof(real_t) != 0 ||
+        !section_in(header.offset_w, header.num_w, header.offset_scale_w) ||
+        !section_in(header.offset_scale_w, num_block * sizeof(real_t),
+                    header.offset_v)) {
+      return false;
+    }
+    if (header.num_v > 0 &&
+        (header.offset_scale_v % sizeof(real_t) != 0 ||
+         !section_in(header.offset_v, header.num_v, header.offset_scale_v) ||
+         !section_in(header.offset_scale_v, header.num_w * sizeof(real_t),
+                     header.offset_b))) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Map the inference-only file
+bool Model::map_inference(const std::string& filename) {
+  char* addr = nullptr;
+  size_t size = 0;
+#ifndef _MSC_VER
+  int fd = open(filename.c_str(), O_RDONLY);
+  if (fd < 0) { return false; }
+  struct stat st;
+  if (fstat(fd, &st) != 0 || st.st_size < (off_t)kModelPageSize) {
+    close(fd);
+    return false;
+  }
+  size = st.st_size;
+  void* ptr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+  close(fd);
+  if (ptr == MAP_FAILED) {
+    Color::print_error(
+      StringPrintf("Cannot map the model file: %s", filename.c_str())
+    );
+    return false;
+  }
+  addr = (char*)ptr;
+#else
+  // No mmap, and the file is read into an aligned buffer
+  FILE* file = OpenFileOrDie(filename.c_str(), "rb");
+  size = GetFileSize(file);
+  if (size < kModelPageSize) {
+    Close(file);
+    return false;
+  }
+  addr = (char*)_aligned_malloc(size, kModelPageSize);
+  ReadDataFromDisk(file, addr, size);
+  Close(file);
+#endif
+  mapped_ = addr;
+  mapped_size_ = size;
+  InferHeader header;
+  memcpy(&header, addr, sizeof(header));
+  if (!check_inference(header, size)) {
+    Color::print_error(
+      StringPrintf("The model file is broken: %s", filename.c_str())
+    );
+    unmap_inference();
+    return false;
+  }
+  header.score_func[sizeof(header.score_func)-1] = '\0';
+  header.loss_func[sizeof(header.loss_func)-1] = '\0';
+  score_func_ = std::string(header.score_func);
+  loss_func_ = std::string(header.loss_func);
+  num_feat_ = header.num_feat;
+  num_field_ = header.num_field;
+  num_K_ = header.num_K;
+  hash_ = header.hash != 0;
+  hash_field_ = header.hash_field != 0;
+  aux_size_ = 1;
+  scale_ = 1.0;
+  param_num_w_ = header.num_w;
+  param_num_v_ = header.num_v;
+  param_b_ = (real_t*)(addr + header.offset_b);
+  if (header.quantized) {
+    param_qw_ = (int8*)(addr + header.offset_w);
+    scale_w_ = (real_t*)(addr + header.offset_scale_w);
+    if (header.num_v > 0) {
+      param_qv_ = (int8*)(addr + header.offset_v);
+      scale_v_ = (real_t*)(addr + header.offset_scale_v);
+    }
+    return true;
+  }
+  param_w_ = (real_t*)(addr + header.offset_w);
+  param_v_ = header.num_v > 0 ? (real_t*)(addr + header.offset_v) : nullptr;
+  return true;
+}
+
+// Release the mapping of the inference-only file
+void Model::unmap_inference() {
+#ifndef _MSC_VER
+  munmap(mapped_, mapped_size_);
+#else
+  _aligned_free(mapped_);
+#endif
+  mapped_ = nullptr;
+  mapped_size_ = 0;
+  // The parameters are not owned by the model
+  param_w_ = nullptr;
+  param_v_ = nullptr;
+  param_b_ = nullptr;
+  param_qw_ = nullptr;
+  scale_w_ = nullptr;
+  param_qv_ = nullptr;
+  scale_v_ = nullptr;
+}
+
+// Header of the pruned model file
+struct PruneHeader {
+  uint64 magic;
+  char score_func[16];
+  char loss_func[16];
+  index_t num_feat;
+  index_t num_field;
+  index_t num_K;
+  index_t hash;
+  index_t hash_field;
+  /* Features with the linear term and the latent factor */
+  index_t num_latent;
+  /* Features with the linear term only */
+  index_t num_linear;
+  real_t bias;
+};
+
+// Write an array which can be empty
+template <typename T>
+static void write_array(FILE* file, const std::vector<T>& vec) {
+  if (vec.empty()) { return; }
+  WriteDataToDisk(file, (char*)vec.data(), vec.size() * sizeof(T));
+}
+
+// Read an array which can be empty, and return true if it is complete
+template <typename T>
+static bool read_array(FILE* file, std::vector<T>* vec) {
+  if (vec->empty()) { return true; }
+  size_t size = vec->size() * sizeof(T);
+  return ReadDataFromDisk(file, (char*)vec->data(), size) == size;
+}
+
+// Serialize the non-zero parameters to a pruned inference file
+index_t Model::SerializePruned(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  CHECK(!IsMapped());
+  CHECK_LT(score_func_.size(), sizeof(PruneHeader().score_func));
+  CHECK_LT(loss_func_.size(), sizeof(PruneHeader().loss_func));
+  // Length of v of one feature without the gradient cache
+  index_t len_v = 0;
+  if (score_func_.compare("fm") == 0) {
+    len_v = get_aligned_k();
+  } else if (score_func_.compare("ffm") == 0) {
+    len_v = get_aligned_k() * num_field_;
+  }
+  // The fm keeps the aligned K values of a feature, and the ffm
+  // keeps the first kAlign values of each kAlign * aux_size values.
+  index_t step = score_func_.compare("fm") == 0 ? len_v : kAlign;
+  // Find the rows to keep, in ascending order of the keys
+  std::vector<index_t> latent_key, linear_key;
+  std::vector<real_t> latent_w, linear_w;
+  std::vector<real_t*> latent_v;
+  auto add_row = [&](index_t key, real_t* w, real_t* v) {
+    // Never updated in training
+    if (aux_size_ > 1 && w[1] == 1.0) { return; }
+    bool has_v = false;
+    for (index_t d = 0; v != nullptr && d < len_v && !has_v; d += step) {
+      real_t* g = v + d * aux_size_;
+      for (index_t s = 0; s < step; ++s) {
+        if (g[s] != 0) { has_v = true; break; }
+      }
+    }
+    if (has_v) {
+      latent_key.push_back(key);
+      latent_w.push_back(w[0]);
+      latent_v.push_back(v);
+    } else if (w[0] != 0) {
+      linear_key.push_back(key);
+      linear_w.push_back(w[0]);
+    }
+  };
+  if (IsSparse()) {
+    std::vector<index_t> keys;
+    sparse_->GetKeys(&keys);
+    for (size_t i = 0; i < keys.size(); ++i) {
+      real_t* row = sparse_->Find(keys[i]);
+      add_row(keys[i], row, len_v > 0 ? row + sparse_->GetOffset_v() : nullptr);
+    }
+    // The linear-only rows are not in the SparseTable
+    if (linear_ != nullptr) {
+      linear_->GetKeys(&keys);
+      for (size_t i = 0; i < keys.size(); ++i) {
+        add_row(keys[i], linear_->Find(keys[i]), nullptr);
+      }
+    }
+  } else {
+    index_t len = len_v * aux_size_;
+    for (index_t j = 0; j < num_feat_; ++j) {
+      add_row(j, param_w_ + j * aux_size_,
+              len_v > 0 ? param_v_ + j * len : nullptr);
+    }
+  }
+  PruneHeader header;
+  memset(&header, 0, sizeof(header));
+  header.magic = kModelPruneMagic;
+  memcpy(header.score_func, score_func_.data(), score_func_.size());
+  memcpy(header.loss_func, loss_func_.data(), loss_func_.size());
+  header.num_feat = num_feat_;
+  header.num_field = num_field_;
+  header.num_K = num_K_;
+  header.hash = hash_;
+  header.hash_field = hash_field_;
+  header.num_latent = latent_key.size();
+  header.num_linear = linear_key.size();
+  header.bias = param_b_[0];
+  std::string tmp_file = filename + ".tmp";
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(tmp_file.c_str(), "w");
+#else
+  FILE *file = OpenFileOrDie(tmp_file.c_str(), "wb");
+#endif
+  setvbuf(file, nullptr, _IOFBF, kModelBufferSize);
+  WriteDataToDisk(file, (char*)&header, sizeof(header));
+  // The features with latent factor: keys, w and v
+  std::vector<real_t> row(std::max(len_v, (index_t)1));
+  write_array(file, latent_key);
+  write_array(file, latent_w);
+  for (size_t i = 0; i < latent_v.size(); ++i) {
+    real_t* v = latent_v[i];
+    for (index_t d = 0; d < len_v; d += step) {
+      memcpy(row.data() + d, v, step * sizeof(real_t));
+      v += step * aux_size_;
+    }
+    WriteDataToDisk(file, (char*)row.data(), len_v * sizeof(real_t));
+  }
+  // The linear-only features: keys and w
+  write_array(file, linear_key);
+  write_array(file, linear_w);
+  Close(file);
+  RenameFile(tmp_file.c_str(), filename.c_str());
+  return header.num_latent + header.num_linear;
+}
+
+// Load the pruned file written by SerializePruned()
+bool Model::load_pruned(FILE* file, const std::string& filename) {
+  PruneHeader header;
+  if (ReadDataFromDisk(file, (char*)&header, sizeof(header)) !=
+      sizeof(header)) {
+    Color::print_error(
+      StringPrintf("The model file is broken: %s", filename.c_str())
+    );
+    return false;
+  }
+  header.score_func[sizeof(header.score_func)-1] = '\0';
+  header.loss_func[sizeof(header.loss_func)-1] = '\0';
+  score_func_ = std::string(header.score_func);
+  loss_func_ = std::string(header.loss_func);
+  num_field_ = header.num_field;
+  num_K_ = header.num_K;
+  hash_ = header.hash != 0;
+  hash_field_ = header.hash_field != 0;
+  // The feature ids of a sparse model are bounded only if hashed
+  num_feat_ = hash_ ? header.num_feat : 0;
+  aux_size_ = 1;
+  scale_ = 1.0;
+  param_num_w_ = 0;
+  param_num_v_ = 0;
+  param_b_ = (real_t*)malloc(sizeof(real_t));
+  param_b_[0] = header.bias;
+  init_sparse();
+  index_t len_v = sparse_->GetLength_v();
+  index_t offset_v = sparse_->GetOffset_v();
+  std::vector<index_t> key(header.num_latent);
+  std::vector<real_t> w(header.num_latent);
+  std::vector<real_t> v((size_t)header.num_latent * len_v);
+  std::vector<index_t> linear_key(header.num_linear);
+  std::vector<real_t> linear_w(header.num_linear);
+  if (!read_array(file, &key) || !read_array(file, &w) ||
+      !read_array(file, &v) || !read_array(file, &linear_key) ||
+      !read_array(file, &linear_w)) {
+    Color::print_error(
+      StringPrintf("The model file is broken: %s", filename.c_str())
+    );
+    free_model();
+    return false;
+  }
+  for (size_t i = 0; i < key.size(); ++i) {
+    real_t* row = sparse_->FindOrCreate(key[i]);
+    row[0] = w[i];
+    if (len_v > 0) {
+      memcpy(row + offset_v, v.data() + i * len_v, len_v * sizeof(real_t));
+    }
+  }
+  // The linear-only features of linear score are in the SparseTable
+  SparseTable* table = sparse_;
+  if (len_v > 0 && !linear_key.empty()) {
+    init_linear();
+    table = linear_;
+  }
+  for (size_t i = 0; i < linear_key.size(); ++i) {
+    table->FindOrCreate(linear_key[i])[0] = linear_w[i];
+  }
+  pruned_ = true;
+  return true;
+}
+
 }  // namespace xLearn
@@ -22,6 +22,8 @@ This file defines the class of model parameters.
 #define XLEARN_DATA_MODEL_PARAMETERS_H_
 
 #include <string>
+#include <vector>
+#include <random>
 
 #include <math.h>
 
@@ -29,8 +31,71 @@ This file defines the class of model parameters.
 #include "src/data/data_structure.h"
 #include "src/base/logging.h"
 
+class ThreadPool;
+
 namespace xLearn {
 
+class SparseTable;
+class CountMinSketch;
+
+// Buffer size (byte) used to write the binary model
+const size_t kModelBufferSize = 4 * 1024 * 1024;  // 4 MB
+
+// Number of features formatted by one task of SerializeToTXT()
+const index_t kTXTChunkSize = 10000;
+
+// Tag of the optional feature-hashing section at the end of
+// the binary model. Old models without it are not hashed.
+const uint64 kModelHashTag = 0x48534148584c4558ULL;
+
+// Tag of the optional sparse-table section, which stores
+// the rows of a sparse model (see InitializeSparse()).
+const uint64 kModelSparseTag = 0x5053524150534c58ULL;
+
+// Tag of the optional section of feature admission and
+// eviction of a sparse model (see SetAdmission()).
+const uint64 kModelAdmitTag = 0x54494d4441534c58ULL;
+
+// Key of the row shared by the features which are not admitted.
+const index_t kSharedFeatureKey = 0xFFFFFFFF;
+
+// Magic number at the start of the inference model file, which
+// is written by SerializeInference() and mapped by Deserialize().
+const uint64 kModelInferMagic = 0x31524e49584c4558ULL;
+
+// Magic number at the start of the pruned model file, which
+// is written by SerializePruned() and read by Deserialize().
+const uint64 kModelPruneMagic = 0x314e5250584c4558ULL;
+
+// The sections of the inference model start at this boundary.
+const size_t kModelPageSize = 4096;
+
+// Number of linear terms sharing one scale in the int8 model.
+const index_t kQuantBlock = 32;
+
+// Header page of the inference-only file. All the
+// offsets are in bytes from the start of the file.
+struct InferHeader {
+  uint64 magic;
+  uint64 file_size;
+  char score_func[16];
+  char loss_func[16];
+  index_t num_feat;
+  index_t num_field;
+  index_t num_K;
+  index_t hash;
+  index_t hash_field;
+  index_t num_w;
+  index_t num_v;
+  uint64 offset_w;
+  uint64 offset_v;
+  uint64 offset_b;
+  /* The following fields are used by the int8 model */
+  index_t quantized;
+  uint64 offset_scale_w;
+  uint64 offset_scale_v;
+};
+
 //------------------------------------------------------------------------------
 // The Model class is responsible for storing the global
 // model prameters. We can dump a checkpoint for current model
@@ -80,6 +145,50 @@ namespace xLearn {
 // The Model class can support early-stopping technique. We can set
 // a record for the best model parameter by using SetBestModel() and
 // we can shrink back to find the best model by using Shrink() method.
+//
+// A model can also be written in an inference-only format by using
+// SerializeInference(). The file has a header page and page-aligned
+// w, v and b sections without the gradient cache, i.e., it has the same
+// layout as a model with aux_size = 1. Deserialize() maps such a file
+// read-only instead of reading it, so the loading is near-instant
+// and the processes on a host share one copy in the page cache. A
+// mapped model (IsMapped()) can only be used for prediction.
+//
+// The inference-only model can also be quantized to int8, which is about
+// 4x smaller. The latent factor of each feature has its own scale, and
+// every kQuantBlock linear terms share one scale. GetParameter_w() and
+// GetParameter_v() of an int8 model (IsQuantized()) return nullptr, and
+// the score functions read GetQuantized_w() and GetQuantized_v() instead.
+//
+// A model trained with L1 regularization (e.g., ftrl) has many zero
+// linear terms, and it can be written in a pruned format by using
+// SerializePruned(). The file keeps the sorted ids of the features with
+// a non-zero latent factor, and then the ids of the linear-only features
+// with a non-zero linear term, without the gradient cache. The features
+// never updated in training (whose gradient cache is still the initial
+// value) are dropped. Deserialize() loads such a file to a sparse model
+// (aux_size = 1), whose linear-only features are kept in the linear-only
+// table, and the features not in the file are unseen features. A pruned
+// model (IsPruned()) can only be used for prediction.
+//
+// A model initialized by InitializeSparse() (or converted by
+// ConvertToSparse()) stores w and v in a SparseTable keyed by the
+// feature id instead of the dense arrays, and GetParameter_w() and
+// GetParameter_v() return nullptr. Its rows are created on the first
+// touch, so the model grows with the features seen in training. The
+// Loss stages the rows of each data matrix into a small dense model
+// (see Loss::calc_grad_sparse()), and hence the score functions
+// only work on dense models.
+//
+// Most of the features in a big dataset are rare, and a sparse model
+// can skip their latent factor by using SetAdmission(). A feature is
+// admitted to the SparseTable only after it has been seen admit_count
+// times, which is counted by a CountMinSketch in the first epoch of
+// each training. Before that, the feature uses a linear-only row in
+// another SparseTable, or the row of kSharedFeatureKey which is shared
+// by all of the features which are not admitted. The rows which are not
+// updated in the last evict_epoch epochs can also be evicted in a long
+// running incremental training (see EndEpoch()).
 //------------------------------------------------------------------------------
 class Model {
  public:
@@ -100,18 +209,89 @@ class Model {
               index_t aux_size,
               real_t scale = 1.0);
 
-  // Serialize model to a checkpoint file.
+  // Initialize a sparse model with no rows. The num_feature is
+  // only kept as the bound of the hashed feature ids, and it can
+  // be 0 (no bound) if the features are not hashed.
+  void InitializeSparse(const std::string& score_func,
+                        const std::string& loss_func,
+                        index_t num_feature,
+                        index_t num_field,
+                        index_t num_K,
+                        index_t aux_size,
+                        real_t scale = 1.0);
+
+  // Move the dense parameters to a SparseTable, so that the
+  // model can grow with the new features in continued training.
+  void ConvertToSparse();
+
+  // Serialize model to a checkpoint file. The model is first
+  // written to a temporary file and then renamed to the target
+  // file, so that the target file is always a complete model.
   void Serialize(const std::string& filename);
 
-  // Serialize model to a TXT file.
-  void SerializeToTXT(const std::string& filename);
-
-  // Deserialize model from a checkpoint file.
+  // Serialize model to a TXT file. The features are formatted
+  // chunk by chunk, and the chunks can be formatted in parallel
+  // by the given thread pool. The file is also written atomically.
+  void SerializeToTXT(const std::string& filename, 
+                      ThreadPool* pool = nullptr);
+
+  // Serialize model to an inference-only file, which has no
+  // gradient cache and can be mapped by Deserialize(). The w and v
+  // are quantized to int8 if quantize is true. The file is written
+  // atomically. Not supported by sparse model.
+  void SerializeInference(const std::string& filename,
+                          bool quantize = false);
+
+  // Serialize the non-zero parameters to a pruned inference file,
+  // which is loaded to a sparse model by Deserialize(). The file
+  // is written atomically. Not supported by the mapped model.
+  // Return the number of features kept in the file.
+  index_t SerializePruned(const std::string& filename);
+
+  // Deserialize model from a checkpoint file, map the file written
+  // by SerializeInference(), or load the file written by
+  // SerializePruned().
   bool Deserialize(const std::string& filename);
 
+  // Is the model loaded from a pruned file ?
+  inline bool IsPruned() { return pruned_; }
+
+  // Is the model mapped from an inference-only file ?
+  inline bool IsMapped() { return mapped_ != nullptr; }
+
+  // Is the model mapped from an int8 inference-only file ?
+  inline bool IsQuantized() { return param_qw_ != nullptr; }
+
+  // Get the int8 linear term and its scales, where the
+  // feature j uses the scale j / kQuantBlock.
+  inline int8* GetQuantized_w() { return param_qw_; }
+  inline real_t* GetScale_w() { return scale_w_; }
+
+  // Get the int8 latent factor and its scales, where
+  // the feature j uses the scale j.
+  inline int8* GetQuantized_v() { return param_qv_; }
+  inline real_t* GetScale_v() { return scale_v_; }
+
   // Take a record of the best model during training.
   void SetBestModel();
 
+  // Take a record of the best model from a snapshot, which
+  // has the same shape with current model, or is taken by
+  // CopyValueFrom(). This is used when the validation runs on
+  // a snapshot of an earlier epoch.
+  void SetBestModel(Model& snapshot);
+
+  // Copy the model parameters from another model. The memory
+  // is allocated at the first call and re-used after that, so
+  // it is cheap to take a snapshot at each epoch.
+  void CopyFrom(Model& model);
+
+  // Copy w, v and b without the gradient cache of adagrad and
+  // ftrl, so the copy is 1/aux_size of the model. The copy has
+  // aux_size 1, which can be scored but not trained. The sparse
+  // model is copied by CopyFrom().
+  void CopyValueFrom(Model& model);
+
   // Shrink back for getting the best model.
   void Shrink();
 
@@ -157,11 +337,79 @@ class Model {
     return (index_t)ceil((real_t)num_K_/kAlign)*kAlign;
   }
 
+  // The feature ids were hashed into num_feat_ buckets by the
+  // parser (see Parser::setHash), and the same hashing must be
+  // used for prediction. This is saved with the model.
+  inline void SetFeatureHash(bool hashed, bool field_space) {
+    hash_ = hashed;
+    hash_field_ = field_space;
+  }
+  inline bool IsHashed() { return hash_; }
+  inline bool IsFieldHashed() { return hash_field_; }
+
   // Get the total size of model parameters.
   // 2 = bias + bias_gradient
-  inline index_t GetNumParameter() {
-    return param_num_w_ + param_num_v_ + 2;
-  }
+  index_t GetNumParameter();
+
+  // Is the model stored in a SparseTable ?
+  inline bool IsSparse() { return sparse_ != nullptr; }
+
+  // Get the SparseTable of a sparse model.
+  inline SparseTable* GetSparseTable() { return sparse_; }
+
+  // Set the feature admission and eviction of a sparse model. A
+  // feature gets its own latent factor after it has been seen
+  // admit_count times (admit_count <= 1 admits all features), and
+  // before that it uses its own linear term (shared is false) or
+  // the shared row. An evict_epoch of 0 disables the eviction.
+  void SetAdmission(index_t admit_count,
+                    bool shared,
+                    index_t evict_epoch);
+
+  // Is the feature admission enabled ?
+  inline bool IsAdmission() { return sketch_ != nullptr; }
+  inline index_t GetAdmitCount() { return admit_count_; }
+  inline bool IsSharedFallback() { return admit_shared_; }
+  inline index_t GetEvictEpoch() { return evict_epoch_; }
+
+  // Get the sketch of feature admission.
+  inline CountMinSketch* GetSketch() { return sketch_; }
+
+  // Get the linear-only rows of the features which are not
+  // admitted. This is nullptr if they use the shared row.
+  inline SparseTable* GetLinearTable() { return linear_; }
+
+  // The sketch counts the features only in the first epoch.
+  inline bool IsCounting() { return counting_; }
+
+  // Number of finished epochs. The rows updated in
+  // the next epoch are stamped with GetEpoch() + 1.
+  inline index_t GetEpoch() { return epoch_; }
+
+  // Finish an epoch of training a sparse model. This stops the
+  // counting and evicts the stale rows. Return the number of
+  // evicted rows.
+  size_t EndEpoch();
+
+  // Initialize the latent factor of one feature in the layout of
+  // param_v_, which is also used by SparseTable to create a row.
+  static void InitLatent(const std::string& score_func,
+                         index_t num_field,
+                         index_t num_K,
+                         index_t aux_size,
+                         real_t scale,
+                         std::default_random_engine& generator,
+                         real_t* v);
+
+  // Estimate the bytes of a dense model before we allocate it, which
+  // is the same as the memory allocated by Initialize(). The result
+  // is in 64-bit, so it also tells us if the number of parameters
+  // overflows index_t.
+  static uint64 EstimateBytes(const std::string& score_func,
+                              index_t num_feature,
+                              index_t num_field,
+                              index_t num_K,
+                              index_t aux_size);
 
  protected:
   /* Score function
@@ -205,8 +453,42 @@ class Model {
   real_t* param_best_w_ = nullptr;
   real_t* param_best_v_ = nullptr;
   real_t* param_best_b_ = nullptr;
+  /* Bytes of the parameters and the best model,
+  which are counted by the MemoryTracker */
+  uint64 model_bytes_ = 0;
+  uint64 best_bytes_ = 0;
   /* Used to init model parameters */
   real_t scale_;
+  /* Hashing trick: feature ids are hash(key) % num_feat_ */
+  bool hash_ = false;
+  bool hash_field_ = false;
+  /* Rows of the sparse model, and nullptr for dense model */
+  SparseTable* sparse_ = nullptr;
+  SparseTable* sparse_best_ = nullptr;
+  /* Feature admission and eviction of sparse model */
+  index_t admit_count_ = 0;
+  bool admit_shared_ = false;
+  index_t evict_epoch_ = 0;
+  index_t epoch_ = 0;
+  bool counting_ = true;
+  CountMinSketch* sketch_ = nullptr;
+  /* Linear-only rows of the features which are not admitted */
+  SparseTable* linear_ = nullptr;
+  SparseTable* linear_best_ = nullptr;
+  /* Read-only mapping of the inference-only file */
+  char* mapped_ = nullptr;
+  size_t mapped_size_ = 0;
+  /* The int8 parameters and scales of the mapped model */
+  int8* param_qw_ = nullptr;
+  real_t* scale_w_ = nullptr;
+  int8* param_qv_ = nullptr;
+  real_t* scale_v_ = nullptr;
+  /* Loaded from the file written by SerializePruned() */
+  bool pruned_ = false;
+  /* Sorted keys of the sparse model used by SerializeToTXT() */
+  std::vector<index_t> txt_key_;
+  /* Zero latent factor of the linear-only rows in TXT model */
+  std::vector<real_t> txt_zero_;
 
   // Initialize the value of model parameters and gradient cache.
   void initial(bool set_value = false);
@@ -220,9 +502,58 @@ class Model {
   // Deserialize w, v, b from disk file.
   void deserialize_w_v_b(FILE* file);
 
+  // Map the inference-only file written by SerializeInference().
+  bool map_inference(const std::string& filename);
+
+  // Release the mapping of the inference-only file.
+  void unmap_inference();
+
+  // Load the pruned file written by SerializePruned().
+  bool load_pruned(FILE* file, const std::string& filename);
+
+  // Format the parameters of feature [start, end) to TXT.
+  // The section is 0 for the linear term and 1 for the latent factor.
+  void format_txt(int section, 
+                  index_t start, 
+                  index_t end, 
+                  std::string* buf);
+
   // Free the allocated memory.
   void free_model();
 
+  // Create an empty SparseTable with the shape of current model.
+  void init_sparse();
+
+  // Create an empty linear-only SparseTable for feature admission.
+  void init_linear();
+
+  // Release the memory of feature admission.
+  void free_admission();
+
+  // Copy a sparse model.
+  void copy_sparse(Model& model);
+
+  // Take a record of the best sparse model.
+  void set_best_sparse(Model& model);
+
+  // Get the linear term and the latent factor of the j-th
+  // feature in TXT model. For sparse model, j is the index
+  // of the sorted keys in txt_key_.
+  real_t* txt_row_w(index_t j);
+  real_t* txt_row_v(index_t j);
+
+  // Copy the values between w, v, b of current shape, which have the
+  // gradient cache, and w_val, v_val, b_val without the gradient cache.
+  // If to_value is false, the values are copied back to w, v and b.
+  void copy_value(real_t* w, real_t* v, real_t* b,
+                  real_t* w_val, real_t* v_val, real_t* b_val,
+                  bool to_value);
+
+  // Copy the given parameters to the best model.
+  void set_best_model(const real_t* w, 
+                      const real_t* v, 
+                      const real_t* b);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Model);
 };
@@ -22,9 +22,17 @@ This file tests model_parameters.h file.
 
 #include <string>
 #include <vector>
+#include <fstream>
+#include <sstream>
+#include <functional>
 
 #include "src/data/model_parameters.h"
 #include "src/data/hyper_parameters.h"
+#include "src/data/sparse_table.h"
+#include "src/data/count_min_sketch.h"
+#include "src/base/file_util.h"
+#include "src/base/memory_tracker.h"
+#include "src/base/thread_pool.h"
 
 namespace xLearn {
 
@@ -197,6 +205,370 @@ TEST(MODEL_TEST, Save_and_Load) {
   RemoveFile(hyper_param.model_file.c_str());
 }
 
+TEST(MODEL_TEST, Save_and_Load_hash) {
+  HyperParam hyper_param = Init();
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K,
+                   hyper_param.auxiliary_size);
+  // A model without hashing
+  model.Serialize(hyper_param.model_file);
+  Model plain_model(hyper_param.model_file);
+  EXPECT_FALSE(plain_model.IsHashed());
+  EXPECT_FALSE(plain_model.IsFieldHashed());
+  // A hashed model keeps its hashing
+  model.SetFeatureHash(true, true);
+  model.Serialize(hyper_param.model_file);
+  Model hash_model(hyper_param.model_file);
+  EXPECT_TRUE(hash_model.IsHashed());
+  EXPECT_TRUE(hash_model.IsFieldHashed());
+  EXPECT_EQ(hash_model.GetNumParameter_v(), model.GetNumParameter_v());
+  Model copy_model;
+  copy_model.CopyFrom(hash_model);
+  EXPECT_TRUE(copy_model.IsHashed());
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+TEST(MODEL_TEST, Save_and_Load_inference) {
+  HyperParam hyper_param = Init();
+  std::string filename = "./test_model.infer";
+  const char* score_list[] = { "linear", "fm", "ffm" };
+  for (int s = 0; s < 3; ++s) {
+    for (index_t aux_size = 1; aux_size <= 3; ++aux_size) {
+      Model model;
+      model.Initialize(score_list[s],
+                       hyper_param.loss_func,
+                       1000,
+                       hyper_param.num_field,
+                       7,  /* aligned to 8 */
+                       aux_size);
+      model.SetFeatureHash(true, false);
+      real_t* w = model.GetParameter_w();
+      for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+        w[i] = i * 0.5;
+      }
+      model.GetParameter_b()[0] = -1.5;
+      model.SerializeInference(filename);
+      Model new_model(filename);
+      EXPECT_TRUE(new_model.IsMapped());
+      EXPECT_TRUE(new_model.IsHashed());
+      EXPECT_FALSE(new_model.IsFieldHashed());
+      EXPECT_EQ(new_model.GetScoreFunction(), score_list[s]);
+      EXPECT_EQ(new_model.GetLossFunction(), hyper_param.loss_func);
+      EXPECT_EQ(new_model.GetNumFeature(), 1000);
+      EXPECT_EQ(new_model.GetNumField(), hyper_param.num_field);
+      EXPECT_EQ(new_model.GetNumK(), 7);
+      EXPECT_EQ(new_model.GetAuxiliarySize(), 1);
+      EXPECT_EQ(new_model.GetNumParameter_w(), 1000);
+      EXPECT_EQ(new_model.GetNumParameter_v(),
+                model.GetNumParameter_v() / aux_size);
+      EXPECT_FLOAT_EQ(new_model.GetParameter_b()[0], -1.5);
+      real_t* new_w = new_model.GetParameter_w();
+      EXPECT_EQ((size_t)new_w % kModelPageSize, 0);
+      for (index_t i = 0; i < 1000; ++i) {
+        EXPECT_FLOAT_EQ(new_w[i], w[i * aux_size]);
+      }
+      // The model values of v without the gradient cache
+      real_t* v = model.GetParameter_v();
+      real_t* new_v = new_model.GetParameter_v();
+      index_t len = new_model.GetNumParameter_v();
+      if (s == 0) {
+        EXPECT_EQ(new_v, nullptr);
+      } else {
+        EXPECT_EQ((size_t)new_v % kModelPageSize, 0);
+      }
+      index_t step = s == 1 ? 8 : kAlign;
+      for (index_t n = 0; n < len; ++n) {
+        index_t src = (n / step) * step * aux_size + n % step;
+        EXPECT_FLOAT_EQ(new_v[n], v[src]);
+      }
+      // A mapped model can be copied
+      Model copy_model;
+      copy_model.CopyFrom(new_model);
+      EXPECT_FALSE(copy_model.IsMapped());
+      EXPECT_FLOAT_EQ(copy_model.GetParameter_w()[999], new_w[999]);
+    }
+  }
+  // The old format is still read
+  Model model;
+  model.Initialize("fm", "squared", 10, 0, 4, 2);
+  model.Serialize(filename);
+  Model old_model(filename);
+  EXPECT_FALSE(old_model.IsMapped());
+  EXPECT_EQ(old_model.GetAuxiliarySize(), 2);
+  RemoveFile(filename.c_str());
+}
+
+// Write an inference file whose header is changed by func,
+// and return true if it can still be loaded
+static bool load_broken_inference(const std::string& filename,
+                                  bool quantize,
+                                  std::function<void(InferHeader*)> func) {
+  Model model;
+  model.Initialize("ffm", "squared", 100, 3, 4, 2);
+  model.SerializeInference(filename, quantize);
+  InferHeader header;
+  FILE* file = OpenFileOrDie(filename.c_str(), "r+b");
+  ReadDataFromDisk(file, (char*)&header, sizeof(header));
+  func(&header);
+  rewind(file);
+  WriteDataToDisk(file, (char*)&header, sizeof(header));
+  Close(file);
+  Model new_model;
+  bool ret = new_model.Deserialize(filename);
+  EXPECT_EQ(ret, new_model.IsMapped());
+  return ret;
+}
+
+TEST(MODEL_TEST, Load_broken_inference) {
+  std::string filename = "./test_model.infer";
+  for (int q = 0; q < 2; ++q) {
+    bool quantize = q == 1;
+    size_t value_size = quantize ? sizeof(int8) : sizeof(real_t);
+    // The original file
+    EXPECT_TRUE(load_broken_inference(filename, quantize,
+      [](InferHeader* h) { }));
+    // w runs into v
+    EXPECT_FALSE(load_broken_inference(filename, quantize,
+      [](InferHeader* h) { h->offset_v = h->offset_w + 4; }));
+    // v runs into b
+    EXPECT_FALSE(load_broken_inference(filename, quantize,
+      [value_size](InferHeader* h) {
+        h->offset_b = h->offset_v + h->num_v * value_size - 4;
+      }));
+    // v does not match the score function
+    EXPECT_FALSE(load_broken_inference(filename, quantize,
+      [](InferHeader* h) { h->num_K = 8; }));
+    // Huge offsets do not wrap around
+    EXPECT_FALSE(load_broken_inference(filename, quantize,
+      [](InferHeader* h) { h->offset_v = ~0ULL - 3; }));
+  }
+  // The scales must lie in the file
+  EXPECT_FALSE(load_broken_inference(filename, true,
+    [](InferHeader* h) { h->offset_scale_w = h->file_size; }));
+  EXPECT_FALSE(load_broken_inference(filename, true,
+    [](InferHeader* h) { h->offset_scale_v = h->offset_b; }));
+  RemoveFile(filename.c_str());
+}
+
+TEST(MODEL_TEST, Save_and_Load_pruned) {
+  std::string filename = "./test_model.prune";
+  const char* score_list[] = { "linear", "fm", "ffm" };
+  for (int s = 0; s < 3; ++s) {
+    Model model;
+    model.Initialize(score_list[s], "cross-entropy", 100, 4, 7, 3);
+    model.SetFeatureHash(true, true);
+    real_t* w = model.GetParameter_w();
+    real_t* v = model.GetParameter_v();
+    index_t len = model.GetNumParameter_v() / 100;
+    // 0 ~ 29 are never updated. 30 ~ 59 have zero latent
+    // factor, and the odd ones of them have zero linear term.
+    for (index_t j = 30; j < 100; ++j) {
+      w[j*3] = j % 2 == 1 ? 0 : j * 0.5;
+      w[j*3+1] = 2.0;
+      if (j < 60) {
+        for (index_t d = 0; d < len; ++d) { v[j*len+d] = 0; }
+      }
+    }
+    model.GetParameter_b()[0] = -1.5;
+    for (int sparse = 0; sparse < 2; ++sparse) {
+      if (sparse == 1) { model.ConvertToSparse(); }
+      index_t num_kept = model.SerializePruned(filename);
+      Model new_model(filename);
+      EXPECT_TRUE(new_model.IsPruned());
+      EXPECT_TRUE(new_model.IsSparse());
+      EXPECT_TRUE(new_model.IsHashed());
+      EXPECT_TRUE(new_model.IsFieldHashed());
+      EXPECT_EQ(new_model.GetScoreFunction(), score_list[s]);
+      EXPECT_EQ(new_model.GetNumFeature(), 100);
+      EXPECT_EQ(new_model.GetAuxiliarySize(), 1);
+      EXPECT_FLOAT_EQ(new_model.GetParameter_b()[0], -1.5);
+      SparseTable* table = new_model.GetSparseTable();
+      SparseTable* linear = new_model.GetLinearTable();
+      if (s == 0) {
+        // The linear score keeps all the non-zero linear terms
+        EXPECT_EQ(num_kept, 35);
+        EXPECT_EQ(table->Size(), 35);
+        EXPECT_EQ(linear, nullptr);
+      } else {
+        EXPECT_EQ(num_kept, 55);
+        EXPECT_EQ(table->Size(), 40);
+        ASSERT_TRUE(linear != nullptr);
+        EXPECT_EQ(linear->Size(), 15);
+      }
+      for (index_t j = 0; j < 100; ++j) {
+        real_t* row = table->Find(j);
+        real_t* lrow = linear == nullptr ? nullptr : linear->Find(j);
+        if (j < 30 || (j % 2 == 1 && (j < 60 || s == 0))) {
+          EXPECT_TRUE(row == nullptr && lrow == nullptr);
+          continue;
+        }
+        if (j < 60 && s > 0) {
+          ASSERT_TRUE(lrow != nullptr);
+          EXPECT_FLOAT_EQ(lrow[0], j % 2 == 1 ? 0 : j * 0.5);
+          continue;
+        }
+        ASSERT_TRUE(row != nullptr);
+        EXPECT_FLOAT_EQ(row[0], j % 2 == 1 ? 0 : j * 0.5);
+        if (s == 0 || sparse == 1) { continue; }
+        // The model values of v without the gradient cache
+        real_t* new_v = row + table->GetOffset_v();
+        index_t step = s == 1 ? 8 : kAlign;
+        for (index_t n = 0; n < table->GetLength_v(); ++n) {
+          index_t src = (n / step) * step * 3 + n % step;
+          EXPECT_FLOAT_EQ(new_v[n], v[j*len+src]);
+        }
+      }
+    }
+  }
+  RemoveFile(filename.c_str());
+}
+
+TEST(MODEL_TEST, Save_and_Load_sparse) {
+  HyperParam hyper_param = Init();
+  // Convert a dense model
+  Model model;
+  model.Initialize(hyper_param.score_func,
+                   hyper_param.loss_func,
+                   hyper_param.num_feature,
+                   hyper_param.num_field,
+                   hyper_param.num_K,
+                   hyper_param.auxiliary_size);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = 2.5;
+  }
+  real_t* v = model.GetParameter_v();
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    v[i] = i;
+  }
+  model.GetParameter_b()[0] = 1.5;
+  index_t num_param = model.GetNumParameter();
+  model.ConvertToSparse();
+  EXPECT_TRUE(model.IsSparse());
+  EXPECT_EQ(model.GetParameter_w(), nullptr);
+  EXPECT_EQ(model.GetParameter_v(), nullptr);
+  EXPECT_EQ(model.GetNumParameter(), num_param);
+  SparseTable* table = model.GetSparseTable();
+  EXPECT_EQ(table->Size(), hyper_param.num_feature);
+  index_t len_v = table->GetLength_v();
+  for (index_t j = 0; j < hyper_param.num_feature; ++j) {
+    real_t* row = table->Find(j);
+    EXPECT_FLOAT_EQ(row[0], 2.5);
+    EXPECT_FLOAT_EQ(row[1], 2.5);
+    for (index_t d = 0; d < len_v; ++d) {
+      EXPECT_FLOAT_EQ(row[table->GetOffset_v()+d], j*len_v+d);
+    }
+  }
+  // A new feature is created on the first touch
+  real_t* row = table->FindOrCreate(1 << 30);
+  EXPECT_FLOAT_EQ(row[0], 0);
+  EXPECT_FLOAT_EQ(row[1], 1.0);
+  model.Serialize(hyper_param.model_file);
+  Model new_model(hyper_param.model_file);
+  EXPECT_TRUE(new_model.IsSparse());
+  EXPECT_FALSE(new_model.IsHashed());
+  EXPECT_FLOAT_EQ(new_model.GetParameter_b()[0], 1.5);
+  SparseTable* new_table = new_model.GetSparseTable();
+  EXPECT_EQ(new_table->Size(), hyper_param.num_feature + 1);
+  std::vector<index_t> keys;
+  table->GetKeys(&keys);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    real_t* row_1 = table->Find(keys[i]);
+    real_t* row_2 = new_table->Find(keys[i]);
+    for (index_t d = 0; d < table->GetRowLength(); ++d) {
+      EXPECT_FLOAT_EQ(row_1[d], row_2[d]);
+    }
+  }
+  // Snapshot, best model, and reset
+  Model snapshot;
+  snapshot.CopyFrom(new_model);
+  EXPECT_EQ(snapshot.GetSparseTable()->Size(), new_table->Size());
+  new_model.SetBestModel();
+  new_model.Reset();
+  EXPECT_EQ(new_table->Size(), 0);
+  EXPECT_FLOAT_EQ(new_model.GetParameter_b()[0], 0);
+  new_model.Shrink();
+  EXPECT_EQ(new_model.GetSparseTable()->Size(), keys.size());
+  EXPECT_FLOAT_EQ(new_model.GetParameter_b()[0], 1.5);
+  EXPECT_FLOAT_EQ(new_model.GetSparseTable()->Find(3)[0], 2.5);
+  // TXT model only has the seen features
+  std::string txt_file = "./test_sparse_model.txt";
+  new_model.SerializeToTXT(txt_file);
+  std::ifstream ifs(txt_file);
+  std::string line;
+  std::getline(ifs, line);
+  EXPECT_EQ(line, "bias: 1.5");
+  std::vector<std::string> linear;
+  while (std::getline(ifs, line)) {
+    if (line.compare(0, 2, "i_") == 0) {
+      linear.push_back(line);
+    }
+  }
+  ASSERT_EQ(linear.size(), keys.size());
+  EXPECT_EQ(linear.front(), "i_0: 2.5");
+  EXPECT_EQ(linear.back(), "i_1073741824: 0");
+  RemoveFile(txt_file.c_str());
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
+TEST(MODEL_TEST, Save_and_Load_admission) {
+  HyperParam hyper_param = Init();
+  Model model;
+  model.InitializeSparse("fm", "cross-entropy", 0, 0, 4, 2);
+  model.SetAdmission(5, false, 2);
+  model.GetSketch()->Add(7, 3);
+  model.GetSparseTable()->FindOrCreate(1)[0] = 1.5;
+  model.GetLinearTable()->FindOrCreate(7)[0] = 0.5;
+  model.GetLinearTable()->FindOrCreate(8)[0] = -0.5;
+  model.EndEpoch();
+  EXPECT_EQ(model.GetNumParameter(), (2 + 8) + 2 * 2 + 2);
+  model.Serialize(hyper_param.model_file);
+  Model new_model(hyper_param.model_file);
+  EXPECT_TRUE(new_model.IsAdmission());
+  EXPECT_EQ(new_model.GetAdmitCount(), 5);
+  EXPECT_FALSE(new_model.IsSharedFallback());
+  EXPECT_EQ(new_model.GetEvictEpoch(), 2);
+  EXPECT_EQ(new_model.GetEpoch(), 1);
+  EXPECT_TRUE(new_model.IsCounting());
+  EXPECT_EQ(new_model.GetSketch()->Estimate(7), 3);
+  EXPECT_FLOAT_EQ(new_model.GetLinearTable()->Find(8)[0], -0.5);
+  // Copy, best model, and shrink
+  Model copy;
+  copy.CopyFrom(new_model);
+  EXPECT_EQ(copy.GetLinearTable()->Size(), 2);
+  EXPECT_EQ(copy.GetSketch()->Estimate(7), 3);
+  new_model.SetBestModel();
+  new_model.GetLinearTable()->Find(7)[0] = 2.0;
+  new_model.Shrink();
+  EXPECT_FLOAT_EQ(new_model.GetLinearTable()->Find(7)[0], 0.5);
+  // The linear-only features are in the TXT model
+  std::string txt_file = "./test_admission_model.txt";
+  new_model.SerializeToTXT(txt_file);
+  std::ifstream ifs(txt_file);
+  std::vector<std::string> lines;
+  std::string line;
+  while (std::getline(ifs, line)) {
+    lines.push_back(line);
+  }
+  ASSERT_EQ(lines.size(), 7);
+  EXPECT_EQ(lines[1], "i_1: 1.5");
+  EXPECT_EQ(lines[2], "i_7: 0.5");
+  EXPECT_EQ(lines[3], "i_8: -0.5");
+  EXPECT_EQ(lines[5], "v_7: 0 0 0 0");
+  // The rows are not updated in the 2 epochs
+  EXPECT_EQ(new_model.EndEpoch(), 3);
+  // Disable the admission
+  new_model.SetAdmission(0, false, 0);
+  EXPECT_FALSE(new_model.IsAdmission());
+  EXPECT_EQ(new_model.GetLinearTable(), nullptr);
+  RemoveFile(txt_file.c_str());
+  RemoveFile(hyper_param.model_file.c_str());
+}
+
 TEST(MODEL_TEST, SerializeToTXT) {
   HyperParam hyper_param = Init();
   // linear
@@ -234,6 +606,76 @@ TEST(MODEL_TEST, SerializeToTXT) {
   model_ffm.SerializeToTXT("test_txt.ffm");
 }
 
+// The TXT format written by std::ostream
+std::string RefTXT(Model& model) {
+  std::ostringstream o_file;
+  real_t* b = model.GetParameter_b();
+  real_t* w = model.GetParameter_w();
+  index_t aux_size = model.GetAuxiliarySize();
+  index_t num_K = model.GetNumK();
+  index_t k_aligned = model.get_aligned_k();
+  o_file << "bias: " << b[0] << "\n";
+  for (index_t i = 0; i < model.GetNumFeature(); ++i) {
+    o_file << "i_" << i << ": " << w[i*aux_size] << "\n";
+  }
+  real_t* v = model.GetParameter_v();
+  if (model.GetScoreFunction().compare("fm") == 0) {
+    for (index_t j = 0; j < model.GetNumFeature(); ++j) {
+      o_file << "v_" << j << ": ";
+      for (index_t d = 0; d < num_K; d++, v++) {
+        o_file << *v;
+        if (d != num_K-1) { o_file << " "; }
+      }
+      o_file << "\n";
+      v += aux_size*k_aligned-num_K;
+    }
+  }
+  if (model.GetScoreFunction().compare("ffm") == 0) {
+    for (index_t j = 0; j < model.GetNumFeature(); ++j) {
+      for (index_t f = 0; f < model.GetNumField(); ++f) {
+        o_file << "v_" << j << "_" << f << ": ";
+        for (index_t d = 0; d < k_aligned; ) {
+          for (index_t s = 0; s < kAlign; s++, v++, d++) {
+            if (d < num_K) {
+              o_file << v[0];
+              if (d != num_K-1) { o_file << " "; }
+            }
+          }
+          v += (aux_size-1) * kAlign;
+        }
+        o_file << "\n";
+      }
+    }
+  }
+  return o_file.str();
+}
+
+std::string ReadTXT(const std::string& filename) {
+  std::ifstream i_file(filename);
+  std::stringstream buf;
+  buf << i_file.rdbuf();
+  return buf.str();
+}
+
+TEST(MODEL_TEST, SerializeToTXTParallel) {
+  std::string score[3] = {"linear", "fm", "ffm"};
+  ThreadPool pool(3);
+  for (int n = 0; n < 3; ++n) {
+    Model model;
+    // More than one round of chunks
+    model.Initialize(score[n], "squared", 
+                     kTXTChunkSize * 4 + 7, 3, 5, 2, 0.5);
+    std::string ref = RefTXT(model);
+    model.SerializeToTXT("test_txt.model");
+    EXPECT_EQ(ReadTXT("test_txt.model"), ref);
+    model.SerializeToTXT("test_txt.model", &pool);
+    EXPECT_EQ(ReadTXT("test_txt.model"), ref);
+    // The temporary file has been renamed
+    EXPECT_EQ(FileExist("test_txt.model.tmp"), false);
+    RemoveFile("test_txt.model");
+  }
+}
+
 TEST(MODEL_TEST, BestModel) {
   // Init model
   HyperParam hyper_param = Init();
@@ -277,4 +719,160 @@ TEST(MODEL_TEST, BestModel) {
   EXPECT_FLOAT_EQ(b[1], 3);
 }
 
+TEST(MODEL_TEST, MemoryTracker) {
+  HyperParam hyper_param = Init();
+  MemoryTracker::Reset();
+  std::string score[3] = { "linear", "fm", "ffm" };
+  for (int i = 0; i < 3; ++i) {
+    uint64 bytes = Model::EstimateBytes(score[i],
+                                        hyper_param.num_feature,
+                                        hyper_param.num_field,
+                                        hyper_param.num_K, 2);
+    {
+      Model model;
+      model.Initialize(score[i],
+                       hyper_param.loss_func,
+                       hyper_param.num_feature,
+                       hyper_param.num_field,
+                       hyper_param.num_K, 2);
+      EXPECT_EQ(bytes, model.GetNumParameter() * sizeof(real_t));
+      EXPECT_EQ(MemoryTracker::Current(kMemModel), bytes);
+      model.SetBestModel();
+      EXPECT_EQ(MemoryTracker::Current(kMemBestModel), bytes);
+      // A snapshot is counted as a model
+      Model snapshot;
+      snapshot.CopyFrom(model);
+      EXPECT_EQ(MemoryTracker::Current(kMemModel), bytes * 2);
+    }
+    EXPECT_EQ(MemoryTracker::Total(), 0);
+  }
+  // 2^32 latent parameters overflow index_t
+  uint64 bytes = Model::EstimateBytes("ffm", 1 << 20, 64, 32, 2);
+  EXPECT_EQ(bytes, ((1ULL << 32) + (1 << 21) + 2) * sizeof(real_t));
+  MemoryTracker::Reset();
+}
+
+TEST(MODEL_TEST, SnapshotBestModel) {
+  // Init model
+  HyperParam hyper_param = Init();
+  Model model_ffm;
+  model_ffm.Initialize(hyper_param.score_func,
+                    hyper_param.loss_func,
+                    hyper_param.num_feature,
+                    hyper_param.num_field,
+                    hyper_param.num_K, 2);
+  real_t* w = model_ffm.GetParameter_w();
+  real_t* v = model_ffm.GetParameter_v();
+  real_t* b = model_ffm.GetParameter_b();
+  for (index_t i = 0; i < model_ffm.GetNumParameter_w(); ++i) {
+    w[i] = 1;
+  }
+  for (index_t i = 0; i < model_ffm.GetNumParameter_v(); ++i) {
+    v[i] = 2;
+  }
+  b[0] = 3;
+  b[1] = 3;
+  // Take a snapshot
+  Model snapshot;
+  snapshot.CopyFrom(model_ffm);
+  EXPECT_EQ(snapshot.GetNumParameter_w(), model_ffm.GetNumParameter_w());
+  EXPECT_EQ(snapshot.GetNumParameter_v(), model_ffm.GetNumParameter_v());
+  real_t* snapshot_v = snapshot.GetParameter_v();
+  // Keep training current model
+  for (index_t i = 0; i < model_ffm.GetNumParameter_v(); ++i) {
+    v[i] = 5;
+  }
+  // The memory of snapshot is re-used
+  snapshot.CopyFrom(model_ffm);
+  EXPECT_EQ(snapshot.GetParameter_v(), snapshot_v);
+  EXPECT_FLOAT_EQ(snapshot_v[0], 5);
+  for (index_t i = 0; i < model_ffm.GetNumParameter_v(); ++i) {
+    v[i] = 2;
+  }
+  snapshot.CopyFrom(model_ffm);
+  // Set best model from snapshot
+  model_ffm.SetBestModel(snapshot);
+  for (index_t i = 0; i < model_ffm.GetNumParameter_w(); ++i) {
+    w[i] = 0;
+  }
+  for (index_t i = 0; i < model_ffm.GetNumParameter_v(); ++i) {
+    v[i] = 0;
+  }
+  b[0] = 0;
+  b[1] = 0;
+  model_ffm.Shrink();
+  // Test
+  for (index_t i = 0; i < model_ffm.GetNumParameter_w(); ++i) {
+    EXPECT_FLOAT_EQ(w[i], 1);
+  }
+  for (index_t i = 0; i < model_ffm.GetNumParameter_v(); ++i) {
+    EXPECT_FLOAT_EQ(v[i], 2);
+  }
+  EXPECT_FLOAT_EQ(b[0], 3);
+  EXPECT_FLOAT_EQ(b[1], 3);
+}
+
+TEST(MODEL_TEST, SnapshotValue) {
+  HyperParam hyper_param = Init();
+  const char* score_list[] = { "linear", "fm", "ffm" };
+  for (int s = 0; s < 3; ++s) {
+    Model model;
+    model.Initialize(score_list[s],
+                     hyper_param.loss_func,
+                     100,
+                     hyper_param.num_field,
+                     7,  /* aligned to 8 */
+                     3);
+    real_t* w = model.GetParameter_w();
+    real_t* v = model.GetParameter_v();
+    real_t* b = model.GetParameter_b();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      w[i] = i * 0.5;
+    }
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      v[i] = i * 0.25;
+    }
+    b[0] = -1.5;
+    // The snapshot has the values only
+    Model snapshot;
+    snapshot.CopyValueFrom(model);
+    EXPECT_EQ(snapshot.GetAuxiliarySize(), 1);
+    EXPECT_EQ(snapshot.GetNumParameter_w(), 100);
+    EXPECT_EQ(snapshot.GetNumParameter_v(), model.GetNumParameter_v() / 3);
+    real_t* snapshot_w = snapshot.GetParameter_w();
+    real_t* snapshot_v = snapshot.GetParameter_v();
+    for (index_t i = 0; i < 100; ++i) {
+      EXPECT_FLOAT_EQ(snapshot_w[i], w[i * 3]);
+    }
+    index_t step = s == 1 ? 8 : kAlign;
+    for (index_t n = 0; n < snapshot.GetNumParameter_v(); ++n) {
+      index_t src = (n / step) * step * 3 + n % step;
+      EXPECT_FLOAT_EQ(snapshot_v[n], v[src]);
+    }
+    EXPECT_FLOAT_EQ(snapshot.GetParameter_b()[0], -1.5);
+    // The memory of snapshot is re-used
+    snapshot.CopyValueFrom(model);
+    EXPECT_EQ(snapshot.GetParameter_v(), snapshot_v);
+    // Set best model from the snapshot, which keeps the
+    // gradient cache of current model
+    model.SetBestModel(snapshot);
+    for (index_t i = 0; i < model.GetNumParameter_w(); i += 3) {
+      w[i] = 0;
+    }
+    for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+      v[i] = 0;
+    }
+    b[0] = 0;
+    model.Shrink();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      EXPECT_FLOAT_EQ(w[i], i * 0.5);
+    }
+    for (index_t n = 0; n < snapshot.GetNumParameter_v(); ++n) {
+      index_t src = (n / step) * step * 3 + n % step;
+      EXPECT_FLOAT_EQ(v[src], src * 0.25);
+    }
+    EXPECT_FLOAT_EQ(b[0], -1.5);
+  }
+}
+
 }   // namespace xLearn
@@ -0,0 +1,392 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of the SparseTable class.
+*/
+
+#include "src/data/sparse_table.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <random>
+#include <algorithm>
+#include <functional>
+
+#include "src/base/file_util.h"
+#include "src/base/logging.h"
+#include "src/base/thread_pool.h"
+#include "src/data/model_parameters.h"
+
+namespace xLearn {
+
+// Initial size of the index of a shard
+static const index_t kSparseMinSlot = 16;
+
+// Mix the bits of the key (the finalizer of murmur3). The low
+// bits select the shard and the high bits select the slot.
+static inline uint32 hash_key(index_t key) {
+  uint32 h = key;
+  h ^= h >> 16;
+  h *= 0x85ebca6b;
+  h ^= h >> 13;
+  h *= 0xc2b2ae35;
+  h ^= h >> 16;
+  return h;
+}
+
+static inline index_t shard_id(uint32 hash) {
+  return hash & (kSparseShards - 1);
+}
+
+// Set the shape of the rows
+void SparseTable::Initialize(const std::string& score_func,
+                             index_t num_field,
+                             index_t num_K,
+                             index_t aux_size,
+                             real_t scale) {
+  CHECK_GT(aux_size, 0);
+  CHECK_GT(scale, 0);
+  Clear();
+  score_func_ = score_func;
+  num_field_ = num_field;
+  num_K_ = num_K;
+  aux_size_ = aux_size;
+  scale_ = scale;
+  index_t aligned_k = (num_K + kAlign - 1) / kAlign * kAlign;
+  if (score_func == "linear") {
+    len_v_ = 0;
+  } else if (score_func == "fm") {
+    len_v_ = aligned_k * aux_size;
+  } else if (score_func == "ffm") {
+    len_v_ = num_field * aligned_k * aux_size;
+  } else {
+    LOG(FATAL) << "Unknow score function: " << score_func;
+  }
+  // The latent factor is aligned for SSE. There is always
+  // a padding after w (aux_size <= 3), which holds the stamp.
+  offset_v_ = (aux_size + 1 + kAlign - 1) / kAlign * kAlign;
+  size_t bytes = (offset_v_ + len_v_) * sizeof(real_t);
+  size_t align = len_v_ > 0 ? kSparseRowAlignByte : kAlignByte;
+  row_stride_ = (bytes + align - 1) / align * align;
+}
+
+// Find the slot of the key by linear probing
+SparseTable::Slot* SparseTable::find_slot(Shard& shard,
+                                          index_t key,
+                                          uint32 hash) {
+  size_t mask = shard.slot.size() - 1;
+  size_t pos = (hash >> 6) & mask;
+  for (;;) {
+    Slot* slot = &shard.slot[pos];
+    if (slot->row == 0 || slot->key == key) {
+      return slot;
+    }
+    pos = (pos + 1) & mask;
+  }
+}
+
+// Return the row of the key, or nullptr if it is not found
+real_t* SparseTable::Find(index_t key) {
+  uint32 hash = hash_key(key);
+  Shard& shard = shard_[shard_id(hash)];
+  if (shard.size == 0) { return nullptr; }
+  Slot* slot = find_slot(shard, key, hash);
+  if (slot->row == 0) { return nullptr; }
+  return get_row(shard, slot->row - 1);
+}
+
+// Return the row of the key, and create it if it is not found
+real_t* SparseTable::FindOrCreate(index_t key) {
+  uint32 hash = hash_key(key);
+  Shard& shard = shard_[shard_id(hash)];
+  // Keep the load factor under 0.7
+  if ((shard.size + 1) * 10 > shard.slot.size() * 7) {
+    rehash(shard);
+  }
+  Slot* slot = find_slot(shard, key, hash);
+  if (slot->row != 0) {
+    return get_row(shard, slot->row - 1);
+  }
+  return create_row(shard, slot, key);
+}
+
+// Add a row to the shard
+real_t* SparseTable::add_row(Shard& shard, Slot* slot, index_t key) {
+  index_t id = shard.size;
+  if (id == shard.capacity) {
+    index_t rows = block_rows(shard.block.size());
+    shard.block.push_back(alloc_block(rows));
+    shard.capacity += rows;
+  }
+  shard.size++;
+  slot->key = key;
+  slot->row = id + 1;
+  return get_row(shard, id);
+}
+
+// Create a new row. The row is initialized in the same way as
+// Model::set_value(), and the random generator is seeded by the
+// key so that the row does not depend on the order of creation.
+real_t* SparseTable::create_row(Shard& shard, Slot* slot, index_t key) {
+  real_t* row = add_row(shard, slot, key);
+  memset(row, 0, row_stride_);
+  row[0] = 0.0;                        /* model */
+  for (index_t j = 1; j < aux_size_; ++j) {
+    row[j] = 1.0;                      /* gradient cache */
+  }
+  if (len_v_ > 0) {
+    std::default_random_engine generator(key);
+    Model::InitLatent(score_func_, num_field_, num_K_,
+                      aux_size_, scale_, generator,
+                      row + offset_v_);
+  }
+  return row;
+}
+
+// Allocate a block of the given rows
+char* SparseTable::alloc_block(index_t rows) {
+  char* block = nullptr;
+  size_t bytes = rows * row_stride_;
+#ifdef _MSC_VER
+  block = (char*)_aligned_malloc(bytes, kSparseRowAlignByte);
+  CHECK_NOTNULL(block);
+#else
+  int ret = posix_memalign((void**)&block, kSparseRowAlignByte, bytes);
+  CHECK_EQ(ret, 0);
+#endif
+  return block;
+}
+
+// Double the size of the index
+void SparseTable::rehash(Shard& shard) {
+  size_t new_size = std::max((size_t)kSparseMinSlot,
+                             shard.slot.size() * 2);
+  std::vector<Slot> old_slot(new_size);
+  old_slot.swap(shard.slot);
+  for (size_t i = 0; i < shard.slot.size(); ++i) {
+    shard.slot[i].row = 0;
+  }
+  for (size_t i = 0; i < old_slot.size(); ++i) {
+    if (old_slot[i].row == 0) { continue; }
+    index_t key = old_slot[i].key;
+    *find_slot(shard, key, hash_key(key)) = old_slot[i];
+  }
+}
+
+// Look up the keys of the shards assigned to one thread
+void SparseTable::find_rows_thread(const std::vector<index_t>* keys,
+                                   const std::vector<size_t>* order,
+                                   const std::vector<size_t>* start,
+                                   bool create,
+                                   std::vector<real_t*>* rows,
+                                   index_t thread_id,
+                                   index_t thread_num) {
+  for (index_t s = thread_id; s < kSparseShards; s += thread_num) {
+    for (size_t i = (*start)[s]; i < (*start)[s+1]; ++i) {
+      size_t k = (*order)[i];
+      index_t key = (*keys)[k];
+      (*rows)[k] = create ? FindOrCreate(key) : Find(key);
+    }
+  }
+}
+
+// Look up a list of keys. Each thread owns a set of
+// shards, and hence no lock is needed for creating rows.
+void SparseTable::FindRows(const std::vector<index_t>& keys,
+                           bool create,
+                           std::vector<real_t*>* rows,
+                           ThreadPool* pool) {
+  CHECK_NOTNULL(rows);
+  rows->resize(keys.size());
+  if (pool == nullptr || pool->ThreadNumber() == 1) {
+    for (size_t k = 0; k < keys.size(); ++k) {
+      (*rows)[k] = create ? FindOrCreate(keys[k]) : Find(keys[k]);
+    }
+    return;
+  }
+  // Group the keys by shard (counting sort)
+  std::vector<size_t> start(kSparseShards + 1, 0);
+  std::vector<index_t> sid(keys.size());
+  for (size_t k = 0; k < keys.size(); ++k) {
+    sid[k] = shard_id(hash_key(keys[k]));
+    start[sid[k] + 1]++;
+  }
+  for (index_t s = 0; s < kSparseShards; ++s) {
+    start[s+1] += start[s];
+  }
+  std::vector<size_t> order(keys.size());
+  std::vector<size_t> pos(start.begin(), start.end() - 1);
+  for (size_t k = 0; k < keys.size(); ++k) {
+    order[pos[sid[k]]++] = k;
+  }
+  index_t thread_num = std::min((index_t)pool->ThreadNumber(),
+                                kSparseShards);
+  for (index_t t = 0; t < thread_num; ++t) {
+    pool->enqueue(std::bind(&SparseTable::find_rows_thread,
+                            this, &keys, &order, &start,
+                            create, rows, t, thread_num));
+  }
+  pool->Sync(thread_num);
+}
+
+// Get all of the keys in ascending order
+void SparseTable::GetKeys(std::vector<index_t>* keys) {
+  CHECK_NOTNULL(keys);
+  keys->clear();
+  keys->reserve(Size());
+  for (index_t s = 0; s < kSparseShards; ++s) {
+    Shard& shard = shard_[s];
+    for (size_t i = 0; i < shard.slot.size(); ++i) {
+      if (shard.slot[i].row != 0) {
+        keys->push_back(shard.slot[i].key);
+      }
+    }
+  }
+  std::sort(keys->begin(), keys->end());
+}
+
+// Remove the stale rows. Each shard is rebuilt with
+// the remaining rows, which releases the memory.
+size_t SparseTable::Evict(index_t min_stamp) {
+  size_t count = 0;
+  for (index_t s = 0; s < kSparseShards; ++s) {
+    Shard old;
+    std::swap(old, shard_[s]);
+    Shard& shard = shard_[s];
+    for (size_t i = 0; i < old.slot.size(); ++i) {
+      if (old.slot[i].row == 0) { continue; }
+      real_t* src = get_row(old, old.slot[i].row - 1);
+      if (GetStamp(src) < min_stamp) {
+        count++;
+        continue;
+      }
+      index_t key = old.slot[i].key;
+      if ((shard.size + 1) * 10 > shard.slot.size() * 7) {
+        rehash(shard);
+      }
+      Slot* slot = find_slot(shard, key, hash_key(key));
+      memcpy(add_row(shard, slot, key), src, row_stride_);
+    }
+    for (size_t b = 0; b < old.block.size(); ++b) {
+#ifdef _MSC_VER
+      _aligned_free(old.block[b]);
+#else
+      free(old.block[b]);
+#endif
+    }
+  }
+  return count;
+}
+
+// Deep copy of another table
+void SparseTable::CopyFrom(SparseTable& table) {
+  Initialize(table.score_func_,
+             table.num_field_,
+             table.num_K_,
+             table.aux_size_,
+             table.scale_);
+  for (index_t s = 0; s < kSparseShards; ++s) {
+    Shard& src = table.shard_[s];
+    Shard& dst = shard_[s];
+    dst.slot = src.slot;
+    dst.size = src.size;
+    dst.capacity = src.capacity;
+    index_t start = 0;
+    for (size_t b = 0; b < src.block.size(); ++b) {
+      index_t rows = block_rows(b);
+      char* block = alloc_block(rows);
+      // Only copy the used rows of the last block
+      index_t used = std::min(rows, src.size - start);
+      memcpy(block, src.block[b], used * row_stride_);
+      dst.block.push_back(block);
+      start += rows;
+    }
+  }
+}
+
+// Remove all of the rows
+void SparseTable::Clear() {
+  for (index_t s = 0; s < kSparseShards; ++s) {
+    Shard& shard = shard_[s];
+    for (size_t b = 0; b < shard.block.size(); ++b) {
+#ifdef _MSC_VER
+      _aligned_free(shard.block[b]);
+#else
+      free(shard.block[b]);
+#endif
+    }
+    std::vector<char*>().swap(shard.block);
+    std::vector<Slot>().swap(shard.slot);
+    shard.size = 0;
+    shard.capacity = 0;
+  }
+}
+
+// Number of rows
+size_t SparseTable::Size() {
+  size_t size = 0;
+  for (index_t s = 0; s < kSparseShards; ++s) {
+    size += shard_[s].size;
+  }
+  return size;
+}
+
+// Memory used by the rows and the index
+size_t SparseTable::MemoryBytes() {
+  size_t bytes = 0;
+  for (index_t s = 0; s < kSparseShards; ++s) {
+    bytes += shard_[s].capacity * row_stride_;
+    bytes += shard_[s].slot.size() * sizeof(Slot);
+  }
+  return bytes;
+}
+
+// The rows are written in ascending order of the keys:
+//
+//   | number of rows | key_1 | row_1 | key_2 | row_2 | ... |
+//
+// where each row has GetRowLength() real_t without the padding.
+void SparseTable::Serialize(FILE* file) {
+  CHECK_NOTNULL(file);
+  std::vector<index_t> keys;
+  GetKeys(&keys);
+  uint64 size = keys.size();
+  WriteDataToDisk(file, (char*)&size, sizeof(size));
+  size_t bytes = GetRowLength() * sizeof(real_t);
+  for (size_t i = 0; i < keys.size(); ++i) {
+    WriteDataToDisk(file, (char*)&keys[i], sizeof(index_t));
+    WriteDataToDisk(file, (char*)Find(keys[i]), bytes);
+  }
+}
+
+// Deserialize the rows from a binary file
+void SparseTable::Deserialize(FILE* file) {
+  CHECK_NOTNULL(file);
+  CHECK_GT(row_stride_, 0);
+  uint64 size = 0;
+  ReadDataFromDisk(file, (char*)&size, sizeof(size));
+  size_t bytes = GetRowLength() * sizeof(real_t);
+  for (uint64 i = 0; i < size; ++i) {
+    index_t key = 0;
+    ReadDataFromDisk(file, (char*)&key, sizeof(index_t));
+    real_t* row = FindOrCreate(key);
+    ReadDataFromDisk(file, (char*)row, bytes);
+  }
+}
+
+}  // namespace xLearn
@@ -0,0 +1,249 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the SparseTable class, which stores the
+model parameters of the seen features in a hash table.
+*/
+
+#ifndef XLEARN_DATA_SPARSE_TABLE_H_
+#define XLEARN_DATA_SPARSE_TABLE_H_
+
+#include <stdio.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+class ThreadPool;
+
+namespace xLearn {
+
+// Number of shards. Must be a power of 2.
+const index_t kSparseShards = 64;
+
+// Number of rows in the row blocks of a shard. The blocks grow
+// from kSparseMinBlockRows to kSparseBlockRows, so that a small
+// table does not waste memory.
+const index_t kSparseMinBlockRows = 8;
+const index_t kSparseBlockRows = 1024;
+
+// Each row with latent factor starts at a cache line, and the
+// rows of a linear model are aligned to kAlignByte.
+const size_t kSparseRowAlignByte = 64;
+
+//------------------------------------------------------------------------------
+// SparseTable maps the feature id to one row of model parameters,
+// including the gradient cache. The layout of a row is:
+//
+//   | w (aux_size) | stamp | padding | v (the latent factor of one feature) |
+//
+// where v has the same layout as one feature in Model::param_v_, so
+// that a row can be copied to (and from) a dense model directly. The
+// stamp is the epoch of the last update, which is set by the trainer
+// and used by Evict() to remove the stale rows.
+//
+// The table uses open addressing with linear probing. It is split into
+// kSparseShards shards by the hash of the key, and each shard has its own
+// index and row blocks. The rows never move after they are created (only
+// the index is rehashed when it grows), and hence the row pointers stay
+// valid until Clear(). A row is created on the first touch and is
+// initialized in the same way as Model::set_value(). Different shards
+// can be written by different threads at the same time, and FindRows()
+// uses this to look up a list of keys in parallel. We can use the
+// SparseTable like this:
+//
+//    SparseTable table;
+//    table.Initialize("fm", 0, 4, 2, 0.66);  /* adagrad */
+//    real_t* row = table.FindOrCreate(12345);
+//    real_t* w = row;                        /* linear term */
+//    real_t* v = row + table.GetOffset_v();  /* latent factor */
+//
+// The memory used by the table is proportional to the number of seen
+// features instead of the largest feature id.
+//------------------------------------------------------------------------------
+class SparseTable {
+ public:
+  // Constructor and Destructor
+  SparseTable()
+   : num_field_(0),
+     num_K_(0),
+     aux_size_(0),
+     scale_(1.0),
+     len_v_(0),
+     offset_v_(0),
+     row_stride_(0) { }
+  ~SparseTable() { Clear(); }
+
+  // Set the shape of the rows. The num_field is only used by 'ffm'.
+  void Initialize(const std::string& score_func,
+                  index_t num_field,
+                  index_t num_K,
+                  index_t aux_size,
+                  real_t scale = 1.0);
+
+  // Return the row of the key, or nullptr if it is not found.
+  real_t* Find(index_t key);
+
+  // Return the row of the key. A new row is created if
+  // it is not found. Not thread-safe for the same shard.
+  real_t* FindOrCreate(index_t key);
+
+  // Look up a list of keys. The rows which are not found are
+  // created if create is true, and set to nullptr otherwise.
+  // The keys are processed shard by shard in the given pool.
+  void FindRows(const std::vector<index_t>& keys,
+                bool create,
+                std::vector<real_t*>* rows,
+                ThreadPool* pool = nullptr);
+
+  // Get all of the keys in ascending order.
+  void GetKeys(std::vector<index_t>* keys);
+
+  // Remove the rows whose stamp is less than min_stamp, and
+  // return the number of removed rows. The remaining rows are
+  // compacted, so that all of the row pointers are invalid.
+  size_t Evict(index_t min_stamp);
+
+  // Deep copy of another table.
+  void CopyFrom(SparseTable& table);
+
+  // Remove all of the rows and release the memory.
+  void Clear();
+
+  // Serialize the rows to a binary file.
+  void Serialize(FILE* file);
+
+  // Deserialize the rows from a binary file. The shape
+  // must be set by Initialize() before calling this method.
+  void Deserialize(FILE* file);
+
+  // Number of rows in the table.
+  size_t Size();
+
+  // Memory used by the rows and the index (byte).
+  size_t MemoryBytes();
+
+  // Number of real_t in one row, excluding the padding.
+  inline index_t GetRowLength() { return offset_v_ + len_v_; }
+
+  // The linear term has aux_size real_t at the start of a row.
+  inline index_t GetLength_w() { return aux_size_; }
+
+  // Offset and length of the latent factor in a row.
+  inline index_t GetOffset_v() { return offset_v_; }
+  inline index_t GetLength_v() { return len_v_; }
+
+  // Get and set the stamp of a row.
+  inline index_t GetStamp(const real_t* row) {
+    index_t stamp;
+    memcpy(&stamp, row + aux_size_, sizeof(stamp));
+    return stamp;
+  }
+  inline void SetStamp(real_t* row, index_t stamp) {
+    memcpy(row + aux_size_, &stamp, sizeof(stamp));
+  }
+
+ protected:
+  /* One slot of the open-addressing index */
+  struct Slot {
+    index_t key;
+    /* Row id + 1, and 0 means empty */
+    index_t row;
+  };
+
+  /* A shard of the table */
+  struct Shard {
+    /* Index with power-of-2 size */
+    std::vector<Slot> slot;
+    /* Row blocks */
+    std::vector<char*> block;
+    /* Number of rows */
+    index_t size = 0;
+    /* Number of rows in the allocated blocks */
+    index_t capacity = 0;
+  };
+
+  /* Score function, which decides the latent factor */
+  std::string score_func_;
+  /* Shape of the model */
+  index_t num_field_;
+  index_t num_K_;
+  index_t aux_size_;
+  /* Used to init the latent factor */
+  real_t scale_;
+  /* Number of real_t of the latent factor */
+  index_t len_v_;
+  /* Offset of the latent factor in a row */
+  index_t offset_v_;
+  /* Bytes of a row, aligned to kSparseRowAlignByte */
+  size_t row_stride_;
+  /* The shards */
+  Shard shard_[kSparseShards];
+
+  // Number of rows in the b-th block of a shard.
+  static inline index_t block_rows(size_t b) {
+    return b >= 7 ? kSparseBlockRows : kSparseMinBlockRows << b;
+  }
+
+  // Get the row of a shard by row id.
+  inline real_t* get_row(Shard& shard, index_t id) {
+    size_t b = 0;
+    index_t rows = kSparseMinBlockRows;
+    while (id >= rows && rows < kSparseBlockRows) {
+      id -= rows;
+      rows <<= 1;
+      ++b;
+    }
+    b += id / rows;
+    id %= rows;
+    return (real_t*)(shard.block[b] + id * row_stride_);
+  }
+
+  // Allocate a block of the given rows.
+  char* alloc_block(index_t rows);
+
+  // Find the slot of the key, which can be an empty slot.
+  Slot* find_slot(Shard& shard, index_t key, uint32 hash);
+
+  // Add a row to the shard without initializing it.
+  real_t* add_row(Shard& shard, Slot* slot, index_t key);
+
+  // Create a new row in the shard.
+  real_t* create_row(Shard& shard, Slot* slot, index_t key);
+
+  // Double the size of the index.
+  void rehash(Shard& shard);
+
+  // Look up the keys of the shards assigned to one thread.
+  void find_rows_thread(const std::vector<index_t>* keys,
+                        const std::vector<size_t>* order,
+                        const std::vector<size_t>* start,
+                        bool create,
+                        std::vector<real_t*>* rows,
+                        index_t thread_id,
+                        index_t thread_num);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(SparseTable);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DATA_SPARSE_TABLE_H_
@@ -0,0 +1,195 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests sparse_table.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+
+#include <vector>
+
+#include "src/data/sparse_table.h"
+#include "src/base/file_util.h"
+#include "src/base/thread_pool.h"
+
+namespace xLearn {
+
+TEST(SPARSE_TABLE_TEST, Init_row) {
+  SparseTable table;
+  // fm with adagrad
+  table.Initialize("fm", 0, 6, 2, 1.0);
+  EXPECT_EQ(table.GetLength_w(), 2);
+  EXPECT_EQ(table.GetOffset_v(), 4);
+  EXPECT_EQ(table.GetLength_v(), 16);
+  EXPECT_EQ(table.Find(7), nullptr);
+  real_t* row = table.FindOrCreate(7);
+  EXPECT_EQ((size_t)row % kSparseRowAlignByte, 0);
+  EXPECT_EQ(table.Find(7), row);
+  EXPECT_EQ(table.Size(), 1);
+  EXPECT_FLOAT_EQ(row[0], 0.0);  /* model */
+  EXPECT_FLOAT_EQ(row[1], 1.0);  /* gradient cache */
+  real_t* v = row + table.GetOffset_v();
+  for (index_t d = 0; d < 6; ++d) {
+    EXPECT_GE(v[d], 0.0);
+    EXPECT_LE(v[d], 1.0 / sqrt(6));
+  }
+  EXPECT_FLOAT_EQ(v[6], 0.0);    /* beyond aligned number */
+  EXPECT_FLOAT_EQ(v[7], 0.0);
+  for (index_t d = 8; d < 16; ++d) {
+    EXPECT_FLOAT_EQ(v[d], 1.0);  /* gradient cache */
+  }
+  // The init of a row depends only on the key
+  SparseTable other;
+  other.Initialize("fm", 0, 6, 2, 1.0);
+  other.FindOrCreate(3);
+  real_t* row_2 = other.FindOrCreate(7);
+  for (index_t i = 0; i < table.GetRowLength(); ++i) {
+    EXPECT_FLOAT_EQ(row[i], row_2[i]);
+  }
+}
+
+TEST(SPARSE_TABLE_TEST, Grow) {
+  SparseTable table;
+  table.Initialize("linear", 0, 0, 3, 1.0);
+  // Large keys and many rehash
+  const index_t kNum = 100000;
+  std::vector<real_t*> rows(kNum);
+  for (index_t i = 0; i < kNum; ++i) {
+    rows[i] = table.FindOrCreate(i * 40503 + 0x80000000);
+    rows[i][0] = i;
+  }
+  EXPECT_EQ(table.Size(), kNum);
+  // The rows never move
+  for (index_t i = 0; i < kNum; ++i) {
+    real_t* row = table.Find(i * 40503 + 0x80000000);
+    EXPECT_EQ(row, rows[i]);
+    EXPECT_FLOAT_EQ(row[0], i);
+    EXPECT_FLOAT_EQ(row[1], 1.0);
+    EXPECT_FLOAT_EQ(row[2], 1.0);
+  }
+  EXPECT_EQ(table.Find(1), nullptr);
+  // One cache line for each row and 8 bytes for each slot
+  EXPECT_LT(table.MemoryBytes(), kNum * 64 * 2 + kNum * 8 * 4);
+  std::vector<index_t> keys;
+  table.GetKeys(&keys);
+  EXPECT_EQ(keys.size(), kNum);
+  for (size_t i = 1; i < keys.size(); ++i) {
+    EXPECT_LT(keys[i-1], keys[i]);
+  }
+  table.Clear();
+  EXPECT_EQ(table.Size(), 0);
+  EXPECT_EQ(table.MemoryBytes(), 0);
+}
+
+TEST(SPARSE_TABLE_TEST, Evict) {
+  SparseTable table;
+  table.Initialize("fm", 0, 4, 2, 1.0);
+  for (index_t i = 0; i < 3000; ++i) {
+    real_t* row = table.FindOrCreate(i);
+    row[0] = i;
+    table.SetStamp(row, i % 3);
+  }
+  size_t bytes = table.MemoryBytes();
+  EXPECT_EQ(table.Evict(2), 2000);
+  EXPECT_EQ(table.Size(), 1000);
+  EXPECT_LT(table.MemoryBytes(), bytes);
+  for (index_t i = 0; i < 3000; ++i) {
+    real_t* row = table.Find(i);
+    if (i % 3 != 2) {
+      EXPECT_EQ(row, nullptr);
+    } else {
+      ASSERT_TRUE(row != nullptr);
+      EXPECT_FLOAT_EQ(row[0], i);
+      EXPECT_FLOAT_EQ(row[1], 1.0);
+      EXPECT_EQ(table.GetStamp(row), 2);
+    }
+  }
+  // The evicted keys can be created again
+  EXPECT_FLOAT_EQ(table.FindOrCreate(0)[0], 0.0);
+  EXPECT_EQ(table.Size(), 1001);
+  EXPECT_EQ(table.Evict(10), 1001);
+  EXPECT_EQ(table.Size(), 0);
+}
+
+TEST(SPARSE_TABLE_TEST, FindRows) {
+  SparseTable table;
+  table.Initialize("ffm", 3, 4, 2, 1.0);
+  ThreadPool pool(4);
+  std::vector<index_t> keys;
+  for (index_t i = 0; i < 5000; ++i) {
+    keys.push_back(i * 7);
+  }
+  std::vector<real_t*> rows;
+  // Do not create
+  table.FindRows(keys, false, &rows, &pool);
+  EXPECT_EQ(rows.size(), keys.size());
+  for (size_t i = 0; i < rows.size(); ++i) {
+    EXPECT_EQ(rows[i], nullptr);
+  }
+  // Create in parallel
+  table.FindRows(keys, true, &rows, &pool);
+  EXPECT_EQ(table.Size(), keys.size());
+  for (size_t i = 0; i < keys.size(); ++i) {
+    EXPECT_EQ(rows[i], table.Find(keys[i]));
+  }
+  // Half of the keys are new
+  for (index_t i = 0; i < 5000; ++i) {
+    keys[i] = i * 14;
+  }
+  table.FindRows(keys, true, &rows);
+  EXPECT_EQ(table.Size(), 7500);
+}
+
+TEST(SPARSE_TABLE_TEST, Serialize_and_Deserialize) {
+  SparseTable table;
+  table.Initialize("ffm", 2, 3, 3, 0.5);
+  for (index_t i = 0; i < 1000; ++i) {
+    real_t* row = table.FindOrCreate(i * 13);
+    row[0] = i * 0.5;
+    row[table.GetOffset_v()] = i * 2.0;
+  }
+  std::string filename = "./test_sparse_table.bin";
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+  table.Serialize(file);
+  Close(file);
+  SparseTable new_table;
+  new_table.Initialize("ffm", 2, 3, 3, 0.5);
+  file = OpenFileOrDie(filename.c_str(), "r");
+  new_table.Deserialize(file);
+  Close(file);
+  EXPECT_EQ(new_table.Size(), 1000);
+  for (index_t i = 0; i < 1000; ++i) {
+    real_t* row_1 = table.Find(i * 13);
+    real_t* row_2 = new_table.Find(i * 13);
+    ASSERT_TRUE(row_2 != nullptr);
+    for (index_t j = 0; j < table.GetRowLength(); ++j) {
+      EXPECT_FLOAT_EQ(row_1[j], row_2[j]);
+    }
+  }
+  RemoveFile(filename.c_str());
+  // Deep copy
+  SparseTable copy;
+  copy.CopyFrom(table);
+  EXPECT_EQ(copy.Size(), 1000);
+  table.Find(13)[0] = 100;
+  EXPECT_FLOAT_EQ(copy.Find(13)[0], 0.5);
+  EXPECT_FLOAT_EQ(copy.Find(13)[copy.GetOffset_v()], 2.0);
+}
+
+}  // namespace xLearn
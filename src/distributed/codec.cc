@@ -0,0 +1,225 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of Codec.
+*/
+
+#include "src/distributed/codec.h"
+
+#include <string.h>
+#include <math.h>
+
+#include <random>
+#include <thread>
+#include <functional>
+#include <algorithm>
+
+#include "src/base/logging.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Class register
+//------------------------------------------------------------------------------
+CLASS_REGISTER_IMPLEMENT_REGISTRY(xLearn_codec_registry, Codec);
+REGISTER_CODEC("none", NoneCodec);
+REGISTER_CODEC("int8", Int8Codec);
+REGISTER_CODEC("int4", Int4Codec);
+REGISTER_CODEC("topk", TopKCodec);
+
+// Random number in [0, 1) used by the stochastic rounding. 
+// Each thread owns its generator.
+static inline real_t uniform_random() {
+  static thread_local std::minstd_rand generator(
+    std::hash<std::thread::id>()(std::this_thread::get_id()));
+  return (generator() - generator.min()) * 
+         (1.0f / ((real_t)generator.max() - generator.min() + 1));
+}
+
+/*********************************************************
+ *  NoneCodec                                            *
+ *********************************************************/
+void NoneCodec::Encode(const real_t* value, 
+                       size_t n, 
+                       std::string* code) {
+  CHECK_NOTNULL(code);
+  code->assign((const char*)value, n * sizeof(real_t));
+}
+
+void NoneCodec::Decode(const char* code, 
+                       size_t size,
+                       real_t* value, 
+                       size_t n) {
+  CHECK_EQ(size, n * sizeof(real_t));
+  memcpy(value, code, size);
+}
+
+/*********************************************************
+ *  QuantizeCodec                                        *
+ *********************************************************/
+//------------------------------------------------------------------------------
+// Each block of the code is:
+//
+//   | scale (real_t) | q_0 | q_1 | ... | q_63 |
+//
+// For int4, two values share one byte, where the low 4 bits store the
+// first one. The integer is stored with an offset of level, so that it
+// can be stored as an unsigned number.
+//------------------------------------------------------------------------------
+void QuantizeCodec::Encode(const real_t* value, 
+                           size_t n, 
+                           std::string* code) {
+  CHECK_NOTNULL(code);
+  size_t num_block = (n + kCodecBlock - 1) / kCodecBlock;
+  size_t value_bytes = (n * bits_ + 7) / 8;
+  code->resize(num_block * sizeof(real_t) + value_bytes);
+  char* scale_ptr = &(*code)[0];
+  unsigned char* q = (unsigned char*)scale_ptr + num_block * sizeof(real_t);
+  memset(q, 0, value_bytes);
+  for (size_t b = 0; b < num_block; ++b) {
+    size_t start = b * kCodecBlock;
+    size_t end = std::min(start + kCodecBlock, n);
+    real_t scale = 0;
+    for (size_t i = start; i < end; ++i) {
+      scale = std::max(scale, (real_t)fabs(value[i]));
+    }
+    memcpy(scale_ptr + b * sizeof(real_t), &scale, sizeof(real_t));
+    real_t inv = scale > 0 ? level_ / scale : 0;
+    for (size_t i = start; i < end; ++i) {
+      real_t x = value[i] * inv;
+      int v = (int)floor(x + uniform_random());
+      v = std::min(std::max(v, -level_), level_) + level_;
+      if (bits_ == 8) {
+        q[i] = (unsigned char)v;
+      } else {
+        q[i/2] |= (unsigned char)(v << ((i % 2) * 4));
+      }
+    }
+  }
+}
+
+void QuantizeCodec::Decode(const char* code, 
+                           size_t size,
+                           real_t* value, 
+                           size_t n) {
+  size_t num_block = (n + kCodecBlock - 1) / kCodecBlock;
+  CHECK_EQ(size, num_block * sizeof(real_t) + (n * bits_ + 7) / 8);
+  const unsigned char* q = 
+    (const unsigned char*)code + num_block * sizeof(real_t);
+  for (size_t b = 0; b < num_block; ++b) {
+    size_t start = b * kCodecBlock;
+    size_t end = std::min(start + kCodecBlock, n);
+    real_t scale = 0;
+    memcpy(&scale, code + b * sizeof(real_t), sizeof(real_t));
+    real_t step = scale / level_;
+    for (size_t i = start; i < end; ++i) {
+      int v = 0;
+      if (bits_ == 8) {
+        v = q[i];
+      } else {
+        v = (q[i/2] >> ((i % 2) * 4)) & 0xF;
+      }
+      value[i] = (v - level_) * step;
+    }
+  }
+}
+
+/*********************************************************
+ *  TopKCodec                                            *
+ *********************************************************/
+//------------------------------------------------------------------------------
+// The code is:
+//
+//   | k (uint32) | position_0 ... position_k-1 | value_0 ... value_k-1 |
+//
+//------------------------------------------------------------------------------
+void TopKCodec::Encode(const real_t* value, 
+                       size_t n, 
+                       std::string* code) {
+  CHECK_NOTNULL(code);
+  uint32 k = std::min((size_t)ceil(ratio_ * n), n);
+  std::vector<uint32> pos(n);
+  for (size_t i = 0; i < n; ++i) {
+    pos[i] = i;
+  }
+  if (k < n) {
+    std::nth_element(pos.begin(), pos.begin() + k, pos.end(),
+      [value](uint32 a, uint32 b) { 
+        return fabs(value[a]) > fabs(value[b]); 
+      });
+    std::sort(pos.begin(), pos.begin() + k);
+  }
+  code->resize(sizeof(uint32) + k * (sizeof(uint32) + sizeof(real_t)));
+  char* ptr = &(*code)[0];
+  memcpy(ptr, &k, sizeof(uint32));
+  ptr += sizeof(uint32);
+  memcpy(ptr, pos.data(), k * sizeof(uint32));
+  ptr += k * sizeof(uint32);
+  for (uint32 i = 0; i < k; ++i) {
+    memcpy(ptr + i * sizeof(real_t), value + pos[i], sizeof(real_t));
+  }
+}
+
+void TopKCodec::Decode(const char* code, 
+                       size_t size,
+                       real_t* value, 
+                       size_t n) {
+  CHECK_GE(size, sizeof(uint32));
+  uint32 k = 0;
+  memcpy(&k, code, sizeof(uint32));
+  CHECK_EQ(size, sizeof(uint32) + k * (sizeof(uint32) + sizeof(real_t)));
+  CHECK_LE(k, n);
+  const char* pos = code + sizeof(uint32);
+  const char* val = pos + k * sizeof(uint32);
+  memset(value, 0, n * sizeof(real_t));
+  for (uint32 i = 0; i < k; ++i) {
+    uint32 p = 0;
+    memcpy(&p, pos + i * sizeof(uint32), sizeof(uint32));
+    CHECK_LT(p, n);
+    memcpy(value + p, val + i * sizeof(real_t), sizeof(real_t));
+  }
+}
+
+/*********************************************************
+ *  Residual                                             *
+ *********************************************************/
+real_t* Residual::Get(int table, index_t key, size_t length) {
+  CHECK_GE(table, 0);
+  CHECK_LT(table, kNumTable);
+  if (length_[table] == 0) {
+    length_[table] = length;
+  }
+  CHECK_EQ(length_[table], length);
+  std::vector<real_t>& value = value_[table];
+  auto it = offset_[table].find(key);
+  if (it == offset_[table].end()) {
+    it = offset_[table].emplace(key, value.size()).first;
+    value.resize(value.size() + length, 0);
+  }
+  return value.data() + it->second;
+}
+
+void Residual::Reset() {
+  for (int i = 0; i < kNumTable; ++i) {
+    std::vector<real_t>().swap(value_[i]);
+    std::unordered_map<index_t, size_t>().swap(offset_[i]);
+    length_[i] = 0;
+  }
+}
+
+}  // namespace xLearn
@@ -0,0 +1,251 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the Codec class, which compresses the values
+sent between the workers and the parameter servers.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_CODEC_H_
+#define XLEARN_DISTRIBUTED_CODEC_H_
+
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/class_register.h"
+#include "src/data/data_structure.h"
+#include "src/distributed/kv_shard.h"
+
+namespace xLearn {
+
+// The quantized codecs use one scale for every kCodecBlock values.
+const size_t kCodecBlock = 64;
+
+//------------------------------------------------------------------------------
+// Codec is an abstract class, which encodes a list of real_t values into
+// a byte buffer and decodes it back. The KVStore uses a Codec to compress
+// the gradients of Push() and the values of Pull(). The codecs include:
+//
+//   "none" :  The raw real_t values (4 bytes per value).
+//   "int8" :  8-bit stochastic quantization (~1.06 bytes per value).
+//   "int4" :  4-bit stochastic quantization (~0.56 bytes per value).
+//   "topk" :  Top-k sparsification, which only keeps the ratio of values
+//             that have the largest magnitude (8 bytes per kept value).
+//
+// The quantized codecs use a random rounding, so that the decoded value
+// is an unbiased estimate of the original value. The lossy codecs are
+// usually used with a Residual (error feedback), which adds the error of
+// the last encoding to the next one. We can use the Codec like this:
+//
+//   Codec* codec = CREATE_CODEC("int8");
+//   codec->Initialize(0);  /* the ratio is used by topk */
+//   std::string code;
+//   codec->Encode(grad.data(), grad.size(), &code);
+//   ... /* send code */
+//   codec->Decode(code.data(), code.size(), grad.data(), grad.size());
+//
+// Note that the Codec is thread-safe.
+//------------------------------------------------------------------------------
+class Codec {
+ public:
+  // Constructor and Destructor
+  Codec() { }
+  virtual ~Codec() { }
+
+  // The ratio is the fraction of values kept by the topk codec.
+  virtual void Initialize(real_t ratio) { }
+
+  // Encode n values into code.
+  virtual void Encode(const real_t* value, 
+                      size_t n, 
+                      std::string* code) = 0;
+
+  // Decode the code of size bytes into n values.
+  virtual void Decode(const char* code, 
+                      size_t size,
+                      real_t* value, 
+                      size_t n) = 0;
+
+  // Return true if the decoded value is exactly the same
+  // with the encoded value.
+  virtual bool Lossless() { return false; }
+
+  // Return the codec type.
+  virtual std::string codec_type() = 0;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Codec);
+};
+
+//------------------------------------------------------------------------------
+// Residual stores the compression error of one worker for each key
+// of the linear and latent table, which is zero at first. Before
+// encoding a gradient, we add the residual of its key to it, and then
+// store the new error back (error feedback). Hence the error is not
+// lost but delayed to the next push. Only the keys touched by this
+// worker are stored: each key maps to an offset in a compact buffer, so
+// the memory follows the worker's working set rather than the largest
+// global key. Each worker owns its Residual, and the Residual is not
+// thread-safe.
+//------------------------------------------------------------------------------
+class Residual {
+ public:
+  // Constructor and Destructor
+  Residual() { 
+    for (int i = 0; i < kNumTable; ++i) {
+      length_[i] = 0;
+    }
+  }
+  ~Residual() { }
+
+  // Get the residual of the given (global) key, 
+  // which is a list of length values. The pointer is valid
+  // until the next call of Get() or Reset().
+  real_t* Get(int table, index_t key, size_t length);
+
+  // Number of keys stored in the given table.
+  size_t Size(int table) const { return offset_[table].size(); }
+
+  // Clear the residual.
+  void Reset();
+
+ protected:
+  /* Residual of each table, stored key by key */
+  std::vector<real_t> value_[kNumTable];
+  /* Offset of each touched key in value_ */
+  std::unordered_map<index_t, size_t> offset_[kNumTable];
+  /* Length of the value list of each table */
+  size_t length_[kNumTable];
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Residual);
+};
+
+//------------------------------------------------------------------------------
+// NoneCodec copies the raw values.
+//------------------------------------------------------------------------------
+class NoneCodec : public Codec {
+ public:
+  // Constructor and Destructor
+  NoneCodec() { }
+  ~NoneCodec() { }
+
+  void Encode(const real_t* value, size_t n, std::string* code);
+
+  void Decode(const char* code, size_t size, real_t* value, size_t n);
+
+  bool Lossless() { return true; }
+
+  std::string codec_type() { return "none"; }
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(NoneCodec);
+};
+
+//------------------------------------------------------------------------------
+// QuantizeCodec stores each block of kCodecBlock values as one real_t
+// scale (the max magnitude of the block) and one signed integer of bits
+// for each value, in the range of [-level, level]. The integer is rounded
+// up or down randomly, where the probability is the distance to the
+// other one, and hence the decoded value is unbiased.
+//------------------------------------------------------------------------------
+class QuantizeCodec : public Codec {
+ public:
+  // Constructor and Destructor
+  explicit QuantizeCodec(int bits) 
+    : bits_(bits), level_((1 << (bits - 1)) - 1) { }
+  ~QuantizeCodec() { }
+
+  void Encode(const real_t* value, size_t n, std::string* code);
+
+  void Decode(const char* code, size_t size, real_t* value, size_t n);
+
+  std::string codec_type() { return bits_ == 8 ? "int8" : "int4"; }
+
+ protected:
+  /* Number of bits for each value (8 or 4) */
+  int bits_;
+  /* Max value of the integer */
+  int level_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(QuantizeCodec);
+};
+
+class Int8Codec : public QuantizeCodec {
+ public:
+  Int8Codec() : QuantizeCodec(8) { }
+};
+
+class Int4Codec : public QuantizeCodec {
+ public:
+  Int4Codec() : QuantizeCodec(4) { }
+};
+
+//------------------------------------------------------------------------------
+// TopKCodec only keeps the ceil(ratio * n) values with the largest
+// magnitude, and stores them as (uint32 position, real_t value) pairs.
+// The other values are decoded as zero.
+//------------------------------------------------------------------------------
+class TopKCodec : public Codec {
+ public:
+  // Constructor and Destructor
+  TopKCodec() : ratio_(0.01) { }
+  ~TopKCodec() { }
+
+  void Initialize(real_t ratio) {
+    CHECK_GT(ratio, 0);
+    CHECK_LE(ratio, 1);
+    ratio_ = ratio;
+  }
+
+  void Encode(const real_t* value, size_t n, std::string* code);
+
+  void Decode(const char* code, size_t size, real_t* value, size_t n);
+
+  std::string codec_type() { return "topk"; }
+
+ protected:
+  /* Fraction of the values to keep */
+  real_t ratio_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(TopKCodec);
+};
+
+//------------------------------------------------------------------------------
+// Class register
+//------------------------------------------------------------------------------
+CLASS_REGISTER_DEFINE_REGISTRY(xLearn_codec_registry, Codec);
+
+#define REGISTER_CODEC(format_name, codec_name)             \
+  CLASS_REGISTER_OBJECT_CREATOR(                            \
+      xLearn_codec_registry,                                \
+      Codec,                                                \
+      format_name,                                          \
+      codec_name)
+
+#define CREATE_CODEC(format_name)                           \
+  CLASS_REGISTER_CREATE_OBJECT(                             \
+      xLearn_codec_registry,                                \
+      format_name)
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_CODEC_H_
@@ -0,0 +1,182 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the benchmark of the push/pull codecs, which trains
+an FM model on a synthetic CTR data set by distributed workers.
+
+Usage: codec_benchmark [num_example] [num_epoch]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+
+#include <vector>
+#include <string>
+#include <thread>
+#include <random>
+
+#include "src/base/common.h"
+#include "src/base/timer.h"
+#include "src/base/thread_pool.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/distributed/parameter_server.h"
+#include "src/loss/cross_entropy_loss.h"
+#include "src/score/fm_score.h"
+
+using namespace xLearn;
+
+const index_t kField = 10;
+const index_t kFeatPerField = 2000;
+const index_t kFeat = kField * kFeatPerField;
+const index_t kK = 32;
+const real_t kLR = 0.2;
+const int kWorker = 2;
+const int kServer = 2;
+const index_t kBatch = 1000;
+
+//------------------------------------------------------------------------------
+// Each example has one feature in each field, and the features are
+// skewed like the real CTR data. The label is sampled from a hidden
+// FM model, where K = 4.
+//------------------------------------------------------------------------------
+void Generate(index_t num, unsigned seed, DMatrix* matrix) {
+  std::mt19937 gen(1234);
+  std::normal_distribution<real_t> normal(0, 1);
+  std::vector<real_t> w(kFeat);
+  std::vector<real_t> v(kFeat * 4);
+  for (index_t i = 0; i < kFeat; ++i) {
+    w[i] = normal(gen) * 0.5;
+    for (index_t d = 0; d < 4; ++d) {
+      v[i*4+d] = normal(gen) * 0.4;
+    }
+  }
+  gen.seed(seed);
+  std::uniform_real_distribution<real_t> uniform(0, 1);
+  matrix->ReAlloc(num);
+  std::vector<index_t> feat(kField);
+  for (index_t n = 0; n < num; ++n) {
+    matrix->row[n] = new SparseRow;
+    real_t score = -1.0;
+    std::vector<real_t> sum(4, 0);
+    for (index_t f = 0; f < kField; ++f) {
+      real_t u = uniform(gen);
+      index_t id = f * kFeatPerField + 
+                   (index_t)(u * u * u * kFeatPerField);
+      matrix->AddNode(n, id, 1.0, f);
+      score += w[id];
+      for (index_t d = 0; d < 4; ++d) {
+        score -= 0.5 * v[id*4+d] * v[id*4+d];
+        sum[d] += v[id*4+d];
+      }
+    }
+    for (index_t d = 0; d < 4; ++d) {
+      score += 0.5 * sum[d] * sum[d];
+    }
+    real_t p = 1.0 / (1.0 + exp(-score));
+    matrix->Y[n] = uniform(gen) < p ? 1 : -1;
+    matrix->norm[n] = 1.0 / kField;
+  }
+}
+
+// Train an FM model by kWorker workers and print the result
+void Run(const std::string& push_codec,
+         const std::string& pull_codec,
+         real_t topk_ratio,
+         int num_epoch,
+         DMatrix& train,
+         DMatrix& test) {
+  Timer timer;
+  timer.tic();
+  KVStore store;
+  store.SetCodec(push_codec, pull_codec, topk_ratio);
+  store.Initialize(kServer, "adagrad", kLR, 0.00002, 0, 0, 0, 0,
+                   0.66 / sqrt(kK));
+  FMScore score;
+  std::string opt_type("sgd");
+  score.Initialize(kLR, 0, 0, 0, 0, 0, opt_type);
+  std::vector<std::unique_ptr<ThreadPool>> pool;
+  std::vector<std::unique_ptr<CrossEntropyLoss>> loss;
+  for (int w = 0; w < kWorker; ++w) {
+    pool.emplace_back(new ThreadPool(1));
+    loss.emplace_back(new CrossEntropyLoss);
+    loss[w]->Initialize(&score, pool[w].get(), true, false, kBatch);
+    loss[w]->InitDist(&store, kLR, "fm", kField, kK);
+  }
+  // Each worker trains a half of the data
+  std::vector<DMatrix> part(kWorker);
+  train.pos = 0;
+  for (int w = 0; w < kWorker; ++w) {
+    train.GetMiniBatch(train.row_length / kWorker, part[w]);
+  }
+  for (int n = 0; n < num_epoch; ++n) {
+    std::vector<std::thread> threads;
+    for (int w = 0; w < kWorker; ++w) {
+      threads.push_back(std::thread(&Loss::CalcGradDist,
+                                    loss[w].get(), &part[w]));
+    }
+    for (int w = 0; w < kWorker; ++w) {
+      threads[w].join();
+    }
+  }
+  real_t time_cost = timer.toc();
+  // Evaluate the global model
+  Model model;
+  model.Initialize("fm", "cross-entropy", kFeat, kField, kK, 1);
+  loss[0]->PullModel(model);
+  std::vector<real_t> pred(test.row_length);
+  loss[0]->Reset();
+  loss[0]->Predict(&test, model, pred);
+  loss[0]->Evalute(pred, test.Y);
+  real_t num_example = (real_t)train.row_length * num_epoch;
+  std::string name = push_codec;
+  if (push_codec == "topk") {
+    char buf[32];
+    snprintf(buf, sizeof(buf), "topk-%g", topk_ratio);
+    name = buf;
+  }
+  printf("%-12s %-10s %14.1f %14.1f %12.6f %10.2f\n",
+         name.c_str(), pull_codec.c_str(),
+         store.PushBytes() / num_example,
+         store.PullBytes() / num_example,
+         loss[0]->GetLoss(), time_cost);
+}
+
+int main(int argc, char* argv[]) {
+  index_t num_example = argc > 1 ? atoi(argv[1]) : 100000;
+  int num_epoch = argc > 2 ? atoi(argv[2]) : 3;
+  DMatrix train, test;
+  Generate(num_example, 1, &train);
+  Generate(num_example / 5, 2, &test);
+  printf("FM (K = %d), %d fields, %d features, %d workers, "
+         "%d servers, batch = %d, %d examples, %d epochs\n",
+         kK, kField, kFeat, kWorker, kServer, kBatch, 
+         num_example, num_epoch);
+  printf("%-12s %-10s %14s %14s %12s %10s\n",
+         "push_codec", "pull_codec", "push B/example",
+         "pull B/example", "test loss", "time (s)");
+  Run("none", "none", 0, num_epoch, train, test);
+  Run("int8", "none", 0, num_epoch, train, test);
+  Run("int4", "none", 0, num_epoch, train, test);
+  Run("topk", "none", 0.1, num_epoch, train, test);
+  Run("topk", "none", 0.01, num_epoch, train, test);
+  Run("int8", "int8", 0, num_epoch, train, test);
+  Run("int4", "int4", 0, num_epoch, train, test);
+  return 0;
+}
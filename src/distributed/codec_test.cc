@@ -0,0 +1,168 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests the Codec class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+
+#include <vector>
+#include <string>
+#include <memory>
+
+#include "src/distributed/codec.h"
+
+namespace xLearn {
+
+const size_t kNum = 1000;
+
+std::vector<real_t> MakeValue() {
+  std::vector<real_t> value(kNum);
+  for (size_t i = 0; i < kNum; ++i) {
+    value[i] = ((i * 7919) % 201 - 100) * 0.01;
+  }
+  return value;
+}
+
+TEST(CodecTest, None) {
+  std::unique_ptr<Codec> codec(CREATE_CODEC("none"));
+  ASSERT_TRUE(codec != nullptr);
+  EXPECT_TRUE(codec->Lossless());
+  std::vector<real_t> value = MakeValue();
+  std::string code;
+  codec->Encode(value.data(), value.size(), &code);
+  EXPECT_EQ(code.size(), kNum * sizeof(real_t));
+  std::vector<real_t> decoded(kNum);
+  codec->Decode(code.data(), code.size(), decoded.data(), kNum);
+  for (size_t i = 0; i < kNum; ++i) {
+    EXPECT_EQ(decoded[i], value[i]);
+  }
+}
+
+void TestQuantize(const char* name, int bits) {
+  std::unique_ptr<Codec> codec(CREATE_CODEC(name));
+  ASSERT_TRUE(codec != nullptr);
+  EXPECT_FALSE(codec->Lossless());
+  int level = (1 << (bits - 1)) - 1;
+  std::vector<real_t> value = MakeValue();
+  // The second block is zero
+  for (size_t i = kCodecBlock; i < 2 * kCodecBlock; ++i) {
+    value[i] = 0;
+  }
+  std::string code;
+  codec->Encode(value.data(), value.size(), &code);
+  size_t num_block = (kNum + kCodecBlock - 1) / kCodecBlock;
+  EXPECT_EQ(code.size(), num_block * sizeof(real_t) + (kNum * bits + 7) / 8);
+  // The error of each value is less than one step, and
+  // the mean of many decoded values is close to the value.
+  std::vector<real_t> decoded(kNum);
+  std::vector<double> sum(kNum, 0);
+  const int kRound = 2000;
+  for (int n = 0; n < kRound; ++n) {
+    codec->Encode(value.data(), value.size(), &code);
+    codec->Decode(code.data(), code.size(), decoded.data(), kNum);
+    for (size_t i = 0; i < kNum; ++i) {
+      sum[i] += decoded[i];
+    }
+  }
+  for (size_t b = 0; b < num_block; ++b) {
+    size_t end = std::min((b + 1) * kCodecBlock, kNum);
+    real_t scale = 0;
+    for (size_t i = b * kCodecBlock; i < end; ++i) {
+      scale = std::max(scale, (real_t)fabs(value[i]));
+    }
+    real_t step = scale / level;
+    for (size_t i = b * kCodecBlock; i < end; ++i) {
+      EXPECT_LE(fabs(decoded[i] - value[i]), step * 1.0001);
+      EXPECT_NEAR(sum[i] / kRound, value[i], step * 0.1 + 1e-6);
+      if (scale == 0) {
+        EXPECT_EQ(decoded[i], 0);
+      }
+    }
+  }
+}
+
+TEST(CodecTest, Int8) {
+  TestQuantize("int8", 8);
+}
+
+TEST(CodecTest, Int4) {
+  TestQuantize("int4", 4);
+}
+
+TEST(CodecTest, TopK) {
+  std::unique_ptr<Codec> codec(CREATE_CODEC("topk"));
+  ASSERT_TRUE(codec != nullptr);
+  codec->Initialize(0.1);
+  std::vector<real_t> value(kNum);
+  for (size_t i = 0; i < kNum; ++i) {
+    value[i] = (i % 2 == 0 ? 1.0 : -1.0) * ((i * 7919) % kNum);
+  }
+  std::string code;
+  codec->Encode(value.data(), value.size(), &code);
+  size_t k = kNum / 10;
+  EXPECT_EQ(code.size(), sizeof(uint32) + k * 8);
+  std::vector<real_t> decoded(kNum);
+  codec->Decode(code.data(), code.size(), decoded.data(), kNum);
+  // The magnitudes are a permutation of [0, kNum)
+  size_t keep = 0;
+  for (size_t i = 0; i < kNum; ++i) {
+    if (fabs(value[i]) >= kNum - k) {
+      EXPECT_EQ(decoded[i], value[i]);
+      keep++;
+    } else {
+      EXPECT_EQ(decoded[i], 0);
+    }
+  }
+  EXPECT_EQ(keep, k);
+  // Keep all of the values
+  codec->Initialize(1.0);
+  codec->Encode(value.data(), value.size(), &code);
+  codec->Decode(code.data(), code.size(), decoded.data(), kNum);
+  for (size_t i = 0; i < kNum; ++i) {
+    EXPECT_EQ(decoded[i], value[i]);
+  }
+}
+
+TEST(CodecTest, Residual) {
+  Residual residual;
+  real_t* r = residual.Get(kLatentTable, 3, 4);
+  for (int d = 0; d < 4; ++d) {
+    EXPECT_EQ(r[d], 0);
+    r[d] = d + 1;
+  }
+  // Growing the table keeps the old residual
+  r = residual.Get(kLatentTable, 4000000000u, 4);
+  EXPECT_EQ(r[0], 0);
+  r = residual.Get(kLatentTable, 3, 4);
+  for (int d = 0; d < 4; ++d) {
+    EXPECT_EQ(r[d], d + 1);
+  }
+  // Only the touched keys are stored
+  EXPECT_EQ(residual.Size(kLatentTable), 2u);
+  // The linear table is independent
+  EXPECT_EQ(residual.Get(kLinearTable, 3, 1)[0], 0);
+  EXPECT_EQ(residual.Size(kLinearTable), 1u);
+  residual.Reset();
+  EXPECT_EQ(residual.Size(kLatentTable), 0u);
+  EXPECT_EQ(residual.Get(kLatentTable, 3, 4)[0], 0);
+}
+
+}  // namespace xLearn
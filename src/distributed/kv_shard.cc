@@ -0,0 +1,234 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file is the implementation of KVShard.
+*/
+
+#include "src/distributed/kv_shard.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <algorithm>
+
+#include "src/base/logging.h"
+#include "src/base/math.h"
+
+namespace xLearn {
+
+// The same hash used by SplitMix64
+static inline uint64 mix64(uint64 x) {
+  x += 0x9E3779B97F4A7C15ULL;
+  x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  x = (x ^ (x >> 27)) * 0x94D049BB133111EBULL;
+  return x ^ (x >> 31);
+}
+
+// Return a random number in [0, 1), which only
+// depends on the global key and the position.
+static inline real_t random_value(uint64 key, uint64 pos) {
+  uint64 r = mix64(mix64(key) + pos);
+  return (r >> 40) * (1.0f / (1 << 24));
+}
+
+// Set the partition and the optimizer
+void KVShard::Initialize(size_t server_id,
+                         size_t server_num,
+                         const std::string& opt_type,
+                         real_t learning_rate,
+                         real_t regu_lambda,
+                         real_t alpha,
+                         real_t beta,
+                         real_t lambda_1,
+                         real_t lambda_2,
+                         real_t init_scale) {
+  CHECK_GT(server_num, 0);
+  CHECK_LT(server_id, server_num);
+  CHECK_GE(init_scale, 0);
+  if (opt_type.compare("sgd") != 0 &&
+      opt_type.compare("adagrad") != 0 &&
+      opt_type.compare("ftrl") != 0) {
+    LOG(FATAL) << "Unknow optimization method: " << opt_type;
+  }
+  server_id_ = server_id;
+  server_num_ = server_num;
+  opt_type_ = opt_type;
+  learning_rate_ = learning_rate;
+  regu_lambda_ = regu_lambda;
+  alpha_ = alpha;
+  beta_ = beta;
+  lambda_1_ = lambda_1;
+  lambda_2_ = lambda_2;
+  init_scale_ = init_scale;
+  for (int i = 0; i < kNumTable; ++i) {
+    table_[i] = Table();
+  }
+}
+
+// Number of keys stored in the table
+size_t KVShard::Size(int table) {
+  CHECK_GE(table, 0);
+  CHECK_LT(table, kNumTable);
+  std::lock_guard<std::mutex> lock(mutex_);
+  return table_[table].num_key;
+}
+
+// Initialize the value of the local id [start, end)
+void KVShard::init_value(int table_id, size_t start, size_t end) {
+  Table& table = table_[table_id];
+  size_t len = table.length;
+  for (size_t i = start; i < end; ++i) {
+    real_t* w = table.value.data() + i * len;
+    if (table_id == kLinearTable) {
+      std::fill(w, w + len, 0);
+    } else {
+      uint64 key = (uint64)i * server_num_ + server_id_;
+      for (size_t d = 0; d < len; ++d) {
+        w[d] = random_value(key, d) * init_scale_;
+      }
+    }
+  }
+  // The same initial value used by Model
+  if (!table.n.empty()) {
+    std::fill(table.n.begin() + start * len, 
+              table.n.begin() + end * len, 1.0);
+  }
+  if (!table.z.empty()) {
+    std::fill(table.z.begin() + start * len, 
+              table.z.begin() + end * len, 1.0);
+  }
+}
+
+// Make sure the table can store the given key
+void KVShard::reserve(int table_id, index_t max_key, size_t length) {
+  CHECK_GE(table_id, 0);
+  CHECK_LT(table_id, kNumTable);
+  CHECK_GT(length, 0);
+  Table& table = table_[table_id];
+  if (table.length == 0) {
+    table.length = length;
+  } else if (table.length != length) {
+    LOG(FATAL) << "The length of value list (" << length 
+               << ") is different from the table (" 
+               << table.length << ").";
+  }
+  size_t need = (size_t)max_key + 1;
+  if (need <= table.num_key) { return; }
+  size_t old_num = table.num_key;
+  table.value.resize(need * length);
+  if (opt_type_.compare("sgd") != 0) {
+    table.n.resize(need * length);
+  }
+  if (opt_type_.compare("ftrl") == 0) {
+    table.z.resize(need * length);
+  }
+  table.num_key = need;
+  init_value(table_id, old_num, need);
+}
+
+// Update the parameters of the given keys
+void KVShard::Push(int table_id,
+                   const index_t* key,
+                   size_t num_key,
+                   const real_t* grad,
+                   size_t length) {
+  if (num_key == 0) { return; }
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_t max_key = *std::max_element(key, key + num_key);
+  reserve(table_id, max_key, length);
+  Table& table = table_[table_id];
+  real_t* w = table.value.data();
+  if (opt_type_.compare("sgd") == 0) {
+    for (size_t i = 0; i < num_key; ++i) {
+      size_t offset = (size_t)key[i] * length;
+      update_sgd(w + offset, grad + i * length, length);
+    }
+  } else if (opt_type_.compare("adagrad") == 0) {
+    real_t* n = table.n.data();
+    for (size_t i = 0; i < num_key; ++i) {
+      size_t offset = (size_t)key[i] * length;
+      update_adagrad(w + offset, n + offset, 
+                     grad + i * length, length);
+    }
+  } else {  // ftrl
+    real_t* n = table.n.data();
+    real_t* z = table.z.data();
+    for (size_t i = 0; i < num_key; ++i) {
+      size_t offset = (size_t)key[i] * length;
+      update_ftrl(w + offset, n + offset, z + offset,
+                  grad + i * length, length);
+    }
+  }
+}
+
+// Get the parameters of the given keys
+void KVShard::Pull(int table_id,
+                   const index_t* key,
+                   size_t num_key,
+                   real_t* value,
+                   size_t length) {
+  if (num_key == 0) { return; }
+  std::lock_guard<std::mutex> lock(mutex_);
+  index_t max_key = *std::max_element(key, key + num_key);
+  reserve(table_id, max_key, length);
+  const real_t* w = table_[table_id].value.data();
+  for (size_t i = 0; i < num_key; ++i) {
+    memcpy(value + i * length, 
+           w + (size_t)key[i] * length, 
+           length * sizeof(real_t));
+  }
+}
+
+/*********************************************************
+ *  Optimization methods                                 *
+ *********************************************************/
+// The same update rules used by the score functions
+void KVShard::update_sgd(real_t* w, const real_t* g, size_t length) {
+  for (size_t d = 0; d < length; ++d) {
+    real_t gradient = g[d] + regu_lambda_ * w[d];
+    w[d] -= learning_rate_ * gradient;
+  }
+}
+
+void KVShard::update_adagrad(real_t* w, real_t* n,
+                             const real_t* g, size_t length) {
+  for (size_t d = 0; d < length; ++d) {
+    real_t gradient = g[d] + regu_lambda_ * w[d];
+    n[d] += gradient * gradient;
+    w[d] -= learning_rate_ * gradient * InvSqrt(n[d]);
+  }
+}
+
+void KVShard::update_ftrl(real_t* w, real_t* n, real_t* z,
+                          const real_t* g, size_t length) {
+  for (size_t d = 0; d < length; ++d) {
+    real_t gradient = lambda_2_ * w[d] + g[d];
+    real_t old_n = n[d];
+    n[d] += gradient * gradient;
+    real_t sigma = (sqrt(n[d]) - sqrt(old_n)) / alpha_;
+    z[d] += gradient - sigma * w[d];
+    int sign = z[d] > 0 ? 1 : -1;
+    if (sign * z[d] <= lambda_1_) {
+      w[d] = 0;
+    } else {
+      w[d] = (sign * lambda_1_ - z[d]) /
+             ((beta_ + sqrt(n[d])) / alpha_ + lambda_2_);
+    }
+  }
+}
+
+}  // namespace xLearn
@@ -0,0 +1,156 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file defines the KVShard class, which stores one
+slice of the model parameters on a parameter server.
+*/
+
+#ifndef XLEARN_DISTRIBUTED_KV_SHARD_H_
+#define XLEARN_DISTRIBUTED_KV_SHARD_H_
+
+#include <string>
+#include <vector>
+#include <mutex>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// Table of the linear term (one value for each key)
+const int kLinearTable = 0;
+// Table of the latent factor (a value list for each key)
+const int kLatentTable = 1;
+// Number of tables in one shard
+const int kNumTable = 2;
+
+//------------------------------------------------------------------------------
+// KVShard stores the parameters of the keys that are assigned to one
+// server, and it updates the parameters using the pushed gradient and
+// the configured optimization method ('sgd', 'adagrad', or 'ftrl').
+// The optimizer state (e.g., the gradient cache of adagrad) is kept
+// by the shard, and hence the workers only pull and push the values.
+//
+// The keys passed to KVShard are the local ids (see KVStore::FeatMap),
+// and the parameters are stored densely by local id:
+//
+//  local id:      0            1            2
+//           -------------------------------------
+//  value:   | v0 ... vk | v0 ... vk | v0 ... vk |
+//           -------------------------------------
+//
+// A new key is initialized when we first touch it: the linear term is
+// set to 0, and the latent factor is set to U(0, 1) * init_scale. The
+// random value only depends on the global key, so that the model is the
+// same for different number of servers.
+//
+// KVShard is thread-safe, and the requests for the same shard are
+// serialized by a mutex.
+//------------------------------------------------------------------------------
+class KVShard {
+ public:
+  // Constructor and Destructor
+  KVShard()
+   : server_id_(0),
+     server_num_(1) { }
+  ~KVShard() { }
+
+  // Invoke this function before we use this class.
+  void Initialize(size_t server_id,
+                  size_t server_num,
+                  const std::string& opt_type,
+                  real_t learning_rate,
+                  real_t regu_lambda,
+                  real_t alpha,
+                  real_t beta,
+                  real_t lambda_1,
+                  real_t lambda_2,
+                  real_t init_scale);
+
+  // Update the parameters of the given keys using the gradient.
+  // The gradient of the i-th key is grad[i*length, (i+1)*length).
+  void Push(int table,
+            const index_t* key,
+            size_t num_key,
+            const real_t* grad,
+            size_t length);
+
+  // Get the parameters of the given keys.
+  // The value of the i-th key is value[i*length, (i+1)*length).
+  void Pull(int table,
+            const index_t* key,
+            size_t num_key,
+            real_t* value,
+            size_t length);
+
+  // Number of keys stored in the table.
+  size_t Size(int table);
+
+ protected:
+  /* Parameters of one table */
+  struct Table {
+    /* Length of the value list */
+    size_t length = 0;
+    /* Number of keys (local id) */
+    size_t num_key = 0;
+    /* Model parameters */
+    std::vector<real_t> value;
+    /* Sum of squared gradient (adagrad and ftrl) */
+    std::vector<real_t> n;
+    /* z of ftrl */
+    std::vector<real_t> z;
+  };
+  /* The id of current server */
+  size_t server_id_;
+  /* The number of server */
+  size_t server_num_;
+  /* 'sgd', 'adagrad', or 'ftrl' */
+  std::string opt_type_;
+  /* Hyper-parameters of the optimizer */
+  real_t learning_rate_;
+  real_t regu_lambda_;
+  real_t alpha_;
+  real_t beta_;
+  real_t lambda_1_;
+  real_t lambda_2_;
+  /* Used to init the latent factor */
+  real_t init_scale_;
+  /* Linear table and latent table */
+  Table table_[kNumTable];
+  /* Serialize the requests */
+  std::mutex mutex_;
+
+  // Make sure the table can store the given key.
+  void reserve(int table_id, index_t max_key, size_t length);
+
+  // Initialize the value of the local id [start, end).
+  void init_value(int table_id, size_t start, size_t end);
+
+  // Update one value list.
+  void update_sgd(real_t* w, const real_t* g, size_t length);
+  void update_adagrad(real_t* w, real_t* n,
+                      const real_t* g, size_t length);
+  void update_ftrl(real_t* w, real_t* n, real_t* z,
+                   const real_t* g, size_t length);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(KVShard);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_DISTRIBUTED_KV_SHARD_H_
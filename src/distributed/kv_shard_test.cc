@@ -0,0 +1,103 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+/*
+This file tests the KVShard class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <vector>
+
+#include "src/base/math.h"
+#include "src/distributed/kv_shard.h"
+
+namespace xLearn {
+
+TEST(KVShardTest, InitValue) {
+  KVShard shard;
+  shard.Initialize(0, 1, "sgd", 0.1, 0, 0, 0, 0, 0, 0.5);
+  std::vector<index_t> key = {0, 3, 7};
+  std::vector<real_t> w(key.size());
+  shard.Pull(kLinearTable, key.data(), key.size(), w.data(), 1);
+  for (size_t i = 0; i < w.size(); ++i) {
+    EXPECT_FLOAT_EQ(w[i], 0);
+  }
+  EXPECT_EQ(shard.Size(kLinearTable), (size_t)8);
+  std::vector<real_t> v(key.size() * 4);
+  shard.Pull(kLatentTable, key.data(), key.size(), v.data(), 4);
+  for (size_t i = 0; i < v.size(); ++i) {
+    EXPECT_GE(v[i], 0);
+    EXPECT_LT(v[i], 0.5);
+  }
+  // The initial value only depends on the global key:
+  // local key 2 on server 1 (of 3 servers) is the key 7.
+  KVShard shard_1;
+  shard_1.Initialize(1, 3, "sgd", 0.1, 0, 0, 0, 0, 0, 0.5);
+  index_t local_key = 2;
+  std::vector<real_t> v_1(4);
+  shard_1.Pull(kLatentTable, &local_key, 1, v_1.data(), 4);
+  for (size_t d = 0; d < 4; ++d) {
+    EXPECT_FLOAT_EQ(v_1[d], v[2*4+d]);
+  }
+}
+
+TEST(KVShardTest, SGD) {
+  KVShard shard;
+  shard.Initialize(0, 1, "sgd", 0.1, 0, 0, 0, 0, 0, 1.0);
+  std::vector<index_t> key = {1, 2};
+  std::vector<real_t> grad = {1.0, -2.0};
+  shard.Push(kLinearTable, key.data(), key.size(), grad.data(), 1);
+  shard.Push(kLinearTable, key.data(), key.size(), grad.data(), 1);
+  std::vector<real_t> w(key.size());
+  shard.Pull(kLinearTable, key.data(), key.size(), w.data(), 1);
+  EXPECT_FLOAT_EQ(w[0], -0.2);
+  EXPECT_FLOAT_EQ(w[1], 0.4);
+}
+
+TEST(KVShardTest, Adagrad) {
+  KVShard shard;
+  shard.Initialize(0, 1, "adagrad", 0.1, 0, 0, 0, 0, 0, 1.0);
+  index_t key = 0;
+  real_t grad = 2.0;
+  shard.Push(kLinearTable, &key, 1, &grad, 1);
+  real_t w = 0;
+  shard.Pull(kLinearTable, &key, 1, &w, 1);
+  // The gradient cache starts from 1.0
+  EXPECT_FLOAT_EQ(w, -0.1 * 2.0 * InvSqrt(5.0));
+}
+
+TEST(KVShardTest, FTRL) {
+  KVShard shard;
+  real_t alpha = 0.5, beta = 1.0, lambda_1 = 0.1, lambda_2 = 0;
+  shard.Initialize(0, 1, "ftrl", 0.1, 0, alpha, beta, 
+                   lambda_1, lambda_2, 1.0);
+  index_t key = 0;
+  // Small gradient: |z| <= lambda_1, w = 0
+  // (n and z start from 1.0 as Model does)
+  real_t grad = -1.05;
+  shard.Push(kLinearTable, &key, 1, &grad, 1);
+  real_t w = 1;
+  shard.Pull(kLinearTable, &key, 1, &w, 1);
+  EXPECT_FLOAT_EQ(w, 0);
+  // Large gradient
+  grad = 3.0;
+  shard.Push(kLinearTable, &key, 1, &grad, 1);
+  shard.Pull(kLinearTable, &key, 1, &w, 1);
+  EXPECT_LT(w, 0);
+}
+
+}  // namespace xLearn
@@ -20,8 +20,297 @@ This file is the implementation of KVStore.
 
 #include "src/distributed/parameter_server.h"
 
+#include <string.h>
+#include <errno.h>
+
+#include <algorithm>
+#include <future>
+
+#ifndef _MSC_VER
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#endif
+
+#include "src/base/logging.h"
+
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// The in-process backend
+//------------------------------------------------------------------------------
+
+KVStore::~KVStore() { }
+
+// Set the optimizer and start the servers
+void KVStore::Initialize(size_t server_num,
+                         const std::string& opt_type,
+                         real_t learning_rate,
+                         real_t regu_lambda,
+                         real_t alpha,
+                         real_t beta,
+                         real_t lambda_1,
+                         real_t lambda_2,
+                         real_t init_scale) {
+  CHECK_GT(server_num, 0);
+  server_num_ = server_num;
+  opt_type_ = opt_type;
+  learning_rate_ = learning_rate;
+  regu_lambda_ = regu_lambda;
+  alpha_ = alpha;
+  beta_ = beta;
+  lambda_1_ = lambda_1;
+  lambda_2_ = lambda_2;
+  init_scale_ = init_scale;
+  push_bytes_ = 0;
+  pull_bytes_ = 0;
+  this->start_server();
+}
+
+// Create the codecs before the servers are started
+void KVStore::SetCodec(const std::string& push_codec,
+                       const std::string& pull_codec,
+                       real_t topk_ratio) {
+  CHECK_EQ(server_num_, 0);
+  push_codec_.reset(CREATE_CODEC(push_codec.c_str()));
+  if (push_codec_ == nullptr) {
+    LOG(FATAL) << "Unknow codec: " << push_codec;
+  }
+  push_codec_->Initialize(topk_ratio);
+  pull_codec_.reset(CREATE_CODEC(pull_codec.c_str()));
+  if (pull_codec_ == nullptr) {
+    LOG(FATAL) << "Unknow codec: " << pull_codec;
+  }
+  pull_codec_->Initialize(topk_ratio);
+}
+
+// Create the shards in current process
+void KVStore::start_server() {
+  shard_.clear();
+  for (size_t i = 0; i < server_num_; ++i) {
+    shard_.emplace_back(new KVShard());
+    shard_[i]->Initialize(i, server_num_, opt_type_,
+                          learning_rate_, regu_lambda_,
+                          alpha_, beta_, lambda_1_, lambda_2_,
+                          init_scale_);
+  }
+  if (server_num_ > 1) {
+    pool_.reset(new ThreadPool(server_num_));
+  }
+}
+
+// Each server is served by one thread
+void KVStore::push_batch(int table, 
+                         std::vector<Batch>& batch, 
+                         size_t length) {
+  std::vector<std::future<void>> result;
+  for (size_t i = 0; i < server_num_; ++i) {
+    if (batch[i].key.empty()) { continue; }
+    KVShard* shard = shard_[i].get();
+    Batch* b = &batch[i];
+    if (pool_ == nullptr) {
+      shard->Push(table, b->key.data(), b->key.size(), 
+                  b->value.data(), length);
+    } else {
+      result.push_back(pool_->enqueue([shard, b, table, length]() {
+        shard->Push(table, b->key.data(), b->key.size(), 
+                    b->value.data(), length);
+      }));
+    }
+  }
+  for (size_t i = 0; i < result.size(); ++i) {
+    result[i].wait();
+  }
+}
+
+void KVStore::pull_batch(int table, 
+                         std::vector<Batch>& batch, 
+                         size_t length) {
+  std::vector<std::future<void>> result;
+  for (size_t i = 0; i < server_num_; ++i) {
+    if (batch[i].key.empty()) { continue; }
+    KVShard* shard = shard_[i].get();
+    Batch* b = &batch[i];
+    b->value.resize(b->key.size() * length);
+    // The value is encoded as if it was sent by the server
+    Codec* codec = lossy(pull_codec_.get()) ? pull_codec_.get() : nullptr;
+    if (pool_ == nullptr) {
+      shard->Pull(table, b->key.data(), b->key.size(), 
+                  b->value.data(), length);
+      if (codec != nullptr) {
+        encode_batch(codec, table, i, b, length, nullptr);
+      }
+    } else {
+      result.push_back(pool_->enqueue(
+        [this, codec, shard, b, i, table, length]() {
+        shard->Pull(table, b->key.data(), b->key.size(), 
+                    b->value.data(), length);
+        if (codec != nullptr) {
+          encode_batch(codec, table, i, b, length, nullptr);
+        }
+      }));
+    }
+  }
+  for (size_t i = 0; i < result.size(); ++i) {
+    result[i].wait();
+  }
+}
+
+/*********************************************************
+ *  Compress the batch                                   *
+ *********************************************************/
+void KVStore::encode_batch(Codec* codec,
+                           int table,
+                           size_t server_id,
+                           Batch* batch,
+                           size_t length,
+                           Residual* residual) {
+  std::vector<real_t>& value = batch->value;
+  if (residual != nullptr) {
+    for (size_t i = 0; i < batch->key.size(); ++i) {
+      // The batch stores the local id
+      index_t key = batch->key[i] * server_num_ + server_id;
+      const real_t* r = residual->Get(table, key, length);
+      real_t* v = value.data() + i * length;
+      for (size_t d = 0; d < length; ++d) {
+        v[d] += r[d];
+      }
+    }
+  }
+  codec->Encode(value.data(), value.size(), &batch->code);
+  if (residual == nullptr) {
+    codec->Decode(batch->code.data(), batch->code.size(),
+                  value.data(), value.size());
+    return;
+  }
+  std::vector<real_t> decoded(value.size());
+  codec->Decode(batch->code.data(), batch->code.size(),
+                decoded.data(), decoded.size());
+  for (size_t i = 0; i < batch->key.size(); ++i) {
+    index_t key = batch->key[i] * server_num_ + server_id;
+    real_t* r = residual->Get(table, key, length);
+    const real_t* v = value.data() + i * length;
+    const real_t* dv = decoded.data() + i * length;
+    for (size_t d = 0; d < length; ++d) {
+      r[d] = v[d] - dv[d];
+    }
+  }
+  value.swap(decoded);
+}
+
+/*********************************************************
+ *  Merge and split the request                          *
+ *********************************************************/
+// Sort the position of keys by key
+bool KVStore::sort_key(const std::vector<index_t>& key,
+                       std::vector<size_t>& order) {
+  order.resize(key.size());
+  for (size_t i = 0; i < key.size(); ++i) {
+    order[i] = i;
+  }
+  // The compressed feature list is sorted and unique
+  bool sorted = true;
+  for (size_t i = 1; i < key.size(); ++i) {
+    if (key[i-1] >= key[i]) {
+      sorted = false;
+      break;
+    }
+  }
+  if (sorted) { return false; }
+  std::stable_sort(order.begin(), order.end(),
+    [&key](size_t a, size_t b) { return key[a] < key[b]; });
+  return true;
+}
+
+// Add the gradients of the same key together
+void KVStore::push(int table,
+                   const std::vector<index_t>& key,
+                   const real_t* value,
+                   size_t length,
+                   Residual* residual) {
+  CHECK_GT(server_num_, 0);
+  CHECK_GT(length, 0);
+  if (key.empty()) { return; }
+  std::vector<size_t> order;
+  sort_key(key, order);
+  std::vector<Batch> batch(server_num_);
+  for (size_t i = 0; i < server_num_; ++i) {
+    batch[i].key.reserve(key.size() / server_num_ + 1);
+    batch[i].value.reserve((key.size() / server_num_ + 1) * length);
+  }
+  for (size_t i = 0; i < order.size(); ++i) {
+    index_t k = key[order[i]];
+    const real_t* v = value + order[i] * length;
+    Batch& b = batch[GetServerId(k)];
+    if (i > 0 && key[order[i-1]] == k) {
+      // Duplicated key
+      real_t* sum = b.value.data() + b.value.size() - length;
+      for (size_t d = 0; d < length; ++d) {
+        sum[d] += v[d];
+      }
+    } else {
+      b.key.push_back(FeatMap(k));
+      b.value.insert(b.value.end(), v, v + length);
+    }
+  }
+  uint64 bytes = 0;
+  for (size_t i = 0; i < server_num_; ++i) {
+    Batch& b = batch[i];
+    if (b.key.empty()) { continue; }
+    if (lossy(push_codec_.get())) {
+      encode_batch(push_codec_.get(), table, i, &b, length, residual);
+      bytes += b.code.size();
+    } else {
+      bytes += b.value.size() * sizeof(real_t);
+    }
+    bytes += b.key.size() * sizeof(index_t);
+  }
+  push_bytes_ += bytes;
+  this->push_batch(table, batch, length);
+}
+
+// Pull each unique key only once
+void KVStore::pull(int table,
+                   const std::vector<index_t>& key,
+                   real_t* value,
+                   size_t length) {
+  CHECK_GT(server_num_, 0);
+  CHECK_GT(length, 0);
+  if (key.empty()) { return; }
+  std::vector<size_t> order;
+  sort_key(key, order);
+  std::vector<Batch> batch(server_num_);
+  for (size_t i = 0; i < server_num_; ++i) {
+    batch[i].key.reserve(key.size() / server_num_ + 1);
+  }
+  // Position of each key in its batch
+  std::vector<size_t> slot(key.size());
+  for (size_t i = 0; i < order.size(); ++i) {
+    index_t k = key[order[i]];
+    Batch& b = batch[GetServerId(k)];
+    if (i == 0 || key[order[i-1]] != k) {
+      b.key.push_back(FeatMap(k));
+    }
+    slot[order[i]] = b.key.size() - 1;
+  }
+  this->pull_batch(table, batch, length);
+  uint64 bytes = 0;
+  for (size_t i = 0; i < server_num_; ++i) {
+    const Batch& b = batch[i];
+    bytes += b.key.size() * sizeof(index_t);
+    bytes += b.code.empty() ? b.value.size() * sizeof(real_t) 
+                            : b.code.size();
+  }
+  pull_bytes_ += bytes;
+  for (size_t i = 0; i < key.size(); ++i) {
+    const Batch& b = batch[GetServerId(key[i])];
+    memcpy(value + i * length, 
+           b.value.data() + slot[i] * length,
+           length * sizeof(real_t));
+  }
+}
+
 // Push a list of (key, value) into store.
 // For example:
 //  ------------------------------------------------------
@@ -29,8 +318,10 @@ namespace xLearn {
 // | value:  | 0.2 | 1.0 | 0.5 | 1.0 | 0.33 |  0.7 |  0.8 |
 //  ------------------------------------------------------
 void KVStore::Push(const std::vector<index_t>& key,
-   	               const std::vector<real_t>& value) {
- // TODO(chao)
+   	               const std::vector<real_t>& value,
+   	               Residual* residual) {
+  CHECK_EQ(key.size(), value.size());
+  this->push(kLinearTable, key, value.data(), 1, residual);
 }
 
 // Push a list of (key, value_list) into store.
@@ -46,8 +337,10 @@ void KVStore::Push(const std::vector<index_t>& key,
 // This method is useful for the FM and FFM task.
 void KVStore::Push(const std::vector<index_t>& key,
    	               const std::vector<real_t>& value_list,
-   	               const size_t length) {
- // TODO(chao)
+   	               const size_t length,
+   	               Residual* residual) {
+  CHECK_EQ(key.size() * length, value_list.size());
+  this->push(kLatentTable, key, value_list.data(), length, residual);
 }
 
 // Pull the values for a list of keys from store.
@@ -58,7 +351,9 @@ void KVStore::Push(const std::vector<index_t>& key,
 //  ------------------------------------------------------
 void KVStore::Pull(const std::vector<index_t>& key,
    	               std::vector<real_t>* value) {
-  // TODO(chao)
+  CHECK_NOTNULL(value);
+  value->resize(key.size());
+  this->pull(kLinearTable, key, value->data(), 1);
 }
 
 // Pull the value list for a list of keys from store.
@@ -75,7 +370,9 @@ void KVStore::Pull(const std::vector<index_t>& key,
 void KVStore::Pull(const std::vector<index_t>& key,
    	               std::vector<real_t>* value_list,
    	               const size_t length) {
- // TODO(Chao)
+  CHECK_NOTNULL(value_list);
+  value_list->resize(key.size() * length);
+  this->pull(kLatentTable, key, value_list->data(), length);
 }
 
 //------------------------------------------------------------------------------
@@ -111,4 +408,246 @@ index_t KVStore::FeatMap(const index_t feat_id) const {
   return feat_id / server_num_;
 }
 
-}  // namespace xLearn
\ No newline at end of file
+#ifndef _MSC_VER
+//------------------------------------------------------------------------------
+// The multi-process backend
+//------------------------------------------------------------------------------
+
+// Operations sent to the server process
+enum KVOperation {
+  kOpPush = 1,
+  kOpPull = 2,
+  kOpStop = 3
+};
+
+// Head of each request
+struct KVMessage {
+  uint32 op;
+  uint32 table;
+  uint64 num_key;
+  uint64 length;
+  /* Size of the encoded value, or 0 for raw values */
+  uint64 code_size;
+};
+
+#ifdef MSG_NOSIGNAL
+static const int kSendFlag = MSG_NOSIGNAL;
+#else
+static const int kSendFlag = 0;
+#endif
+
+// Write the whole buffer to socket
+static bool write_all(int fd, const void* buf, size_t len) {
+  const char* ptr = (const char*)buf;
+  while (len > 0) {
+    ssize_t ret = send(fd, ptr, len, kSendFlag);
+    if (ret < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    ptr += ret;
+    len -= ret;
+  }
+  return true;
+}
+
+// Read the whole buffer from socket.
+// Return false if the peer is closed.
+static bool read_all(int fd, void* buf, size_t len) {
+  char* ptr = (char*)buf;
+  while (len > 0) {
+    ssize_t ret = recv(fd, ptr, len, 0);
+    if (ret < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    if (ret == 0) { return false; }
+    ptr += ret;
+    len -= ret;
+  }
+  return true;
+}
+
+// Send one request. The value is sent as code if the code is given.
+static void send_request(int fd, uint32 op, int table,
+                         const std::vector<index_t>& key,
+                         const real_t* value, size_t length,
+                         const std::string* code = nullptr) {
+  KVMessage msg;
+  msg.op = op;
+  msg.table = table;
+  msg.num_key = key.size();
+  msg.length = length;
+  msg.code_size = (code != nullptr) ? code->size() : 0;
+  bool bo = write_all(fd, &msg, sizeof(msg));
+  if (bo && !key.empty()) {
+    bo = write_all(fd, key.data(), key.size() * sizeof(index_t));
+  }
+  if (bo && msg.code_size > 0) {
+    bo = write_all(fd, code->data(), code->size());
+  } else if (bo && value != nullptr) {
+    bo = write_all(fd, value, key.size() * length * sizeof(real_t));
+  }
+  if (!bo) {
+    LOG(FATAL) << "Cannot send request to server: " << strerror(errno);
+  }
+}
+
+ProcessKVStore::~ProcessKVStore() {
+  stop_server();
+}
+
+// Fork one process for each server
+void ProcessKVStore::start_server() {
+  stop_server();
+  for (size_t i = 0; i < server_num_; ++i) {
+    int fd[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM, 0, fd) != 0) {
+      LOG(FATAL) << "Cannot create socket: " << strerror(errno);
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+      LOG(FATAL) << "Cannot fork server process: " << strerror(errno);
+    }
+    if (pid == 0) {  // server process
+      close(fd[0]);
+      // Do not keep the sockets of other servers
+      for (size_t j = 0; j < socket_.size(); ++j) {
+        close(socket_[j]);
+      }
+      serve(fd[1], i);
+      close(fd[1]);
+      _exit(0);
+    }
+    close(fd[1]);
+    socket_.push_back(fd[0]);
+    pid_.push_back(pid);
+    mutex_.emplace_back(new std::mutex());
+  }
+}
+
+// Main loop of the server process
+void ProcessKVStore::serve(int fd, size_t server_id) {
+  KVShard shard;
+  shard.Initialize(server_id, server_num_, opt_type_,
+                   learning_rate_, regu_lambda_,
+                   alpha_, beta_, lambda_1_, lambda_2_,
+                   init_scale_);
+  std::vector<index_t> key;
+  std::vector<real_t> value;
+  std::string code;
+  Codec* pull_codec = lossy(pull_codec_.get()) ? pull_codec_.get() : nullptr;
+  for (;;) {
+    KVMessage msg;
+    if (!read_all(fd, &msg, sizeof(msg))) { break; }
+    if (msg.op == kOpStop) { break; }
+    key.resize(msg.num_key);
+    value.resize(msg.num_key * msg.length);
+    if (!read_all(fd, key.data(), key.size() * sizeof(index_t))) { 
+      break; 
+    }
+    if (msg.op == kOpPush) {
+      if (msg.code_size > 0) {
+        code.resize(msg.code_size);
+        if (!read_all(fd, &code[0], code.size())) { break; }
+        push_codec_->Decode(code.data(), code.size(), 
+                            value.data(), value.size());
+      } else if (!read_all(fd, value.data(), 
+                           value.size() * sizeof(real_t))) { 
+        break; 
+      }
+      shard.Push(msg.table, key.data(), key.size(), 
+                 value.data(), msg.length);
+    } else if (msg.op == kOpPull) {
+      shard.Pull(msg.table, key.data(), key.size(), 
+                 value.data(), msg.length);
+      bool bo = true;
+      if (pull_codec != nullptr) {
+        // The response is the size of code and the code
+        pull_codec->Encode(value.data(), value.size(), &code);
+        uint64 size = code.size();
+        bo = write_all(fd, &size, sizeof(size)) &&
+             write_all(fd, code.data(), code.size());
+      } else {
+        bo = write_all(fd, value.data(), value.size() * sizeof(real_t));
+      }
+      if (!bo) { break; }
+    }
+  }
+}
+
+// Send the stop request and wait the server processes
+void ProcessKVStore::stop_server() {
+  for (size_t i = 0; i < socket_.size(); ++i) {
+    KVMessage msg;
+    msg.op = kOpStop;
+    msg.table = 0;
+    msg.num_key = 0;
+    msg.length = 0;
+    msg.code_size = 0;
+    write_all(socket_[i], &msg, sizeof(msg));
+    close(socket_[i]);
+    waitpid(pid_[i], nullptr, 0);
+  }
+  socket_.clear();
+  pid_.clear();
+  mutex_.clear();
+}
+
+// The servers apply the push in the order of request, 
+// and hence we do not wait the response of push.
+void ProcessKVStore::push_batch(int table, 
+                                std::vector<Batch>& batch, 
+                                size_t length) {
+  for (size_t i = 0; i < server_num_; ++i) {
+    if (batch[i].key.empty()) { continue; }
+    std::lock_guard<std::mutex> lock(*mutex_[i]);
+    const std::string* code = 
+      batch[i].code.empty() ? nullptr : &batch[i].code;
+    send_request(socket_[i], kOpPush, table, 
+                 batch[i].key, batch[i].value.data(), length, code);
+  }
+}
+
+// Send all of the requests first, and then receive the 
+// responses, so that the servers work in parallel. The
+// locks are always taken in the order of server id.
+void ProcessKVStore::pull_batch(int table, 
+                                std::vector<Batch>& batch, 
+                                size_t length) {
+  std::vector<std::unique_lock<std::mutex>> lock(server_num_);
+  for (size_t i = 0; i < server_num_; ++i) {
+    if (batch[i].key.empty()) { continue; }
+    lock[i] = std::unique_lock<std::mutex>(*mutex_[i]);
+    send_request(socket_[i], kOpPull, table, 
+                 batch[i].key, nullptr, length);
+  }
+  for (size_t i = 0; i < server_num_; ++i) {
+    if (batch[i].key.empty()) { continue; }
+    Batch& b = batch[i];
+    b.value.resize(b.key.size() * length);
+    bool bo = true;
+    if (lossy(pull_codec_.get())) {
+      uint64 size = 0;
+      bo = read_all(socket_[i], &size, sizeof(size));
+      if (bo) {
+        b.code.resize(size);
+        bo = read_all(socket_[i], &b.code[0], size);
+      }
+    } else {
+      bo = read_all(socket_[i], b.value.data(), 
+                    b.value.size() * sizeof(real_t));
+    }
+    if (!bo) {
+      LOG(FATAL) << "Cannot receive response from server " << i;
+    }
+    lock[i].unlock();
+    if (!b.code.empty()) {
+      pull_codec_->Decode(b.code.data(), b.code.size(),
+                          b.value.data(), b.value.size());
+    }
+  }
+}
+#endif  // _MSC_VER
+
+}  // namespace xLearn
@@ -22,40 +22,106 @@ to get and set the model parameters.
 #ifndef XLEARN_DISTRIBUTED_KVSTORE_H_
 #define XLEARN_DISTRIBUTED_KVSTORE_H_
 
+#include <string>
 #include <vector>
+#include <mutex>
+#include <memory>
+#include <atomic>
 
 #include "src/base/common.h"
+#include "src/base/thread_pool.h"
 #include "src/data/data_structure.h"
+#include "src/distributed/kv_shard.h"
+#include "src/distributed/codec.h"
 
 namespace xLearn {
 
 //------------------------------------------------------------------------------
 // KVStore are used for distributed training and it allows workers to get
 // and set the model parameters by using pull() and push() API.
+//
+// The model is partitioned into server_num shards (see GetServerId()), and
+// each shard is stored by a KVShard, which updates the parameters using the
+// pushed gradient and the configured optimization method. Each Push() and
+// Pull() sends one batch to each server, and the duplicated keys in a
+// request are merged before sending, e.g., the gradients of the same key
+// are added together.
+//
+// The KVStore class itself is the in-process backend, which stores all of
+// the shards in current process and serves the requests of different
+// servers in parallel by a thread pool (one thread for each server). The
+// ProcessKVStore stores each shard in a different process. We can use
+// the KVStore like this:
+//
+//   KVStore* store = new KVStore();  /* or new ProcessKVStore() */
+//   store->Initialize(server_num, "adagrad", 
+//                     learning_rate, regu_lambda,
+//                     alpha, beta, lambda_1, lambda_2,
+//                     init_scale);
+//
+//   store->Pull(key, &value);      /* linear term */
+//   store->Pull(key, &v, K);       /* latent factor */
+//   ... /* calculate gradient */
+//   store->Push(key, grad);
+//   store->Push(key, grad_v, K);
+//
+// The values sent to the servers can be compressed by a Codec (see 
+// SetCodec()), and each worker can give its Residual to Push() for the
+// error feedback of the lossy codecs.
+//
+// KVStore is thread-safe, and different workers can share the same store.
 //------------------------------------------------------------------------------
 class KVStore {
  public:
    // Constructor and Destructor
-   KVStore() { }
-   ~KVStore() { }
+   KVStore() 
+     : server_num_(0),
+       push_bytes_(0),
+       pull_bytes_(0) { }
+   virtual ~KVStore();
 
    // Initial KVStore. 
    // Invoke this function before we use it.
-   virtual void Initialize(size_t server_num) {
-   	 CHECK_GT(server_num, 0);
-     server_num_ = server_num;
+   void Initialize(size_t server_num) {
+     Initialize(server_num, "sgd", 0.2, 0.00002, 
+                0.3, 1.0, 0.00001, 0.00002, 1.0);
    }
 
-   // Push a list of (key, value) into store.
+   // Initial KVStore with the optimization method used by
+   // the servers. The init_scale is used to initialize the
+   // latent factor, which is set to U(0, 1) * init_scale.
+   void Initialize(size_t server_num,
+                   const std::string& opt_type,
+                   real_t learning_rate,
+                   real_t regu_lambda,
+                   real_t alpha,
+                   real_t beta,
+                   real_t lambda_1,
+                   real_t lambda_2,
+                   real_t init_scale);
+
+   // Compress the gradient of push and the value of pull by the given
+   // codec ("none", "int8", "int4" or "topk"), where the ratio is used
+   // by the "topk" codec. The topk codec is designed for the gradient,
+   // and the pull codec is usually "none" or a quantized codec.
+   // Invoke this function before Initialize().
+   void SetCodec(const std::string& push_codec,
+                 const std::string& pull_codec,
+                 real_t topk_ratio = 0.01);
+
+   // Push a list of (key, gradient) into store.
    // For example:
    //  ------------------------------------------------------
    // |  key:   |  0  |  2  |  4  |  5  |  6   |  7   |  9   |
    // | value:  | 0.2 | 1.0 | 0.5 | 1.0 | 0.33 |  0.7 |  0.8 |
    //  ------------------------------------------------------
-   virtual void Push(const std::vector<index_t>& key, 
-   	               const std::vector<real_t>& value);
+   // If the residual is given, the error of the push codec
+   // will be fed back to the next push of the same key.
+   void Push(const std::vector<index_t>& key, 
+   	               const std::vector<real_t>& value,
+   	               Residual* residual = nullptr);
 
-   // Push a list of (key, value_list) into store.
+   // Push a list of (key, gradient_list) into store.
    // For example:
    //  ------------------------------------------------------
    // |  key:   |  0  |  2  |  4  |  5  |  6   |  7   |  9   |
@@ -66,9 +132,10 @@ class KVStore {
    // |         | ..  | ..  | ..  | ..  | ..   |  ..  |  ..  |
    //  ------------------------------------------------------
    // This method is useful for the FM and FFM task.
-   virtual void Push(const std::vector<index_t>& key, 
+   void Push(const std::vector<index_t>& key, 
    	               const std::vector<real_t>& value_list, 
-   	               const size_t length);
+   	               const size_t length,
+   	               Residual* residual = nullptr);
 
    // Pull the values for a list of keys from store.
    // For example:
@@ -76,7 +143,7 @@ class KVStore {
    // |  key:   |  0  |  2  |  4  |  5  |  6   |  7   |  9   |
    // | value:  | 0.2 | 1.0 | 0.5 | 1.0 | 0.33 |  0.7 |  0.8 |
    //  ------------------------------------------------------
-   virtual void Pull(const std::vector<index_t>& key, 
+   void Pull(const std::vector<index_t>& key, 
    	               std::vector<real_t>* value);
 
    // Pull the value list for a list of keys from store.
@@ -90,7 +157,7 @@ class KVStore {
    // |         | ..  | ..  | ..  | ..  | ..   |  ..  |  ..  |
    //  ------------------------------------------------------
    // This method is useful for the FM and FFM task.
-   virtual void Pull(const std::vector<index_t>& key, 
+   void Pull(const std::vector<index_t>& key, 
    	               std::vector<real_t>* value_list, 
    	               const size_t length);
 
@@ -121,13 +188,144 @@ class KVStore {
    // Mapping the global feature id to a local feature id
    virtual index_t FeatMap(const index_t feat_id) const;
 
- private:
+   // Return the number of server
+   size_t ServerNum() const { return server_num_; }
+
+   // Return the bytes of keys and (encoded) values sent by Push()
+   // and received by Pull(), which are counted since Initialize().
+   uint64 PushBytes() const { return push_bytes_; }
+   uint64 PullBytes() const { return pull_bytes_; }
+
+ protected:
+  /* The request sent to one server */
+  struct Batch {
+    /* Local id of the keys */
+    std::vector<index_t> key;
+    /* Gradient for push, or value for pull */
+    std::vector<real_t> value;
+    /* Encoded value, which is empty if the codec is lossless */
+    std::string code;
+  };
   /* The number of server */
   size_t server_num_;  
+  /* Optimization method used by the servers */
+  std::string opt_type_;
+  real_t learning_rate_;
+  real_t regu_lambda_;
+  real_t alpha_;
+  real_t beta_;
+  real_t lambda_1_;
+  real_t lambda_2_;
+  real_t init_scale_;
+  /* Codec of push and pull, which can be nullptr */
+  std::unique_ptr<Codec> push_codec_;
+  std::unique_ptr<Codec> pull_codec_;
+  /* Bytes sent by push and received by pull */
+  std::atomic<uint64> push_bytes_;
+  std::atomic<uint64> pull_bytes_;
+  /* Shards of the in-process backend */
+  std::vector<std::unique_ptr<KVShard>> shard_;
+  /* One thread for each server */
+  std::unique_ptr<ThreadPool> pool_;
+
+  // Start the servers.
+  virtual void start_server();
+
+  // Send the batches to the servers. The batch[i] 
+  // is sent to the i-th server, and empty batches
+  // are skipped. For pull, the value of each batch
+  // will be filled by the servers.
+  virtual void push_batch(int table, 
+                          std::vector<Batch>& batch, 
+                          size_t length);
+  virtual void pull_batch(int table, 
+                          std::vector<Batch>& batch, 
+                          size_t length);
+
+  // Merge the duplicated keys, split the request
+  // by server, and then send the batches.
+  void push(int table,
+            const std::vector<index_t>& key,
+            const real_t* value,
+            size_t length,
+            Residual* residual);
+  void pull(int table,
+            const std::vector<index_t>& key,
+            real_t* value,
+            size_t length);
+
+  // Encode the value of the batch sent to the given server by a
+  // lossy codec, and replace the value by the decoded one. If the
+  // residual is given, it is added to the value before encoding, 
+  // and the new error is stored back.
+  void encode_batch(Codec* codec,
+                    int table,
+                    size_t server_id,
+                    Batch* batch,
+                    size_t length,
+                    Residual* residual);
 
+  // Return true if the codec changes the value.
+  static bool lossy(Codec* codec) {
+    return codec != nullptr && !codec->Lossless();
+  }
+
+  // Sort the position of keys by key. Return false
+  // if the keys are already sorted and unique.
+  bool sort_key(const std::vector<index_t>& key,
+                std::vector<size_t>& order);
+
+ private:
   DISALLOW_COPY_AND_ASSIGN(KVStore);
 };
 
+#ifndef _MSC_VER
+//------------------------------------------------------------------------------
+// ProcessKVStore is the multi-process backend of KVStore. Each server is
+// a child process forked in Initialize(), which owns one shard, and the
+// workers talk to the servers through Unix domain sockets. Hence the model
+// can be larger than the address space of one process, and we can test the
+// distributed training on one host without network.
+//
+// Note that Initialize() invokes fork(), and we should initialize the 
+// ProcessKVStore before we create any other thread.
+//------------------------------------------------------------------------------
+class ProcessKVStore : public KVStore {
+ public:
+  // Constructor and Destructor
+  ProcessKVStore() { }
+  ~ProcessKVStore();
+
+ protected:
+  /* Socket connected to each server */
+  std::vector<int> socket_;
+  /* Process id of each server */
+  std::vector<int> pid_;
+  /* Serialize the requests sent to the same server */
+  std::vector<std::unique_ptr<std::mutex>> mutex_;
+
+  // Fork the server processes.
+  void start_server();
+
+  // Send the batches through sockets.
+  void push_batch(int table, 
+                  std::vector<Batch>& batch, 
+                  size_t length);
+  void pull_batch(int table, 
+                  std::vector<Batch>& batch, 
+                  size_t length);
+
+  // Main loop of the server process.
+  void serve(int fd, size_t server_id);
+
+  // Stop the server processes.
+  void stop_server();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(ProcessKVStore);
+};
+#endif  // _MSC_VER
+
 }  // namespace xLearn
 
 #endif  // XLEARN_DISTRIBUTED_KVSTORE_H_
\ No newline at end of file
@@ -20,6 +20,11 @@ This file tests the KVStore class file
 
 #include "gtest/gtest.h"
 
+#include <math.h>
+
+#include <vector>
+#include <thread>
+
 #include "src/distributed/parameter_server.h"
 
 namespace xLearn {
@@ -54,4 +59,218 @@ TEST(KVStoreTest, FeatMap) {
   EXPECT_EQ(store.FeatMap((index_t)9), (index_t)3);
 }
 
-}  // namespace xLearn
\ No newline at end of file
+// sgd with learning_rate = 1 and no regularization,
+// so that the value is the negative sum of gradients.
+void InitStore(KVStore* store, size_t server_num) {
+  store->Initialize(server_num, "sgd", 1.0, 0, 0, 0, 0, 0, 1.0);
+}
+
+void TestPushPull(KVStore* store) {
+  // Linear term with duplicated keys
+  std::vector<index_t> key = {5, 1, 5, 9};
+  std::vector<real_t> grad = {1.0, 2.0, 3.0, 4.0};
+  store->Push(key, grad);
+  std::vector<index_t> pull_key = {1, 5, 5, 9, 100};
+  std::vector<real_t> value;
+  store->Pull(pull_key, &value);
+  ASSERT_EQ(value.size(), pull_key.size());
+  EXPECT_FLOAT_EQ(value[0], -2.0);
+  EXPECT_FLOAT_EQ(value[1], -4.0);
+  EXPECT_FLOAT_EQ(value[2], -4.0);
+  EXPECT_FLOAT_EQ(value[3], -4.0);
+  EXPECT_FLOAT_EQ(value[4], 0);
+  // Latent factor
+  size_t length = 3;
+  std::vector<real_t> init_v;
+  store->Pull(key, &init_v, length);
+  ASSERT_EQ(init_v.size(), key.size() * length);
+  for (size_t d = 0; d < length; ++d) {
+    // The same key has the same value
+    EXPECT_FLOAT_EQ(init_v[d], init_v[2*length+d]);
+  }
+  std::vector<real_t> grad_v(key.size() * length, 0.5);
+  store->Push(key, grad_v, length);
+  std::vector<real_t> v;
+  store->Pull(key, &v, length);
+  for (size_t d = 0; d < length; ++d) {
+    EXPECT_FLOAT_EQ(v[d], init_v[d] - 1.0);  // key 5 (twice)
+    EXPECT_FLOAT_EQ(v[length+d], init_v[length+d] - 0.5);  // key 1
+  }
+}
+
+TEST(KVStoreTest, InProcessPushPull) {
+  KVStore store;
+  InitStore(&store, 3);
+  TestPushPull(&store);
+}
+
+TEST(KVStoreTest, MultiProcessPushPull) {
+  ProcessKVStore store;
+  InitStore(&store, 3);
+  TestPushPull(&store);
+}
+
+// The model does not depend on the backend
+// and the number of servers.
+TEST(KVStoreTest, SameModel) {
+  KVStore store_1;
+  InitStore(&store_1, 1);
+  ProcessKVStore store_4;
+  InitStore(&store_4, 4);
+  std::vector<index_t> key;
+  for (index_t i = 0; i < 1000; ++i) {
+    key.push_back((i * 7919) % 503);
+  }
+  std::vector<real_t> grad(key.size() * 4);
+  for (size_t i = 0; i < grad.size(); ++i) {
+    grad[i] = (i % 13) * 0.1;
+  }
+  store_1.Push(key, grad, 4);
+  store_4.Push(key, grad, 4);
+  std::vector<real_t> v_1, v_4;
+  store_1.Pull(key, &v_1, 4);
+  store_4.Pull(key, &v_4, 4);
+  ASSERT_EQ(v_1.size(), v_4.size());
+  for (size_t i = 0; i < v_1.size(); ++i) {
+    EXPECT_FLOAT_EQ(v_1[i], v_4[i]);
+  }
+}
+
+void TestConcurrentPush(KVStore* store) {
+  std::vector<std::thread> worker;
+  for (int t = 0; t < 4; ++t) {
+    worker.push_back(std::thread([store]() {
+      std::vector<index_t> key = {0, 1, 2, 3, 4, 5, 6, 7};
+      std::vector<real_t> grad(key.size(), 1.0);
+      std::vector<real_t> value;
+      for (int n = 0; n < 100; ++n) {
+        store->Push(key, grad);
+        store->Pull(key, &value);
+      }
+    }));
+  }
+  for (size_t t = 0; t < worker.size(); ++t) {
+    worker[t].join();
+  }
+  std::vector<index_t> key = {0, 1, 2, 3, 4, 5, 6, 7};
+  std::vector<real_t> value;
+  store->Pull(key, &value);
+  for (size_t i = 0; i < value.size(); ++i) {
+    EXPECT_FLOAT_EQ(value[i], -400.0);
+  }
+}
+
+TEST(KVStoreTest, InProcessConcurrentPush) {
+  KVStore store;
+  InitStore(&store, 3);
+  TestConcurrentPush(&store);
+}
+
+TEST(KVStoreTest, MultiProcessConcurrentPush) {
+  ProcessKVStore store;
+  InitStore(&store, 3);
+  TestConcurrentPush(&store);
+}
+
+// With the error feedback, the sum of applied gradients is
+// the sum of pushed gradients minus the last residual.
+void TestErrorFeedback(KVStore* store) {
+  const int kRound = 50;
+  std::vector<index_t> key;
+  std::vector<real_t> grad;
+  for (index_t i = 0; i < 64; ++i) {
+    key.push_back(i);
+    grad.push_back(0.01 * (i + 1));
+  }
+  Residual residual;
+  for (int n = 0; n < kRound; ++n) {
+    store->Push(key, grad, &residual);
+  }
+  std::vector<real_t> value;
+  store->Pull(key, &value);
+  for (size_t i = 0; i < key.size(); ++i) {
+    real_t r = residual.Get(kLinearTable, key[i], 1)[0];
+    EXPECT_NEAR(value[i], -(kRound * grad[i] - r), 1e-4);
+    // Each key is sent at least once every 1/ratio pushes
+    EXPECT_LE(fabs(r), 4 * 0.64 + 1e-4);
+  }
+}
+
+TEST(KVStoreTest, InProcessErrorFeedback) {
+  KVStore store;
+  store.SetCodec("topk", "none", 0.25);
+  InitStore(&store, 3);
+  TestErrorFeedback(&store);
+}
+
+TEST(KVStoreTest, MultiProcessErrorFeedback) {
+  ProcessKVStore store;
+  store.SetCodec("topk", "none", 0.25);
+  InitStore(&store, 3);
+  TestErrorFeedback(&store);
+}
+
+// Push and pull a latent table of K = 32 and
+// return the pushed and pulled bytes.
+void TestCodecBytes(KVStore* store, uint64* push, uint64* pull) {
+  const size_t kK = 32;
+  std::vector<index_t> key;
+  for (index_t i = 0; i < 1000; ++i) {
+    key.push_back(i);
+  }
+  std::vector<real_t> grad(key.size() * kK);
+  for (size_t i = 0; i < grad.size(); ++i) {
+    grad[i] = ((i * 31) % 17) * 0.1;
+  }
+  store->Push(key, grad, kK);
+  std::vector<real_t> value;
+  store->Pull(key, &value, kK);
+  *push = store->PushBytes();
+  *pull = store->PullBytes();
+}
+
+TEST(KVStoreTest, CodecBytes) {
+  uint64 raw_push = 0, raw_pull = 0;
+  KVStore raw;
+  InitStore(&raw, 2);
+  TestCodecBytes(&raw, &raw_push, &raw_pull);
+  EXPECT_EQ(raw_push, (uint64)1000 * (4 + 32 * 4));
+  EXPECT_EQ(raw_pull, raw_push);
+  uint64 int8_push = 0, int8_pull = 0;
+  ProcessKVStore int8;
+  int8.SetCodec("int8", "int8");
+  InitStore(&int8, 2);
+  TestCodecBytes(&int8, &int8_push, &int8_pull);
+  EXPECT_LT(int8_push * 3, raw_push);
+  EXPECT_LT(int8_pull * 3, raw_pull);
+  uint64 int4_push = 0, int4_pull = 0;
+  KVStore int4;
+  int4.SetCodec("int4", "none");
+  InitStore(&int4, 2);
+  TestCodecBytes(&int4, &int4_push, &int4_pull);
+  EXPECT_LT(int4_push, int8_push);
+  EXPECT_EQ(int4_pull, raw_pull);
+}
+
+// The quantized pull is close to the raw pull
+TEST(KVStoreTest, PullCodec) {
+  KVStore raw;
+  InitStore(&raw, 2);
+  ProcessKVStore int8;
+  int8.SetCodec("none", "int8");
+  InitStore(&int8, 2);
+  std::vector<index_t> key;
+  for (index_t i = 0; i < 100; ++i) {
+    key.push_back(i * 3);
+  }
+  std::vector<real_t> v_raw, v_int8;
+  raw.Pull(key, &v_raw, 16);
+  int8.Pull(key, &v_int8, 16);
+  ASSERT_EQ(v_raw.size(), v_int8.size());
+  for (size_t i = 0; i < v_raw.size(); ++i) {
+    // init_scale = 1.0, so the step is less than 1/127
+    EXPECT_NEAR(v_raw[i], v_int8[i], 1.0 / 127 + 1e-6);
+  }
+}
+
+}  // namespace xLearn
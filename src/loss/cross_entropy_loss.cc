@@ -19,6 +19,7 @@ This file is the implementation of CrossEntropyLoss class.
 */
 
 #include "src/loss/cross_entropy_loss.h"
+#include "src/base/profiler.h"
 
 #include <thread>
 #include<atomic>
@@ -58,7 +59,8 @@ void CrossEntropyLoss::Evalute(const std::vector<real_t>& pred,
   CHECK_NE(label.empty(), true);
   total_example_ += pred.size();
   // multi-thread training
-  std::vector<real_t> sum(threadNumber_, 0);
+  ScratchScope scope;
+  real_t* sum = scope.AllocZero<real_t>(threadNumber_);
   for (int i = 0; i < threadNumber_; ++i) {
     size_t start_idx = getStart(pred.size(), threadNumber_, i);
     size_t end_idx = getEnd(pred.size(), threadNumber_, i);
@@ -72,7 +74,7 @@ void CrossEntropyLoss::Evalute(const std::vector<real_t>& pred,
   // Wait all of the threads finish their job
   pool_->Sync(threadNumber_);
   // Accumulate loss
-  for (size_t i = 0; i < sum.size(); ++i) {
+  for (size_t i = 0; i < threadNumber_; ++i) {
     loss_sum_ += sum[i];
   }
 }
@@ -87,6 +89,7 @@ static void ce_gradient_thread(const DMatrix* matrix,
                                size_t start_idx,
                                size_t end_idx) {
   CHECK_GE(end_idx, start_idx);
+  ProfileScope scope(kPhaseGrad);
   *sum = 0;
   for (size_t i = start_idx; i < end_idx; ++i) {
     SparseRow* row = matrix->row[i];
@@ -118,11 +121,17 @@ void CrossEntropyLoss::CalcGrad(const DMatrix* matrix,
                                 Model& model) {
   CHECK_NOTNULL(matrix);
   CHECK_GT(matrix->row_length, 0);
+  // The sparse model is trained on a dense copy of its rows
+  if (model.IsSparse()) {
+    calc_grad_sparse(matrix, model);
+    return;
+  }
   size_t row_len = matrix->row_length;
   total_example_ += row_len;
   // multi-thread training
   int count = lock_free_ ? threadNumber_ : 1;
-  std::vector<real_t> sum(count, 0);
+  ScratchScope scope;
+  real_t* sum = scope.AllocZero<real_t>(count);
   for (int i = 0; i < count; ++i) {
     index_t start_idx = getStart(row_len, count, i);
     index_t end_idx = getEnd(row_len, count, i);
@@ -138,7 +147,7 @@ void CrossEntropyLoss::CalcGrad(const DMatrix* matrix,
   // Wait all of the threads finish their job
   pool_->Sync(count);
   // Accumulate loss
-  for (int i = 0; i < sum.size(); ++i) {
+  for (int i = 0; i < count; ++i) {
     loss_sum_ += sum[i];
   }
 }
@@ -21,9 +21,13 @@ This file tests the CrossEntropyLoss class.
 #include "gtest/gtest.h"
 
 #include <vector>
+#include <string>
 
 #include "src/loss/cross_entropy_loss.h"
+#include "src/score/linear_score.h"
 #include "src/score/fm_score.h"
+#include "src/score/ffm_score.h"
+#include "src/distributed/parameter_server.h"
 
 namespace xLearn {
 
@@ -61,4 +65,117 @@ TEST(CROSS_ENTROPY_LOSS, Evalute) {
   EXPECT_LT(val, 0.000001);
 }
 
+Score* CreateSGDScore(const std::string& score_func, real_t lr) {
+  Score* score = nullptr;
+  if (score_func == "linear") {
+    score = new LinearScore;
+  } else if (score_func == "fm") {
+    score = new FMScore;
+  } else {
+    score = new FFMScore;
+  }
+  std::string opt_type = "sgd";
+  score->Initialize(lr, 0, 0, 0, 0, 0, opt_type);
+  return score;
+}
+
+// With a single mini-batch and 'sgd' on servers, the distributed
+// training should get the same model with the local training.
+void CheckCalcGradDist(const std::string& score_func) {
+  const index_t kRow = 50;
+  const index_t kFeat = 20;
+  const index_t kField = 4;
+  const index_t kK = 6;
+  const real_t kLR = 0.1;
+  // Create data matrix, where the feature 7 is never used
+  DMatrix matrix;
+  matrix.ReAlloc(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    matrix.Y[i] = (i % 3 == 0) ? 1 : -1;
+    matrix.norm[i] = 0.5;
+    matrix.row[i] = new SparseRow;
+    for (index_t j = 0; j < 4; ++j) {
+      index_t feat = (i * 7 + j * 3) % kFeat;
+      if (feat == 7) { continue; }
+      matrix.AddNode(i, feat, 0.5 + j, j % kField);
+    }
+  }
+  ThreadPool pool(1);
+  KVStore store;
+  store.Initialize(2, "sgd", kLR, 0, 0, 0, 0, 0, 0.5);
+  // Distributed training
+  CrossEntropyLoss dist_loss;
+  Score* dist_score = CreateSGDScore(score_func, kLR);
+  dist_loss.Initialize(dist_score, &pool, true, false, kRow);
+  dist_loss.InitDist(&store, kLR, score_func, kField, kK);
+  // Local training from the same initial model
+  Model model;
+  model.Initialize(score_func, "cross-entropy", kFeat, kField, kK, 1);
+  dist_loss.PullModel(model);
+  CrossEntropyLoss local_loss;
+  Score* local_score = CreateSGDScore(score_func, kLR);
+  local_loss.Initialize(local_score, &pool);
+  local_loss.CalcGrad(&matrix, model);
+  dist_loss.CalcGradDist(&matrix);
+  EXPECT_FLOAT_EQ(dist_loss.GetLoss(), local_loss.GetLoss());
+  // The feature id of data matrix should be restored
+  EXPECT_EQ((*matrix.row[1])[0].feat_id, 10);
+  // Compare the model
+  Model dist_model;
+  dist_model.Initialize(score_func, "cross-entropy", kFeat, kField, kK, 1);
+  dist_loss.PullModel(dist_model);
+  EXPECT_NEAR(dist_model.GetParameter_b()[0],
+              model.GetParameter_b()[0], 1e-5);
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    EXPECT_NEAR(dist_model.GetParameter_w()[i],
+                model.GetParameter_w()[i], 1e-5);
+  }
+  EXPECT_FLOAT_EQ(dist_model.GetParameter_w()[7], 0);
+  for (index_t i = 0; i < model.GetNumParameter_v(); ++i) {
+    EXPECT_NEAR(dist_model.GetParameter_v()[i],
+                model.GetParameter_v()[i], 1e-5);
+  }
+  delete dist_score;
+  delete local_score;
+}
+
+TEST(CROSS_ENTROPY_LOSS, CalcGradDist_Linear) {
+  CheckCalcGradDist("linear");
+}
+
+TEST(CROSS_ENTROPY_LOSS, CalcGradDist_FM) {
+  CheckCalcGradDist("fm");
+}
+
+TEST(CROSS_ENTROPY_LOSS, CalcGradDist_FFM) {
+  CheckCalcGradDist("ffm");
+}
+
+TEST(CROSS_ENTROPY_LOSS, CalcGradDist_MiniBatch) {
+  const index_t kRow = 200;
+  DMatrix matrix;
+  matrix.ReAlloc(kRow);
+  for (index_t i = 0; i < kRow; ++i) {
+    matrix.Y[i] = (i % 2 == 0) ? 1 : -1;
+    matrix.row[i] = new SparseRow;
+    matrix.AddNode(i, i % 2, 1.0);
+    matrix.AddNode(i, 2 + i % 5, 1.0);
+  }
+  ThreadPool pool(2);
+  KVStore store;
+  store.Initialize(3, "adagrad", 0.1, 0, 0, 0, 0, 0, 0.5);
+  CrossEntropyLoss loss;
+  Score* score = CreateSGDScore("fm", 0.1);
+  loss.Initialize(score, &pool, true, false, 16);
+  loss.InitDist(&store, 0.1, "fm", 0, 4);
+  real_t first_loss = 0;
+  for (int n = 0; n < 5; ++n) {
+    loss.Reset();
+    loss.CalcGradDist(&matrix);
+    if (n == 0) { first_loss = loss.GetLoss(); }
+  }
+  EXPECT_LT(loss.GetLoss(), first_loss);
+  delete score;
+}
+
 }  // namespace xLearn
@@ -18,9 +18,14 @@
 This file is the implementation of the basic Loss class.
 */
 
+#include <algorithm>
+#include <future>
+
 #include "src/loss/loss.h"
 #include "src/loss/squared_loss.h"
 #include "src/loss/cross_entropy_loss.h"
+#include "src/data/sparse_table.h"
+#include "src/data/count_min_sketch.h"
 
 namespace xLearn {
 
@@ -54,6 +59,10 @@ void Loss::Predict(const DMatrix* matrix,
   CHECK_NOTNULL(matrix);
   CHECK_NE(pred.empty(), true);
   CHECK_EQ(pred.size(), matrix->row_length);
+  if (model.IsSparse()) {
+    predict_sparse(matrix, model, pred);
+    return;
+  }
   index_t row_len = matrix->row_length;
   // Predict in multi-thread
   for (int i = 0; i < threadNumber_; ++i) {
@@ -72,37 +81,492 @@ void Loss::Predict(const DMatrix* matrix,
   pool_->Sync(threadNumber_);
 }
 
-// Given data sample and current model, calculate gradient.
-// Note that this method doesn't update local model, and the
-// gradient will be pushed to the parameter server, which is 
-// used for distributed computation.
-void Loss::CalcGradDist(DMatrix* matrix,
-                        Model& model,
-                        std::vector<real_t>& grad) {
-  for(;;) {
-    // Get a mini-batch from current data matrix
-    DMatrix mini_batch;
-    mini_batch.ReAlloc(batch_size_);
-    index_t len = matrix->GetMiniBatch(batch_size_, mini_batch);
-    if (len == 0) {
-      break;
+// Initialize the distributed training
+void Loss::InitDist(KVStore* store,
+                    real_t learning_rate,
+                    const std::string& score_func,
+                    index_t num_field,
+                    index_t num_K) {
+  CHECK_NOTNULL(store);
+  CHECK_GT(learning_rate, 0);
+  store_ = store;
+  dist_learning_rate_ = learning_rate;
+  dist_score_func_ = score_func;
+  dist_num_field_ = num_field;
+  dist_num_K_ = num_K;
+  if (score_func == "linear") {
+    dist_v_len_ = 0;
+  } else if (score_func == "fm") {
+    dist_v_len_ = num_K;
+  } else if (score_func == "ffm") {
+    dist_v_len_ = num_field * num_K;
+  } else {
+    LOG(FATAL) << "Unknow score function: " << score_func;
+  }
+  if (pull_pool_ == nullptr) {
+    pull_pool_ = new ThreadPool(1);
+  }
+}
+
+// Get the next mini-batch and pull its parameters
+index_t Loss::pull_batch(DMatrix* matrix, DistBatch* batch) {
+  index_t len = matrix->GetMiniBatch(batch_size_, batch->mini_batch);
+  if (len == 0) {
+    return 0;
+  }
+  // Compress the sparse data matrix to dense format
+  batch->feature_list.clear();
+  batch->mini_batch.Compress(batch->feature_list);
+  size_t feat_num = batch->feature_list.size();
+  batch->key.resize(feat_num + 1);
+  batch->key[0] = 0;  /* bias */
+  for (size_t i = 0; i < feat_num; ++i) {
+    batch->key[i+1] = batch->feature_list[i] + 1;
+  }
+  store_->Pull(batch->key, &batch->w);
+  if (dist_v_len_ > 0) {
+    // The feature keys start from key[1]
+    std::vector<index_t> feat_key(batch->key.begin() + 1,
+                                  batch->key.end());
+    store_->Pull(feat_key, &batch->v, dist_v_len_);
+  }
+  return len;
+}
+
+// Train the mini-model and push gradient
+void Loss::push_batch(DistBatch* batch) {
+  index_t feat_num = batch->feature_list.size();
+  // The compressed feature id starts from 1, and the
+  // mini-model only grows to avoid re-allocation.
+  index_t num_feat = feat_num + 1;
+  if (mini_model_.GetParameter_w() == nullptr ||
+      mini_model_.GetNumFeature() < num_feat) {
+    index_t capacity = std::max(num_feat,
+                                mini_model_.GetParameter_w() == nullptr ?
+                                0 : mini_model_.GetNumFeature() * 2);
+    mini_model_.Initialize(dist_score_func_,
+                           loss_type(),
+                           capacity,
+                           dist_num_field_,
+                           dist_num_K_,
+                           1);  /* aux_size of sgd */
+  }
+  real_t* w = mini_model_.GetParameter_w();
+  real_t* v = mini_model_.GetParameter_v();
+  real_t* b = mini_model_.GetParameter_b();
+  index_t aligned_k = mini_model_.get_aligned_k();
+  index_t num_field = dist_score_func_ == "ffm" ? dist_num_field_ : 1;
+  index_t num_K = dist_num_K_;
+  // Fill the mini-model. Note that the features which are not in
+  // current mini-batch are never accessed by CalcGrad().
+  b[0] = batch->w[0];
+  for (index_t i = 1; i <= feat_num; ++i) {
+    w[i] = batch->w[i];
+  }
+  if (dist_v_len_ > 0) {
+    for (index_t i = 1; i <= feat_num; ++i) {
+      real_t* dst = v + i * num_field * aligned_k;
+      const real_t* src = batch->v.data() + (i-1) * dist_v_len_;
+      for (index_t f = 0; f < num_field; ++f) {
+        for (index_t d = 0; d < num_K; ++d) {
+          dst[d] = src[d];
+        }
+        for (index_t d = num_K; d < aligned_k; ++d) {
+          dst[d] = 0;
+        }
+        dst += aligned_k;
+        src += num_K;
+      }
+    }
+  }
+  // Calculate gradient on the mini-model
+  this->CalcGrad(&batch->mini_batch, mini_model_);
+  batch->mini_batch.Decompress(batch->feature_list);
+  // The gradient of 'sgd' is the change of model / learning rate
+  real_t inv_lr = 1.0 / dist_learning_rate_;
+  batch->w[0] = (batch->w[0] - b[0]) * inv_lr;
+  for (index_t i = 1; i <= feat_num; ++i) {
+    batch->w[i] = (batch->w[i] - w[i]) * inv_lr;
+  }
+  store_->Push(batch->key, batch->w, &residual_);
+  if (dist_v_len_ > 0) {
+    for (index_t i = 1; i <= feat_num; ++i) {
+      const real_t* cur = v + i * num_field * aligned_k;
+      real_t* grad = batch->v.data() + (i-1) * dist_v_len_;
+      for (index_t f = 0; f < num_field; ++f) {
+        for (index_t d = 0; d < num_K; ++d) {
+          grad[d] = (grad[d] - cur[d]) * inv_lr;
+        }
+        cur += aligned_k;
+        grad += num_K;
+      }
+    }
+    std::vector<index_t> feat_key(batch->key.begin() + 1,
+                                  batch->key.end());
+    store_->Push(feat_key, batch->v, dist_v_len_, &residual_);
+  }
+}
+
+// Given data sample, calculate gradient by mini-batch
+// and push the gradient to the parameter server.
+void Loss::CalcGradDist(DMatrix* matrix) {
+  CHECK_NOTNULL(matrix);
+  CHECK_NOTNULL(store_);
+  CHECK_GT(batch_size_, 0);
+  matrix->pos = 0;
+  int cur = 0;
+  index_t len = pull_batch(matrix, &dist_batch_[cur]);
+  while (len > 0) {
+    // Pull the next mini-batch in background. The two
+    // mini-batches never share rows of the data matrix.
+    std::future<index_t> next = pull_pool_->enqueue(
+      std::bind(&Loss::pull_batch, this, matrix, &dist_batch_[1-cur]));
+    push_batch(&dist_batch_[cur]);
+    len = next.get();
+    pull_pool_->Sync(1);
+    cur = 1 - cur;
+  }
+}
+
+// Pull the global model from parameter server
+void Loss::PullModel(Model& model) {
+  CHECK_NOTNULL(store_);
+  index_t num_feat = model.GetNumFeature();
+  index_t aux_size = model.GetAuxiliarySize();
+  std::vector<index_t> key(num_feat + 1);
+  for (index_t i = 0; i <= num_feat; ++i) {
+    key[i] = i;
+  }
+  std::vector<real_t> value;
+  store_->Pull(key, &value);
+  real_t* w = model.GetParameter_w();
+  model.GetParameter_b()[0] = value[0];
+  for (index_t i = 0; i < num_feat; ++i) {
+    w[i*aux_size] = value[i+1];
+  }
+  if (dist_v_len_ == 0) {
+    return;
+  }
+  key.erase(key.begin());
+  store_->Pull(key, &value, dist_v_len_);
+  real_t* v = model.GetParameter_v();
+  index_t aligned_k = model.get_aligned_k();
+  index_t num_field = dist_score_func_ == "ffm" ? dist_num_field_ : 1;
+  for (index_t i = 0; i < num_feat; ++i) {
+    const real_t* src = value.data() + i * dist_v_len_;
+    for (index_t f = 0; f < num_field; ++f) {
+      real_t* dst = v + (i * num_field + f) * aligned_k * aux_size;
+      for (index_t d = 0; d < dist_num_K_; ++d) {
+        // The ffm model stores the gradient cache after
+        // every kAlign parameters (see Model::set_value()).
+        index_t idx = d;
+        if (dist_score_func_ == "ffm") {
+          idx = (d / kAlign) * kAlign * aux_size + d % kAlign;
+        }
+        dst[idx] = src[f*dist_num_K_+d];
+      }
+    }
+  }
+}
+
+// The latent factor of a linear-only feature is zero, and its gradient
+// cache is so large that adagrad and ftrl keep it (almost) zero during
+// CalcGrad(). It is never copied back to the SparseTable.
+static const real_t kFrozenCache = 1e30;
+
+// Set the frozen latent factor in the layout of Model::param_v_
+static void init_frozen_latent(Model& model,
+                               index_t len_v,
+                               std::vector<real_t>* frozen) {
+  index_t aux_size = model.GetAuxiliarySize();
+  index_t aligned_k = model.get_aligned_k();
+  frozen->assign(len_v, 0);
+  // No gradient cache in the model for prediction (see IsPruned())
+  if (aux_size == 1) { return; }
+  if (model.GetScoreFunction().compare("fm") == 0) {
+    for (index_t d = aligned_k; d < aligned_k * 2; ++d) {
+      (*frozen)[d] = kFrozenCache;
+    }
+  } else if (model.GetScoreFunction().compare("ffm") == 0) {
+    // Each kAlign values are followed by their gradient cache
+    for (index_t i = 0; i < len_v; i += kAlign * aux_size) {
+      for (index_t s = 0; s < kAlign; ++s) {
+        (*frozen)[i + kAlign + s] = kFrozenCache;
+      }
     }
-    mini_batch.row_length = len;
-    // Compress the sparse data matrix and sparse model
-    // parameter to dense format
-    std::vector<index_t> feature_list;
-    mini_batch.Compress(feature_list);
-    /*
-    // Pull the model parameter from parameter server
-    store->pull(feature_list, model);
-
-    // Calculate gradient
-    this->CalcGrad(matrix, model, grad);
-
-    // Push gradient to the parameter server
-    ps->push(grad, feature_list);
-    */
   }
 }
 
+// Copy the rows [start_idx, end_idx) between the SparseTable
+// and the staged dense model in one thread. A feature without
+// its own row uses its linear-only row (if any) and the frozen
+// latent factor. The rows copied back to the table are stamped.
+static void copy_rows_thread(const std::vector<real_t*>* rows,
+                             const std::vector<real_t*>* linear,
+                             const std::vector<real_t>* frozen,
+                             SparseTable* table,
+                             SparseTable* linear_table,
+                             real_t* w,
+                             real_t* v,
+                             index_t aux_size,
+                             bool to_table,
+                             index_t stamp,
+                             size_t start_idx,
+                             size_t end_idx) {
+  index_t offset_v = table->GetOffset_v();
+  index_t len_v = table->GetLength_v();
+  for (size_t k = start_idx; k < end_idx; ++k) {
+    real_t* row = (*rows)[k];
+    real_t* wk = w + k * aux_size;
+    real_t* vk = v + k * len_v;
+    if (row == nullptr && !linear->empty() && (*linear)[k] != nullptr) {
+      real_t* lrow = (*linear)[k];
+      if (to_table) {
+        memcpy(lrow, wk, aux_size * sizeof(real_t));
+        linear_table->SetStamp(lrow, stamp);
+      } else {
+        memcpy(wk, lrow, aux_size * sizeof(real_t));
+        if (len_v > 0) {
+          memcpy(vk, frozen->data(), len_v * sizeof(real_t));
+        }
+      }
+    } else if (to_table) {
+      if (row == nullptr) { continue; }
+      memcpy(row, wk, aux_size * sizeof(real_t));
+      if (len_v > 0) {
+        memcpy(row + offset_v, vk, len_v * sizeof(real_t));
+      }
+      table->SetStamp(row, stamp);
+    } else if (row != nullptr) {
+      memcpy(wk, row, aux_size * sizeof(real_t));
+      if (len_v > 0) {
+        memcpy(vk, row + offset_v, len_v * sizeof(real_t));
+      }
+    } else {
+      // Unseen feature in prediction
+      memset(wk, 0, aux_size * sizeof(real_t));
+      if (len_v > 0) {
+        memset(vk, 0, len_v * sizeof(real_t));
+      }
+    }
+  }
+}
+
+// Stage the rows of data matrix into sparse_model_
+void Loss::stage_sparse(const DMatrix* matrix, Model& model, bool create) {
+  SparseBatch& batch = sparse_batch_;
+  index_t row_len = matrix->row_length;
+  bool admission = model.IsAdmission();
+  batch.key.clear();
+  batch.count.clear();
+  batch.local.clear();
+  if (batch.storage.size() < row_len) {
+    batch.storage.resize(row_len);
+  }
+  DMatrix& staged = batch.matrix;
+  staged.row.resize(row_len);
+  staged.Y.resize(row_len);
+  staged.norm.resize(row_len);
+  staged.row_length = row_len;
+  staged.has_label = matrix->has_label;
+  // Renumber the features in the order they appear
+  for (index_t i = 0; i < row_len; ++i) {
+    const SparseRow* src = matrix->row[i];
+    SparseRow& dst = batch.storage[i];
+    dst.resize(src->size());
+    for (size_t n = 0; n < src->size(); ++n) {
+      const Node& node = (*src)[n];
+      std::pair<feature_map::iterator, bool> ret =
+        batch.local.insert(std::make_pair(node.feat_id,
+                                          (index_t)batch.key.size()));
+      if (ret.second) {
+        batch.key.push_back(node.feat_id);
+        if (admission) { batch.count.push_back(0); }
+      }
+      // The occurrences are counted for feature admission
+      if (admission) { batch.count[ret.first->second]++; }
+      dst[n] = Node(node.field_id, ret.first->second, node.feat_val);
+    }
+    staged.row[i] = &dst;
+    staged.Y[i] = matrix->Y[i];
+    staged.norm[i] = matrix->norm[i];
+  }
+  SparseTable* table = model.GetSparseTable();
+  if (admission) {
+    admit_sparse(model, create);
+  } else if (model.GetLinearTable() != nullptr) {
+    // The linear-only rows of a pruned model
+    CHECK(!create);
+    admit_sparse(model, false);
+  } else {
+    table->FindRows(batch.key, create, &batch.row, pool_);
+    batch.linear.clear();
+  }
+  if (!batch.linear.empty()) {
+    init_frozen_latent(model, table->GetLength_v(), &batch.frozen);
+  }
+  // The staged model only grows to avoid re-allocation
+  index_t num_feat = std::max((index_t)batch.key.size(), (index_t)1);
+  if (sparse_model_.GetParameter_w() == nullptr ||
+      sparse_model_.GetNumFeature() < num_feat ||
+      sparse_model_.GetAuxiliarySize() != model.GetAuxiliarySize()) {
+    index_t capacity = num_feat;
+    if (sparse_model_.GetParameter_w() != nullptr) {
+      capacity = std::max(capacity, sparse_model_.GetNumFeature() * 2);
+    }
+    sparse_model_.Initialize(model.GetScoreFunction(),
+                             model.GetLossFunction(),
+                             capacity,
+                             model.GetNumField(),
+                             model.GetNumK(),
+                             model.GetAuxiliarySize());
+  }
+  index_t aux_size = model.GetAuxiliarySize();
+  memcpy(sparse_model_.GetParameter_b(),
+         model.GetParameter_b(),
+         aux_size * sizeof(real_t));
+  size_t count = std::min(threadNumber_, batch.key.size());
+  for (size_t i = 0; i < count; ++i) {
+    pool_->enqueue(std::bind(copy_rows_thread,
+                             &batch.row,
+                             &batch.linear,
+                             &batch.frozen,
+                             table,
+                             model.GetLinearTable(),
+                             sparse_model_.GetParameter_w(),
+                             sparse_model_.GetParameter_v(),
+                             aux_size,
+                             false,
+                             0,
+                             getStart(batch.key.size(), count, i),
+                             getEnd(batch.key.size(), count, i)));
+  }
+  pool_->Sync(count);
+}
+
+// Look up the rows with feature admission
+void Loss::admit_sparse(Model& model, bool create) {
+  SparseBatch& batch = sparse_batch_;
+  SparseTable* table = model.GetSparseTable();
+  SparseTable* linear = model.GetLinearTable();
+  CountMinSketch* sketch = model.GetSketch();
+  std::vector<index_t>& key = batch.key;
+  std::vector<real_t*>& row = batch.row;
+  table->FindRows(key, false, &row, pool_);
+  // Count the new features, and find the admitted ones
+  std::vector<size_t> admit;
+  std::vector<size_t> rest;
+  for (size_t k = 0; k < key.size(); ++k) {
+    if (row[k] != nullptr) { continue; }
+    if (create) {
+      uint32 count = model.IsCounting() ?
+                     sketch->Add(key[k], batch.count[k]) :
+                     sketch->Estimate(key[k]);
+      if (count >= model.GetAdmitCount()) {
+        admit.push_back(k);
+        continue;
+      }
+    }
+    rest.push_back(k);
+  }
+  // Create the rows of the admitted features. The linear
+  // term learned before the admission is kept.
+  std::vector<index_t>& sub_key = batch.sub_key;
+  std::vector<real_t*>& sub_row = batch.sub_row;
+  if (!admit.empty()) {
+    sub_key.clear();
+    for (size_t i = 0; i < admit.size(); ++i) {
+      sub_key.push_back(key[admit[i]]);
+    }
+    table->FindRows(sub_key, true, &sub_row, pool_);
+    for (size_t i = 0; i < admit.size(); ++i) {
+      row[admit[i]] = sub_row[i];
+      real_t* old = linear == nullptr ? nullptr : linear->Find(sub_key[i]);
+      if (old != nullptr) {
+        memcpy(sub_row[i], old, table->GetLength_w() * sizeof(real_t));
+      }
+    }
+  }
+  // The other features use their linear-only rows
+  if (linear != nullptr) {
+    batch.linear.assign(key.size(), nullptr);
+    if (rest.empty()) { return; }
+    sub_key.clear();
+    for (size_t i = 0; i < rest.size(); ++i) {
+      sub_key.push_back(key[rest[i]]);
+    }
+    linear->FindRows(sub_key, create, &sub_row, pool_);
+    for (size_t i = 0; i < rest.size(); ++i) {
+      batch.linear[rest[i]] = sub_row[i];
+    }
+    return;
+  }
+  // Or they are mapped to one local feature of the shared row
+  batch.linear.clear();
+  if (rest.empty()) { return; }
+  real_t* shared = create ? table->FindOrCreate(kSharedFeatureKey)
+                          : table->Find(kSharedFeatureKey);
+  std::vector<index_t>& remap = batch.remap;
+  remap.resize(key.size());
+  index_t num = 0;
+  for (size_t k = 0; k < key.size(); ++k) {
+    if (row[k] == nullptr) { continue; }
+    remap[k] = num;
+    key[num] = key[k];
+    row[num] = row[k];
+    num++;
+  }
+  for (size_t i = 0; i < rest.size(); ++i) {
+    remap[rest[i]] = num;
+  }
+  key[num] = kSharedFeatureKey;
+  row[num] = shared;
+  key.resize(num + 1);
+  row.resize(num + 1);
+  for (index_t i = 0; i < batch.matrix.row_length; ++i) {
+    SparseRow& r = batch.storage[i];
+    for (size_t n = 0; n < r.size(); ++n) {
+      r[n].feat_id = remap[r[n].feat_id];
+    }
+  }
+}
+
+// Calculate gradient for the sparse model
+void Loss::calc_grad_sparse(const DMatrix* matrix, Model& model) {
+  stage_sparse(matrix, model, true);
+  this->CalcGrad(&sparse_batch_.matrix, sparse_model_);
+  // Copy the staged rows back
+  SparseTable* table = model.GetSparseTable();
+  index_t aux_size = model.GetAuxiliarySize();
+  std::vector<real_t*>& rows = sparse_batch_.row;
+  size_t count = std::min(threadNumber_, rows.size());
+  for (size_t i = 0; i < count; ++i) {
+    pool_->enqueue(std::bind(copy_rows_thread,
+                             &rows,
+                             &sparse_batch_.linear,
+                             &sparse_batch_.frozen,
+                             table,
+                             model.GetLinearTable(),
+                             sparse_model_.GetParameter_w(),
+                             sparse_model_.GetParameter_v(),
+                             aux_size,
+                             true,
+                             model.GetEpoch() + 1,
+                             getStart(rows.size(), count, i),
+                             getEnd(rows.size(), count, i)));
+  }
+  pool_->Sync(count);
+  memcpy(model.GetParameter_b(),
+         sparse_model_.GetParameter_b(),
+         aux_size * sizeof(real_t));
+}
+
+// Predict by using the sparse model
+void Loss::predict_sparse(const DMatrix* matrix,
+                          Model& model,
+                          std::vector<real_t>& pred) {
+  stage_sparse(matrix, model, false);
+  this->Predict(&sparse_batch_.matrix, sparse_model_, pred);
+}
+
 }  // namespace xLearn
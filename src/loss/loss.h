@@ -28,8 +28,10 @@ function or objective function.
 #include "src/base/common.h"
 #include "src/base/class_register.h"
 #include "src/base/math.h"
+#include "src/base/scratch_arena.h"
 #include "src/base/thread_pool.h"
 #include "src/data/model_parameters.h"
+#include "src/distributed/parameter_server.h"
 #include "src/score/score_function.h"
 
 namespace xLearn {
@@ -70,8 +72,9 @@ namespace xLearn {
 class Loss {
  public:
   // Constructor and Desstructor
-  Loss() : loss_sum_(0), total_example_ (0) { };
-  virtual ~Loss() { }
+  Loss() : loss_sum_(0), total_example_ (0), store_(nullptr),
+           pull_pool_(nullptr) { };
+  virtual ~Loss() { delete pull_pool_; }
 
   // This function needs to be invoked before using this class
   void Initialize(Score* score, 
@@ -105,13 +108,34 @@ class Loss {
   virtual void CalcGrad(const DMatrix* data_matrix, 
                         Model& model) = 0;
 
-  // Given data sample and current model, calculate gradient.
-  // Note that this method doesn't update local model, and the
-  // gradient will be pushed to the parameter server, which is 
-  // used for distributed computation.
-  virtual void CalcGradDist(DMatrix* data_matrix,
-                            Model& model,
-                            std::vector<real_t>& grad);
+  // This function needs to be invoked before using CalcGradDist().
+  // The global model is stored in the store, where key 0 is the
+  // bias and the feature i uses the key i+1. The score function
+  // given in Initialize() should use the 'sgd' method with the
+  // same learning_rate and without regularization, because the
+  // optimization method runs on the servers.
+  void InitDist(KVStore* store,
+                real_t learning_rate,
+                const std::string& score_func,
+                index_t num_field,
+                index_t num_K);
+
+  // Given data sample, calculate gradient by mini-batch and push
+  // the gradient to the parameter server, which is used for
+  // distributed computation. For each mini-batch, we only pull the
+  // parameters of the features in this batch into a dense local
+  // mini-model, and then run CalcGrad() on it. The gradient is the
+  // change of the mini-model divided by the learning rate. The pull
+  // of the next mini-batch runs together with the computation of
+  // current mini-batch in a thread created by InitDist(), and hence the
+  // parameters used by a mini-batch can miss the update of the previous
+  // one.
+  // This function will also acummulate loss value.
+  virtual void CalcGradDist(DMatrix* data_matrix);
+
+  // Pull the global model from the parameter server to the model,
+  // which has the same shape with the mini-model.
+  void PullModel(Model& model);
 
   // Return the calculated loss value
   virtual real_t GetLoss() {
@@ -146,6 +170,103 @@ class Loss {
   /* Mini-batch size */
   index_t batch_size_;
 
+  // The buffers of one mini-batch in CalcGradDist().
+  struct DistBatch {
+    /* Mini-batch, which borrows the rows of data matrix */
+    DMatrix mini_batch;
+    /* Sorted features of the mini-batch */
+    std::vector<index_t> feature_list;
+    /* Keys of the bias and the features */
+    std::vector<index_t> key;
+    /* Pulled linear term, where w[0] is the bias */
+    std::vector<real_t> w;
+    /* Pulled latent factor */
+    std::vector<real_t> v;
+  };
+
+  /* Parameter server used by CalcGradDist() */
+  KVStore* store_;
+  /* Learning rate of the local score function */
+  real_t dist_learning_rate_;
+  /* Score function of the global model */
+  std::string dist_score_func_;
+  /* Number of field of the global model */
+  index_t dist_num_field_;
+  /* Number of K of the global model */
+  index_t dist_num_K_;
+  /* Length of the value list in latent table */
+  size_t dist_v_len_;
+  /* Error feedback of the push codec */
+  Residual residual_;
+  /* Dense model for current mini-batch */
+  Model mini_model_;
+  /* Double buffers for the pipelined pull */
+  DistBatch dist_batch_[2];
+  /* One thread for the pipelined pull, which is
+  created by InitDist() and re-used by each batch */
+  ThreadPool* pull_pool_;
+
+  // The buffers used to stage a data matrix for sparse model.
+  struct SparseBatch {
+    /* Data matrix using the local feature ids */
+    DMatrix matrix;
+    /* Rows of the matrix, which are re-used by each call */
+    std::vector<SparseRow> storage;
+    /* Feature id of each local feature id */
+    std::vector<index_t> key;
+    /* Row of each local feature in the SparseTable */
+    std::vector<real_t*> row;
+    /* Mapping from feature id to local feature id */
+    feature_map local;
+    /* Occurrences of each local feature (feature admission) */
+    std::vector<index_t> count;
+    /* Linear-only row of each local feature, which is empty
+    if the model has no linear-only rows */
+    std::vector<real_t*> linear;
+    /* Latent factor staged for the linear-only rows */
+    std::vector<real_t> frozen;
+    /* Buffers used by admit_sparse() */
+    std::vector<index_t> sub_key;
+    std::vector<real_t*> sub_row;
+    std::vector<index_t> remap;
+  };
+
+  /* Staged data matrix for sparse model */
+  SparseBatch sparse_batch_;
+  /* Dense copy of the staged rows of sparse model */
+  Model sparse_model_;
+
+  // Copy the rows of the features in data matrix from the sparse
+  // model to sparse_model_, and renumber the features from 0 in
+  // sparse_batch_.matrix. The rows which are not in the table are
+  // created if create is true, and set to zero otherwise.
+  void stage_sparse(const DMatrix* matrix, Model& model, bool create);
+
+  // Look up the rows of the staged features with feature admission.
+  // A new feature is admitted to the SparseTable once its count in
+  // the sketch reaches the admit count. Otherwise, it uses its
+  // linear-only row, or it is mapped to the shared row.
+  void admit_sparse(Model& model, bool create);
+
+  // Calculate gradient for the sparse model. CalcGrad() runs on the
+  // staged dense model, and the rows are copied back after that.
+  // This function will also acummulate loss value.
+  void calc_grad_sparse(const DMatrix* matrix, Model& model);
+
+  // Predict by using the sparse model. The unseen
+  // features are skipped like the dense model does.
+  void predict_sparse(const DMatrix* matrix,
+                      Model& model,
+                      std::vector<real_t>& pred);
+
+  // Get the next mini-batch of the data matrix and pull
+  // its parameters. Return the size of mini-batch.
+  index_t pull_batch(DMatrix* matrix, DistBatch* batch);
+
+  // Train the mini-model on a pulled mini-batch and
+  // push the gradient to the parameter server.
+  void push_batch(DistBatch* batch);
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Loss);
 };
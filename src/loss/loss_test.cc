@@ -27,6 +27,8 @@ This file tests the Loss class.
 #include "src/data/data_structure.h"
 #include "src/data/model_parameters.h"
 #include "src/data/hyper_parameters.h"
+#include "src/data/sparse_table.h"
+#include "src/data/count_min_sketch.h"
 #include "src/score/linear_score.h"
 #include "src/score/fm_score.h"
 #include "src/score/ffm_score.h"
@@ -44,9 +46,7 @@ class TestLoss : public Loss {
   void CalcGrad(const DMatrix* data_matrix,
                 Model& model) { return; }
 
-  void CalcGradDist(DMatrix* data_matrix,
-                    Model& model,
-                    std::vector<real_t>& grad) { return; }
+  void CalcGradDist(DMatrix* data_matrix) { return; }
 
   std::string loss_type() { return "test"; }
 
@@ -203,6 +203,141 @@ Loss* CreateLoss(const char* format_name) {
   return CREATE_LOSS(format_name);
 }
 
+TEST_F(LossTest, CalcGrad_Sparse) {
+  // The linear term is initialized to zero in both models, and
+  // hence the sparse model is trained in the same way as the dense.
+  param.score_func = "linear";
+  index_t num_feat = 50;
+  Model dense;
+  dense.Initialize(param.score_func, "cross-entropy",
+                   num_feat, 0, 0, param.auxiliary_size);
+  Model sparse;
+  sparse.InitializeSparse(param.score_func, "cross-entropy",
+                          0, 0, 0, param.auxiliary_size);
+  DMatrix matrix;
+  matrix.ReAlloc(kLine * 10);
+  for (index_t i = 0; i < kLine * 10; ++i) {
+    matrix.Y[i] = i % 3 == 0 ? 1 : 0;
+    for (int j = 0; j < 5; ++j) {
+      matrix.AddNode(i, (i * 7 + j * 13) % 30, 1.0);
+    }
+  }
+  std::string opt_type = "adagrad";
+  Score* score = new LinearScore;
+  score->Initialize(param.learning_rate, param.regu_lambda,
+                    0, 0, 0, 0, opt_type);
+  ThreadPool pool(4);
+  Loss* loss = CreateLoss("cross-entropy");
+  loss->Initialize(score, &pool, true, false);
+  for (int n = 0; n < 3; ++n) {
+    loss->CalcGrad(&matrix, dense);
+    loss->CalcGrad(&matrix, sparse);
+  }
+  // Only the seen features are created
+  SparseTable* table = sparse.GetSparseTable();
+  EXPECT_EQ(table->Size(), 30);
+  for (index_t j = 0; j < 30; ++j) {
+    real_t* row = table->Find(j);
+    ASSERT_TRUE(row != nullptr);
+    EXPECT_FLOAT_EQ(row[0], dense.GetParameter_w()[j*2]);
+    EXPECT_FLOAT_EQ(row[1], dense.GetParameter_w()[j*2+1]);
+  }
+  EXPECT_FLOAT_EQ(sparse.GetParameter_b()[0], dense.GetParameter_b()[0]);
+  std::vector<real_t> pred_dense(matrix.row_length);
+  std::vector<real_t> pred_sparse(matrix.row_length);
+  loss->Predict(&matrix, dense, pred_dense);
+  loss->Predict(&matrix, sparse, pred_sparse);
+  for (size_t i = 0; i < pred_dense.size(); ++i) {
+    EXPECT_FLOAT_EQ(pred_dense[i], pred_sparse[i]);
+  }
+  // A new feature beyond the dense model is learned
+  DMatrix new_data;
+  new_data.ReAlloc(1);
+  new_data.Y[0] = 1;
+  new_data.AddNode(0, 1000000, 1.0);
+  new_data.AddNode(0, 3, 1.0);
+  std::vector<real_t> pred(1);
+  loss->Predict(&new_data, sparse, pred);
+  EXPECT_EQ(table->Size(), 30);
+  loss->CalcGrad(&new_data, sparse);
+  EXPECT_EQ(table->Size(), 31);
+  EXPECT_GT(table->Find(1000000)[0], 0);
+  delete loss;
+  delete score;
+}
+
+TEST_F(LossTest, CalcGrad_Admission) {
+  // Feature 0 ~ 9 appear 10 times, and 100 ~ 199 appear once
+  DMatrix matrix;
+  matrix.ReAlloc(100);
+  for (int i = 0; i < 100; ++i) {
+    matrix.Y[i] = i % 3 == 0 ? 1 : 0;
+    matrix.AddNode(i, i % 10, 1.0);
+    matrix.AddNode(i, 100 + i, 1.0);
+  }
+  std::string opt_type = "adagrad";
+  Score* score = new FMScore;
+  score->Initialize(param.learning_rate, param.regu_lambda,
+                    0, 0, 0, 0, opt_type);
+  ThreadPool pool(4);
+  Loss* loss = CreateLoss("cross-entropy");
+  loss->Initialize(score, &pool, true, false);
+  // Linear-only fallback
+  Model model;
+  model.InitializeSparse("fm", "cross-entropy", 0, 0, 4, 2);
+  model.SetAdmission(3, false, 1);
+  EXPECT_TRUE(model.IsAdmission());
+  loss->CalcGrad(&matrix, model);
+  SparseTable* table = model.GetSparseTable();
+  SparseTable* linear = model.GetLinearTable();
+  ASSERT_TRUE(linear != nullptr);
+  EXPECT_EQ(table->Size(), 10);
+  EXPECT_EQ(linear->Size(), 100);
+  EXPECT_EQ(model.GetSketch()->Estimate(150), 1);
+  EXPECT_EQ(model.GetSketch()->Estimate(5), 10);
+  EXPECT_NE(linear->Find(150)[0], 0);
+  EXPECT_EQ(linear->GetStamp(linear->Find(150)), 1);
+  EXPECT_EQ(table->GetStamp(table->Find(5)), 1);
+  // The rare feature is scored by its linear term
+  DMatrix rare;
+  rare.ReAlloc(1);
+  rare.AddNode(0, 150, 1.0);
+  std::vector<real_t> pred(1);
+  loss->Predict(&rare, model, pred);
+  real_t expected = model.GetParameter_b()[0] + linear->Find(150)[0];
+  EXPECT_NEAR(pred[0], expected, 1e-6);
+  // The counting stops after the first epoch
+  EXPECT_EQ(model.EndEpoch(), 0);
+  EXPECT_FALSE(model.IsCounting());
+  for (int n = 0; n < 3; ++n) {
+    loss->CalcGrad(&rare, model);
+  }
+  EXPECT_EQ(model.GetSketch()->Estimate(150), 1);
+  EXPECT_EQ(table->Find(150), nullptr);
+  // Evict the features which are not updated in epoch 2
+  EXPECT_EQ(model.EndEpoch(), 10 + 99);
+  EXPECT_EQ(table->Size(), 0);
+  EXPECT_EQ(linear->Size(), 1);
+  // Shared fallback
+  Model shared;
+  shared.InitializeSparse("fm", "cross-entropy", 0, 0, 4, 2);
+  shared.SetAdmission(3, true, 0);
+  EXPECT_EQ(shared.GetLinearTable(), nullptr);
+  loss->CalcGrad(&matrix, shared);
+  table = shared.GetSparseTable();
+  EXPECT_EQ(table->Size(), 11);
+  ASSERT_TRUE(table->Find(kSharedFeatureKey) != nullptr);
+  EXPECT_NE(table->Find(kSharedFeatureKey)[0], 0);
+  // An unseen feature also uses the shared row
+  std::vector<real_t> pred_rare(1);
+  loss->Predict(&rare, shared, pred_rare);
+  rare.row[0]->at(0).feat_id = 123456;
+  loss->Predict(&rare, shared, pred);
+  EXPECT_FLOAT_EQ(pred[0], pred_rare[0]);
+  delete loss;
+  delete score;
+}
+
 TEST_F(LossTest, Create_Loss) {
   EXPECT_TRUE(CreateLoss("squared") != NULL);
   EXPECT_TRUE(CreateLoss("cross-entropy") != NULL);
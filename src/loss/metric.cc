@@ -31,5 +31,6 @@ REGISTER_METRIC("mae", MAEMetric);
 REGISTER_METRIC("mape", MAPEMetric);
 REGISTER_METRIC("rmsd", RMSDMetric);
 REGISTER_METRIC("auc", AUCMetric);
+REGISTER_METRIC("gauc", GroupAUCMetric);
 
 }  // namespace xLearn
@@ -23,15 +23,21 @@ This file defines the Metric class.
 
 #include <math.h>
 
+#include <map>
+#include <vector>
+#include <unordered_map>
+
 #include "src/base/common.h"
 #include "src/base/math.h"
 #include "src/base/class_register.h"
+#include "src/base/memory_tracker.h"
+#include "src/base/scratch_arena.h"
 #include "src/base/thread_pool.h"
 #include "src/data/data_structure.h"
 
 namespace xLearn {
 
-// Bucket size used by AUC
+// Default bucket size used by AUC
 const index_t kMaxBucketSize = 1e6;
 
 //------------------------------------------------------------------------------
@@ -59,16 +65,29 @@ class Metric {
   Metric() { }
   virtual ~Metric() { }
 
-  void Initialize(ThreadPool* pool) {
+  // The bucket_size is used by AUC, which controls
+  // the accuracy and the memory cost of the metric.
+  void Initialize(ThreadPool* pool, 
+                  index_t bucket_size = kMaxBucketSize) {
     CHECK_NOTNULL(pool);
+    CHECK_GT(bucket_size, 0);
     pool_ = pool;
     threadNumber_ = pool_->ThreadNumber();
+    bucket_size_ = bucket_size;
   }
 
   // Accumulate counters during the training.
   virtual void Accumulate(const std::vector<real_t>& Y,
                           const std::vector<real_t>& pred) = 0;
 
+  // Accumulate counters using the data matrix, which is 
+  // used by the metric that needs more than the label y.
+  virtual void AccumulateMatrix(const DMatrix* matrix,
+                                const std::vector<real_t>& pred) {
+    CHECK_NOTNULL(matrix);
+    Accumulate(matrix->Y, pred);
+  }
+
   // Reset counters
   virtual void Reset() = 0;
 
@@ -86,6 +105,8 @@ class Metric {
   ThreadPool* pool_;
   /* Thread number used by Metric */
   size_t threadNumber_;
+  /* Bucket size used by AUC */
+  index_t bucket_size_;
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Metric);
@@ -132,7 +153,8 @@ class AccMetric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<index_t> sum(threadNumber_, 0);
+    ScratchScope scope;
+    index_t* sum = scope.AllocZero<index_t>(threadNumber_);
     for (int i = 0; i < threadNumber_; ++i) {
       size_t start_idx = getStart(pred.size(), threadNumber_, i);
       size_t end_idx = getEnd(pred.size(), threadNumber_, i);
@@ -145,7 +167,7 @@ class AccMetric : public Metric {
     }
     // Wait all of the threads finish their job
     pool_->Sync(threadNumber_);
-    for (size_t i = 0; i < sum.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       true_pred_ += sum[i];
     }
   }
@@ -219,8 +241,9 @@ class PrecMetric : public Metric {
                   const std::vector<real_t>& pred) {
     CHECK_EQ(Y.size(), pred.size());
     // multi-thread training
-    std::vector<index_t> sum_1(threadNumber_, 0);
-    std::vector<index_t> sum_2(threadNumber_, 0);
+    ScratchScope scope;
+    index_t* sum_1 = scope.AllocZero<index_t>(threadNumber_);
+    index_t* sum_2 = scope.AllocZero<index_t>(threadNumber_);
     for (int i = 0; i < threadNumber_; ++i) {
       size_t start_idx = getStart(pred.size(), threadNumber_, i);
       size_t end_idx = getEnd(pred.size(), threadNumber_, i);
@@ -234,10 +257,10 @@ class PrecMetric : public Metric {
     }
     // Wait all of the threads finish their job
     pool_->Sync(threadNumber_);
-    for (size_t i = 0; i < sum_1.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       true_positive_ += sum_1[i];
     }
-    for (size_t i = 0; i < sum_2.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       false_positive_ += sum_2[i];
     }
   }
@@ -312,8 +335,9 @@ class RecallMetric : public Metric {
                   const std::vector<real_t>& pred) {
     CHECK_EQ(Y.size(), pred.size());
     // multi-thread training
-    std::vector<index_t> sum_1(threadNumber_, 0);
-    std::vector<index_t> sum_2(threadNumber_, 0);
+    ScratchScope scope;
+    index_t* sum_1 = scope.AllocZero<index_t>(threadNumber_);
+    index_t* sum_2 = scope.AllocZero<index_t>(threadNumber_);
     for (int i = 0; i < threadNumber_; ++i) {
       size_t start_idx = getStart(pred.size(), threadNumber_, i);
       size_t end_idx = getEnd(pred.size(), threadNumber_, i);
@@ -327,10 +351,10 @@ class RecallMetric : public Metric {
     }
     // Wait all of the threads finish their job
     pool_->Sync(threadNumber_);
-    for (size_t i = 0; i < sum_1.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       true_positive_ += sum_1[i];
     }
-    for (size_t i = 0; i < sum_2.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       false_negative_ += sum_2[i];
     }
   }
@@ -408,8 +432,9 @@ class F1Metric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<index_t> sum_1(threadNumber_, 0);
-    std::vector<index_t> sum_2(threadNumber_, 0);
+    ScratchScope scope;
+    index_t* sum_1 = scope.AllocZero<index_t>(threadNumber_);
+    index_t* sum_2 = scope.AllocZero<index_t>(threadNumber_);
     for (int i = 0; i < threadNumber_; ++i) {
       size_t start_idx = getStart(pred.size(), threadNumber_, i);
       size_t end_idx = getEnd(pred.size(), threadNumber_, i);
@@ -423,10 +448,10 @@ class F1Metric : public Metric {
     }
     // Wait all of the threads finish their job
     pool_->Sync(threadNumber_);
-    for (size_t i = 0; i < sum_1.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       true_positive_ += sum_1[i];
     }
-    for (size_t i = 0; i < sum_2.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       true_negative_ += sum_2[i];
     }
   }
@@ -463,51 +488,157 @@ class F1Metric : public Metric {
   DISALLOW_COPY_AND_ASSIGN(F1Metric);
 };
 
+//------------------------------------------------------------------------------
+// AUCHistogram counts the positive and negative examples in the buckets
+// of the predicted probability. The AUC computed from the histogram is
+// exact up to the ties inside one bucket, so the bucket size controls
+// the accuracy, and the memory cost is fixed (8 bytes per bucket) no
+// matter how many examples we have. Histograms can be merged, and hence
+// each thread can keep its own histogram without any lock.
+//------------------------------------------------------------------------------
+struct AUCHistogram {
+  // Allocate buckets and set all of them to zero
+  void Resize(index_t bucket_size) {
+    positive_vec_.assign(bucket_size, 0);
+    negative_vec_.assign(bucket_size, 0);
+  }
+
+  // Set all of the buckets to zero
+  void Clear() {
+    std::fill(positive_vec_.begin(), positive_vec_.end(), 0);
+    std::fill(negative_vec_.begin(), negative_vec_.end(), 0);
+  }
+
+  // Add an example to the histogram
+  void Add(real_t score, real_t label) {
+    index_t bkt_id = GetBucket(score, positive_vec_.size());
+    if (label > 0) {
+      positive_vec_[bkt_id] += 1;
+    } else {
+      negative_vec_[bkt_id] += 1;
+    }
+  }
+
+  // Merge another histogram to this histogram
+  void Merge(const AUCHistogram& other) {
+    CHECK_EQ(positive_vec_.size(), other.positive_vec_.size());
+    for (size_t i = 0; i < positive_vec_.size(); ++i) {
+      positive_vec_[i] += other.positive_vec_[i];
+      negative_vec_[i] += other.negative_vec_[i];
+    }
+  }
+
+  // Return the AUC of current histogram
+  real_t AUC() const {
+    long long positive_sum = 0;
+    long long negative_sum = 0;
+    long long pre_positive_sum = 0;
+    double auc = 0.0;
+    for (size_t i = 0; i < positive_vec_.size(); ++i) {
+      pre_positive_sum = positive_sum;
+      positive_sum += positive_vec_[i];
+      negative_sum += negative_vec_[i];
+      auc += (pre_positive_sum + positive_sum) * 
+             (double)(negative_vec_[i]) * 1.0 / 2;
+    }
+    return 1.0 - auc / ((double)positive_sum * negative_sum);
+  }
+
+  // Map the score to a bucket
+  static index_t GetBucket(real_t score, index_t bucket_size) {
+    real_t sigmoid_score = fastsigmoid(score);
+    index_t bkt_id = index_t(sigmoid_score * bucket_size) % bucket_size;
+    CHECK_LT(bkt_id, bucket_size);
+    return bkt_id;
+  }
+
+  std::vector<index_t> positive_vec_;
+  std::vector<index_t> negative_vec_;
+};
+
+//------------------------------------------------------------------------------
+// SparseAUCHistogram is the sparse version of AUCHistogram, which only
+// stores the non-empty buckets. It is used by the group AUC, where
+// each group (user) only has a few examples.
+//------------------------------------------------------------------------------
+struct SparseAUCHistogram {
+  SparseAUCHistogram() : total_(0) { }
+
+  // Add an example to the histogram
+  void Add(real_t score, real_t label, index_t bucket_size) {
+    index_t bkt_id = AUCHistogram::GetBucket(score, bucket_size);
+    std::pair<index_t, index_t>& count = bucket_[bkt_id];
+    if (label > 0) {
+      count.first += 1;
+    } else {
+      count.second += 1;
+    }
+    total_++;
+  }
+
+  // Merge another histogram to this histogram
+  void Merge(const SparseAUCHistogram& other) {
+    for (auto iter = other.bucket_.begin(); 
+         iter != other.bucket_.end(); ++iter) {
+      std::pair<index_t, index_t>& count = bucket_[iter->first];
+      count.first += iter->second.first;
+      count.second += iter->second.second;
+    }
+    total_ += other.total_;
+  }
+
+  // Return the AUC of current histogram. Return false
+  // if all of the examples have the same label.
+  bool AUC(real_t* auc_val) const {
+    long long positive_sum = 0;
+    long long negative_sum = 0;
+    long long pre_positive_sum = 0;
+    double auc = 0.0;
+    for (auto iter = bucket_.begin(); iter != bucket_.end(); ++iter) {
+      pre_positive_sum = positive_sum;
+      positive_sum += iter->second.first;
+      negative_sum += iter->second.second;
+      auc += (pre_positive_sum + positive_sum) * 
+             (double)(iter->second.second) * 1.0 / 2;
+    }
+    if (positive_sum == 0 || negative_sum == 0) {
+      return false;
+    }
+    *auc_val = 1.0 - auc / ((double)positive_sum * negative_sum);
+    return true;
+  }
+
+  /* bucket id -> (positive count, negative count) */
+  std::map<index_t, std::pair<index_t, index_t> > bucket_;
+  /* Number of examples */
+  index_t total_;
+};
+
 //------------------------------------------------------------------------------
 // The area under the curve (often referred to as simply the AUC) is 
 // equal to the probability that a classifier will rank a randomly chosen 
 // positive instance higher than a randomly chosen negative one 
 // (assuming 'positive' ranks higher than 'negative').
+// Each thread accumulates examples into its own AUCHistogram, which is
+// allocated only once and merged only when we call GetMetric().
 //------------------------------------------------------------------------------
 class AUCMetric : public Metric {
- public:
-  struct Info {
-    Info() {
-      positive_vec_.resize(kMaxBucketSize, 0);
-      negative_vec_.resize(kMaxBucketSize, 0);
-    }
-    std::vector<index_t> positive_vec_;
-    std::vector<index_t> negative_vec_;
-  };
-
  public:
   // Constrcutor and Destructor
-  AUCMetric() {
-    all_positive_number_.clear();
-    all_negative_number_.clear();
-    all_positive_number_.resize(kMaxBucketSize, 0);
-    all_negative_number_.resize(kMaxBucketSize, 0);
+  AUCMetric() : hist_bytes_(0) { }
+  ~AUCMetric() {
+    MemoryTracker::Add(kMemMetric, -(int64)hist_bytes_);
   }
-  ~AUCMetric() { }
 
   // Calculate AUC in one thread
   static void auc_accum_thread(const std::vector<real_t>* Y,
                                const std::vector<real_t>* pred,
-                               Info* info,
+                               AUCHistogram* hist,
                                size_t start_idx,
                                size_t end_idx) {
     CHECK_GE(end_idx, start_idx);
     for (size_t i = start_idx; i < end_idx; ++i) {
-      real_t r_label = (*Y)[i] > 0 ? 1 : -1;
-      real_t sigmoid_score = fastsigmoid((*pred)[i]);
-      index_t bkt_id = index_t(sigmoid_score * kMaxBucketSize) 
-                       % kMaxBucketSize;
-      CHECK_LT(bkt_id, kMaxBucketSize);
-      if (r_label > 0) {
-        info->positive_vec_[bkt_id] += 1;
-      } else {
-        info->negative_vec_[bkt_id] += 1;
-      }
+      hist->Add((*pred)[i], (*Y)[i]);
     }
   }
 
@@ -515,41 +646,37 @@ class AUCMetric : public Metric {
   void Accumulate(const std::vector<real_t>& Y,
                   const std::vector<real_t>& pred) {
     CHECK_EQ(Y.size(), pred.size());
+    init_hist();
     // multi-thread
-    Info single_info;
-    std::vector<Info> info(threadNumber_, single_info);
     for (int i = 0; i < threadNumber_; ++i) {
       size_t start_idx = getStart(pred.size(), threadNumber_, i);
       size_t end_idx = getEnd(pred.size(), threadNumber_, i);
       pool_->enqueue(std::bind(auc_accum_thread,
                                &Y,
                                &pred,
-                               &(info[i]),
+                               &(hist_[i]),
                                start_idx,
                                end_idx));
     }
     // Wait all thread finish their job
     pool_->Sync(threadNumber_);
-    for (index_t i = 0; i < info.size(); ++i) {
-      for (index_t j = 0; j < kMaxBucketSize; ++j) {
-        all_positive_number_[j] += info[i].positive_vec_[j];
-        all_negative_number_[j] += info[i].negative_vec_[j];
-      }
-    } 
   }
   
   // Reset counters
   void Reset() {
-    all_positive_number_.clear();
-    all_negative_number_.clear();
-    all_positive_number_.resize(kMaxBucketSize, 0);
-    all_negative_number_.resize(kMaxBucketSize, 0);
+    for (size_t i = 0; i < hist_.size(); ++i) {
+      hist_[i].Clear();
+    }
   }
 
   // Return AUC
   real_t GetMetric() {
-    return CalcAUC(all_positive_number_, 
-                   all_negative_number_);
+    init_hist();
+    all_hist_.Resize(bucket_size_);
+    for (size_t i = 0; i < hist_.size(); ++i) {
+      all_hist_.Merge(hist_[i]);
+    }
+    return all_hist_.AUC();
   }
 
   // Metric type
@@ -563,34 +690,140 @@ class AUCMetric : public Metric {
   }
 
  protected:
-  std::vector<index_t> all_positive_number_;
-  std::vector<index_t> all_negative_number_;
-
-  real_t CalcAUC(std::vector<index_t> positive_vec,
-                 std::vector<index_t> negative_vec) {
-    CHECK_EQ(positive_vec.size(), negative_vec.size());
-    long long positive_sum = 0;
-    long long negative_sum= 0;
-    long long pre_positive_sum = 0.0;
-    long long positivesum_dot_negativesum = 0;
-    double auc = 0.0;
-    double auc_res = 0.0;
-    for (index_t i = 0; i < kMaxBucketSize; ++i) {
-      pre_positive_sum = positive_sum;
-      positive_sum += all_positive_number_[i];
-      negative_sum += all_negative_number_[i];
-      auc += (pre_positive_sum + positive_sum) * 
-             (double)(all_negative_number_[i]) * 1.0 / 2;
+  /* Histogram for each thread */
+  std::vector<AUCHistogram> hist_;
+  /* Merged histogram */
+  AUCHistogram all_hist_;
+  /* Bytes of the histograms counted by the MemoryTracker */
+  uint64 hist_bytes_;
+
+  // Allocate the histograms at the first call
+  void init_hist() {
+    if (hist_.size() != threadNumber_) {
+      hist_.resize(threadNumber_);
+      for (size_t i = 0; i < hist_.size(); ++i) {
+        hist_[i].Resize(bucket_size_);
+      }
+      // Including the merged histogram
+      uint64 bytes = (threadNumber_ + 1) * 2 *
+                     (uint64)bucket_size_ * sizeof(index_t);
+      MemoryTracker::Add(kMemMetric, (int64)bytes - (int64)hist_bytes_);
+      hist_bytes_ = bytes;
     }
-    positivesum_dot_negativesum = positive_sum * negative_sum;
-    auc_res = auc / (positivesum_dot_negativesum);
-    return 1.0 - auc_res;
   }
 
  private:
   DISALLOW_COPY_AND_ASSIGN(AUCMetric);
 };
 
+//------------------------------------------------------------------------------
+// Group AUC (GAUC) is the average of the AUC of each group (e.g., each
+// user) weighted by the number of examples in the group. The groups
+// that only have positive or negative examples are ignored. xLearn
+// uses the first feature of each example as its group id, so the user
+// id should be the first feature in the data file. Each thread keeps a
+// SparseAUCHistogram for each group, and they are merged in GetMetric().
+//------------------------------------------------------------------------------
+class GroupAUCMetric : public Metric {
+ public:
+  typedef std::unordered_map<index_t, SparseAUCHistogram> GroupHistogram;
+
+  // Constrcutor and Destructor
+  GroupAUCMetric() { }
+  ~GroupAUCMetric() { }
+
+  // Calculate group AUC in one thread
+  static void gauc_accum_thread(const DMatrix* matrix,
+                                const std::vector<real_t>* pred,
+                                GroupHistogram* hist,
+                                index_t bucket_size,
+                                size_t start_idx,
+                                size_t end_idx) {
+    CHECK_GE(end_idx, start_idx);
+    for (size_t i = start_idx; i < end_idx; ++i) {
+      SparseRow* row = matrix->row[i];
+      index_t group = row->empty() ? 0 : (*row)[0].feat_id;
+      (*hist)[group].Add((*pred)[i], matrix->Y[i], bucket_size);
+    }
+  }
+
+  // Group AUC needs the group id of each example.
+  void Accumulate(const std::vector<real_t>& Y,
+                  const std::vector<real_t>& pred) {
+    LOG(FATAL) << "Group AUC needs the data matrix to get the group id.";
+  }
+
+  // Accumulate counters during the training.
+  void AccumulateMatrix(const DMatrix* matrix,
+                        const std::vector<real_t>& pred) {
+    CHECK_NOTNULL(matrix);
+    CHECK_EQ(matrix->row_length, pred.size());
+    if (hist_.size() != threadNumber_) {
+      hist_.resize(threadNumber_);
+    }
+    // multi-thread
+    for (int i = 0; i < threadNumber_; ++i) {
+      size_t start_idx = getStart(pred.size(), threadNumber_, i);
+      size_t end_idx = getEnd(pred.size(), threadNumber_, i);
+      pool_->enqueue(std::bind(gauc_accum_thread,
+                               matrix,
+                               &pred,
+                               &(hist_[i]),
+                               bucket_size_,
+                               start_idx,
+                               end_idx));
+    }
+    // Wait all thread finish their job
+    pool_->Sync(threadNumber_);
+  }
+
+  // Reset counters
+  void Reset() {
+    for (size_t i = 0; i < hist_.size(); ++i) {
+      hist_[i].clear();
+    }
+  }
+
+  // Return group AUC
+  real_t GetMetric() {
+    GroupHistogram all_hist;
+    for (size_t i = 0; i < hist_.size(); ++i) {
+      for (auto iter = hist_[i].begin(); 
+           iter != hist_[i].end(); ++iter) {
+        all_hist[iter->first].Merge(iter->second);
+      }
+    }
+    double auc_sum = 0;
+    double weight_sum = 0;
+    for (auto iter = all_hist.begin(); 
+         iter != all_hist.end(); ++iter) {
+      real_t auc = 0;
+      if (iter->second.AUC(&auc)) {
+        auc_sum += auc * iter->second.total_;
+        weight_sum += iter->second.total_;
+      }
+    }
+    return weight_sum == 0 ? 0 : auc_sum / weight_sum;
+  }
+
+  // Metric type
+  std::string metric_type() {
+    return "GAUC";
+  }
+
+  // Compare two metric value
+  bool cmp(const real_t a, const real_t b) {
+    return a >= b ? true : false;
+  }
+
+ protected:
+  /* Histograms of each group for each thread */
+  std::vector<GroupHistogram> hist_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(GroupAUCMetric);
+};
+
  /*********************************************************
   *  For regression                                       *
   *********************************************************/
@@ -629,7 +862,8 @@ class MAEMetric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<real_t> sum(threadNumber_, 0);
+    ScratchScope scope;
+    real_t* sum = scope.AllocZero<real_t>(threadNumber_);
     for (int i = 0; i < threadNumber_; ++i) {
       size_t start_idx = getStart(pred.size(), threadNumber_, i);
       size_t end_idx = getEnd(pred.size(), threadNumber_, i);
@@ -642,7 +876,7 @@ class MAEMetric : public Metric {
     }
     // Wait all of the threads finish their job
     pool_->Sync(threadNumber_);
-    for (size_t i = 0; i < sum.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       error_ += sum[i];
     }
   }
@@ -708,7 +942,8 @@ class MAPEMetric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<real_t> sum(threadNumber_, 0);
+    ScratchScope scope;
+    real_t* sum = scope.AllocZero<real_t>(threadNumber_);
     for (int i = 0; i < threadNumber_; ++i) {
       size_t start_idx = getStart(pred.size(), threadNumber_, i);
       size_t end_idx = getEnd(pred.size(), threadNumber_, i);
@@ -721,7 +956,7 @@ class MAPEMetric : public Metric {
     }
     // Wait all of the threads finish their job
     pool_->Sync(threadNumber_);
-    for (size_t i = 0; i < sum.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       error_ += sum[i];
     }
   }
@@ -789,7 +1024,8 @@ class RMSDMetric : public Metric {
     CHECK_EQ(Y.size(), pred.size());
     total_example_ += Y.size();
     // multi-thread training
-    std::vector<real_t> sum(threadNumber_, 0);
+    ScratchScope scope;
+    real_t* sum = scope.AllocZero<real_t>(threadNumber_);
     for (int i = 0; i < threadNumber_; ++i) {
       size_t start_idx = getStart(pred.size(), threadNumber_, i);
       size_t end_idx = getEnd(pred.size(), threadNumber_, i);
@@ -802,7 +1038,7 @@ class RMSDMetric : public Metric {
     }
     // Wait all of the threads finish their job
     pool_->Sync(threadNumber_);
-    for (size_t i = 0; i < sum.size(); ++i) {
+    for (size_t i = 0; i < threadNumber_; ++i) {
       error_ += sum[i];
     }
   }
@@ -179,6 +179,75 @@ TEST(AUCMetricTest, auc_test) {
   EXPECT_EQ(metric.metric_type(), "AUC");
 }
 
+TEST(AUCMetricTest, auc_streaming_test) {
+  // Accumulate many mini-batches with a small bucket size
+  std::vector<real_t> Y;
+  std::vector<real_t> pred;
+  for (int i = 0; i < 1000; ++i) {
+    Y.push_back(i % 2 == 0 ? 1.0 : -1.0);
+    pred.push_back(i % 2 == 0 ? (i % 10) * 0.1 : (i % 10) * 0.1 - 0.25);
+  }
+  AUCMetric metric;
+  ThreadPool* pool = new ThreadPool(3);
+  metric.Initialize(pool, 1000);
+  for (int n = 0; n < 10; ++n) {
+    metric.Accumulate(Y, pred);
+  }
+  real_t metric_val = metric.GetMetric();
+  // GetMetric() does not change the counters
+  EXPECT_FLOAT_EQ(metric.GetMetric(), metric_val);
+  // Same result with one big batch
+  AUCMetric metric_all;
+  metric_all.Initialize(pool, 1000);
+  std::vector<real_t> Y_all;
+  std::vector<real_t> pred_all;
+  for (int n = 0; n < 10; ++n) {
+    Y_all.insert(Y_all.end(), Y.begin(), Y.end());
+    pred_all.insert(pred_all.end(), pred.begin(), pred.end());
+  }
+  metric_all.Accumulate(Y_all, pred_all);
+  EXPECT_FLOAT_EQ(metric_all.GetMetric(), metric_val);
+  // Scores are well separated, so the small
+  // bucket size still gives the exact AUC
+  AUCMetric metric_exact;
+  metric_exact.Initialize(pool);
+  metric_exact.Accumulate(Y, pred);
+  EXPECT_NEAR(metric_exact.GetMetric(), metric_val, 1e-4);
+  metric.Reset();
+  Y = {-1.0, -1.0, 1.0, 1.0};
+  pred = {0.1, 0.4, 0.35, 0.8};
+  metric.Accumulate(Y, pred);
+  EXPECT_FLOAT_EQ(metric.GetMetric(), 0.75);
+}
+
+TEST(GroupAUCMetricTest, gauc_test) {
+  // Group 0: auc = 0.75, Group 1: auc = 1.0, Group 2: only positive
+  index_t group[10] = {0, 0, 0, 0, 1, 1, 1, 1, 2, 2};
+  real_t label[10] = {-1, -1, 1, 1, -1, 1, 1, -1, 1, 1};
+  real_t score[10] = {0.1, 0.4, 0.35, 0.8, -2, 3, 4, -1, 1, 2};
+  DMatrix matrix;
+  std::vector<real_t> pred;
+  for (index_t i = 0; i < 10; ++i) {
+    matrix.AddRow();
+    matrix.AddNode(i, group[i], 1.0);
+    matrix.AddNode(i, 100+i, 1.0);
+    matrix.Y[i] = label[i];
+    pred.push_back(score[i]);
+  }
+  GroupAUCMetric metric;
+  ThreadPool* pool = new ThreadPool(3);
+  metric.Initialize(pool);
+  metric.AccumulateMatrix(&matrix, pred);
+  real_t metric_val = metric.GetMetric();
+  EXPECT_FLOAT_EQ(metric_val, (0.75*4 + 1.0*4) / 8);
+  // Accumulate twice gives the same result
+  metric.AccumulateMatrix(&matrix, pred);
+  EXPECT_FLOAT_EQ(metric.GetMetric(), metric_val);
+  metric.Reset();
+  EXPECT_FLOAT_EQ(metric.GetMetric(), 0);
+  EXPECT_EQ(metric.metric_type(), "GAUC");
+}
+
 TEST(MAEMetricTest, mae_test) {
   std::vector<real_t> Y;
   Y.push_back(12);
@@ -288,6 +357,7 @@ TEST(MetricTest, Create_Metric) {
   EXPECT_TRUE(CreateMetric("recall") != NULL);
   EXPECT_TRUE(CreateMetric("f1") != NULL);
   EXPECT_TRUE(CreateMetric("auc") != NULL);
+  EXPECT_TRUE(CreateMetric("gauc") != NULL);
   EXPECT_TRUE(CreateMetric("mae") != NULL);
   EXPECT_TRUE(CreateMetric("mape") != NULL);
   EXPECT_TRUE(CreateMetric("rmsd") != NULL);
@@ -19,6 +19,7 @@ This file is the implementation of SquaredLoss class.
 */
 
 #include "src/loss/squared_loss.h"
+#include "src/base/profiler.h"
 
 namespace xLearn {
 
@@ -56,7 +57,8 @@ void SquaredLoss::Evalute(const std::vector<real_t>& pred,
   CHECK_NE(label.empty(), true);
   total_example_ += pred.size();
   // multi-thread training
-  std::vector<real_t> sum(threadNumber_, 0);
+  ScratchScope scope;
+  real_t* sum = scope.AllocZero<real_t>(threadNumber_);
   for (int i = 0; i < threadNumber_; ++i) {
     size_t start_idx = getStart(pred.size(), threadNumber_, i);
     size_t end_idx = getEnd(pred.size(), threadNumber_, i);
@@ -70,7 +72,7 @@ void SquaredLoss::Evalute(const std::vector<real_t>& pred,
   // Wait all of the threads finish their job
   pool_->Sync(threadNumber_);
   // Accumulate loss
-  for (size_t i = 0; i < sum.size(); ++i) {
+  for (size_t i = 0; i < threadNumber_; ++i) {
     loss_sum_ += sum[i];
   }
 }
@@ -84,6 +86,7 @@ void sq_gradient_thread(const DMatrix* matrix,
                         index_t start,
                         index_t end) {
   CHECK_GE(end, start);
+  ProfileScope scope(kPhaseGrad);
   *sum = 0;
   for (size_t i = start; i < end; ++i) {
     SparseRow* row = matrix->row[i];
@@ -117,10 +120,16 @@ void SquaredLoss::CalcGrad(const DMatrix* matrix,
                            Model& model) {
   CHECK_NOTNULL(matrix);
   CHECK_GT(matrix->row_length, 0);
+  // The sparse model is trained on a dense copy of its rows
+  if (model.IsSparse()) {
+    calc_grad_sparse(matrix, model);
+    return;
+  }
   size_t row_len = matrix->row_length;
   total_example_ += row_len;
   int count = lock_free_ ? threadNumber_ : 1;
-  std::vector<real_t> sum(count, 0);
+  ScratchScope scope;
+  real_t* sum = scope.AllocZero<real_t>(count);
   for (int i = 0; i < count; ++i) {
     size_t start = getStart(row_len, count, i);
     size_t end = getEnd(row_len, count, i);
@@ -136,7 +145,7 @@ void SquaredLoss::CalcGrad(const DMatrix* matrix,
   // Wait all of the threads finish their job
   pool_->Sync(count);
   // Accumulate loss
-  for (int i = 0; i < sum.size(); ++i) {
+  for (int i = 0; i < count; ++i) {
     loss_sum_ += sum[i];
   }
 }
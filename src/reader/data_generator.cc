@@ -0,0 +1,178 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of the DataGenerator class.
+*/
+
+#include "src/reader/data_generator.h"
+
+#include <math.h>
+#include <stdio.h>
+
+#include <algorithm>
+
+#include "src/base/file_util.h"
+#include "src/base/logging.h"
+
+namespace xLearn {
+
+// Bias of the hidden model, which gives about 25% positive rows
+static const real_t kHiddenBias = -1.5;
+
+// Buffer size (byte) used to write the data set
+static const size_t kGeneratorBufferSize = 4 * 1024 * 1024;
+
+// A normal random number hashed from the feature id and the dimension
+static real_t hash_normal(index_t id, index_t d) {
+  uint64 h = ((uint64)id << 8 | d) + 0x9E3779B97F4A7C15ULL;
+  h = (h ^ (h >> 30)) * 0xBF58476D1CE4E5B9ULL;
+  h = (h ^ (h >> 27)) * 0x94D049BB133111EBULL;
+  h = h ^ (h >> 31);
+  // Box-Muller transform of two uniform numbers in (0, 1]
+  double u1 = ((h >> 32) + 1.0) / 4294967296.0;
+  double u2 = ((h & 0xFFFFFFFF) + 1.0) / 4294967296.0;
+  return sqrt(-2.0 * log(u1)) * cos(2.0 * M_PI * u2);
+}
+
+// Invoke this function before Write()
+void DataGenerator::Initialize(index_t num_row,
+                               index_t num_field,
+                               index_t feat_per_field,
+                               real_t avg_nnz,
+                               real_t zipf,
+                               uint32 seed,
+                               bool fixed_nnz) {
+  CHECK_GT(num_field, 0);
+  CHECK_GT(feat_per_field, 0);
+  CHECK_GE(avg_nnz, 1);
+  CHECK_GE(zipf, 0);
+  num_row_ = num_row;
+  num_field_ = num_field;
+  feat_per_field_ = feat_per_field;
+  avg_nnz_ = avg_nnz;
+  fixed_nnz_ = fixed_nnz;
+  seed_ = seed;
+  generator_.seed(seed_);
+  zipf_cdf_.resize(feat_per_field_);
+  double sum = 0;
+  for (index_t r = 0; r < feat_per_field_; ++r) {
+    sum += pow(r + 1.0, -zipf);
+    zipf_cdf_[r] = sum;
+  }
+  for (index_t r = 0; r < feat_per_field_; ++r) {
+    zipf_cdf_[r] /= sum;
+  }
+}
+
+// Draw the rank of a feature in its field
+index_t DataGenerator::draw_rank() {
+  std::uniform_real_distribution<double> uniform(0, 1);
+  double u = uniform(generator_);
+  index_t r = std::upper_bound(zipf_cdf_.begin(), zipf_cdf_.end(), u) -
+              zipf_cdf_.begin();
+  return std::min(r, feat_per_field_ - 1);
+}
+
+// Generate the next row of the data set, and its label
+void DataGenerator::NextRow(SparseRow* row, real_t* label) {
+  CHECK_NOTNULL(row);
+  CHECK_NOTNULL(label);
+  index_t nnz = (index_t)(avg_nnz_ + 0.5);
+  if (!fixed_nnz_) {
+    std::poisson_distribution<index_t> poisson(avg_nnz_ - 1);
+    nnz = 1 + poisson(generator_);
+  }
+  row->clear();
+  // The hidden FM model, where the latent factor is scaled by
+  // 1 / sqrt(nnz) to keep the score in a small range
+  real_t score = kHiddenBias;
+  real_t scale = 1.0 / sqrt(avg_nnz_);
+  real_t sum[kGeneratorK] = { 0 };
+  for (index_t n = 0; n < nnz; ++n) {
+    index_t field = n % num_field_;
+    index_t feat = field * feat_per_field_ + draw_rank();
+    row->push_back(Node(field, feat, 1.0));
+    score += hash_normal(feat, kGeneratorK) * 0.5;
+    for (index_t d = 0; d < kGeneratorK; ++d) {
+      real_t v = hash_normal(feat, d) * scale;
+      score -= 0.5 * v * v;
+      sum[d] += v;
+    }
+  }
+  for (index_t d = 0; d < kGeneratorK; ++d) {
+    score += 0.5 * sum[d] * sum[d];
+  }
+  std::uniform_real_distribution<real_t> uniform(0, 1);
+  real_t p = 1.0 / (1.0 + exp(-score));
+  *label = uniform(generator_) < p ? 1 : 0;
+}
+
+// Write the data set to a file
+uint64 DataGenerator::Write(const std::string& filename,
+                            const std::string& format) {
+  CHECK(format == "libsvm" || format == "libffm" || format == "csv");
+  Reset();
+#ifndef _MSC_VER
+  FILE* file = OpenFileOrDie(filename.c_str(), "w");
+#else
+  FILE* file = OpenFileOrDie(filename.c_str(), "wb");
+#endif
+  std::string buf;
+  buf.reserve(kGeneratorBufferSize + 4096);
+  uint64 total = 0;
+  SparseRow row;
+  real_t label = 0;
+  std::vector<real_t> column(num_field_);
+  char str[64];
+  for (index_t i = 0; i < num_row_; ++i) {
+    NextRow(&row, &label);
+    buf.push_back(label > 0 ? '1' : '0');
+    if (format == "csv") {
+      std::fill(column.begin(), column.end(), 0);
+      for (size_t n = row.size(); n > 0; --n) {
+        const Node& node = row[n-1];
+        index_t rank = node.feat_id - node.field_id * feat_per_field_;
+        column[node.field_id] = log(2.0 + rank);
+      }
+      for (index_t f = 0; f < num_field_; ++f) {
+        int len = snprintf(str, sizeof(str), ",%.4g", column[f]);
+        buf.append(str, len);
+      }
+    } else {
+      for (size_t n = 0; n < row.size(); ++n) {
+        int len = format == "libsvm" ?
+          snprintf(str, sizeof(str), " %u:1", row[n].feat_id) :
+          snprintf(str, sizeof(str), " %u:%u:1",
+                   row[n].field_id, row[n].feat_id);
+        buf.append(str, len);
+      }
+    }
+    buf.push_back('\n');
+    if (buf.size() >= kGeneratorBufferSize) {
+      total += WriteDataToDisk(file, buf.data(), buf.size());
+      buf.clear();
+    }
+  }
+  if (!buf.empty()) {
+    total += WriteDataToDisk(file, buf.data(), buf.size());
+  }
+  Close(file);
+  return total;
+}
+
+}  // namespace xLearn
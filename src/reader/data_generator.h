@@ -0,0 +1,118 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the DataGenerator class, which writes a
+synthetic CTR data set for benchmarks.
+*/
+
+#ifndef XLEARN_READER_DATA_GENERATOR_H_
+#define XLEARN_READER_DATA_GENERATOR_H_
+
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+// Latent dimension of the hidden FM model which gives the labels.
+const index_t kGeneratorK = 4;
+
+//------------------------------------------------------------------------------
+// DataGenerator writes a synthetic CTR data set in libsvm, libffm or csv
+// format, so that the benchmarks do not need a private data set. Each row
+// has nnz features, where nnz is 1 + Poisson(avg_nnz - 1) (or exactly
+// avg_nnz if fixed_nnz is true). The node n of a row is in the field
+// n % num_field, and each field has feat_per_field features whose
+// popularity follows a Zipf distribution: the feature of rank r is
+// drawn with probability ~ 1 / (r + 1)^zipf. The feature id is
+// field * feat_per_field + r, and the value is 1. The label (0 or 1) is
+// sampled from a hidden FM model, so that the data can be learned, and
+// the parameters of the hidden model are hashed from the feature id. The
+// csv file has one numeric column per field, i.e., log(2 + r) of the
+// first feature of the field in the row, or 0 if the field is empty.
+// The same seed always gives the same file. We can use it like this:
+//
+//   DataGenerator gen;
+//   gen.Initialize(1000000, 10, 100000, 20, 1.1, 1);
+//   gen.Write("./train.txt", "libffm");
+//
+//------------------------------------------------------------------------------
+class DataGenerator {
+ public:
+  // Constructor and Destructor
+  DataGenerator()
+   : num_row_(0),
+     num_field_(1),
+     feat_per_field_(1),
+     avg_nnz_(1),
+     fixed_nnz_(false),
+     seed_(1) { }
+  ~DataGenerator() { }
+
+  // Invoke this function before Write().
+  void Initialize(index_t num_row,
+                  index_t num_field,
+                  index_t feat_per_field,
+                  real_t avg_nnz,
+                  real_t zipf,
+                  uint32 seed,
+                  bool fixed_nnz = false);
+
+  // Write the data set to a file in the format of "libsvm", "libffm"
+  // or "csv". Return the size (byte) of the file.
+  uint64 Write(const std::string& filename, const std::string& format);
+
+  // Generate the next row of the data set, and its label (0 or 1).
+  void NextRow(SparseRow* row, real_t* label);
+
+  // Restart from the first row.
+  void Reset() { generator_.seed(seed_); }
+
+  // Number of features in all of the fields.
+  inline index_t GetNumFeature() { return num_field_ * feat_per_field_; }
+
+ protected:
+  /* Number of rows of Write() */
+  index_t num_row_;
+  /* Number of fields */
+  index_t num_field_;
+  /* Number of features of each field */
+  index_t feat_per_field_;
+  /* Average number of features in a row */
+  real_t avg_nnz_;
+  /* Each row has exactly avg_nnz features */
+  bool fixed_nnz_;
+  /* Random seed of the rows */
+  uint32 seed_;
+  std::mt19937 generator_;
+  /* CDF of the Zipf distribution of the feature rank */
+  std::vector<double> zipf_cdf_;
+
+  // Draw the rank of a feature in its field.
+  index_t draw_rank();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(DataGenerator);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_READER_DATA_GENERATOR_H_
@@ -0,0 +1,129 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests the DataGenerator class.
+*/
+
+#include "gtest/gtest.h"
+
+#include <string>
+#include <vector>
+
+#include "src/reader/data_generator.h"
+#include "src/reader/parser.h"
+#include "src/base/file_util.h"
+
+namespace xLearn {
+
+const std::string kGenFile = "./test_data_generator.txt";
+const index_t kGenRow = 20000;
+const index_t kGenField = 8;
+const index_t kGenFeat = 1000;
+const real_t kGenNnz = 12;
+
+// Parse the file written by the generator
+void parse_file(Parser* parser, DMatrix* matrix) {
+  char* buffer = nullptr;
+  uint64 size = ReadFileToMemory(kGenFile, &buffer);
+  parser->setLabel(true);
+  parser->Parse(buffer, size, *matrix, true);
+  delete [] buffer;
+}
+
+TEST(DATA_GENERATOR_TEST, Write_libsvm_and_libffm) {
+  DataGenerator gen;
+  gen.Initialize(kGenRow, kGenField, kGenFeat, kGenNnz, 1.1, 7);
+  EXPECT_EQ(gen.GetNumFeature(), kGenField * kGenFeat);
+  std::string format[2] = { "libsvm", "libffm" };
+  for (int i = 0; i < 2; ++i) {
+    uint64 size = gen.Write(kGenFile, format[i]);
+    FILE* file = OpenFileOrDie(kGenFile.c_str(), "r");
+    EXPECT_EQ(GetFileSize(file), size);
+    Close(file);
+    DMatrix matrix;
+    Parser* parser = i == 0 ? (Parser*)new LibsvmParser() :
+                              (Parser*)new FFMParser();
+    parser->setSplitor(" ");
+    parse_file(parser, &matrix);
+    ASSERT_EQ(matrix.row_length, kGenRow);
+    uint64 nnz = 0, positive = 0, head = 0, tail = 0;
+    for (index_t r = 0; r < matrix.row_length; ++r) {
+      EXPECT_TRUE(matrix.Y[r] == 0 || matrix.Y[r] == 1);
+      positive += matrix.Y[r] > 0;
+      SparseRow* row = matrix.row[r];
+      nnz += row->size();
+      for (size_t n = 0; n < row->size(); ++n) {
+        index_t field = n % kGenField;
+        index_t feat = (*row)[n].feat_id;
+        EXPECT_GE(feat, field * kGenFeat);
+        EXPECT_LT(feat, (field + 1) * kGenFeat);
+        EXPECT_FLOAT_EQ((*row)[n].feat_val, 1.0);
+        if (i == 1) {
+          EXPECT_EQ((*row)[n].field_id, field);
+        }
+        head += feat % kGenFeat == 0;
+        tail += feat % kGenFeat == kGenFeat - 1;
+      }
+    }
+    // Average nnz and a skewed popularity of the features
+    EXPECT_NEAR((real_t)nnz / kGenRow, kGenNnz, 0.2);
+    EXPECT_GT(head, tail * 100);
+    // Both of the labels are present
+    EXPECT_GT(positive, kGenRow / 20);
+    EXPECT_LT(positive, kGenRow * 19 / 20);
+    delete parser;
+  }
+  RemoveFile(kGenFile.c_str());
+}
+
+TEST(DATA_GENERATOR_TEST, Write_csv_and_fixed_nnz) {
+  DataGenerator gen;
+  gen.Initialize(kGenRow, kGenField, kGenFeat, kGenField, 1.1, 7, true);
+  gen.Write(kGenFile, "csv");
+  DMatrix matrix;
+  CSVParser parser;
+  parser.setSplitor(",");
+  parse_file(&parser, &matrix);
+  ASSERT_EQ(matrix.row_length, kGenRow);
+  for (index_t r = 0; r < matrix.row_length; ++r) {
+    ASSERT_EQ(matrix.row[r]->size(), kGenField);
+    for (index_t f = 0; f < kGenField; ++f) {
+      EXPECT_GE((*matrix.row[r])[f].feat_val, 0.69);
+    }
+  }
+  RemoveFile(kGenFile.c_str());
+}
+
+TEST(DATA_GENERATOR_TEST, Same_seed_same_rows) {
+  DataGenerator gen_1, gen_2;
+  gen_1.Initialize(0, kGenField, kGenFeat, kGenNnz, 1.1, 3);
+  gen_2.Initialize(0, kGenField, kGenFeat, kGenNnz, 1.1, 3);
+  SparseRow row_1, row_2;
+  real_t y_1, y_2;
+  for (int i = 0; i < 1000; ++i) {
+    gen_1.NextRow(&row_1, &y_1);
+    gen_2.NextRow(&row_2, &y_2);
+    ASSERT_EQ(row_1.size(), row_2.size());
+    EXPECT_EQ(y_1, y_2);
+    for (size_t n = 0; n < row_1.size(); ++n) {
+      EXPECT_EQ(row_1[n].feat_id, row_2[n].feat_id);
+    }
+  }
+}
+
+}  // namespace xLearn
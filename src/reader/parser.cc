@@ -67,7 +67,7 @@ uint64 Parser::get_line_from_buffer(char* line,
 // LibsvmParser parses the following data format:
 // [y1 idx:value idx:value ...]
 // [y2 idx:value idx:value ...]
-// idx can start from 0
+// idx can start from 0, or be a raw key in hashing mode
 //------------------------------------------------------------------------------
 void LibsvmParser::Parse(char* buf, 
                          uint64 size, 
@@ -103,7 +103,7 @@ void LibsvmParser::Parse(char* buf,
       char *idx_char = strtok(line_buf, ":");
       char *value_char = strtok(nullptr, splitor_.c_str());
       if (idx_char != nullptr && *idx_char != '\n') {
-        index_t idx = atoi(idx_char);
+        index_t idx = get_feature(idx_char, 0);
         real_t value = atof(value_char);
         matrix.AddNode(i, idx, value);
         norm += value*value;
@@ -116,7 +116,7 @@ void LibsvmParser::Parse(char* buf,
       if (idx_char == nullptr || *idx_char == '\n') {
         break;
       }
-      index_t idx = atoi(idx_char);
+      index_t idx = get_feature(idx_char, 0);
       real_t value = atof(value_char);
       matrix.AddNode(i, idx, value);
       norm += value*value;
@@ -130,7 +130,7 @@ void LibsvmParser::Parse(char* buf,
 // FFMParser parses the following data format:
 // [y1 field:idx:value field:idx:value ...]
 // [y2 field:idx:value field:idx:value ...]
-// idx can start from 0
+// idx can start from 0, or be a raw key in hashing mode
 //------------------------------------------------------------------------------
 void FFMParser::Parse(char* buf, 
                       uint64 size, 
@@ -165,9 +165,9 @@ void FFMParser::Parse(char* buf,
       char *idx_char = strtok(nullptr, ":");
       char *value_char = strtok(nullptr, splitor_.c_str());
       if (idx_char != nullptr && *idx_char != '\n') {
-        index_t idx = atoi(idx_char);
-        real_t value = atof(value_char);
         index_t field_id = atoi(field_char);
+        index_t idx = get_feature(idx_char, field_id);
+        real_t value = atof(value_char);
         matrix.AddNode(i, idx, value, field_id);
         norm += value*value;
       }
@@ -180,9 +180,9 @@ void FFMParser::Parse(char* buf,
       if (field_char == nullptr || *field_char == '\n') {
         break;
       }
-      index_t idx = atoi(idx_char);
-      real_t value = atof(value_char);
       index_t field_id = atoi(field_char);
+      index_t idx = get_feature(idx_char, field_id);
+      real_t value = atof(value_char);
       matrix.AddNode(i, idx, value, field_id);
       norm += value*value;
     }
@@ -22,6 +22,8 @@ datasets to the DMatrix.
 #ifndef XLEARN_READER_PARSER_H_
 #define XLEARN_READER_PARSER_H_
 
+#include <stdlib.h>
+
 #include <vector>
 #include <string>
 
@@ -31,6 +33,24 @@ datasets to the DMatrix.
 
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// Hash a raw feature key by 64-bit FNV-1a followed by the murmur3
+// finalizer, which spreads the short numeric keys over all of the bits.
+//------------------------------------------------------------------------------
+inline uint64 HashFeature(const char* key, uint64 seed) {
+  uint64 h = 14695981039346656037ULL ^ (seed * 0x9e3779b97f4a7c15ULL);
+  for (; *key != '\0'; ++key) {
+    h ^= (unsigned char)(*key);
+    h *= 1099511628211ULL;
+  }
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
 //------------------------------------------------------------------------------
 // Given a memory buffer, parse it to the DMatrix format.
 // Parser is an abstract class, which can be implemented by real
@@ -55,7 +75,7 @@ namespace xLearn {
 //------------------------------------------------------------------------------
 class Parser {
  public:
-  Parser() { }
+  Parser() : hash_buckets_(0), hash_field_(false) { }
   virtual ~Parser() {  }
 
   // Wether this dataset contains label y ?
@@ -68,6 +88,16 @@ class Parser {
     splitor_ = splitor;
   }
 
+  // Hashing trick. If buckets > 0, the feature index is read as
+  // a raw key (any string without ':', e.g., a 64-bit id) and is
+  // hashed into [0, buckets). If field_space is true, the field id
+  // is mixed into the hash, so that each field has its own sub-space
+  // and the same key in two fields maps to different features.
+  inline void setHash(index_t buckets, bool field_space) {
+    hash_buckets_ = buckets;
+    hash_field_ = field_space;
+  }
+
   // The real parse function invoked by users.
   // If reset == true, Parser will invoke matrix.Reset();
   virtual void Parse(char* buf, 
@@ -87,6 +117,16 @@ class Parser {
    bool has_label_;
    /* Split string for data items */
    std::string splitor_;
+   /* Number of hash buckets. 0 means no hashing */
+   index_t hash_buckets_;
+   /* Mix the field id into the hash */
+   bool hash_field_;
+
+   // Map the feature index (or raw key) to feature id.
+   inline index_t get_feature(const char* key, index_t field) {
+     if (hash_buckets_ == 0) { return atoi(key); }
+     return HashFeature(key, hash_field_ ? field + 1 : 0) % hash_buckets_;
+   }
 
  private:
   DISALLOW_COPY_AND_ASSIGN(Parser);
@@ -280,6 +280,50 @@ TEST(PARSER_TEST, Parse_csv_comma) {
   RemoveFile(Kfilename.c_str());
 }
 
+TEST(PARSER_TEST, Parse_hash) {
+  std::string data = "1 1:user_17:1 2:18446744073709551615:1 "
+                     "3:user_17:1 1:user_18:1\n";
+  char* buffer = const_cast<char*>(data.data());
+  const index_t buckets = 1000;
+  // Without field sub-space
+  DMatrix matrix;
+  FFMParser parser;
+  parser.setLabel(true);
+  parser.setSplitor(" ");
+  parser.setHash(buckets, false);
+  parser.Parse(buffer, data.size(), matrix, true);
+  EXPECT_EQ(matrix.row_length, 1);
+  SparseRow* row = matrix.row[0];
+  EXPECT_EQ(row->size(), 4);
+  for (size_t i = 0; i < row->size(); ++i) {
+    EXPECT_LT((*row)[i].feat_id, buckets);
+  }
+  EXPECT_EQ((*row)[0].feat_id, HashFeature("user_17", 0) % buckets);
+  EXPECT_EQ((*row)[0].feat_id, (*row)[2].feat_id);
+  EXPECT_NE((*row)[0].feat_id, (*row)[3].feat_id);
+  EXPECT_EQ((*row)[2].field_id, 3);
+  // With field sub-space the same key in different field is
+  // mapped to a different feature
+  parser.setHash(buckets, true);
+  parser.Parse(buffer, data.size(), matrix, true);
+  row = matrix.row[0];
+  EXPECT_EQ((*row)[0].feat_id, HashFeature("user_17", 2) % buckets);
+  EXPECT_NE((*row)[0].feat_id, (*row)[2].feat_id);
+  // libsvm
+  std::string data_svm = "0 a:1 b:2 a:3\n";
+  LibsvmParser parser_svm;
+  parser_svm.setLabel(true);
+  parser_svm.setSplitor(" ");
+  parser_svm.setHash(buckets, true);
+  parser_svm.Parse(const_cast<char*>(data_svm.data()),
+                   data_svm.size(), matrix, true);
+  row = matrix.row[0];
+  EXPECT_EQ(row->size(), 3);
+  EXPECT_EQ((*row)[0].feat_id, HashFeature("a", 1) % buckets);
+  EXPECT_EQ((*row)[0].feat_id, (*row)[2].feat_id);
+  EXPECT_FLOAT_EQ((*row)[1].feat_val, 2);
+}
+
 Parser* CreateParser(const char* format_name) {
   return CREATE_PARSER(format_name);
 }
@@ -21,11 +21,13 @@ This file is the implementation of Reader class.
 #include "src/reader/reader.h"
 
 #include <string.h>
-#include <algorithm> // for random_shuffle
+#include <algorithm> // for shuffle
 
 #include "src/base/file_util.h"
 #include "src/base/split_string.h"
 #include "src/base/format_print.h"
+#include "src/base/memory_tracker.h"
+#include "src/base/profiler.h"
 
 namespace xLearn {
 
@@ -115,6 +117,33 @@ void Reader::shrink_block(char* block, size_t* ret, FILE* file) {
   *ret = index + 1;
 }
 
+// Allocate the block buffer
+void Reader::alloc_block() {
+  free_block();
+  block_ = (char*)malloc(block_size_*1024*1024);
+  if (block_ == nullptr) {
+    LOG(FATAL) << "Cannot allocate enough memory for data  \
+                   block. Block size: " 
+               << block_size_ << "MB. "
+               << "You set change the block size via configuration.";
+  }
+  MemoryTracker::Add(kMemBuffer, block_size_*1024*1024);
+}
+
+// Release the block buffer
+void Reader::free_block() {
+  if (block_ == nullptr) { return; }
+  free(block_);
+  block_ = nullptr;
+  MemoryTracker::Add(kMemBuffer, -(int64)(block_size_*1024*1024));
+}
+
+// Count the memory of the loaded data
+void Reader::set_data_bytes(uint64 bytes) {
+  MemoryTracker::Add(kMemData, (int64)bytes - (int64)data_bytes_);
+  data_bytes_ = bytes;
+}
+
 //------------------------------------------------------------------------------
 // Implementation of InmemReader
 //------------------------------------------------------------------------------
@@ -137,7 +166,7 @@ void InmemReader::Initialize(const std::string& filename) {
                    "Skip converting text to binary.",
                    filename_.c_str())
     );
-    filename_ += ".bin";
+    filename_ = bin_file_name(filename_);
     init_from_binary();
   } else {
     Color::print_info(
@@ -146,14 +175,7 @@ void InmemReader::Initialize(const std::string& filename) {
                    filename_.c_str())
     );
     // Allocate memory for block
-    try {
-      this->block_ = (char*)malloc(block_size_*1024*1024);
-    } catch (std::bad_alloc&) {
-      LOG(FATAL) << "Cannot allocate enough memory for data  \
-                     block. Block size: " 
-                 << block_size_ << "MB. "
-                 << "You set change the block size via configuration.";
-    }
+    alloc_block();
     init_from_txt();
   }
 }
@@ -162,7 +184,7 @@ void InmemReader::Initialize(const std::string& filename) {
 // We use double check here, that is, we first check 
 // the hash value of a small data block, then check the whole file.
 bool InmemReader::hash_binary(const std::string& filename) {
-  std::string bin_file = filename + ".bin";
+  std::string bin_file = bin_file_name(filename);
   // If the ".bin" file does not exists, return false.
   if (!FileExist(bin_file.c_str())) { return false; }
 #ifndef _MSC_VER
@@ -196,6 +218,8 @@ void InmemReader::init_from_binary() {
   // Init data_samples_
   num_samples_ = data_buf_.row_length;
   data_samples_.ReAlloc(num_samples_);
+  set_data_bytes(data_buf_.MemoryBytes() +
+                 data_samples_.MemoryBytes(false));
   // for shuffle
   order_.resize(num_samples_);
   for (int i = 0; i < order_.size(); ++i) {
@@ -229,6 +253,8 @@ void InmemReader::init_from_txt() {
       // Find the last '\n', and shrink back file pointer
       this->shrink_block(block_, &ret, file);
     } // else ret < read_byte: we don't need shrink_block()
+    ProfileScope scope(kPhaseParse);
+    Profiler::AddCount(kCountByte, ret);
     parser_->Parse(block_, ret, data_buf_, false);
   }
   data_buf_.SetHash(HashFile(filename_, true),
@@ -237,6 +263,8 @@ void InmemReader::init_from_txt() {
   // Init data_samples_ 
   num_samples_ = data_buf_.row_length;
   data_samples_.ReAlloc(num_samples_, has_label_);
+  set_data_bytes(data_buf_.MemoryBytes() +
+                 data_samples_.MemoryBytes(false));
   // for shuffle
   order_.resize(num_samples_);
   for (int i = 0; i < order_.size(); ++i) {
@@ -244,10 +272,10 @@ void InmemReader::init_from_txt() {
   }
   // Deserialize in-memory buffer to disk file.
   if (bin_out_) {
-    std::string bin_file = filename_ + ".bin";
+    std::string bin_file = bin_file_name(filename_);
     data_buf_.Serialize(bin_file);
   }
-  delete [] block_;
+  free_block();
   Close(file);
 }
 
@@ -258,8 +286,7 @@ index_t InmemReader::Samples(DMatrix* &matrix) {
       // End of the data buffer
       if (i == 0) {
         if (shuffle_) {
-          srand(this->seed_+1);
-          random_shuffle(order_.begin(), order_.end());
+          std::shuffle(order_.begin(), order_.end(), rng_);
         }
         matrix = nullptr;
         return 0;
@@ -294,14 +321,7 @@ void OndiskReader::Initialize(const std::string& filename) {
   // Set splitor
   parser_->setSplitor(this->splitor_);
   // Allocate memory for block
-  try {
-    this->block_ = (char*)malloc(block_size_*1024*1024);
-  } catch (std::bad_alloc&) {
-    LOG(FATAL) << "Cannot allocate enough memory for data  \
-                   block. Block size: " 
-               << block_size_ << "MB. "
-               << "You set change the block size via configuration.";
-  }
+  alloc_block();
   // Open file
 #ifndef _MSC_VER
   file_ptr_ = OpenFileOrDie(filename_.c_str(), "r");
@@ -332,6 +352,8 @@ index_t OndiskReader::Samples(DMatrix* &matrix) {
     shrink_block(block_, &ret, file_ptr_);
   } // else ret < read_byte: we don't need shrink_block()
   // Parse block to data_sample_
+  ProfileScope scope(kPhaseParse);
+  Profiler::AddCount(kCountByte, ret);
   parser_->Parse(block_, ret, data_samples_, true);
   matrix = &data_samples_;
   return data_samples_.row_length;
@@ -356,8 +378,7 @@ index_t FromDMReader::Samples(DMatrix* &matrix) {
       // End of the data buffer
       if (i == 0) {
         if (shuffle_) {
-          srand(this->seed_+1);
-          random_shuffle(order_.begin(), order_.end());
+          std::shuffle(order_.begin(), order_.end(), rng_);
         }
         matrix = nullptr;
         return 0;
@@ -26,6 +26,7 @@ reading data from data source.
 #include <vector>
 #include <thread>
 #include <algorithm>
+#include <random>
 
 #include "src/base/common.h"
 #include "src/base/class_register.h"
@@ -79,8 +80,13 @@ class Reader {
   Reader() : 
     shuffle_(false), 
     bin_out_(true),
-    block_size_(kDefautBlockSize) {  }
-  virtual ~Reader() {  }
+    block_size_(kDefautBlockSize),
+    hash_buckets_(0),
+    hash_field_(false) {  }
+  virtual ~Reader() {
+    free_block();
+    set_data_bytes(0);
+  }
 
   // We need to invoke the Initialize() function before
   // we start to sample data. We can shuffle data before 
@@ -120,6 +126,14 @@ class Reader {
   // Set random see
   void SetSeed(int seed) {
     seed_ = seed;
+    rng_.seed(seed_);
+  }
+
+  // Hash the raw feature keys into buckets (see Parser::setHash).
+  // Must be invoked before Initialize().
+  void SetFeatureHash(index_t buckets, bool field_space) {
+    hash_buckets_ = buckets;
+    hash_field_ = field_space;
   }
 
   // If shuffle data ?
@@ -145,11 +159,19 @@ class Reader {
   /* Split string for data items */
   std::string splitor_;
   /* A block of memory to store the data */
-  char* block_;
+  char* block_ = nullptr;
   /* Block size */
   size_t block_size_;
   /* Random seed */
   int seed_ = 1;
+  /* Random engine for shuffle. Each reader has its own engine,
+  so the readers of parallel cross-validation are reproducible */
+  std::mt19937 rng_ { 1 };
+  /* Hashing trick used by the parser */
+  index_t hash_buckets_;
+  bool hash_field_;
+  /* Bytes of the loaded data counted by the MemoryTracker */
+  uint64 data_bytes_ = 0;
 
   // Check current file format and return
   // "libsvm", "ffm", or "csv".
@@ -162,9 +184,29 @@ class Reader {
   // shrink back file pointer.
   void shrink_block(char* block, size_t* ret, FILE* file);
 
+  // Allocate and release the block buffer (block_size_ MB),
+  // which is counted by the MemoryTracker.
+  void alloc_block();
+  void free_block();
+
+  // Count the memory of the data loaded by current reader.
+  void set_data_bytes(uint64 bytes);
+
   // Create parser for different file format
   Parser* CreateParser(const char* format_name) {
-    return CREATE_PARSER(format_name);
+    Parser* parser = CREATE_PARSER(format_name);
+    if (parser != nullptr) {
+      parser->setHash(hash_buckets_, hash_field_);
+    }
+    return parser;
+  }
+
+  // The binary cache of a txt file. The hashed data is
+  // cached apart, because its feature ids are different.
+  std::string bin_file_name(const std::string& filename) {
+    if (hash_buckets_ == 0) { return filename + ".bin"; }
+    return StringPrintf("%s.hash%u%s.bin", filename.c_str(),
+                        hash_buckets_, hash_field_ ? "f" : "");
   }
 
  private:
@@ -196,9 +238,8 @@ class InmemReader : public Reader {
   virtual void Clear() {
     data_buf_.Reset();
     data_samples_.Reset();
-    if (block_ != nullptr) {
-      delete [] block_;
-    }
+    set_data_bytes(0);
+    free_block();
   }
 
   // Return the Reader type
@@ -210,8 +251,8 @@ class InmemReader : public Reader {
   virtual inline void SetShuffle(bool shuffle) {
     this->shuffle_ = shuffle;
     if (shuffle_ && !order_.empty()) {
-      srand(this->seed_);
-      random_shuffle(order_.begin(), order_.end());
+      rng_.seed(this->seed_);
+      std::shuffle(order_.begin(), order_.end(), rng_);
     }
   }
 
@@ -272,9 +313,7 @@ class OndiskReader : public Reader {
   // Free the memory of data matrix.
   virtual void Clear() {
     data_samples_.Reset();
-    if (block_ != nullptr) {
-      delete [] block_;
-    }
+    free_block();
   }
 
   // Return the Reader type
@@ -315,9 +354,7 @@ class FromDMReader : public Reader {
   // Free the memory of data matrix.
   virtual void Clear() {
     data_samples_.Reset();
-    if (block_ != nullptr) {
-      delete [] block_;
-    }
+    free_block();
   }
 
   // Return the Reader type
@@ -329,8 +366,8 @@ class FromDMReader : public Reader {
   virtual inline void SetShuffle(bool shuffle) {
     this->shuffle_ = shuffle;
     if (shuffle_ && !order_.empty()) {
-      srand(this->seed_);
-      random_shuffle(order_.begin(), order_.end());
+      rng_.seed(this->seed_);
+      std::shuffle(order_.begin(), order_.end(), rng_);
     }
   }
 
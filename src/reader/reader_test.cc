@@ -20,7 +20,9 @@ This file tests the Reader class.
 
 #include "gtest/gtest.h"
 
+#include <algorithm>
 #include <string>
+#include <thread>
 #include <vector>
 
 #include "src/reader/reader.h"
@@ -378,4 +380,53 @@ TEST(READER_TEST, CreateReader) {
   EXPECT_TRUE(CreateReader("unknow_name") == NULL);
 }
 
+// Labels of the rows in 3 epochs of a shuffled reader
+void read_shuffled(DMatrix* data, std::vector<real_t>* out) {
+  FromDMReader reader;
+  reader.SetSeed(7);
+  reader.Initialize(data);
+  reader.SetShuffle(true);
+  DMatrix* matrix = nullptr;
+  for (int epoch = 0; epoch < 3; ++epoch) {
+    while (reader.Samples(matrix) > 0) {
+      out->insert(out->end(), matrix->Y.begin(), matrix->Y.end());
+    }
+    reader.Reset();
+  }
+}
+
+TEST(READER_TEST, ShuffleConcurrently) {
+  const index_t kNumRow = 1000;
+  DMatrix data;
+  data.ReAlloc(kNumRow);
+  for (index_t i = 0; i < kNumRow; ++i) {
+    data.Y[i] = i;
+  }
+  DMatrix* ptr = &data;
+  std::vector<real_t> expect;
+  read_shuffled(ptr, &expect);
+  ASSERT_EQ(expect.size(), kNumRow * 3);
+  // Each epoch is a permutation, and the epochs are different
+  for (int epoch = 0; epoch < 3; ++epoch) {
+    std::vector<real_t> order(expect.begin() + epoch * kNumRow,
+                              expect.begin() + (epoch + 1) * kNumRow);
+    EXPECT_NE(order, data.Y);
+    std::sort(order.begin(), order.end());
+    EXPECT_EQ(order, data.Y);
+  }
+  EXPECT_FALSE(std::equal(expect.begin(), expect.begin() + kNumRow,
+                          expect.begin() + kNumRow));
+  // The readers of parallel cross-validation do not
+  // change the order of each other
+  std::vector<std::vector<real_t>> result(4);
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 4; ++t) {
+    threads.push_back(std::thread(read_shuffled, ptr, &result[t]));
+  }
+  for (int t = 0; t < 4; ++t) {
+    threads[t].join();
+    EXPECT_EQ(result[t], expect);
+  }
+}
+
 } // namespace xLearn
@@ -22,6 +22,7 @@ This file is the implementation of FFMScore class.
 
 #include "src/score/ffm_score.h"
 #include "src/base/math.h"
+#include "src/score/int8_kernel.h"
 
 namespace xLearn {
 
@@ -30,6 +31,9 @@ namespace xLearn {
 real_t FFMScore::CalcScore(const SparseRow* row,
                            Model& model,
                            real_t norm) {
+  if (model.IsQuantized()) {
+    return calc_score_int8(row, model, norm);
+  }
   /*********************************************************
    *  linear term and bias term                            *
    *********************************************************/
@@ -91,6 +95,196 @@ real_t FFMScore::CalcScore(const SparseRow* row,
   return sum_v + sum_w;
 }
 
+// The same score on the int8 model. The dot product of each
+// pair of the int8 latent factors is exact, and it is scaled by
+// the scales of the two features.
+real_t FFMScore::calc_score_int8(const SparseRow* row,
+                                 Model& model,
+                                 real_t norm) {
+  /*********************************************************
+   *  linear term and bias term                            *
+   *********************************************************/
+  real_t sum_w = 0;
+  real_t sqrt_norm = sqrt(norm);
+  const int8* qw = model.GetQuantized_w();
+  const real_t* scale_w = model.GetScale_w();
+  index_t num_feat = model.GetNumFeature();
+  index_t num_field = model.GetNumField();
+  for (SparseRow::const_iterator iter = row->begin();
+       iter != row->end(); ++iter) {
+    index_t feat_id = iter->feat_id;
+    // To avoid unseen feature
+    if (feat_id >= num_feat) continue;
+    sum_w += (iter->feat_val * scale_w[feat_id / kQuantBlock] *
+              qw[feat_id] * sqrt_norm);
+  }
+  // bias
+  sum_w += model.GetParameter_b()[0];
+  /*********************************************************
+   *  latent factor                                        *
+   *********************************************************/
+  index_t align0 = model.get_aligned_k();
+  index_t align1 = num_field * align0;
+  const int8* qv = model.GetQuantized_v();
+  const real_t* scale_v = model.GetScale_v();
+  real_t sum_v = 0;
+  for (SparseRow::const_iterator iter_i = row->begin();
+       iter_i != row->end(); ++iter_i) {
+    index_t j1 = iter_i->feat_id;
+    index_t f1 = iter_i->field_id;
+    // To avoid unseen feature in Prediction
+    if (j1 >= num_feat || f1 >= num_field) continue;
+    real_t v1 = iter_i->feat_val * scale_v[j1] * norm;
+    for (SparseRow::const_iterator iter_j = iter_i+1;
+         iter_j != row->end(); ++iter_j) {
+      index_t j2 = iter_j->feat_id;
+      index_t f2 = iter_j->field_id;
+      // To avoid unseen feature in Prediction
+      if (j2 >= num_feat || f2 >= num_field) continue;
+      real_t v2 = iter_j->feat_val * scale_v[j2];
+      int32 dot = DotInt8(qv + j1*align1 + f2*align0,
+                          qv + j2*align1 + f1*align0,
+                          align0);
+      sum_v += v1 * v2 * dot;
+    }
+  }
+  return sum_v + sum_w;
+}
+
+// The partial sums of the context features. The pairwise term
+// of a context feature i and a candidate feature j in field fj is
+// x_i * x_j * <V_i_fj, V_j_fi>, and hence it only needs the sum of
+// x_i * V_i_fj over the context features i in each field fi.
+void FFMScore::CalcContext(const SparseRow* context,
+                           Model& model,
+                           ScoreContext* ctx) {
+  Score::CalcContext(context, model, ctx);
+  if (model.IsQuantized()) { return; }
+  real_t* w = model.GetParameter_w();
+  index_t num_feat = model.GetNumFeature();
+  index_t num_field = model.GetNumField();
+  index_t aux_size = model.GetAuxiliarySize();
+  index_t aligned_k = model.get_aligned_k();
+  index_t align0 = aux_size * aligned_k;
+  index_t align1 = num_field * align0;
+  int align = kAlign * aux_size;
+  ctx->sum_v.assign(num_field * num_field * aligned_k, 0);
+  ctx->field.clear();
+  std::vector<bool> has_field(num_field, false);
+  real_t* v = model.GetParameter_v();
+  __m128 XMMt = _mm_setzero_ps();
+  for (SparseRow::const_iterator iter_i = context->begin();
+       iter_i != context->end(); ++iter_i) {
+    index_t j1 = iter_i->feat_id;
+    index_t f1 = iter_i->field_id;
+    // To avoid unseen feature in Prediction
+    if (j1 >= num_feat) continue;
+    real_t v1 = iter_i->feat_val;
+    ctx->linear += v1 * w[j1*aux_size];
+    if (f1 >= num_field) continue;
+    if (!has_field[f1]) {
+      has_field[f1] = true;
+      ctx->field.push_back(f1);
+    }
+    __m128 XMMx = _mm_set1_ps(v1);
+    for (index_t f = 0; f < num_field; ++f) {
+      real_t* s = ctx->sum_v.data() + (f * num_field + f1) * aligned_k;
+      real_t* w_base = v + j1*align1 + f*align0;
+      for (index_t d = 0; d < aligned_k; d += kAlign) {
+        _mm_storeu_ps(s+d, _mm_add_ps(_mm_loadu_ps(s+d),
+          _mm_mul_ps(_mm_load_ps(w_base + d*aux_size), XMMx)));
+      }
+    }
+    for (SparseRow::const_iterator iter_j = iter_i+1;
+         iter_j != context->end(); ++iter_j) {
+      index_t j2 = iter_j->feat_id;
+      index_t f2 = iter_j->field_id;
+      // To avoid unseen feature in Prediction
+      if (j2 >= num_feat || f2 >= num_field) continue;
+      real_t* w1_base = v + j1*align1 + f2*align0;
+      real_t* w2_base = v + j2*align1 + f1*align0;
+      __m128 XMMv = _mm_set1_ps(v1*iter_j->feat_val);
+      for (index_t d = 0; d < align0; d += align) {
+        XMMt = _mm_add_ps(XMMt,
+               _mm_mul_ps(_mm_mul_ps(_mm_load_ps(w1_base + d),
+                                     _mm_load_ps(w2_base + d)), XMMv));
+      }
+    }
+  }
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  _mm_store_ss(&ctx->pair, XMMt);
+}
+
+// The pairwise term of the whole row is the pairwise term of the
+// context, the pairs of the context and the candidate (by the sums
+// of each field), and the pairs in the candidate.
+real_t FFMScore::CalcScoreWithContext(const SparseRow* candidate,
+                                      const ScoreContext& ctx,
+                                      Model& model,
+                                      bool is_norm) {
+  if (model.IsQuantized()) {
+    return Score::CalcScoreWithContext(candidate, ctx, model, is_norm);
+  }
+  real_t norm = context_norm(candidate, ctx, is_norm);
+  real_t* w = model.GetParameter_w();
+  index_t num_feat = model.GetNumFeature();
+  index_t num_field = model.GetNumField();
+  index_t aux_size = model.GetAuxiliarySize();
+  index_t aligned_k = model.get_aligned_k();
+  index_t align0 = aux_size * aligned_k;
+  index_t align1 = num_field * align0;
+  int align = kAlign * aux_size;
+  real_t* v = model.GetParameter_v();
+  real_t linear = ctx.linear;
+  __m128 XMMt = _mm_setzero_ps();
+  for (SparseRow::const_iterator iter_i = candidate->begin();
+       iter_i != candidate->end(); ++iter_i) {
+    index_t j1 = iter_i->feat_id;
+    index_t f1 = iter_i->field_id;
+    // To avoid unseen feature in Prediction
+    if (j1 >= num_feat) continue;
+    real_t v1 = iter_i->feat_val;
+    linear += v1 * w[j1*aux_size];
+    if (f1 >= num_field) continue;
+    // Pairs with the context
+    __m128 XMMx = _mm_set1_ps(v1);
+    for (size_t n = 0; n < ctx.field.size(); ++n) {
+      index_t f = ctx.field[n];
+      const real_t* s = ctx.sum_v.data() + (f1 * num_field + f) * aligned_k;
+      real_t* w_base = v + j1*align1 + f*align0;
+      for (index_t d = 0; d < aligned_k; d += kAlign) {
+        XMMt = _mm_add_ps(XMMt,
+               _mm_mul_ps(_mm_mul_ps(_mm_loadu_ps(s + d),
+                          _mm_load_ps(w_base + d*aux_size)), XMMx));
+      }
+    }
+    // Pairs in the candidate
+    for (SparseRow::const_iterator iter_j = iter_i+1;
+         iter_j != candidate->end(); ++iter_j) {
+      index_t j2 = iter_j->feat_id;
+      index_t f2 = iter_j->field_id;
+      // To avoid unseen feature in Prediction
+      if (j2 >= num_feat || f2 >= num_field) continue;
+      real_t* w1_base = v + j1*align1 + f2*align0;
+      real_t* w2_base = v + j2*align1 + f1*align0;
+      __m128 XMMv = _mm_set1_ps(v1*iter_j->feat_val);
+      for (index_t d = 0; d < align0; d += align) {
+        XMMt = _mm_add_ps(XMMt,
+               _mm_mul_ps(_mm_mul_ps(_mm_load_ps(w1_base + d),
+                                     _mm_load_ps(w2_base + d)), XMMv));
+      }
+    }
+  }
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  real_t pair;
+  _mm_store_ss(&pair, XMMt);
+  return model.GetParameter_b()[0] +
+         linear * sqrt(norm) +
+         (ctx.pair + pair) * norm;
+}
+
 // Calculate gradient and update current model.
 // Using the SSE to accelerate vector operation.
 void FFMScore::CalcGrad(const SparseRow* row,
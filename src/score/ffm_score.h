@@ -44,6 +44,18 @@ public:
                   Model& model,
                   real_t norm = 1.0);
 
+ // Compute the linear term, the pairwise term and the
+ // per-field sums of the latent factors of the context.
+ void CalcContext(const SparseRow* context,
+                  Model& model,
+                  ScoreContext* ctx);
+
+ // Score the row (context + candidate) by the partial sums.
+ real_t CalcScoreWithContext(const SparseRow* candidate,
+                             const ScoreContext& ctx,
+                             Model& model,
+                             bool is_norm = true);
+
  // Calculate gradient and update current
  // model parameters.
  void CalcGrad(const SparseRow* row,
@@ -52,6 +64,11 @@ public:
                real_t norm = 1.0);
 
  protected:
+  // Score the int8 model (see Model::IsQuantized()).
+  real_t calc_score_int8(const SparseRow* row,
+                         Model& model,
+                         real_t norm);
+
   // Calculate gradient and update model using sgd
   void calc_grad_sgd(const SparseRow* row,
                      Model& model,
@@ -20,7 +20,12 @@ This file tests the FFMScore class.
 
 #include "gtest/gtest.h"
 
+#include <math.h>
+
+#include <vector>
+
 #include "src/base/common.h"
+#include "src/base/file_util.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
 #include "src/score/score_function.h"
@@ -133,4 +138,85 @@ TEST(FFMScore_Test, calc_score_overflow) {
   }
 }
 
+TEST(FFMScore_Test, calc_score_int8) {
+  std::string filename = "./test_ffm_int8.infer";
+  for (index_t k = 1; k < 20; ++k) {
+    Model model;
+    model.Initialize("ffm", "squared", 100, 4, k, 2, 0.66);
+    real_t* w = model.GetParameter_w();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      w[i] = (i % 7) * 0.1 - 0.3;
+    }
+    model.GetParameter_b()[0] = 0.2;
+    model.SerializeInference(filename, true);
+    Model int8_model(filename);
+    ASSERT_TRUE(int8_model.IsQuantized());
+    EXPECT_TRUE(int8_model.GetParameter_v() == nullptr);
+    FFMScore score;
+    for (index_t n = 0; n < 50; ++n) {
+      // Including the unseen features and fields
+      SparseRow row(10);
+      for (index_t i = 0; i < row.size(); ++i) {
+        row[i].feat_id = (n * 31 + i * 17) % 110;
+        row[i].field_id = (n + i) % 5;
+        row[i].feat_val = 1.0 + i % 3;
+      }
+      real_t norm = 0.1;
+      real_t expect = score.CalcScore(&row, model, norm);
+      real_t val = score.CalcScore(&row, int8_model, norm);
+      EXPECT_NEAR(val, expect, 0.02 * (1 + fabs(expect)));
+    }
+  }
+  RemoveFile(filename.c_str());
+}
+
+TEST(FFMScore_Test, calc_score_with_context) {
+  Model model;
+  model.Initialize("ffm", "squared", 100, 4, 7, 2, 0.66);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = (i % 7) * 0.1 - 0.3;
+  }
+  model.GetParameter_b()[0] = 0.2;
+  FFMScore score;
+  // Including the unseen features and fields
+  SparseRow context(8);
+  for (index_t i = 0; i < context.size(); ++i) {
+    context[i].feat_id = (i * 17) % 110;
+    context[i].field_id = i % 5;
+    context[i].feat_val = 1.0 + i % 3;
+  }
+  ScoreContext ctx;
+  score.CalcContext(&context, model, &ctx);
+  std::vector<SparseRow> candidates(50, SparseRow(3));
+  std::vector<const SparseRow*> ptr;
+  for (index_t n = 0; n < candidates.size(); ++n) {
+    SparseRow& cand = candidates[n];
+    for (index_t i = 0; i < cand.size(); ++i) {
+      cand[i].feat_id = (n * 31 + i * 13) % 105;
+      cand[i].field_id = (n + i) % 5;
+      cand[i].feat_val = 0.5 + i;
+    }
+    ptr.push_back(&cand);
+  }
+  std::vector<real_t> out(candidates.size());
+  score.RankCandidates(&context, ptr.data(), ptr.size(), model, true, out.data());
+  for (index_t n = 0; n < candidates.size(); ++n) {
+    SparseRow row(context);
+    row.insert(row.end(), candidates[n].begin(), candidates[n].end());
+    real_t sum = 0;
+    for (index_t i = 0; i < row.size(); ++i) {
+      sum += row[i].feat_val * row[i].feat_val;
+    }
+    real_t expect = score.CalcScore(&row, model, 1.0 / sum);
+    real_t val = score.CalcScoreWithContext(&candidates[n], ctx, model, true);
+    EXPECT_NEAR(val, expect, 1e-5 * (1 + fabs(expect)));
+    EXPECT_NEAR(out[n], expect, 1e-5 * (1 + fabs(expect)));
+    // Without norm
+    expect = score.CalcScore(&row, model, 1.0);
+    val = score.CalcScoreWithContext(&candidates[n], ctx, model, false);
+    EXPECT_NEAR(val, expect, 1e-5 * (1 + fabs(expect)));
+  }
+}
+
 } // namespace xLearn
@@ -22,6 +22,8 @@ This file is the implementation of FMScore class.
 
 #include "src/score/fm_score.h"
 #include "src/base/math.h"
+#include "src/base/scratch_arena.h"
+#include "src/score/int8_kernel.h"
 
 namespace xLearn {
 
@@ -30,6 +32,9 @@ namespace xLearn {
 real_t FMScore::CalcScore(const SparseRow* row,
                           Model& model,
                           real_t norm) {
+  if (model.IsQuantized()) {
+    return calc_score_int8(row, model, norm);
+  }
   /*********************************************************
    *  linear term and bias term                            *
    *********************************************************/
@@ -53,8 +58,9 @@ real_t FMScore::CalcScore(const SparseRow* row,
    *********************************************************/
   index_t aligned_k = model.get_aligned_k();
   index_t align0 = model.get_aligned_k() * aux_size;
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
+  // The sum vector lives in the scratch arena of current thread
+  ScratchScope scope;
+  real_t* s = scope.AllocZero<real_t>(aligned_k);
   for (SparseRow::const_iterator iter = row->begin();
        iter != row->end(); ++iter) {
     index_t j1 = iter->feat_id;
@@ -96,6 +102,161 @@ real_t FMScore::CalcScore(const SparseRow* row,
   return t_all;
 }
 
+// The same score on the int8 model. With a = x_i * norm * scale_i,
+// the sum vector s = sum(a * q_i) is built in one pass, and
+// y = 0.5 * (|s|^2 - sum(|a * q_i|^2)), which equals the above.
+real_t FMScore::calc_score_int8(const SparseRow* row,
+                                Model& model,
+                                real_t norm) {
+  /*********************************************************
+   *  linear term and bias term                            *
+   *********************************************************/
+  real_t sqrt_norm = sqrt(norm);
+  const int8* qw = model.GetQuantized_w();
+  const real_t* scale_w = model.GetScale_w();
+  index_t num_feat = model.GetNumFeature();
+  real_t t = 0;
+  for (SparseRow::const_iterator iter = row->begin();
+       iter != row->end(); ++iter) {
+    index_t feat_id = iter->feat_id;
+    // To avoid unseen feature in Prediction
+    if (feat_id >= num_feat) continue;
+    t += (iter->feat_val * scale_w[feat_id / kQuantBlock] *
+          qw[feat_id] * sqrt_norm);
+  }
+  // bias
+  t += model.GetParameter_b()[0];
+  /*********************************************************
+   *  latent factor                                        *
+   *********************************************************/
+  index_t aligned_k = model.get_aligned_k();
+  const int8* qv = model.GetQuantized_v();
+  const real_t* scale_v = model.GetScale_v();
+  ScratchScope scope;
+  real_t* s = scope.AllocZero<real_t>(aligned_k);
+  __m128 XMMsq = _mm_setzero_ps();
+  for (SparseRow::const_iterator iter = row->begin();
+       iter != row->end(); ++iter) {
+    index_t j1 = iter->feat_id;
+    // To avoid unseen feature in Prediction
+    if (j1 >= num_feat) continue;
+    const int8* q = qv + j1 * aligned_k;
+    __m128 XMMa = _mm_set1_ps(iter->feat_val * norm * scale_v[j1]);
+    for (index_t d = 0; d < aligned_k; d += kAlign) {
+      __m128 XMMwv = _mm_mul_ps(LoadInt8(q + d), XMMa);
+      _mm_store_ps(s+d, _mm_add_ps(_mm_load_ps(s+d), XMMwv));
+      XMMsq = _mm_add_ps(XMMsq, _mm_mul_ps(XMMwv, XMMwv));
+    }
+  }
+  __m128 XMMt = _mm_setzero_ps();
+  for (index_t d = 0; d < aligned_k; d += kAlign) {
+    __m128 XMMs = _mm_load_ps(s+d);
+    XMMt = _mm_add_ps(XMMt, _mm_mul_ps(XMMs, XMMs));
+  }
+  XMMt = _mm_sub_ps(XMMt, XMMsq);
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  real_t t_all;
+  _mm_store_ss(&t_all, XMMt);
+  return t_all * 0.5 + t;
+}
+
+// The partial sums of the context features:
+//   linear = sum(x_i * w_i), sum_v = sum(x_i * V_i),
+//   pair = 0.5 * (|sum_v|^2 - sum(|x_i * V_i|^2))
+void FMScore::CalcContext(const SparseRow* context,
+                          Model& model,
+                          ScoreContext* ctx) {
+  Score::CalcContext(context, model, ctx);
+  if (model.IsQuantized()) { return; }
+  real_t* w = model.GetParameter_w();
+  index_t num_feat = model.GetNumFeature();
+  index_t aux_size = model.GetAuxiliarySize();
+  index_t aligned_k = model.get_aligned_k();
+  index_t align0 = aligned_k * aux_size;
+  ctx->sum_v.assign(aligned_k, 0);
+  real_t* s = ctx->sum_v.data();
+  __m128 XMMsq = _mm_setzero_ps();
+  for (SparseRow::const_iterator iter = context->begin();
+       iter != context->end(); ++iter) {
+    index_t j1 = iter->feat_id;
+    // To avoid unseen feature in Prediction
+    if (j1 >= num_feat) continue;
+    ctx->linear += iter->feat_val * w[j1*aux_size];
+    real_t* v = model.GetParameter_v() + j1 * align0;
+    __m128 XMMx = _mm_set1_ps(iter->feat_val);
+    for (index_t d = 0; d < aligned_k; d += kAlign) {
+      __m128 XMMxv = _mm_mul_ps(_mm_load_ps(v+d), XMMx);
+      _mm_storeu_ps(s+d, _mm_add_ps(_mm_loadu_ps(s+d), XMMxv));
+      XMMsq = _mm_add_ps(XMMsq, _mm_mul_ps(XMMxv, XMMxv));
+    }
+  }
+  __m128 XMMt = _mm_setzero_ps();
+  for (index_t d = 0; d < aligned_k; d += kAlign) {
+    __m128 XMMs = _mm_loadu_ps(s+d);
+    XMMt = _mm_add_ps(XMMt, _mm_mul_ps(XMMs, XMMs));
+  }
+  XMMt = _mm_sub_ps(XMMt, XMMsq);
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  real_t pair;
+  _mm_store_ss(&pair, XMMt);
+  ctx->pair = pair * 0.5;
+}
+
+// With the sum vector s of the candidate features, the pairwise
+// term of the whole row is pair + <sum_v, s> + the pairwise term
+// of the candidate, and it is scaled by norm^2 as CalcScore().
+real_t FMScore::CalcScoreWithContext(const SparseRow* candidate,
+                                     const ScoreContext& ctx,
+                                     Model& model,
+                                     bool is_norm) {
+  if (model.IsQuantized()) {
+    return Score::CalcScoreWithContext(candidate, ctx, model, is_norm);
+  }
+  real_t norm = context_norm(candidate, ctx, is_norm);
+  real_t* w = model.GetParameter_w();
+  index_t num_feat = model.GetNumFeature();
+  index_t aux_size = model.GetAuxiliarySize();
+  index_t aligned_k = model.get_aligned_k();
+  index_t align0 = aligned_k * aux_size;
+  real_t linear = ctx.linear;
+  ScratchScope scope;
+  real_t* s = scope.AllocZero<real_t>(aligned_k);
+  __m128 XMMsq = _mm_setzero_ps();
+  for (SparseRow::const_iterator iter = candidate->begin();
+       iter != candidate->end(); ++iter) {
+    index_t j1 = iter->feat_id;
+    // To avoid unseen feature in Prediction
+    if (j1 >= num_feat) continue;
+    linear += iter->feat_val * w[j1*aux_size];
+    real_t* v = model.GetParameter_v() + j1 * align0;
+    __m128 XMMx = _mm_set1_ps(iter->feat_val);
+    for (index_t d = 0; d < aligned_k; d += kAlign) {
+      __m128 XMMxv = _mm_mul_ps(_mm_load_ps(v+d), XMMx);
+      _mm_store_ps(s+d, _mm_add_ps(_mm_load_ps(s+d), XMMxv));
+      XMMsq = _mm_add_ps(XMMsq, _mm_mul_ps(XMMxv, XMMxv));
+    }
+  }
+  // <sum_v, s> + 0.5 * (|s|^2 - sq)
+  const real_t* c = ctx.sum_v.data();
+  __m128 XMMhalf = _mm_set1_ps(0.5);
+  __m128 XMMt = _mm_mul_ps(XMMsq, XMMhalf);
+  XMMt = _mm_sub_ps(_mm_setzero_ps(), XMMt);
+  for (index_t d = 0; d < aligned_k; d += kAlign) {
+    __m128 XMMs = _mm_load_ps(s+d);
+    XMMt = _mm_add_ps(XMMt, _mm_mul_ps(XMMs,
+           _mm_add_ps(_mm_loadu_ps(c+d), _mm_mul_ps(XMMs, XMMhalf))));
+  }
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  XMMt = _mm_hadd_ps(XMMt, XMMt);
+  real_t pair;
+  _mm_store_ss(&pair, XMMt);
+  return model.GetParameter_b()[0] +
+         linear * sqrt(norm) +
+         (ctx.pair + pair) * norm * norm;
+}
+
 // Calculate gradient and update current model parameters.
 // Using SSE to accelerate vector operation.
 void FMScore::CalcGrad(const SparseRow* row,
@@ -153,8 +314,9 @@ void FMScore::calc_grad_sgd(const SparseRow* row,
   __m128 XMMpg = _mm_set1_ps(pg);
   __m128 XMMlr = _mm_set1_ps(learning_rate_);
   __m128 XMMlamb = _mm_set1_ps(regu_lambda_);
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
+  // The sum vector lives in the scratch arena of current thread
+  ScratchScope scope;
+  real_t* s = scope.AllocZero<real_t>(aligned_k);
   for (SparseRow::const_iterator iter = row->begin();
        iter != row->end(); ++iter) {
     index_t j1 = iter->feat_id;
@@ -229,8 +391,9 @@ void FMScore::calc_grad_adagrad(const SparseRow* row,
   __m128 XMMpg = _mm_set1_ps(pg);
   __m128 XMMlr = _mm_set1_ps(learning_rate_);
   __m128 XMMlamb = _mm_set1_ps(regu_lambda_);
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
+  // The sum vector lives in the scratch arena of current thread
+  ScratchScope scope;
+  real_t* s = scope.AllocZero<real_t>(aligned_k);
   for (SparseRow::const_iterator iter = row->begin();
        iter != row->end(); ++iter) {
     index_t j1 = iter->feat_id;
@@ -332,8 +495,9 @@ void FMScore::calc_grad_ftrl(const SparseRow* row,
   __m128 XMMpg = _mm_set1_ps(pg);
   __m128 XMMalpha = _mm_set1_ps(alpha_);
   __m128 XMML2 = _mm_set1_ps(lambda_2_);
-  std::vector<real_t> sv(aligned_k, 0);
-  real_t* s = sv.data();
+  // The sum vector lives in the scratch arena of current thread
+  ScratchScope scope;
+  real_t* s = scope.AllocZero<real_t>(aligned_k);
  for (SparseRow::const_iterator iter = row->begin();
        iter != row->end(); ++iter) {
     index_t j1 = iter->feat_id;
@@ -20,7 +20,13 @@ This file tests the FMScore class.
 
 #include "gtest/gtest.h"
 
+#include <math.h>
+
+#include <vector>
+
 #include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/alloc_counter.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
 #include "src/score/score_function.h"
@@ -124,4 +130,124 @@ TEST(FMScoreTest, calc_score_overflow) {
   }
 }
 
+TEST(FMScoreTest, no_allocation_in_steady_state) {
+  HyperParam param;
+  param.num_feature = 10;
+  param.num_K = 17;
+  param.num_field = 1;
+  SparseRow row(param.num_feature);
+  for (index_t i = 0; i < param.num_feature; ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 0.5;
+  }
+  std::string opt_list[3] = { "sgd", "adagrad", "ftrl" };
+  for (int n = 0; n < 3; ++n) {
+    Model model;
+    model.Initialize("fm", "squared",
+                param.num_feature,
+                param.num_field,
+                param.num_K, n+1);
+    FMScore score;
+    score.Initialize(0.1, 0, 1.0, 1.0, 0.1, 0.1, opt_list[n]);
+    // Warm up the scratch arena
+    score.CalcScore(&row, model);
+    score.CalcGrad(&row, model, 0.5);
+    uint64 before = ThreadAllocCount();
+    for (int i = 0; i < 100; ++i) {
+      real_t val = score.CalcScore(&row, model);
+      score.CalcGrad(&row, model, val - 1.0);
+    }
+    EXPECT_EQ(ThreadAllocCount(), before);
+  }
+}
+
+TEST(FMScoreTest, calc_score_int8) {
+  std::string filename = "./test_fm_int8.infer";
+  for (index_t k = 1; k < 20; ++k) {
+    Model model;
+    model.Initialize("fm", "squared", 100, 0, k, 2, 0.66);
+    real_t* w = model.GetParameter_w();
+    for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+      w[i] = (i % 7) * 0.1 - 0.3;
+    }
+    model.GetParameter_b()[0] = 0.2;
+    model.SerializeInference(filename, true);
+    Model int8_model(filename);
+    ASSERT_TRUE(int8_model.IsQuantized());
+    EXPECT_TRUE(int8_model.GetParameter_v() == nullptr);
+    FMScore score;
+    for (index_t n = 0; n < 50; ++n) {
+      // Including the unseen features
+      SparseRow row(10);
+      for (index_t i = 0; i < row.size(); ++i) {
+        row[i].feat_id = (n * 31 + i * 17) % 110;
+        row[i].feat_val = 1.0 + i % 3;
+      }
+      real_t norm = 0.1;
+      real_t expect = score.CalcScore(&row, model, norm);
+      real_t val = score.CalcScore(&row, int8_model, norm);
+      EXPECT_NEAR(val, expect, 0.02 * (1 + fabs(expect)));
+    }
+  }
+  RemoveFile(filename.c_str());
+}
+
+TEST(FMScoreTest, calc_score_with_context) {
+  Model model;
+  model.Initialize("fm", "squared", 100, 0, 7, 2, 0.66);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = (i % 7) * 0.1 - 0.3;
+  }
+  model.GetParameter_b()[0] = 0.2;
+  FMScore score;
+  // Including the unseen features
+  SparseRow context(8);
+  for (index_t i = 0; i < context.size(); ++i) {
+    context[i].feat_id = (i * 17) % 110;
+    context[i].feat_val = 1.0 + i % 3;
+  }
+  ScoreContext ctx;
+  score.CalcContext(&context, model, &ctx);
+  std::vector<SparseRow> candidates(50, SparseRow(3));
+  std::vector<const SparseRow*> ptr;
+  for (index_t n = 0; n < candidates.size(); ++n) {
+    SparseRow& cand = candidates[n];
+    for (index_t i = 0; i < cand.size(); ++i) {
+      cand[i].feat_id = (n * 31 + i * 13) % 105;
+      cand[i].feat_val = 0.5 + i;
+    }
+    ptr.push_back(&cand);
+  }
+  std::vector<real_t> out(candidates.size());
+  score.RankCandidates(&context, ptr.data(), ptr.size(), model, true, out.data());
+  for (index_t n = 0; n < candidates.size(); ++n) {
+    SparseRow row(context);
+    row.insert(row.end(), candidates[n].begin(), candidates[n].end());
+    real_t sum = 0;
+    for (index_t i = 0; i < row.size(); ++i) {
+      sum += row[i].feat_val * row[i].feat_val;
+    }
+    real_t expect = score.CalcScore(&row, model, 1.0 / sum);
+    real_t val = score.CalcScoreWithContext(&candidates[n], ctx, model, true);
+    EXPECT_NEAR(val, expect, 1e-5 * (1 + fabs(expect)));
+    EXPECT_NEAR(out[n], expect, 1e-5 * (1 + fabs(expect)));
+    // Without norm
+    expect = score.CalcScore(&row, model, 1.0);
+    val = score.CalcScoreWithContext(&candidates[n], ctx, model, false);
+    EXPECT_NEAR(val, expect, 1e-5 * (1 + fabs(expect)));
+  }
+  // The int8 model scores the joined row
+  std::string filename = "./test_fm_context.infer";
+  model.SerializeInference(filename, true);
+  Model int8_model(filename);
+  score.CalcContext(&context, int8_model, &ctx);
+  SparseRow row(context);
+  row.insert(row.end(), candidates[0].begin(), candidates[0].end());
+  EXPECT_FLOAT_EQ(score.CalcScoreWithContext(&candidates[0], ctx,
+                                             int8_model, false),
+                  score.CalcScore(&row, int8_model, 1.0));
+  RemoveFile(filename.c_str());
+}
+
 } // namespace xLearn
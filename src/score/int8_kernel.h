@@ -0,0 +1,83 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the SSE kernels used by the score
+functions to read the int8 model.
+*/
+
+#ifndef XLEARN_SCORE_INT8_KERNEL_H_
+#define XLEARN_SCORE_INT8_KERNEL_H_
+
+#include <string.h>
+#include <pmmintrin.h>  // for SSE
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// The int8 model (see Model::SerializeInference()) stores each value as
+// scale * q, where q is an int8 and the scale is shared by a block of
+// values. The kernels below only use SSE2, which is a subset of the SSE3
+// used by the other kernels. The length of the int8 vector is always a
+// multiple of kAlign, because it is a row of the aligned latent factor.
+//------------------------------------------------------------------------------
+
+// Convert 4 int8 values to 4 floats. The int8 values are
+// copied to the high byte of each 32-bit lane, and then
+// shifted back with sign extension.
+inline __m128 LoadInt8(const int8* q) {
+  int32 raw;
+  memcpy(&raw, q, sizeof(raw));
+  __m128i x = _mm_cvtsi32_si128(raw);
+  x = _mm_unpacklo_epi8(x, x);
+  x = _mm_unpacklo_epi16(x, x);
+  return _mm_cvtepi32_ps(_mm_srai_epi32(x, 24));
+}
+
+// Dot product of two int8 vectors. The values are extended to
+// int16 and multiplied by _mm_madd_epi16(), so the sum is exact.
+inline int32 DotInt8(const int8* a, const int8* b, index_t len) {
+  __m128i sum = _mm_setzero_si128();
+  index_t d = 0;
+  for (; d + 8 <= len; d += 8) {
+    __m128i x = _mm_loadl_epi64((const __m128i*)(a + d));
+    __m128i y = _mm_loadl_epi64((const __m128i*)(b + d));
+    x = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+    y = _mm_srai_epi16(_mm_unpacklo_epi8(y, y), 8);
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(x, y));
+  }
+  for (; d < len; d += kAlign) {
+    int32 raw_a, raw_b;
+    memcpy(&raw_a, a + d, sizeof(raw_a));
+    memcpy(&raw_b, b + d, sizeof(raw_b));
+    __m128i x = _mm_cvtsi32_si128(raw_a);
+    __m128i y = _mm_cvtsi32_si128(raw_b);
+    x = _mm_srai_epi16(_mm_unpacklo_epi8(x, x), 8);
+    y = _mm_srai_epi16(_mm_unpacklo_epi8(y, y), 8);
+    sum = _mm_add_epi32(sum, _mm_madd_epi16(x, y));
+  }
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(1, 0, 3, 2)));
+  sum = _mm_add_epi32(sum, _mm_shuffle_epi32(sum, _MM_SHUFFLE(2, 3, 0, 1)));
+  return _mm_cvtsi128_si32(sum);
+}
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SCORE_INT8_KERNEL_H_
@@ -20,6 +20,7 @@ This file is the implementation of LinearScore class.
 
 #include "src/score/linear_score.h"
 #include "src/base/math.h"
+#include "src/score/int8_kernel.h"
 
 namespace xLearn {
 
@@ -27,6 +28,9 @@ namespace xLearn {
 real_t LinearScore::CalcScore(const SparseRow* row,
                               Model& model,
                               real_t norm) {
+  if (model.IsQuantized()) {
+    return calc_score_int8(row, model, norm);
+  }
   real_t* w = model.GetParameter_w();
   index_t num_feat = model.GetNumFeature();
   real_t score = 0.0;
@@ -45,6 +49,68 @@ real_t LinearScore::CalcScore(const SparseRow* row,
   return score;
 }
 
+// y = wTx on the int8 model
+real_t LinearScore::calc_score_int8(const SparseRow* row,
+                                    Model& model,
+                                    real_t norm) {
+  const int8* qw = model.GetQuantized_w();
+  const real_t* scale_w = model.GetScale_w();
+  index_t num_feat = model.GetNumFeature();
+  real_t score = 0.0;
+  for (SparseRow::const_iterator iter = row->begin();
+       iter != row->end(); ++iter) {
+    index_t feat_id = iter->feat_id;
+    // To avoid unseen feature in Prediction
+    if (feat_id >= num_feat) continue;
+    score += scale_w[feat_id / kQuantBlock] * qw[feat_id] * iter->feat_val;
+  }
+  // bias
+  score += model.GetParameter_b()[0];
+  return score;
+}
+
+// Sum the linear term of the context features.
+void LinearScore::CalcContext(const SparseRow* context,
+                              Model& model,
+                              ScoreContext* ctx) {
+  Score::CalcContext(context, model, ctx);
+  if (model.IsQuantized()) { return; }
+  real_t* w = model.GetParameter_w();
+  index_t num_feat = model.GetNumFeature();
+  index_t auxiliary_size = model.GetAuxiliarySize();
+  for (SparseRow::const_iterator iter = context->begin();
+       iter != context->end(); ++iter) {
+    index_t feat_id = iter->feat_id;
+    // To avoid unseen feature in Prediction
+    if (feat_id >= num_feat) continue;
+    ctx->linear += w[feat_id * auxiliary_size] * iter->feat_val;
+  }
+}
+
+// y = wTx of the context plus the candidate features
+real_t LinearScore::CalcScoreWithContext(const SparseRow* candidate,
+                                         const ScoreContext& ctx,
+                                         Model& model,
+                                         bool is_norm) {
+  if (model.IsQuantized()) {
+    return Score::CalcScoreWithContext(candidate, ctx, model, is_norm);
+  }
+  real_t* w = model.GetParameter_w();
+  index_t num_feat = model.GetNumFeature();
+  index_t auxiliary_size = model.GetAuxiliarySize();
+  real_t score = ctx.linear;
+  for (SparseRow::const_iterator iter = candidate->begin();
+       iter != candidate->end(); ++iter) {
+    index_t feat_id = iter->feat_id;
+    // To avoid unseen feature in Prediction
+    if (feat_id >= num_feat) continue;
+    score += w[feat_id * auxiliary_size] * iter->feat_val;
+  }
+  // bias
+  score += model.GetParameter_b()[0];
+  return score;
+}
+
 // Calculate gradient and update current model
 void LinearScore::CalcGrad(const SparseRow* row,
                            Model& model,
@@ -43,6 +43,17 @@ class LinearScore : public Score {
                    Model& model,
                    real_t norm = 1.0);
 
+  // Compute the linear term of the context features.
+  void CalcContext(const SparseRow* context,
+                   Model& model,
+                   ScoreContext* ctx);
+
+  // Score the row (context + candidate) by the partial sums.
+  real_t CalcScoreWithContext(const SparseRow* candidate,
+                              const ScoreContext& ctx,
+                              Model& model,
+                              bool is_norm = true);
+
   // Calculate gradient and update current
   // model parameters.
   void CalcGrad(const SparseRow* row,
@@ -51,6 +62,11 @@ class LinearScore : public Score {
                 real_t norm = 1.0);
 
  protected:
+  // Score the int8 model (see Model::IsQuantized()).
+  real_t calc_score_int8(const SparseRow* row,
+                         Model& model,
+                         real_t norm);
+
   // Calculate gradient and update model using sgd
   void calc_grad_sgd(const SparseRow* row,
                      Model& model,
@@ -20,7 +20,12 @@ This file tests the LinearScore class.
 
 #include "gtest/gtest.h"
 
+#include <math.h>
+
+#include <vector>
+
 #include "src/base/common.h"
+#include "src/base/file_util.h"
 #include "src/data/data_structure.h"
 #include "src/data/hyper_parameters.h"
 
@@ -90,4 +95,80 @@ TEST_F(LinearScoreTest, calc_score_overflow) {
   EXPECT_FLOAT_EQ(val, 600.0);
 }
 
+TEST_F(LinearScoreTest, calc_score_int8) {
+  std::string filename = "./test_linear_int8.infer";
+  Model model;
+  model.Initialize(param.score_func,
+                param.loss_func,
+                param.num_feature,
+                0, 0, 2);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < kLength; ++i) {
+    w[i*2] = (i % 11) * 0.25 - 1.0;
+  }
+  model.GetParameter_b()[0] = 0.5;
+  model.SerializeInference(filename, true);
+  Model int8_model(filename);
+  ASSERT_TRUE(int8_model.IsQuantized());
+  EXPECT_TRUE(int8_model.GetParameter_w() == nullptr);
+  // Including the unseen features
+  SparseRow row(kLength + 10);
+  for (index_t i = 0; i < row.size(); ++i) {
+    row[i].feat_id = i;
+    row[i].feat_val = 2.0;
+  }
+  LinearScore score;
+  real_t expect = score.CalcScore(&row, model);
+  real_t val = score.CalcScore(&row, int8_model);
+  EXPECT_NEAR(val, expect, 0.01 * (1 + fabs(expect)));
+  RemoveFile(filename.c_str());
+}
+
+TEST_F(LinearScoreTest, calc_score_with_context) {
+  Model model;
+  model.Initialize("linear", "squared", 100, 0, 7, 2, 0.66);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < model.GetNumParameter_w(); ++i) {
+    w[i] = (i % 7) * 0.1 - 0.3;
+  }
+  model.GetParameter_b()[0] = 0.2;
+  LinearScore score;
+  // Including the unseen features
+  SparseRow context(8);
+  for (index_t i = 0; i < context.size(); ++i) {
+    context[i].feat_id = (i * 17) % 110;
+    context[i].feat_val = 1.0 + i % 3;
+  }
+  ScoreContext ctx;
+  score.CalcContext(&context, model, &ctx);
+  std::vector<SparseRow> candidates(50, SparseRow(3));
+  std::vector<const SparseRow*> ptr;
+  for (index_t n = 0; n < candidates.size(); ++n) {
+    SparseRow& cand = candidates[n];
+    for (index_t i = 0; i < cand.size(); ++i) {
+      cand[i].feat_id = (n * 31 + i * 13) % 105;
+      cand[i].feat_val = 0.5 + i;
+    }
+    ptr.push_back(&cand);
+  }
+  std::vector<real_t> out(candidates.size());
+  score.RankCandidates(&context, ptr.data(), ptr.size(), model, true, out.data());
+  for (index_t n = 0; n < candidates.size(); ++n) {
+    SparseRow row(context);
+    row.insert(row.end(), candidates[n].begin(), candidates[n].end());
+    real_t sum = 0;
+    for (index_t i = 0; i < row.size(); ++i) {
+      sum += row[i].feat_val * row[i].feat_val;
+    }
+    real_t expect = score.CalcScore(&row, model, 1.0 / sum);
+    real_t val = score.CalcScoreWithContext(&candidates[n], ctx, model, true);
+    EXPECT_NEAR(val, expect, 1e-5 * (1 + fabs(expect)));
+    EXPECT_NEAR(out[n], expect, 1e-5 * (1 + fabs(expect)));
+    // Without norm
+    expect = score.CalcScore(&row, model, 1.0);
+    val = score.CalcScoreWithContext(&candidates[n], ctx, model, false);
+    EXPECT_NEAR(val, expect, 1e-5 * (1 + fabs(expect)));
+  }
+}
+
 } // namespace xLearn
@@ -0,0 +1,249 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the benchmark of the score functions, which times
+CalcScore() and CalcGrad() of LinearScore, FMScore and FFMScore
+on one thread for a grid of K, nnz per row, number of fields,
+optimization method and model size.
+
+Usage: score_benchmark [csv_file] [min_time_sec] [large_model_mb]
+
+The table is printed to stdout, and the same results are written
+to csv_file (if given), which can be compared across commits.
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <memory>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/timer.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/score_function.h"
+#include "src/score/linear_score.h"
+#include "src/score/fm_score.h"
+#include "src/score/ffm_score.h"
+
+using namespace xLearn;
+
+// Number of rows generated for each nnz, which are scored in a loop
+const index_t kRows = 4096;
+// The small model fits in the L2 cache
+const size_t kSmallModelBytes = 256 * 1024;
+
+const index_t kListK[] = { 4, 16, 64 };
+const index_t kListNNZ[] = { 10, 40 };
+const index_t kListField[] = { 10, 40 };
+const char* kListOpt[] = { "sgd", "adagrad", "ftrl" };
+
+// Keep the scores alive, so that the loops are not optimized away
+static volatile real_t sink = 0;
+
+//------------------------------------------------------------------------------
+// One case of the benchmark
+//------------------------------------------------------------------------------
+struct Case {
+  std::string score_func;
+  std::string op;  /* "score" or "grad" */
+  std::string opt;
+  index_t K;
+  index_t nnz;
+  index_t field;
+  index_t num_feat;
+  real_t model_mb;
+};
+
+// Bytes of one feature in the model, including the gradient cache
+size_t FeatureBytes(const std::string& score_func,
+                    index_t K,
+                    index_t field,
+                    index_t aux_size) {
+  size_t aligned_k = (K + kAlign - 1) / kAlign * kAlign;
+  size_t len = 1;
+  if (score_func == "fm") {
+    len += aligned_k;
+  } else if (score_func == "ffm") {
+    len += aligned_k * field;
+  }
+  return len * aux_size * sizeof(real_t);
+}
+
+// Bytes of the model touched by one row. The grad
+// reads and writes the parameters and the gradient cache.
+real_t TouchedBytes(const Case& c, index_t aux_size) {
+  real_t aligned_k = (c.K + kAlign - 1) / kAlign * kAlign;
+  real_t floats = c.nnz;
+  if (c.score_func == "fm") {
+    floats += c.nnz * aligned_k;
+  } else if (c.score_func == "ffm") {
+    floats += (real_t)c.nnz * (c.nnz - 1) * aligned_k;
+  }
+  if (c.op == "grad") { floats *= aux_size * 2; }
+  return floats * sizeof(real_t);
+}
+
+// Each row has nnz features drawn uniformly from the model,
+// and the node n of a row is in field n % num_field.
+void Generate(index_t nnz,
+              index_t num_feat,
+              index_t num_field,
+              DMatrix* matrix) {
+  std::mt19937 gen(1234);
+  std::uniform_int_distribution<index_t> feat(0, num_feat - 1);
+  matrix->ReAlloc(kRows);
+  for (index_t i = 0; i < kRows; ++i) {
+    matrix->row[i] = new SparseRow;
+    for (index_t n = 0; n < nnz; ++n) {
+      matrix->AddNode(i, feat(gen), 1.0, n % num_field);
+    }
+    matrix->Y[i] = i % 2 ? 1 : -1;
+    matrix->norm[i] = 1.0 / nnz;
+  }
+}
+
+Score* CreateScore(const std::string& score_func) {
+  if (score_func == "linear") { return new LinearScore; }
+  if (score_func == "fm") { return new FMScore; }
+  return new FFMScore;
+}
+
+// Time one case, and print the result to stdout and csv
+void Run(Case& c,
+         Model& model,
+         Score& score,
+         DMatrix& matrix,
+         real_t min_time,
+         FILE* csv) {
+  uint64 num_row = 0;
+  real_t sum = 0;
+  Timer timer;
+  timer.tic();
+  real_t time_cost = 0;
+  do {
+    for (index_t i = 0; i < kRows; ++i) {
+      SparseRow* row = matrix.row[i];
+      if (c.op == "score") {
+        sum += score.CalcScore(row, model, matrix.norm[i]);
+      } else {
+        // A small gradient keeps the model stable
+        score.CalcGrad(row, model, matrix.Y[i] * 1e-3, matrix.norm[i]);
+      }
+    }
+    num_row += kRows;
+    time_cost = timer.toc();
+  } while (time_cost < min_time);
+  sink = sink + sum;
+  real_t ns_per_row = time_cost * 1e9 / num_row;
+  real_t rows_per_sec = num_row / time_cost;
+  real_t gb_per_sec = TouchedBytes(c, model.GetAuxiliarySize()) *
+                      rows_per_sec / 1e9;
+  printf("%-7s %-6s %-8s %4u %5u %6u %10u %10.1f %12.1f %14.1f %9.2f\n",
+         c.score_func.c_str(), c.op.c_str(), c.opt.c_str(),
+         c.K, c.nnz, c.field, c.num_feat, c.model_mb,
+         ns_per_row, rows_per_sec, gb_per_sec);
+  fflush(stdout);
+  if (csv != nullptr) {
+    fprintf(csv, "%s,%s,%s,%u,%u,%u,%u,%.3f,%.2f,%.1f,%.4f\n",
+            c.score_func.c_str(), c.op.c_str(), c.opt.c_str(),
+            c.K, c.nnz, c.field, c.num_feat, c.model_mb,
+            ns_per_row, rows_per_sec, gb_per_sec);
+    fflush(csv);
+  }
+}
+
+// Run all the cases of one model shape
+void RunModel(const std::string& score_func,
+              index_t K,
+              index_t field,
+              size_t model_bytes,
+              real_t min_time,
+              FILE* csv) {
+  for (int o = 0; o < 3; ++o) {
+    std::string opt = kListOpt[o];
+    index_t aux_size = o + 1;  /* sgd 1, adagrad 2, ftrl 3 */
+    size_t feat_bytes = FeatureBytes(score_func, K, field, aux_size);
+    index_t num_feat = std::max(model_bytes / feat_bytes, (size_t)64);
+    Model model;
+    model.Initialize(score_func, "cross-entropy", num_feat,
+                     field, K, aux_size, 0.66);
+    std::unique_ptr<Score> score(CreateScore(score_func));
+    score->Initialize(0.2, 0.00002, 0.3, 1.0, 0.00001, 0.00002, opt);
+    for (index_t nnz : kListNNZ) {
+      DMatrix matrix;
+      Generate(nnz, num_feat, field, &matrix);
+      Case c;
+      c.score_func = score_func;
+      c.opt = opt;
+      c.K = score_func == "linear" ? 0 : K;
+      c.nnz = nnz;
+      c.field = field;
+      c.num_feat = num_feat;
+      c.model_mb = (real_t)num_feat * feat_bytes / (1024 * 1024);
+      // The scoring does not depend on the optimization method
+      if (o == 0) {
+        c.op = "score";
+        c.opt = "-";
+        Run(c, model, *score, matrix, min_time, csv);
+        c.opt = opt;
+      }
+      c.op = "grad";
+      Run(c, model, *score, matrix, min_time, csv);
+    }
+  }
+}
+
+int main(int argc, char* argv[]) {
+  FILE* csv = nullptr;
+  if (argc > 1) {
+    csv = fopen(argv[1], "w");
+    if (csv == nullptr) {
+      fprintf(stderr, "Cannot open the file: %s\n", argv[1]);
+      return 1;
+    }
+    fprintf(csv, "score,op,opt,k,nnz,field,num_feat,model_mb,"
+                 "ns_per_row,rows_per_sec,gb_per_sec\n");
+  }
+  real_t min_time = argc > 2 ? atof(argv[2]) : 0.2;
+  size_t large_bytes = (argc > 3 ? atoi(argv[3]) : 256) * 1024 * 1024;
+  printf("Score kernels on one thread, %g sec per case, model "
+         "size %.2f MB (in cache) and %.0f MB (out of cache)\n",
+         min_time, kSmallModelBytes / (1024.0 * 1024.0),
+         large_bytes / (1024.0 * 1024.0));
+  printf("%-7s %-6s %-8s %4s %5s %6s %10s %10s %12s %14s %9s\n",
+         "score", "op", "opt", "k", "nnz", "field", "num_feat",
+         "model MB", "ns/row", "rows/sec", "GB/s");
+  size_t model_bytes[] = { kSmallModelBytes, large_bytes };
+  for (size_t size : model_bytes) {
+    RunModel("linear", 0, 1, size, min_time, csv);
+    for (index_t K : kListK) {
+      RunModel("fm", K, 1, size, min_time, csv);
+    }
+    for (index_t K : kListK) {
+      for (index_t field : kListField) {
+        RunModel("ffm", K, field, size, min_time, csv);
+      }
+    }
+  }
+  if (csv != nullptr) { fclose(csv); }
+  return 0;
+}
@@ -22,6 +22,7 @@ This file is the implementation of the base Score class.
 #include "src/score/linear_score.h"
 #include "src/score/fm_score.h"
 #include "src/score/ffm_score.h"
+#include "src/base/logging.h"
 
 namespace xLearn {
 
@@ -33,4 +34,46 @@ REGISTER_SCORE("linear", LinearScore);
 REGISTER_SCORE("fm", FMScore);
 REGISTER_SCORE("ffm", FFMScore);
 
+// Copy the context row.
+void Score::CalcContext(const SparseRow* context,
+                        Model& model,
+                        ScoreContext* ctx) {
+  CHECK_NOTNULL(context);
+  CHECK_NOTNULL(ctx);
+  ctx->row.assign(context->begin(), context->end());
+  ctx->sum_sq = 0;
+  for (SparseRow::const_iterator iter = context->begin();
+       iter != context->end(); ++iter) {
+    ctx->sum_sq += iter->feat_val * iter->feat_val;
+  }
+  ctx->linear = 0;
+  ctx->pair = 0;
+}
+
+// Score the joined row. The row lives in the thread-local
+// buffer, which stops touching the heap after the first calls.
+real_t Score::CalcScoreWithContext(const SparseRow* candidate,
+                                   const ScoreContext& ctx,
+                                   Model& model,
+                                   bool is_norm) {
+  static thread_local SparseRow row;
+  row.assign(ctx.row.begin(), ctx.row.end());
+  row.insert(row.end(), candidate->begin(), candidate->end());
+  return CalcScore(&row, model, context_norm(candidate, ctx, is_norm));
+}
+
+// Score num candidates which share one context.
+void Score::RankCandidates(const SparseRow* context,
+                           const SparseRow* const* candidates,
+                           index_t num,
+                           Model& model,
+                           bool is_norm,
+                           real_t* out) {
+  static thread_local ScoreContext ctx;
+  CalcContext(context, model, &ctx);
+  for (index_t i = 0; i < num; ++i) {
+    out[i] = CalcScoreWithContext(candidates[i], ctx, model, is_norm);
+  }
+}
+
 }  // namespace xLearn
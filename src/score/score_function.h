@@ -32,6 +32,31 @@ FM score, FFM score, and etc.
 
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// ScoreContext keeps the partial sums of the context features, which are
+// shared by a group of rows, e.g., the user and context features of the
+// candidates of one ranking request (see Score::CalcContext()). The sums
+// do not include the norm, because the norm depends on the candidate.
+// A ScoreContext can be reused by the next request, and then its buffers
+// are not allocated again.
+//------------------------------------------------------------------------------
+struct ScoreContext {
+  /* Copy of the context row */
+  SparseRow row;
+  /* Sum of the squared feature values of the context */
+  real_t sum_sq = 0;
+  /* Linear term of the context */
+  real_t linear = 0;
+  /* Pairwise term of the context */
+  real_t pair = 0;
+  /* fm: sum of x_j * V_j over the context (aligned_k values).
+     ffm: sum of x_j * V_j_f over the context features j in field
+     g, at (f * num_field + g) * aligned_k for each field f and g */
+  std::vector<real_t> sum_v;
+  /* ffm: the fields g which have context features */
+  std::vector<index_t> field;
+};
+
 //------------------------------------------------------------------------------
 // Score is an abstract class, which can be implemented by different
 // score functions such as LinearScore (liner_score.h), FMScore (fm_score.h)
@@ -73,6 +98,31 @@ class Score {
                            Model& model,
                            real_t norm = 1.0) = 0;
 
+  // Compute the partial sums of the context features, which
+  // are shared by all of the candidates of one request. The
+  // base class only copies the context row.
+  virtual void CalcContext(const SparseRow* context,
+                           Model& model,
+                           ScoreContext* ctx);
+
+  // Score the row (context + candidate) by using the partial sums
+  // of the context, which only touches the candidate features. If
+  // is_norm is true, the norm of the whole row is 1 / sum(x^2), the
+  // same as the reader. The base class scores the joined row.
+  virtual real_t CalcScoreWithContext(const SparseRow* candidate,
+                                      const ScoreContext& ctx,
+                                      Model& model,
+                                      bool is_norm = true);
+
+  // Score num candidates which share one context, and write
+  // the scores to out.
+  void RankCandidates(const SparseRow* context,
+                      const SparseRow* const* candidates,
+                      index_t num,
+                      Model& model,
+                      bool is_norm,
+                      real_t* out);
+
   // Calculate gradient and update current
   // model parameters
   virtual void CalcGrad(const SparseRow* row,
@@ -89,6 +139,19 @@ class Score {
   real_t lambda_2_;
   std::string opt_type_;
 
+  // Get the norm of the row (context + candidate).
+  static inline real_t context_norm(const SparseRow* candidate,
+                                    const ScoreContext& ctx,
+                                    bool is_norm) {
+    if (!is_norm) { return 1.0; }
+    real_t sum_sq = ctx.sum_sq;
+    for (SparseRow::const_iterator iter = candidate->begin();
+         iter != candidate->end(); ++iter) {
+      sum_sq += iter->feat_val * iter->feat_val;
+    }
+    return 1.0f / sum_sq;
+  }
+
  private:
   DISALLOW_COPY_AND_ASSIGN(Score);
 };
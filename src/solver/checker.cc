@@ -52,9 +52,14 @@ OPTIONS:
          4 -- factorization machines (FM) 
          5 -- field-aware factorization machines (FFM) 
                                                                             
-  -x <metric>          :  The metric can be 'acc', 'prec', 'recall', 'f1', 'auc' (classification), and 
+  -x <metric>          :  The metric can be 'acc', 'prec', 'recall', 'f1', 'auc', 'gauc' (classification), and 
                           'mae', 'mape', 'rmsd (rmse)' (regression). On defaurt, xLearn will not print 
-                          any evaluation metric information.                                            
+                          any evaluation metric information. For 'gauc' (group AUC), the first feature 
+                          of each example is used as its group (user) id. 
+                                                                                                      
+  -auc_bucket <size>   :  Number of buckets used by 'auc' and 'gauc'. More buckets give more accurate 
+                          result but use more memory (8 bytes per bucket for each thread). Using 
+                          1000000 by default. 
                                                                                                       
   -p <opt_method>      :  Choose the optimization method, including 'sgd', adagrad', and 'ftrl'. On default, 
                           we use the adagrad optimization. 
@@ -70,6 +75,27 @@ OPTIONS:
 
   -t <txt_model_file>  :  Path of the txt model checkpoint file. On default, this option is empty 
                           and xLearn will not dump the txt model. 
+
+  -infer <infer_model_file> :  Path of the inference-only model file. It has no gradient cache, and its 
+                               page-aligned sections are mapped read-only by xlearn_predict and the C API, 
+                               so that the loading is near-instant and the processes on a host share one 
+                               copy of the model. On default, this option is empty. Not supported by 
+                               --sparse-model. 
+
+  -prune <prune_model_file> :  Path of the pruned inference model file. It only keeps the non-zero linear 
+                               terms and latent factors of the features updated in training, without the 
+                               gradient cache, which is much smaller for the model trained by ftrl with L1 
+                               regularization (-alpha, -beta, -lambda_1). It is read by xlearn_predict and 
+                               the C API. On default, this option is empty. 
+
+  --quantize           :  Quantize the inference-only model (-infer) to int8, which is about 4x smaller 
+                          and faster to score. The loss and metric of the int8 model are compared with 
+                          the fp32 model on the validation set (-v). 
+
+  -ckpt_epoch <epoch>  :  Write a checkpoint ('model_file' + '.ckpt') every <epoch> epochs during the 
+                          training. The checkpoint is written in background and it can be used by -pre. 
+
+  -ckpt_time <second>  :  Write a checkpoint every <second> seconds during the training. 
                                                                              
   -l <log_file>        :  Path of the log file. Using '/tmp/xlearn_log/' by default. 
                                                                                        
@@ -109,6 +135,52 @@ OPTIONS:
                                                                                       
   -seed <random_seed>  :  Random Seed to shuffle data set.
 
+  -vthread <thread_number> :  Number of thread used by pipelined validation (--pipeline). Using a 
+                              quarter of the threads by default. 
+
+  -cvp <worker_number> :  Number of folds trained concurrently in cross-validation (--cv). The threads 
+                          are shared equally by the folds. Using 1 by default. 
+
+  -nworker <number>    :  Number of worker for distributed training. Each worker computes the gradient 
+                          of mini-batches on a part of the data, and the model is stored on the parameter 
+                          server. Using 0 (disable distributed training) by default. 
+
+  -nserver <number>    :  Number of parameter server for distributed training. Using 1 by default. 
+
+  -batch <batch_size>  :  Mini-batch size for distributed training. Using 1000000 by default. 
+
+  -push_codec <codec>  :  Compress the gradient pushed to the parameter server. The codec can be 'none', 
+                          'int8', 'int4' (stochastic quantization) or 'topk' (top-k sparsification). 
+                          The compression error is fed back to the next push. Using 'none' by default. 
+
+  -pull_codec <codec>  :  Compress the model parameters pulled from the parameter server. The codec 
+                          can be 'none', 'int8' or 'int4'. Using 'none' by default. 
+
+  -topk <ratio>        :  Fraction of the gradient kept by the 'topk' codec. Using 0.01 by default. 
+
+  -hash <buckets>      :  Feature hashing. The feature index in libsvm and libffm data can be any raw 
+                          key (e.g., a 64-bit id or a string), which is hashed into <buckets> features. 
+                          The model size is fixed by <buckets>. Using 0 (disable hashing) by default. 
+
+  --hash-field         :  Mix the field id into the hash (-hash), so that each field has its own 
+                          sub-space and the same key in different fields is different features. 
+
+  --sparse-model       :  Store the model in a hash table keyed by the feature id. The parameters of a 
+                          feature are created when it is first seen, so the memory is proportional to 
+                          the seen features, and the model grows in continued training (-pre). 
+
+  -admit <count>       :  Feature admission for --sparse-model. A feature gets its latent factor only 
+                          after it is seen <count> times, which is counted by a count-min sketch in the 
+                          first epoch. Using 0 (admit all features) by default. 
+
+  -admit_fallback <type> :  Parameters of the features which are not admitted (-admit). The type can be 
+                            'linear' (own linear term, needs adagrad or ftrl) or 'shared' (one row shared 
+                            by these features). Using 'linear' by default. 
+
+  -evict <epoch>       :  Evict the features of --sparse-model which are not updated in the last <epoch> 
+                          epochs, including the epochs of the pre-trained model (-pre). Using 0 (disable 
+                          eviction) by default. 
+
   --disk               :  Open on-disk training for large-scale machine learning problems. 
                                                                     
   --cv                 :  Open cross-validation in training tasks. If we use this option, xLearn 
@@ -128,6 +200,18 @@ OPTIONS:
                                                                   
   --quiet              :  Don't print any evaluation information during the training and 
                           just train the model quietly. 
+
+  --pipeline           :  Evaluate the validation set on a snapshot of the model, concurrently with 
+                          the training of next epoch. The early-stopping decision is made one epoch later. 
+
+  --profile            :  Write the time of reading, parsing, gradient, sync, evaluation and checkpoint 
+                          of each epoch to a JSON-lines file next to the log file (<log_file>*.profile.json). 
+
+  --trace              :  Write the tasks of the thread pools to a Chrome-trace file next to the log file 
+                          (<log_file>*.trace.json), which can be opened by chrome://tracing or Perfetto. 
+
+  --no-mem-check       :  Don't stop the training when the estimated memory of the model exceeds the 
+                          available memory. 
 ----------------------------------------------------------------------------------------------)"
     );
   } else {
@@ -153,6 +237,8 @@ OPTIONS:
   --sigmoid                :  Converting output to 0~1 (problebility). 
 
   --disk                   :  On-disk prediction.
+
+  --binary                 :  Write the output file as a raw array of float32 instead of text. 
   
   --no-norm                :  Disable instance-wise normalization. By default, xLearn will use 
                               instance-wise normalization for both training and prediction. 
@@ -171,6 +257,10 @@ void Checker::Initialize(bool is_train, int argc, char* argv[]) {
     menu_.push_back(std::string("-p"));
     menu_.push_back(std::string("-m"));
     menu_.push_back(std::string("-t"));
+    menu_.push_back(std::string("-infer"));
+    menu_.push_back(std::string("-prune"));
+    menu_.push_back(std::string("-ckpt_epoch"));
+    menu_.push_back(std::string("-ckpt_time"));
     menu_.push_back(std::string("-l"));
     menu_.push_back(std::string("-k"));
     menu_.push_back(std::string("-r"));
@@ -189,6 +279,26 @@ void Checker::Initialize(bool is_train, int argc, char* argv[]) {
     menu_.push_back(std::string("--no-norm"));
     menu_.push_back(std::string("--no-bin"));
     menu_.push_back(std::string("--quiet"));
+    menu_.push_back(std::string("--pipeline"));
+    menu_.push_back(std::string("--profile"));
+    menu_.push_back(std::string("--trace"));
+    menu_.push_back(std::string("--no-mem-check"));
+    menu_.push_back(std::string("-vthread"));
+    menu_.push_back(std::string("-cvp"));
+    menu_.push_back(std::string("-nworker"));
+    menu_.push_back(std::string("-nserver"));
+    menu_.push_back(std::string("-batch"));
+    menu_.push_back(std::string("-push_codec"));
+    menu_.push_back(std::string("-pull_codec"));
+    menu_.push_back(std::string("-topk"));
+    menu_.push_back(std::string("-hash"));
+    menu_.push_back(std::string("--hash-field"));
+    menu_.push_back(std::string("--sparse-model"));
+    menu_.push_back(std::string("--quantize"));
+    menu_.push_back(std::string("-admit"));
+    menu_.push_back(std::string("-admit_fallback"));
+    menu_.push_back(std::string("-evict"));
+    menu_.push_back(std::string("-auc_bucket"));
     menu_.push_back(std::string("-alpha"));
     menu_.push_back(std::string("-beta"));
     menu_.push_back(std::string("-lambda_1"));
@@ -202,6 +312,7 @@ void Checker::Initialize(bool is_train, int argc, char* argv[]) {
     menu_.push_back(std::string("--sigmoid"));
     menu_.push_back(std::string("--disk"));
     menu_.push_back(std::string("--no-norm"));
+    menu_.push_back(std::string("--binary"));
   }
   // Get the user's input
   for (int i = 0; i < argc; ++i) {
@@ -304,6 +415,7 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
           list[i+1].compare("recall") != 0 &&
           list[i+1].compare("f1") != 0 &&
           list[i+1].compare("auc") != 0 &&
+          list[i+1].compare("gauc") != 0 &&
           list[i+1].compare("mae") != 0 &&
           list[i+1].compare("mape") != 0 &&
           list[i+1].compare("rmsd") != 0 &&
@@ -317,6 +429,7 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
                "   recall \n"
                "   f1 \n"
                "   auc\n"
+               "   gauc\n"
                "   mae \n"
                "   mape \n"
                "   rmsd \n"
@@ -360,6 +473,12 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
     } else if (list[i].compare("-t") == 0) { // txt model file
       hyper_param.txt_model_file = list[i+1];
       i += 2;
+    } else if (list[i].compare("-infer") == 0) { // inference model file
+      hyper_param.infer_model_file = list[i+1];
+      i += 2;
+    } else if (list[i].compare("-prune") == 0) { // pruned model file
+      hyper_param.prune_model_file = list[i+1];
+      i += 2;
     } else if (list[i].compare("-l") == 0) {  // log file
       hyper_param.log_file = list[i+1];
       i += 2;
@@ -508,6 +627,203 @@ bool Checker::check_train_options(HyperParam& hyper_param) {
     } else if (list[i].compare("--quiet") == 0) {  // quiet
       hyper_param.quiet = true;
       i += 1;
+    } else if (list[i].compare("-auc_bucket") == 0) {  // bucket size for auc
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -auc_bucket : '%i'. -auc_bucket must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.auc_bucket = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--pipeline") == 0) {  // pipelined validation
+      hyper_param.pipeline_valid = true;
+      i += 1;
+    } else if (list[i].compare("--profile") == 0) {  // per-epoch profiling
+      hyper_param.profile = true;
+      i += 1;
+    } else if (list[i].compare("--trace") == 0) {  // timeline of threads
+      hyper_param.trace = true;
+      i += 1;
+    } else if (list[i].compare("--no-mem-check") == 0) {  // no memory check
+      hyper_param.mem_check = false;
+      i += 1;
+    } else if (list[i].compare("-vthread") == 0) {  // thread for validation
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -vthread : '%i'. -vthread must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.valid_thread_number = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ckpt_epoch") == 0) {  // checkpoint epoch
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -ckpt_epoch : '%i'. -ckpt_epoch must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.checkpoint_epoch = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-ckpt_time") == 0) {  // checkpoint time
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -ckpt_time : '%f'. -ckpt_time must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.checkpoint_time = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-cvp") == 0) {  // parallel cross-validation
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -cvp : '%i'. -cvp must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.cv_parallel = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-nworker") == 0) {  // distributed worker
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -nworker : '%i'. -nworker must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.num_worker = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-nserver") == 0) {  // parameter server
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -nserver : '%i'. -nserver must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.num_server = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-batch") == 0) {  // mini-batch size
+      int value = atoi(list[i+1].c_str());
+      if (value <= 0) {
+        Color::print_error(
+          StringPrintf("Illegal -batch : '%i'. -batch must be greater than zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.batch_size = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-push_codec") == 0 ||
+               list[i].compare("-pull_codec") == 0) {  // codec
+      std::string value = list[i+1];
+      bool is_push = list[i].compare("-push_codec") == 0;
+      if (value.compare("none") != 0 &&
+          value.compare("int8") != 0 &&
+          value.compare("int4") != 0 &&
+          (value.compare("topk") != 0 || !is_push)) {
+        Color::print_error(
+          StringPrintf("Unknow codec '%s' for %s.",
+               value.c_str(), list[i].c_str())
+        );
+        bo = false;
+      } else if (is_push) {
+        hyper_param.push_codec = value;
+      } else {
+        hyper_param.pull_codec = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-topk") == 0) {  // topk ratio
+      real_t value = atof(list[i+1].c_str());
+      if (value <= 0 || value > 1) {
+        Color::print_error(
+          StringPrintf("Illegal -topk : '%f'. -topk must be in (0, 1].",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.topk_ratio = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-hash") == 0) {  // feature hashing
+      long long value = atoll(list[i+1].c_str());
+      if (value < 0 || value > kMaxHashBuckets) {
+        Color::print_error(
+          StringPrintf("Illegal -hash : '%lld'. -hash must be in [0, %u].",
+               value, kMaxHashBuckets)
+        );
+        bo = false;
+      } else {
+        hyper_param.hash_buckets = value;
+      }
+      i += 2;
+    } else if (list[i].compare("--hash-field") == 0) {  // field sub-space
+      hyper_param.hash_field = true;
+      i += 1;
+    } else if (list[i].compare("--sparse-model") == 0) {  // sparse model
+      hyper_param.sparse_model = true;
+      i += 1;
+    } else if (list[i].compare("--quantize") == 0) {  // int8 inference model
+      hyper_param.quantize = true;
+      i += 1;
+    } else if (list[i].compare("-admit") == 0) {  // feature admission
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -admit : '%i'. -admit must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.admit_count = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-admit_fallback") == 0) {  // fallback
+      std::string value = list[i+1];
+      if (value.compare("linear") != 0 &&
+          value.compare("shared") != 0) {
+        Color::print_error(
+          StringPrintf("Unknow -admit_fallback : '%s'. It can be 'linear' or 'shared'.",
+               value.c_str())
+        );
+        bo = false;
+      } else {
+        hyper_param.admit_fallback = value;
+      }
+      i += 2;
+    } else if (list[i].compare("-evict") == 0) {  // feature eviction
+      int value = atoi(list[i+1].c_str());
+      if (value < 0) {
+        Color::print_error(
+          StringPrintf("Illegal -evict : '%i'. -evict must be greater than or equal to zero.",
+               value)
+        );
+        bo = false;
+      } else {
+        hyper_param.evict_epoch = value;
+      }
+      i += 2;
     } else if (list[i].compare("-alpha") == 0) {  // alpha
       real_t value = atof(list[i+1].c_str());
       if (value <= 0) {
@@ -641,6 +957,7 @@ bool Checker::check_train_param(HyperParam& hyper_param) {
       hyper_param.metric.compare("recall") != 0 &&
       hyper_param.metric.compare("f1") != 0 &&
       hyper_param.metric.compare("auc") != 0 &&
+      hyper_param.metric.compare("gauc") != 0 &&
       hyper_param.metric.compare("mae") != 0 &&
       hyper_param.metric.compare("mape") != 0 &&
       hyper_param.metric.compare("rmsd") != 0 &&
@@ -744,6 +1061,84 @@ void Checker::check_conflict_train(HyperParam& hyper_param) {
                          "disable early-stopping.");
     hyper_param.early_stop = false;
   }
+  if (hyper_param.pipeline_valid && hyper_param.quiet) {
+    Color::print_warning("The --quiet option has been set, and xLearn "
+                         "has already disable the --pipeline option.");
+    hyper_param.pipeline_valid = false;
+  }
+  if ((hyper_param.checkpoint_epoch > 0 || 
+       hyper_param.checkpoint_time > 0) &&
+      (hyper_param.cross_validation || 
+       hyper_param.model_file.compare("none") == 0)) {
+    Color::print_warning("No model file is written in cross-validation or "
+                         "when -m is 'none', and xLearn has already disable "
+                         "the checkpoint (-ckpt_epoch, -ckpt_time).");
+    hyper_param.checkpoint_epoch = 0;
+    hyper_param.checkpoint_time = 0;
+  }
+  if (hyper_param.pipeline_valid && 
+      hyper_param.cross_validation &&
+      hyper_param.cv_parallel > 1) {
+    Color::print_warning("The folds are trained concurrently (-cvp), and xLearn "
+                         "has already disable the --pipeline option.");
+    hyper_param.pipeline_valid = false;
+  }
+  if (hyper_param.hash_field && hyper_param.hash_buckets == 0) {
+    Color::print_warning("The --hash-field option is used with feature "
+                         "hashing (-hash), and xLearn has already ignored it.");
+    hyper_param.hash_field = false;
+  }
+  if (hyper_param.num_worker > 0 && hyper_param.cross_validation) {
+    Color::print_warning("The --cv (cross-validation) has been set, and xLearn "
+                         "has already disable the distributed training (-nworker).");
+    hyper_param.num_worker = 0;
+  }
+  if (hyper_param.num_worker > 0 && !hyper_param.pre_model_file.empty()) {
+    Color::print_warning("The parameter server cannot start from a pre-trained "
+                         "model (-pre), and xLearn has already disable the "
+                         "distributed training (-nworker).");
+    hyper_param.num_worker = 0;
+  }
+  if ((hyper_param.admit_count > 1 || hyper_param.evict_epoch > 0) &&
+      !hyper_param.sparse_model && hyper_param.num_worker == 0) {
+    Color::print_warning("The feature admission (-admit) and eviction (-evict) "
+                         "need a sparse model, and xLearn has already enabled "
+                         "the --sparse-model option.");
+    hyper_param.sparse_model = true;
+  }
+  if (hyper_param.sparse_model && hyper_param.num_worker > 0) {
+    Color::print_warning("The parameter server stores a dense model (-nworker), "
+                         "and xLearn has already ignored the --sparse-model option.");
+    hyper_param.sparse_model = false;
+  }
+  if (hyper_param.admit_count > 1 &&
+      hyper_param.score_func.compare("linear") == 0) {
+    Color::print_warning("The linear model has no latent factor, and xLearn "
+                         "has already ignored the -admit option.");
+    hyper_param.admit_count = 0;
+  }
+  if (hyper_param.admit_count > 1 &&
+      hyper_param.admit_fallback.compare("linear") == 0 &&
+      hyper_param.opt_type.compare("sgd") == 0) {
+    Color::print_warning("The linear-only features (-admit_fallback linear) "
+                         "need adagrad or ftrl, and xLearn has already used "
+                         "the shared fallback (-admit_fallback shared).");
+    hyper_param.admit_fallback = "shared";
+  }
+  if (hyper_param.quantize &&
+      hyper_param.infer_model_file.compare("none") == 0) {
+    Color::print_warning("The --quantize option is used by the inference model "
+                         "(-infer), and xLearn has already ignored it.");
+    hyper_param.quantize = false;
+  }
+  if (hyper_param.pipeline_valid &&
+      hyper_param.validate_set_file.empty() && 
+      hyper_param.valid_dataset == nullptr &&
+      !hyper_param.cross_validation) {
+    Color::print_warning("Validation file(dataset) not found, xLearn has already "
+                         "disable the --pipeline option.");
+    hyper_param.pipeline_valid = false;
+  }
   if (hyper_param.metric.compare("none") != 0 &&
       hyper_param.validate_set_file.empty() && 
       hyper_param.valid_dataset == nullptr &&
@@ -863,6 +1258,9 @@ bool Checker::check_prediction_options(HyperParam& hyper_param) {
     } else if (list[i].compare("--disk") == 0) {  // on-disk prediction
       hyper_param.on_disk = true;
       i += 1;
+    } else if (list[i].compare("--binary") == 0) {  // binary output
+      hyper_param.binary_out = true;
+      i += 1;
     } else if (list[i].compare("--no-norm") == 0) {  // normalization
       hyper_param.norm = false;
       i += 1;
@@ -0,0 +1,82 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+/*
+This file is the implementation of the Checkpoint class.
+*/
+
+#include "src/solver/checkpoint.h"
+
+#include "src/base/logging.h"
+#include "src/base/profiler.h"
+#include "src/base/timer.h"
+
+namespace xLearn {
+
+// Set the file and the interval of checkpoint
+void Checkpoint::Initialize(const std::string& filename,
+                            int epoch_interval,
+                            real_t time_interval) {
+  CHECK_NE(filename.empty(), true);
+  CHECK_GE(epoch_interval, 0);
+  CHECK_GE(time_interval, 0);
+  filename_ = filename;
+  epoch_interval_ = epoch_interval;
+  time_interval_ = time_interval;
+  last_epoch_ = 0;
+  last_time_ = std::chrono::steady_clock::now();
+}
+
+// Take a snapshot and write it in background
+bool Checkpoint::Save(Model& model, int epoch) {
+  if (!Enabled()) { return false; }
+  std::chrono::duration<real_t> elapsed = 
+    std::chrono::steady_clock::now() - last_time_;
+  bool due = (epoch_interval_ > 0 && 
+              epoch - last_epoch_ >= epoch_interval_) ||
+             (time_interval_ > 0 && 
+              elapsed.count() >= time_interval_);
+  if (!due) { return false; }
+  // Do not stall the training
+  if (busy_) {
+    LOG(INFO) << "Skip the checkpoint of epoch " << epoch
+              << ", because the last one is still being written.";
+    return false;
+  }
+  ProfileScope scope(kPhaseCheckpoint);
+  if (writer_.joinable()) { writer_.join(); }
+  snapshot_.CopyFrom(model);
+  last_epoch_ = epoch;
+  last_time_ = std::chrono::steady_clock::now();
+  busy_ = true;
+  writer_ = std::thread([this, epoch]() {
+    ProfileScope scope(kPhaseCheckpoint);
+    Timer timer;
+    timer.tic();
+    snapshot_.Serialize(filename_);
+    LOG(INFO) << "Write checkpoint of epoch " << epoch 
+              << " to " << filename_ << " in " 
+              << timer.toc() << " (sec)";
+    busy_ = false;
+  });
+  return true;
+}
+
+// Wait the background thread
+void Checkpoint::Wait() {
+  if (writer_.joinable()) { writer_.join(); }
+}
+
+} // namespace xLearn
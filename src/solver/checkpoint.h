@@ -0,0 +1,107 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+/*
+This file defines the Checkpoint class.
+*/
+
+#ifndef XLEARN_SOLVER_CHECKPOINT_H_
+#define XLEARN_SOLVER_CHECKPOINT_H_
+
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+
+#include "src/base/common.h"
+#include "src/data/model_parameters.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Checkpoint writes the model to disk file periodically during the
+// training. It takes a snapshot of the model parameters (memcpy) and
+// then writes the snapshot in a background thread, so that training
+// does not wait for the disk. If the last checkpoint is still being
+// written, the current one will be skipped. We can use the Checkpoint
+// class like this:
+//
+//   Checkpoint checkpoint;
+//   checkpoint.Initialize("./model.out.ckpt",
+//                         1,     /* every epoch */
+//                         600);  /* or every 10 minutes */
+//
+//   for (int n = 1; n <= epoch; ++n) {
+//     ... /* train one epoch */
+//     checkpoint.Save(model, n);
+//   }
+//
+//   checkpoint.Wait();
+//
+// The checkpoint file can be used to resume the training (-pre).
+//------------------------------------------------------------------------------
+class Checkpoint {
+ public:
+  // Constructor and Destructor
+  Checkpoint()
+   : epoch_interval_(0),
+     time_interval_(0),
+     last_epoch_(0),
+     busy_(false) { }
+  ~Checkpoint() { Wait(); }
+
+  // Invoke this function before we use this class.
+  // 0 means disable the epoch interval (or time interval).
+  void Initialize(const std::string& filename,
+                  int epoch_interval,
+                  real_t time_interval);
+
+  // Invoke this function after each epoch. Return true 
+  // if a new checkpoint has been started.
+  bool Save(Model& model, int epoch);
+
+  // Wait the checkpoint that is being written.
+  void Wait();
+
+  // Is the checkpoint enabled ?
+  bool Enabled() const {
+    return epoch_interval_ > 0 || time_interval_ > 0;
+  }
+
+ protected:
+  /* Checkpoint file */
+  std::string filename_;
+  /* Save the model every epoch_interval_ epochs */
+  int epoch_interval_;
+  /* Save the model every time_interval_ seconds */
+  real_t time_interval_;
+  /* The epoch of the last checkpoint */
+  int last_epoch_;
+  /* The time of the last checkpoint */
+  std::chrono::steady_clock::time_point last_time_;
+  /* Model snapshot, which is allocated once */
+  Model snapshot_;
+  /* Background thread for writing */
+  std::thread writer_;
+  /* True if the snapshot is being written */
+  std::atomic<bool> busy_;
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Checkpoint);
+};
+
+} // namespace xLearn
+
+#endif  // XLEARN_SOLVER_CHECKPOINT_H_
@@ -0,0 +1,293 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the end-to-end throughput benchmark of xLearn, which
+writes a synthetic CTR data set by the DataGenerator, and then times
+the parsing, the loading, the training and the prediction of the
+Solver for a list of thread numbers, both in-memory and on-disk.
+
+Usage: e2e_benchmark [-rows 1000000] [-format libffm] [-field 10]
+                     [-feat 100000] [-nnz 20] [-zipf 1.1]
+                     [-score ffm] [-epoch 3] [-threads 1,2,4,8]
+                     [-dir /tmp] [-csv result.csv] [--keep]
+
+The table is printed to stdout, and the same results are written to
+the csv file (if given). The speedup and the efficiency of N threads
+are relative to the run on the first thread number in the list.
+*/
+
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/split_string.h"
+#include "src/base/timer.h"
+#include "src/data/data_structure.h"
+#include "src/data/hyper_parameters.h"
+#include "src/reader/data_generator.h"
+#include "src/reader/parser.h"
+#include "src/solver/solver.h"
+
+using namespace xLearn;
+
+//------------------------------------------------------------------------------
+// The Solver prints its logo and logs to stdout. We redirect stdout
+// to /dev/null when the Solver is running, so that the table is clean.
+//------------------------------------------------------------------------------
+class Mute {
+ public:
+  Mute() {
+    fflush(stdout);
+    saved_ = dup(STDOUT_FILENO);
+    int null = open("/dev/null", O_WRONLY);
+    dup2(null, STDOUT_FILENO);
+    close(null);
+  }
+  ~Mute() {
+    fflush(stdout);
+    dup2(saved_, STDOUT_FILENO);
+    close(saved_);
+  }
+
+ private:
+  int saved_;
+};
+
+// Result of one run
+struct Result {
+  std::string mode;
+  int thread;
+  real_t load_sec;
+  real_t train_sec;
+  real_t train_rows;
+  real_t predict_sec;
+  real_t predict_rows;
+};
+
+// Run the Solver, and return the time cost of
+// Initialize() and StartWork() respectively.
+void RunSolver(HyperParam& param, bool train,
+               real_t* init_sec, real_t* work_sec) {
+  Mute mute;
+  Timer timer;
+  Solver solver;
+  if (train) {
+    solver.SetTrain();
+  } else {
+    solver.SetPredict();
+  }
+  param.is_train = train;
+  timer.tic();
+  solver.Initialize(param);
+  *init_sec = timer.toc();
+  timer.reset();
+  timer.tic();
+  solver.StartWork();
+  *work_sec = timer.toc();
+  solver.Clear();
+}
+
+// Rows per second, where the Timer has a resolution of 1 ms
+real_t Rate(real_t rows, real_t sec) {
+  return rows / std::max(sec, (real_t)1e-3);
+}
+
+// Parse the whole file in one thread, and return MB/sec
+real_t ParseSpeed(const std::string& filename, const std::string& format) {
+  char* buffer = nullptr;
+  uint64 size = ReadFileToMemory(filename, &buffer);
+  Parser* parser = CREATE_PARSER(format.c_str());
+  CHECK_NOTNULL(parser);
+  parser->setLabel(true);
+  parser->setSplitor(format == "csv" ? "," : " ");
+  DMatrix matrix;
+  Timer timer;
+  timer.tic();
+  parser->Parse(buffer, size, matrix, true);
+  real_t sec = timer.toc();
+  delete parser;
+  delete [] buffer;
+  return Rate(size / 1024.0 / 1024.0, sec);
+}
+
+void Usage() {
+  printf("Usage: e2e_benchmark [-rows 1000000] [-format libffm] "
+         "[-field 10]\n"
+         "                     [-feat 100000] [-nnz 20] [-zipf 1.1]\n"
+         "                     [-score ffm] [-epoch 3] "
+         "[-threads 1,2,4,8]\n"
+         "                     [-dir /tmp] [-csv result.csv] [--keep]\n");
+}
+
+int main(int argc, char* argv[]) {
+  index_t num_row = 1000000;
+  std::string format = "libffm";
+  index_t num_field = 10;
+  index_t feat_per_field = 100000;
+  real_t avg_nnz = 20;
+  real_t zipf = 1.1;
+  std::string score;
+  int num_epoch = 3;
+  std::string thread_list = "1,2,4,8";
+  std::string dir = "/tmp";
+  std::string csv_file;
+  bool keep = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string opt = argv[i];
+    if (opt == "--keep") {
+      keep = true;
+      continue;
+    }
+    if (i + 1 >= argc) {
+      Usage();
+      return 1;
+    }
+    std::string value = argv[++i];
+    if (opt == "-rows") {
+      num_row = atoi(value.c_str());
+    } else if (opt == "-format") {
+      format = value;
+    } else if (opt == "-field") {
+      num_field = atoi(value.c_str());
+    } else if (opt == "-feat") {
+      feat_per_field = atoi(value.c_str());
+    } else if (opt == "-nnz") {
+      avg_nnz = atof(value.c_str());
+    } else if (opt == "-zipf") {
+      zipf = atof(value.c_str());
+    } else if (opt == "-score") {
+      score = value;
+    } else if (opt == "-epoch") {
+      num_epoch = atoi(value.c_str());
+    } else if (opt == "-threads") {
+      thread_list = value;
+    } else if (opt == "-dir") {
+      dir = value;
+    } else if (opt == "-csv") {
+      csv_file = value;
+    } else {
+      Usage();
+      return 1;
+    }
+  }
+  if (format != "libsvm" && format != "libffm" && format != "csv") {
+    printf("Unknown format: %s\n", format.c_str());
+    return 1;
+  }
+  if (score.empty()) {
+    score = format == "libffm" ? "ffm" : "fm";
+  }
+  std::vector<std::string> str_vec;
+  SplitStringUsing(thread_list, ",", &str_vec);
+  std::vector<int> threads;
+  for (size_t i = 0; i < str_vec.size(); ++i) {
+    threads.push_back(atoi(str_vec[i].c_str()));
+  }
+  CHECK(!threads.empty());
+  // Generate the data set, where the test set is 1/10 of the train set
+  std::string train_file = dir + "/xlearn_e2e_train.txt";
+  std::string test_file = dir + "/xlearn_e2e_test.txt";
+  std::string model_file = dir + "/xlearn_e2e_model.out";
+  std::string output_file = dir + "/xlearn_e2e_output.txt";
+  index_t num_test = std::max(num_row / 10, (index_t)1);
+  DataGenerator gen;
+  Timer timer;
+  timer.tic();
+  gen.Initialize(num_row, num_field, feat_per_field, avg_nnz, zipf, 1);
+  uint64 train_bytes = gen.Write(train_file, format);
+  gen.Initialize(num_test, num_field, feat_per_field, avg_nnz, zipf, 2);
+  gen.Write(test_file, format);
+  printf("Data: %d rows (%.1f MB) in %s, %d fields, %d features, "
+         "avg nnz %.1f, zipf %.2f, generated in %.2f sec\n",
+         num_row, train_bytes / 1024.0 / 1024.0, format.c_str(),
+         num_field, gen.GetNumFeature(), avg_nnz, zipf, timer.toc());
+  printf("Parse (1 thread): %.1f MB/sec\n",
+         ParseSpeed(train_file, format));
+  printf("Model: %s, %d epochs\n\n", score.c_str(), num_epoch);
+  printf("%-9s %7s %10s %14s %14s %9s %7s\n",
+         "mode", "threads", "load(sec)", "train(rows/s)",
+         "pred(rows/s)", "speedup", "eff");
+  std::vector<Result> result;
+  const char* modes[2] = { "in-memory", "on-disk" };
+  for (int m = 0; m < 2; ++m) {
+    real_t base = 0;
+    for (size_t t = 0; t < threads.size(); ++t) {
+      HyperParam param;
+      param.train_set_file = train_file;
+      param.test_set_file = test_file;
+      param.model_file = model_file;
+      param.output_file = output_file;
+      param.log_file = dir + "/xlearn_e2e_log";
+      param.score_func = score;
+      param.num_epoch = num_epoch;
+      param.thread_number = threads[t];
+      param.on_disk = m == 1;
+      param.bin_out = false;
+      param.quiet = true;
+      Result r;
+      r.mode = modes[m];
+      r.thread = threads[t];
+      real_t init_sec = 0;
+      RunSolver(param, true, &r.load_sec, &r.train_sec);
+      r.train_rows = Rate((real_t)num_row * num_epoch, r.train_sec);
+      RunSolver(param, false, &init_sec, &r.predict_sec);
+      r.predict_rows = Rate(num_test, r.predict_sec);
+      if (t == 0) { base = r.train_rows / threads[0]; }
+      real_t speedup = r.train_rows / (base * threads[0]);
+      printf("%-9s %7d %10.3f %14.1f %14.1f %8.2fx %6.1f%%\n",
+             r.mode.c_str(), r.thread, r.load_sec, r.train_rows,
+             r.predict_rows, speedup,
+             r.train_rows / (base * r.thread) * 100);
+      fflush(stdout);
+      result.push_back(r);
+    }
+  }
+  if (!csv_file.empty()) {
+    FILE* file = OpenFileOrDie(csv_file.c_str(), "w");
+    fprintf(file, "format,score,rows,mode,threads,load_sec,train_sec,"
+                  "train_rows_per_sec,predict_sec,predict_rows_per_sec\n");
+    for (size_t i = 0; i < result.size(); ++i) {
+      const Result& r = result[i];
+      fprintf(file, "%s,%s,%d,%s,%d,%.4f,%.4f,%.1f,%.4f,%.1f\n",
+              format.c_str(), score.c_str(), num_row, r.mode.c_str(),
+              r.thread, r.load_sec, r.train_sec, r.train_rows,
+              r.predict_sec, r.predict_rows);
+    }
+    Close(file);
+  }
+  if (!keep) {
+    RemoveFile(train_file.c_str());
+    RemoveFile(test_file.c_str());
+    // The prediction caches the test set in binary
+    std::string bin_file = test_file + ".bin";
+    if (FileExist(bin_file.c_str())) {
+      RemoveFile(bin_file.c_str());
+    }
+    RemoveFile(model_file.c_str());
+    RemoveFile(output_file.c_str());
+  }
+  return 0;
+}
@@ -21,6 +21,7 @@ This file is the implementation of the Predictor class.
 #include "src/solver/inference.h"
 #include "src/base/timer.h"
 #include "src/base/format_print.h"
+#include "src/base/result_writer.h"
 
 #include <vector>
 #include <sstream>
@@ -30,8 +31,10 @@ namespace xLearn {
 // Given a pre-trained model and test data, the predictor
 // will return the prediction output
 void Predictor::Predict() {
-  if (res_out_)
-    std::ofstream o_file(out_file_);
+  ResultWriter writer;
+  if (res_out_) {
+    writer.Open(out_file_, binary_);
+  }
   static std::vector<real_t> out;
   DMatrix* matrix = nullptr;
   reader_->Reset();
@@ -49,14 +52,14 @@ void Predictor::Predict() {
     } else if (sign_) {
       this->sign(out, out);
     }
-    this->out_.insert(this->out_.end(), out.begin(), out.end());
+    if (retain_) {
+      this->out_.insert(this->out_.end(), out.begin(), out.end());
+    }
     if (res_out_) {
-      std::ofstream o_file(out_file_, std::ofstream::app);
-      for (index_t i = 0; i < out.size(); ++i) {
-        o_file << out[i] << "\n";
-      }
+      writer.Write(out.data(), out.size());
     }
   }
+  writer.Close();
   if (reader_->has_label()) {
     Color::print_info(
       StringPrintf("The test loss is: %.6f", 
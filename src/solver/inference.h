@@ -33,7 +33,11 @@ namespace xLearn {
 
 //------------------------------------------------------------------------------
 // Given a pre-trained model and test data, the predictor
-// will return the prediction output
+// will return the prediction output. The output file is written
+// by a ResultWriter in the background, in text or in binary float32.
+// The results are kept in memory (GetResult()) only if retain is
+// true, and hence a large job writing to a file does not hold all
+// of its results.
 //------------------------------------------------------------------------------
 class Predictor {
  public:
@@ -48,7 +52,9 @@ class Predictor {
                   const std::string& out,
                   bool sign = false,
                   bool sigmoid = false,
-                  bool res_out = true) {
+                  bool res_out = true,
+                  bool binary = false,
+                  bool retain = true) {
     CHECK_NOTNULL(reader);
     CHECK_NOTNULL(model);
     CHECK_NOTNULL(loss);
@@ -61,6 +67,8 @@ class Predictor {
     sign_ = sign;
     sigmoid_ = sigmoid;
     res_out_ = res_out;
+    binary_ = binary;
+    retain_ = retain;
   }
 
   // The core function
@@ -80,6 +88,8 @@ class Predictor {
   bool sign_;
   bool sigmoid_;
   bool res_out_;
+  bool binary_;
+  bool retain_;
 
   // Convert output by using the sigmoid function.
   void sigmoid(std::vector<real_t>& in, 
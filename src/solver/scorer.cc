@@ -0,0 +1,228 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of Scorer.
+*/
+
+#include "src/solver/scorer.h"
+
+#include <math.h>
+#include <string.h>
+
+#include <condition_variable>
+#include <iterator>
+#include <mutex>
+#include <thread>
+
+#include "src/base/file_util.h"
+#include "src/base/format_print.h"
+#include "src/data/sparse_table.h"
+
+namespace xLearn {
+
+// Each job of PredictRows() scores at least this number of
+// rows, so that a small batch runs on the calling thread.
+static const index_t kScorerMinRows = 64;
+
+Scorer::~Scorer() {
+  delete pool_;
+  delete score_;
+  delete model_;
+}
+
+// Invoke this function before Load()
+void Scorer::Initialize(index_t thread_num,
+                        bool norm,
+                        bool sign,
+                        bool sigmoid) {
+  thread_num_ = thread_num;
+  if (thread_num_ == 0) {
+    thread_num_ = std::max(std::thread::hardware_concurrency(), 1u);
+  }
+  norm_ = norm;
+  sign_ = sign;
+  sigmoid_ = sigmoid;
+}
+
+// Load the binary model and create the score function
+bool Scorer::Load(const std::string& filename) {
+  CHECK_NE(filename.empty(), true);
+  CHECK(score_ == nullptr);
+  if (!FileExist(filename.c_str())) {
+    return false;
+  }
+  Model* model = new Model();
+  if (!model->Deserialize(filename)) {
+    delete model;
+    return false;
+  }
+  // The compacted model has fewer rows than the buckets
+  hash_buckets_ = model->IsHashed() ? model->GetNumFeature() : 0;
+  if (model->IsSparse()) {
+    model_ = compact(*model);
+    delete model;
+  } else {
+    model_ = model;
+  }
+  score_ = CREATE_SCORE(model_->GetScoreFunction().c_str());
+  if (score_ == nullptr) {
+    Color::print_error(
+      StringPrintf("Unknow score function: %s",
+                   model_->GetScoreFunction().c_str())
+    );
+    delete model_;
+    model_ = nullptr;
+    return false;
+  }
+  // The calling thread runs one job of each PredictRows()
+  if (thread_num_ > 1) {
+    pool_ = new ThreadPool(thread_num_ - 1);
+  }
+  return true;
+}
+
+// Copy the rows of a sparse model to a new dense model
+Model* Scorer::compact(Model& sparse) {
+  SparseTable* table = sparse.GetSparseTable();
+  SparseTable* linear = sparse.GetLinearTable();
+  table->GetKeys(&keys_);
+  if (linear != nullptr) {
+    std::vector<index_t> table_keys;
+    std::vector<index_t> linear_keys;
+    keys_.swap(table_keys);
+    linear->GetKeys(&linear_keys);
+    std::set_union(table_keys.begin(), table_keys.end(),
+                   linear_keys.begin(), linear_keys.end(),
+                   std::back_inserter(keys_));
+  }
+  compacted_ = true;
+  index_t num_keys = keys_.size();
+  // The unseen features are skipped by the score functions,
+  // or they use the shared row of the features not admitted.
+  unseen_id_ = num_keys;
+  if (sparse.IsAdmission() && sparse.IsSharedFallback() &&
+      table->Find(kSharedFeatureKey) != nullptr) {
+    unseen_id_ = dense_id(kSharedFeatureKey);
+  }
+  Model* dense = new Model();
+  index_t aux_size = sparse.GetAuxiliarySize();
+  dense->Initialize(sparse.GetScoreFunction(),
+                    sparse.GetLossFunction(),
+                    std::max(num_keys, (index_t)1),
+                    sparse.GetNumField(),
+                    sparse.GetNumK(),
+                    aux_size);
+  dense->SetFeatureHash(sparse.IsHashed(), sparse.IsFieldHashed());
+  memcpy(dense->GetParameter_b(),
+         sparse.GetParameter_b(),
+         aux_size * sizeof(real_t));
+  real_t* w = dense->GetParameter_w();
+  real_t* v = dense->GetParameter_v();
+  index_t offset_v = table->GetOffset_v();
+  index_t len_v = table->GetLength_v();
+  memset(w, 0, dense->GetNumParameter_w() * sizeof(real_t));
+  if (len_v > 0) {
+    memset(v, 0, dense->GetNumParameter_v() * sizeof(real_t));
+  }
+  for (index_t k = 0; k < num_keys; ++k) {
+    real_t* row = table->Find(keys_[k]);
+    if (row != nullptr) {
+      memcpy(w + k * aux_size, row, aux_size * sizeof(real_t));
+      if (len_v > 0) {
+        memcpy(v + k * len_v, row + offset_v, len_v * sizeof(real_t));
+      }
+    } else {
+      // Linear-only feature, whose latent factor is zero
+      row = linear->Find(keys_[k]);
+      memcpy(w + k * aux_size, row, aux_size * sizeof(real_t));
+    }
+  }
+  return dense;
+}
+
+// Score the rows in [start, end) on current thread
+void Scorer::score_rows(const uint64* indptr,
+                        const index_t* indices,
+                        const index_t* fields,
+                        const real_t* values,
+                        real_t* out,
+                        size_t start,
+                        size_t end) {
+  // Re-used by all the calls on this thread
+  static thread_local SparseRow row;
+  for (size_t i = start; i < end; ++i) {
+    row.clear();
+    real_t norm = 0.0;
+    for (uint64 n = indptr[i]; n < indptr[i+1]; ++n) {
+      real_t value = values == nullptr ? 1.0 : values[n];
+      index_t field = fields == nullptr ? 0 : fields[n];
+      row.push_back(Node(field, dense_id(indices[n]), value));
+      norm += value*value;
+    }
+    norm = (norm_ && norm > 0) ? 1.0f / norm : 1.0f;
+    real_t score = score_->CalcScore(&row, *model_, norm);
+    if (sigmoid_) {
+      score = 1.0 / (1.0 + exp(-score));
+    } else if (sign_) {
+      score = score > 0 ? 1 : 0;
+    }
+    out[i] = score;
+  }
+}
+
+// Score nrow rows in CSR format
+void Scorer::PredictRows(const uint64* indptr,
+                         const index_t* indices,
+                         const index_t* fields,
+                         const real_t* values,
+                         index_t nrow,
+                         real_t* out) {
+  CHECK(IsLoaded());
+  if (nrow == 0) { return; }
+  CHECK_NOTNULL(indptr);
+  CHECK_NOTNULL(out);
+  if (indptr[nrow] > indptr[0]) {
+    CHECK_NOTNULL(indices);
+  }
+  size_t count = std::min((size_t)thread_num_,
+                          (size_t)(nrow + kScorerMinRows - 1) / kScorerMinRows);
+  if (count <= 1 || pool_ == nullptr) {
+    score_rows(indptr, indices, fields, values, out, 0, nrow);
+    return;
+  }
+  // Other callers may share the pool, and hence we wait
+  // for the jobs of this call instead of ThreadPool::Sync().
+  std::mutex mutex;
+  std::condition_variable done;
+  size_t left = count - 1;
+  for (size_t i = 1; i < count; ++i) {
+    size_t start = getStart(nrow, count, i);
+    size_t end = getEnd(nrow, count, i);
+    pool_->enqueue([&, start, end]() {
+      score_rows(indptr, indices, fields, values, out, start, end);
+      std::unique_lock<std::mutex> lock(mutex);
+      if (--left == 0) { done.notify_one(); }
+    });
+  }
+  score_rows(indptr, indices, fields, values, out,
+             0, getEnd(nrow, count, 0));
+  std::unique_lock<std::mutex> lock(mutex);
+  done.wait(lock, [&]() { return left == 0; });
+}
+
+}  // namespace xLearn
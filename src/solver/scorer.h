@@ -0,0 +1,162 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the Scorer class, which keeps a loaded
+model in memory and scores the caller-provided rows.
+*/
+
+#ifndef XLEARN_SOLVER_SCORER_H_
+#define XLEARN_SOLVER_SCORER_H_
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/thread_pool.h"
+#include "src/data/data_structure.h"
+#include "src/data/model_parameters.h"
+#include "src/score/score_function.h"
+
+namespace xLearn {
+
+//------------------------------------------------------------------------------
+// Scorer is used for online inference, where the caller sends many small
+// batches to the same model. The Predictor (inference.h) reads a file and
+// builds the Model, Score, Loss and ThreadPool for each call, while the
+// Scorer does all of them once in Load(), and then PredictRows() only
+// reads the caller's CSR buffers and writes the caller's output array.
+// We can use the Scorer like this:
+//
+//    Scorer scorer;
+//    scorer.Initialize(4, true, false, true);  /* nthread, norm, sign, sigmoid */
+//    if (!scorer.Load("./model.out")) { ... }
+//    /* row i has the nodes [indptr[i], indptr[i+1]) */
+//    scorer.PredictRows(indptr, indices, fields, values, nrow, out);
+//
+// PredictRows() is reentrant: it does not change the Scorer, and hence
+// it can be called by many threads at the same time. Each call splits its
+// rows over the thread pool and waits for its own jobs only. The SparseRow
+// and the score buffers live in per-thread scratch memory, which stops
+// touching the heap after the first calls.
+//
+// A sparse model (see Model::InitializeSparse()) is compacted to a dense
+// model by Load(), and the feature ids are mapped to the dense ids by a
+// binary search. The features which are not admitted (see SetAdmission())
+// use their linear-only rows or the shared row in the same way as Loss.
+//------------------------------------------------------------------------------
+class Scorer {
+ public:
+  // Constructor and Destructor
+  Scorer()
+   : thread_num_(1),
+     norm_(true),
+     sign_(false),
+     sigmoid_(false),
+     model_(nullptr),
+     score_(nullptr),
+     pool_(nullptr),
+     compacted_(false),
+     unseen_id_(0),
+     hash_buckets_(0) { }
+  ~Scorer();
+
+  // Invoke this function before Load().
+  void Initialize(index_t thread_num,
+                  bool norm = true,
+                  bool sign = false,
+                  bool sigmoid = false);
+
+  // Load the binary model and create the score function.
+  // Return false if the model cannot be loaded.
+  bool Load(const std::string& filename);
+
+  // Score nrow rows in CSR format. The row i has the nodes in
+  // [indptr[i], indptr[i+1]) of indices (feature id), fields (field id,
+  // can be nullptr for linear and fm) and values (can be nullptr for
+  // all ones). The indptr has nrow+1 items. The feature ids are the
+  // ones used in training, i.e., the hashed ids of a hashed model.
+  void PredictRows(const uint64* indptr,
+                   const index_t* indices,
+                   const index_t* fields,
+                   const real_t* values,
+                   index_t nrow,
+                   real_t* out);
+
+  // Get the model used for scoring.
+  inline Model* GetModel() { return model_; }
+
+  // Is the model loaded ?
+  inline bool IsLoaded() { return score_ != nullptr; }
+
+  // Number of hash buckets used by the parser (see
+  // Parser::setHash), or 0 if the model is not hashed.
+  inline index_t GetHashBuckets() { return hash_buckets_; }
+
+ protected:
+  /* Number of threads */
+  index_t thread_num_;
+  /* Use instance-wise normalization */
+  bool norm_;
+  /* Convert output to 0 and 1 */
+  bool sign_;
+  /* Convert output by sigmoid */
+  bool sigmoid_;
+  /* Dense model used for scoring */
+  Model* model_;
+  /* Score function of the model */
+  Score* score_;
+  /* Thread pool used by PredictRows() */
+  ThreadPool* pool_;
+  /* Is model_ compacted from a sparse model ? */
+  bool compacted_;
+  /* Sorted feature ids of a compacted sparse model */
+  std::vector<index_t> keys_;
+  /* Dense id of the features which are not in keys_ */
+  index_t unseen_id_;
+  /* Hash buckets of the loaded model */
+  index_t hash_buckets_;
+
+  // Copy the rows of a sparse model to a new dense model.
+  Model* compact(Model& sparse);
+
+  // Map the feature id to the id in model_.
+  inline index_t dense_id(index_t feat_id) const {
+    if (!compacted_) { return feat_id; }
+    std::vector<index_t>::const_iterator it =
+      std::lower_bound(keys_.begin(), keys_.end(), feat_id);
+    if (it == keys_.end() || *it != feat_id) { return unseen_id_; }
+    return (index_t)(it - keys_.begin());
+  }
+
+  // Score the rows in [start, end) on current thread.
+  void score_rows(const uint64* indptr,
+                  const index_t* indices,
+                  const index_t* fields,
+                  const real_t* values,
+                  real_t* out,
+                  size_t start,
+                  size_t end);
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Scorer);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_SCORER_H_
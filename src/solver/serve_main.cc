@@ -0,0 +1,137 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the entry for the scoring server of the xLearn.
+*/
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+
+#include "src/base/common.h"
+#include "src/base/format_print.h"
+#include "src/base/stringprintf.h"
+#include "src/solver/server.h"
+
+static xLearn::Server* server = nullptr;
+
+static void stop_server(int) {
+  if (server != nullptr) { server->Stop(); }
+}
+
+static void print_usage() {
+  Color::print_info(
+    "Usage: xlearn_serve model_file [OPTIONS]\n"
+    "\n"
+    "  Each line of the input is a request in libsvm format (libffm for\n"
+    "  a ffm model), and its score is written in one line of the output.\n"
+    "\n"
+    "  -socket <path>   :  Serve the connections of this Unix domain socket.\n"
+    "                      By default, read stdin and write stdout.\n"
+    "  -nthread <n>     :  Number of threads for scoring (default: all cores).\n"
+    "  -batch <n>       :  Max number of requests in a micro-batch (default: 256).\n"
+    "  -delay <ms>      :  Max time a request waits for its batch (default: 2).\n"
+    "  -report <sec>    :  Seconds between two latency reports (default: 10).\n"
+    "                      0 means only reporting at exit.\n"
+    "  --sign           :  Convert the scores to 0 and 1.\n"
+    "  --sigmoid        :  Convert the scores to (0, 1) by sigmoid.\n"
+    "  --no-norm        :  Disable instance-wise normalization.\n", false);
+}
+
+//------------------------------------------------------------------------------
+// The pre-defined main function
+//------------------------------------------------------------------------------
+
+int main(int argc, char* argv[]) {
+  if (argc < 2) {
+    print_usage();
+    return 1;
+  }
+  std::string model_file = argv[1];
+  std::string socket_path;
+  xLearn::index_t nthread = 0;
+  xLearn::index_t max_batch = xLearn::kServerMaxBatch;
+  float max_delay = xLearn::kServerMaxDelay;
+  float report = 10;
+  bool sign = false;
+  bool sigmoid = false;
+  bool norm = true;
+  for (int i = 2; i < argc; ++i) {
+    std::string opt = argv[i];
+    bool has_value = i + 1 < argc;
+    if (opt == "-socket" && has_value) {
+      socket_path = argv[++i];
+    } else if (opt == "-nthread" && has_value) {
+      nthread = atoi(argv[++i]);
+    } else if (opt == "-batch" && has_value) {
+      max_batch = atoi(argv[++i]);
+    } else if (opt == "-delay" && has_value) {
+      max_delay = atof(argv[++i]);
+    } else if (opt == "-report" && has_value) {
+      report = atof(argv[++i]);
+    } else if (opt == "--sign") {
+      sign = true;
+    } else if (opt == "--sigmoid") {
+      sigmoid = true;
+    } else if (opt == "--no-norm") {
+      norm = false;
+    } else {
+      Color::print_error(
+        StringPrintf("Unknow argument or missing value: %s", opt.c_str())
+      );
+      print_usage();
+      return 1;
+    }
+  }
+  if (max_batch == 0 || max_delay < 0 || report < 0) {
+    Color::print_error("-batch must be > 0, -delay and -report must be >= 0.");
+    return 1;
+  }
+  // In the stream mode, the scores own the stdout, and
+  // all of the messages are written to stderr.
+  int out_fd = 1;
+  if (socket_path.empty()) {
+    out_fd = dup(1);
+    dup2(2, 1);
+  }
+  xLearn::Server serve;
+  serve.Initialize(nthread, norm, sign, sigmoid,
+                   max_batch, max_delay, report);
+  if (!serve.Load(model_file)) {
+    Color::print_error(
+      StringPrintf("Cannot load model from the file: %s",
+                   model_file.c_str())
+    );
+    return 1;
+  }
+  server = &serve;
+  signal(SIGINT, stop_server);
+  signal(SIGTERM, stop_server);
+  bool ok = true;
+  if (socket_path.empty()) {
+    serve.ServeStream(0, out_fd);
+    close(out_fd);
+  } else {
+    ok = serve.ServeSocket(socket_path);
+  }
+  server = nullptr;
+  return ok ? 0 : 1;
+}
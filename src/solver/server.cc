@@ -0,0 +1,511 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file is the implementation of the Server class.
+*/
+
+#include "src/solver/server.h"
+
+#include <errno.h>
+#include <poll.h>
+#include <signal.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <limits>
+#include <thread>
+
+#include "src/base/format_print.h"
+#include "src/base/result_writer.h"
+#include "src/base/stringprintf.h"
+
+namespace xLearn {
+
+typedef std::chrono::steady_clock Clock;
+
+// The blocking calls wake up in this time to check Stop()
+static const int kServerPollMs = 100;
+
+// Size of the read buffer of a stream
+static const size_t kServerReadSize = 64 * 1024;
+
+Server::Connection::~Connection() {
+  if (owned) { close(in_fd); }
+}
+
+Server::~Server() {
+  delete parser_;
+}
+
+// Invoke this function before Load()
+void Server::Initialize(index_t thread_num,
+                        bool norm,
+                        bool sign,
+                        bool sigmoid,
+                        index_t max_batch,
+                        real_t max_delay,
+                        real_t report_interval) {
+  CHECK_GT(max_batch, 0);
+  CHECK_GE(max_delay, 0);
+  scorer_.Initialize(thread_num, norm, sign, sigmoid);
+  max_batch_ = max_batch;
+  max_delay_ = max_delay;
+  report_interval_ = report_interval;
+}
+
+// Load the binary model and create the parser
+bool Server::Load(const std::string& filename) {
+  if (!scorer_.Load(filename)) { return false; }
+  Model* model = scorer_.GetModel();
+  if (model->GetScoreFunction() == "ffm") {
+    parser_ = CREATE_PARSER("libffm");
+  } else {
+    parser_ = CREATE_PARSER("libsvm");
+  }
+  // Each line is given a label before parsing
+  parser_->setLabel(true);
+  ffm_ = model->GetScoreFunction() == "ffm";
+  hashed_ = scorer_.GetHashBuckets() > 0;
+  parser_->setSplitor(" \t");
+  if (scorer_.GetHashBuckets() > 0) {
+    parser_->setHash(scorer_.GetHashBuckets(), model->IsFieldHashed());
+  }
+  return true;
+}
+
+// Start a thread to read the requests of a stream
+void Server::add_stream(int in_fd, int out_fd, bool owned) {
+  std::shared_ptr<Connection> conn(new Connection(in_fd, out_fd, owned));
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    ++num_stream_;
+  }
+  std::thread(&Server::read_stream, this, conn).detach();
+}
+
+// Return true if [begin, end) is a non-empty number
+static bool is_number(const char* begin, const char* end, bool integer) {
+  if (begin == end) { return false; }
+  std::string str(begin, end);
+  char* stop = nullptr;
+  if (integer) {
+    if (str[0] == '-' || str[0] == '+') { return false; }
+    strtoul(str.c_str(), &stop, 10);
+  } else {
+    strtod(str.c_str(), &stop);
+  }
+  return *stop == '\0';
+}
+
+// Return true if each feature of the line has the format of the
+// parser (field:idx:value for ffm, or idx:value). The idx can be
+// a raw key in hashing mode.
+static bool check_line(const std::string& line, bool ffm, bool hashed) {
+  const char* p = line.c_str();
+  const char* end = p + line.size();
+  bool label = true;
+  for (;;) {
+    while (p < end && (*p == ' ' || *p == '\t')) { ++p; }
+    if (p == end) { break; }
+    const char* q = p;
+    while (q < end && *q != ' ' && *q != '\t') { ++q; }
+    if (label) {
+      if (!is_number(p, q, false)) { return false; }
+      label = false;
+    } else {
+      // The parts of the feature
+      const char* part[3];
+      int num_part = 0;
+      part[num_part++] = p;
+      for (const char* c = p; c < q; ++c) {
+        if (*c != ':') { continue; }
+        if (num_part == 3) { return false; }
+        part[num_part++] = c + 1;
+      }
+      if (num_part != (ffm ? 3 : 2)) { return false; }
+      int idx = num_part - 2;
+      if (ffm && !is_number(part[0], part[1] - 1, true)) { return false; }
+      if (part[idx+1] - 1 == part[idx] ||
+          (!hashed && !is_number(part[idx], part[idx+1] - 1, true))) {
+        return false;
+      }
+      if (!is_number(part[idx+1], q, false)) { return false; }
+    }
+    p = q;
+  }
+  return true;
+}
+
+// Add a dummy label to the line if it has no label, and
+// check its format. Return false if the line is blank.
+static bool make_request(std::string& line,
+                         bool ffm,
+                         bool hashed,
+                         bool* valid) {
+  if (!line.empty() && line.back() == '\r') { line.pop_back(); }
+  size_t start = line.find_first_not_of(" \t");
+  if (start == std::string::npos) { return false; }
+  size_t end = line.find_first_of(" \t", start);
+  if (end == std::string::npos) { end = line.size(); }
+  if (line.find(':', start) < end) {
+    line.insert(0, "0 ");
+  }
+  *valid = check_line(line, ffm, hashed);
+  return true;
+}
+
+// Split the data of a stream into lines and queue them
+void Server::read_stream(std::shared_ptr<Connection> conn) {
+  std::vector<char> buf(kServerReadSize);
+  std::string pending;
+  std::vector<std::string> lines;
+  for (;;) {
+    if (stop_) { break; }
+    struct pollfd pfd;
+    pfd.fd = conn->in_fd;
+    pfd.events = POLLIN;
+    int ret = poll(&pfd, 1, kServerPollMs);
+    if (ret < 0 && errno != EINTR) { break; }
+    if (ret <= 0) { continue; }
+    ssize_t size = read(conn->in_fd, buf.data(), buf.size());
+    if (size < 0 && errno == EINTR) { continue; }
+    bool eof = size <= 0;
+    if (!eof) {
+      const char* p = buf.data();
+      const char* end = p + size;
+      while (p < end) {
+        const char* nl = static_cast<const char*>(memchr(p, '\n', end - p));
+        if (nl == nullptr) {
+          pending.append(p, end);
+          break;
+        }
+        pending.append(p, nl);
+        lines.push_back(std::string());
+        lines.back().swap(pending);
+        p = nl + 1;
+      }
+    } else if (!pending.empty()) {
+      // The last line without '\n'
+      lines.push_back(std::string());
+      lines.back().swap(pending);
+    }
+    if (!lines.empty()) {
+      Clock::time_point now = Clock::now();
+      std::unique_lock<std::mutex> lock(mutex_);
+      for (size_t i = 0; i < lines.size(); ++i) {
+        bool valid = false;
+        if (!make_request(lines[i], ffm_, hashed_, &valid)) { continue; }
+        queue_.push_back(Request());
+        Request& req = queue_.back();
+        req.line.swap(lines[i]);
+        req.valid = valid;
+        req.conn = conn;
+        req.arrival = now;
+      }
+      lines.clear();
+      cond_.notify_all();
+    }
+    if (eof) { break; }
+  }
+  // The fds are closed after the queued requests are answered
+  conn.reset();
+  std::unique_lock<std::mutex> lock(mutex_);
+  --num_stream_;
+  cond_.notify_all();
+}
+
+// Wait until all of the reader threads have exited
+void Server::wait_streams() {
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (num_stream_ > 0) {
+    cond_.wait(lock);
+  }
+}
+
+// Write all of the data to fd. Return false if the peer has gone.
+static bool write_all(int fd, const char* data, size_t size) {
+  while (size > 0) {
+    ssize_t n = write(fd, data, size);
+    if (n < 0) {
+      if (errno == EINTR) { continue; }
+      return false;
+    }
+    data += n;
+    size -= n;
+  }
+  return true;
+}
+
+// Score a batch and write the scores
+void Server::score_batch(std::vector<Request>& batch) {
+  size_t num = batch.size();
+  // Only the valid lines are parsed
+  text_.clear();
+  size_t num_valid = 0;
+  for (size_t i = 0; i < num; ++i) {
+    if (!batch[i].valid) { continue; }
+    text_.insert(text_.end(), batch[i].line.begin(), batch[i].line.end());
+    text_.push_back('\n');
+    num_valid++;
+  }
+  // The malformed lines get NaN
+  out_.assign(num, std::numeric_limits<real_t>::quiet_NaN());
+  if (num_valid > 0) {
+    parser_->Parse(text_.data(), text_.size(), matrix_, true);
+    CHECK_EQ(matrix_.row_length, num_valid);
+    // The rows in CSR format
+    indptr_.resize(num_valid + 1);
+    indices_.clear();
+    fields_.clear();
+    values_.clear();
+    indptr_[0] = 0;
+    for (size_t i = 0; i < num_valid; ++i) {
+      SparseRow* row = matrix_.row[i];
+      for (SparseRow::const_iterator it = row->begin();
+           it != row->end(); ++it) {
+        indices_.push_back(it->feat_id);
+        fields_.push_back(it->field_id);
+        values_.push_back(it->feat_val);
+      }
+      indptr_[i+1] = indices_.size();
+    }
+    score_.resize(num_valid);
+    scorer_.PredictRows(indptr_.data(),
+                        indices_.data(),
+                        fields_.data(),
+                        values_.data(),
+                        num_valid,
+                        score_.data());
+    for (size_t i = 0, j = 0; i < num; ++i) {
+      if (batch[i].valid) { out_[i] = score_[j++]; }
+    }
+  }
+  // The scores of each stream are written in the order of its requests
+  std::vector<std::pair<Connection*, std::string>> reply;
+  char buf[kResultTextSize];
+  for (size_t i = 0; i < num; ++i) {
+    Connection* conn = batch[i].conn.get();
+    size_t j = 0;
+    while (j < reply.size() && reply[j].first != conn) { ++j; }
+    if (j == reply.size()) {
+      reply.push_back(std::make_pair(conn, std::string()));
+    }
+    reply[j].second.append(buf, FormatResult(out_[i], buf));
+  }
+  for (size_t j = 0; j < reply.size(); ++j) {
+    Connection* conn = reply[j].first;
+    if (conn->broken) { continue; }
+    if (!write_all(conn->out_fd,
+                   reply[j].second.data(),
+                   reply[j].second.size())) {
+      conn->broken = true;
+      Color::print_warning(
+        StringPrintf("Cannot write to the stream: %s", strerror(errno))
+      );
+    }
+  }
+  Clock::time_point now = Clock::now();
+  for (size_t i = 0; i < num; ++i) {
+    uint64 us = std::chrono::duration_cast<std::chrono::microseconds>(
+      now - batch[i].arrival).count();
+    latency_hist_[latency_bucket(us)]++;
+  }
+  num_request_ += num;
+  num_batch_++;
+}
+
+// Take the batches from the queue and score them
+void Server::batch_loop(bool wait_streams) {
+  std::chrono::duration<real_t, std::milli> delay(max_delay_);
+  std::vector<Request> batch;
+  last_report_ = Clock::now();
+  for (;;) {
+    {
+      std::unique_lock<std::mutex> lock(mutex_);
+      // Wait for the first request, and wake up in a
+      // while for Stop() and the periodic report
+      if (queue_.empty() && !stop_ &&
+          !(wait_streams && num_stream_ == 0)) {
+        cond_.wait_for(lock, std::chrono::milliseconds(kServerPollMs));
+      }
+      if (queue_.empty()) {
+        if (stop_ || (wait_streams && num_stream_ == 0)) { break; }
+      } else {
+        // Wait for a full batch, or the deadline of the oldest request.
+        // No more requests come if all of the streams are closed.
+        Clock::time_point deadline = queue_.front().arrival +
+          std::chrono::duration_cast<Clock::duration>(delay);
+        while (queue_.size() < max_batch_ && !stop_ && num_stream_ > 0) {
+          if (cond_.wait_until(lock, deadline) == std::cv_status::timeout) {
+            break;
+          }
+        }
+        size_t num = std::min(queue_.size(), (size_t)max_batch_);
+        batch.resize(num);
+        for (size_t i = 0; i < num; ++i) {
+          batch[i] = std::move(queue_.front());
+          queue_.pop_front();
+        }
+      }
+    }
+    if (!batch.empty()) {
+      score_batch(batch);
+      // Release the connections
+      batch.clear();
+    }
+    if (report_interval_ > 0 && num_request_ > 0 &&
+        std::chrono::duration<real_t>(
+          Clock::now() - last_report_).count() >= report_interval_) {
+      report(false);
+    }
+  }
+}
+
+// Print the latency and throughput since the last report
+void Server::report(bool final) {
+  Clock::time_point now = Clock::now();
+  real_t sec = std::chrono::duration<real_t>(now - last_report_).count();
+  total_request_ += num_request_;
+  total_batch_ += num_batch_;
+  if (num_request_ > 0) {
+    real_t lat_50 = percentile(0.5);
+    real_t lat_99 = percentile(0.99);
+    Color::print_info(
+      StringPrintf("Requests: %llu, batches: %llu (avg size %.1f), "
+                   "%.1f requests/sec, latency p50: %.3f ms, p99: %.3f ms",
+                   (unsigned long long)num_request_,
+                   (unsigned long long)num_batch_,
+                   (real_t)num_request_ / num_batch_,
+                   sec > 0 ? num_request_ / sec : 0,
+                   lat_50,
+                   lat_99)
+    );
+  }
+  if (final) {
+    Color::print_info(
+      StringPrintf("Total requests: %llu, total batches: %llu",
+                   (unsigned long long)total_request_,
+                   (unsigned long long)total_batch_)
+    );
+  }
+  memset(latency_hist_, 0, sizeof(latency_hist_));
+  num_request_ = 0;
+  num_batch_ = 0;
+  last_report_ = now;
+}
+
+// Bucket of a latency (us). The values below kLatencySubBucket
+// have a bucket each, and then each power of 2 is split into
+// kLatencySubBucket buckets of the same width.
+int Server::latency_bucket(uint64 us) {
+  if (us < kLatencySubBucket) { return us; }
+  int exp = 63 - __builtin_clzll(us);
+  int sub = (us >> (exp - 3)) & (kLatencySubBucket - 1);
+  return (exp - 2) * kLatencySubBucket + sub;
+}
+
+// The latency (us) at the end of a bucket
+uint64 Server::bucket_end(int bucket) {
+  if (bucket < kLatencySubBucket) { return bucket + 1; }
+  int exp = bucket / kLatencySubBucket + 2;
+  uint64 sub = bucket % kLatencySubBucket;
+  // The end of the last bucket is 2^64
+  if (exp == 63 && sub == kLatencySubBucket - 1) { return ~0ULL; }
+  return (kLatencySubBucket + sub + 1) << (exp - 3);
+}
+
+// The latency (ms) of the given percentile. We report the end
+// of the bucket, which is an upper bound of the latency.
+real_t Server::percentile(real_t p) const {
+  uint64 count = 0;
+  for (int b = 0; b < kNumLatencyBucket; ++b) {
+    count += latency_hist_[b];
+  }
+  if (count == 0) { return 0; }
+  // Rank of the percentile in the sorted latency
+  uint64 rank = std::min((uint64)(count * p), count - 1);
+  uint64 sum = 0;
+  for (int b = 0; b < kNumLatencyBucket; ++b) {
+    sum += latency_hist_[b];
+    if (sum > rank) { return bucket_end(b) / 1000.0; }
+  }
+  return bucket_end(kNumLatencyBucket - 1) / 1000.0;
+}
+
+// Read the requests from in_fd and write the scores to out_fd
+void Server::ServeStream(int in_fd, int out_fd) {
+  CHECK_NOTNULL(parser_);
+  add_stream(in_fd, out_fd, false);
+  batch_loop(true);
+  wait_streams();
+  report(true);
+}
+
+// Listen on a Unix domain socket, and serve each connection
+bool Server::ServeSocket(const std::string& path) {
+  CHECK_NOTNULL(parser_);
+  struct sockaddr_un addr;
+  memset(&addr, 0, sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  if (path.empty() || path.size() >= sizeof(addr.sun_path)) {
+    Color::print_error(
+      StringPrintf("Invalid socket path: %s", path.c_str())
+    );
+    return false;
+  }
+  strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+  int sock = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path.c_str());
+  if (sock < 0 ||
+      bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0 ||
+      listen(sock, SOMAXCONN) != 0) {
+    Color::print_error(
+      StringPrintf("Cannot listen on the socket %s: %s",
+                   path.c_str(), strerror(errno))
+    );
+    if (sock >= 0) { close(sock); }
+    return false;
+  }
+  // A closed peer makes write() fail instead of killing us
+  signal(SIGPIPE, SIG_IGN);
+  Color::print_info(
+    StringPrintf("Listening on the socket: %s", path.c_str())
+  );
+  std::thread acceptor([this, sock]() {
+    while (!stop_) {
+      struct pollfd pfd;
+      pfd.fd = sock;
+      pfd.events = POLLIN;
+      if (poll(&pfd, 1, kServerPollMs) <= 0) { continue; }
+      int conn = accept(sock, nullptr, nullptr);
+      if (conn >= 0) { add_stream(conn, conn, true); }
+    }
+  });
+  batch_loop(false);
+  acceptor.join();
+  wait_streams();
+  close(sock);
+  unlink(path.c_str());
+  report(true);
+  return true;
+}
+
+}  // namespace xLearn
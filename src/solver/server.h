@@ -0,0 +1,225 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file defines the Server class, which keeps a loaded model
+in memory and scores the rows sent over a stream.
+*/
+
+#ifndef XLEARN_SOLVER_SERVER_H_
+#define XLEARN_SOLVER_SERVER_H_
+
+#include <string.h>
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/data/data_structure.h"
+#include "src/reader/parser.h"
+#include "src/solver/scorer.h"
+
+namespace xLearn {
+
+// Default max number of requests in one micro-batch.
+const index_t kServerMaxBatch = 256;
+
+// Default max time (ms) a request waits for its micro-batch.
+const real_t kServerMaxDelay = 2.0;
+
+// The latency histogram has 8 buckets for each power of 2 (us),
+// so a percentile is within 12.5% of the exact value, and 512
+// buckets cover any uint64.
+const int kLatencySubBucket = 8;
+const int kNumLatencyBucket = 512;
+
+//------------------------------------------------------------------------------
+// Server is the streaming mode of the online inference. It loads the model
+// once (by the Scorer), reads the requests from the standard input or from
+// the connections of a Unix domain socket, and writes one score for each
+// request. Each request is one line of libsvm (or libffm for a ffm model)
+// data, and the label is optional. The requests of all the streams are
+// coalesced into micro-batches: a batch is scored when it has max_batch
+// requests, or when its oldest request has waited for max_delay (ms).
+// Hence, a busy server scores large batches on the whole thread pool, and
+// an idle server answers a single request in max_delay. The scores are
+// written to the stream of each request in the same order as the requests.
+// We can use the Server like this:
+//
+//    Server server;
+//    server.Initialize(4, true, false, true, 256, 2.0);
+//    if (!server.Load("./model.out")) { ... }
+//    server.ServeStream(0, 1);          /* stdin -> stdout, until EOF */
+//    server.ServeSocket("/tmp/xl.sock");  /* until Stop() */
+//
+// The Server records the latency of each request, from the time its line
+// is read to the time its score is written, in a fixed-size histogram,
+// and it prints the p50 / p99 latency and the throughput every
+// report_interval seconds, and when it stops. The blank lines are not
+// requests and get no response, and a malformed line (e.g., a feature
+// without its value) gets "nan".
+//------------------------------------------------------------------------------
+class Server {
+ public:
+  // Constructor and Destructor
+  Server()
+   : max_batch_(kServerMaxBatch),
+     max_delay_(kServerMaxDelay),
+     report_interval_(10),
+     parser_(nullptr),
+     ffm_(false),
+     hashed_(false),
+     num_stream_(0),
+     stop_(false),
+     num_request_(0),
+     num_batch_(0),
+     total_request_(0),
+     total_batch_(0) {
+    memset(latency_hist_, 0, sizeof(latency_hist_));
+  }
+  ~Server();
+
+  // Invoke this function before Load().
+  void Initialize(index_t thread_num,
+                  bool norm = true,
+                  bool sign = false,
+                  bool sigmoid = false,
+                  index_t max_batch = kServerMaxBatch,
+                  real_t max_delay = kServerMaxDelay,
+                  real_t report_interval = 10);
+
+  // Load the binary model and create the parser.
+  // Return false if the model cannot be loaded.
+  bool Load(const std::string& filename);
+
+  // Read the requests from in_fd and write the scores to
+  // out_fd, until in_fd is closed or Stop() is invoked.
+  void ServeStream(int in_fd, int out_fd);
+
+  // Listen on a Unix domain socket, and serve each connection
+  // until Stop() is invoked. Return false if we cannot listen.
+  bool ServeSocket(const std::string& path);
+
+  // Stop serving. It can be invoked by another thread.
+  inline void Stop() { stop_ = true; }
+
+ protected:
+  // One input stream and its output. The fds are closed
+  // (if owned) after the last score of the stream is written.
+  struct Connection {
+    Connection(int in, int out, bool own)
+     : in_fd(in), out_fd(out), owned(own), broken(false) { }
+    ~Connection();
+    int in_fd;
+    int out_fd;
+    bool owned;
+    /* The peer has gone, and we stop writing */
+    bool broken;
+  };
+
+  // One line of data and where its score goes.
+  struct Request {
+    std::string line;
+    /* The line has the format of the parser */
+    bool valid;
+    std::shared_ptr<Connection> conn;
+    std::chrono::steady_clock::time_point arrival;
+  };
+
+  /* Scores the micro-batches */
+  Scorer scorer_;
+  /* Max number of requests in a batch */
+  index_t max_batch_;
+  /* Max waiting time (ms) of a request */
+  real_t max_delay_;
+  /* Seconds between two reports. 0 means no periodic report */
+  real_t report_interval_;
+  /* Parses the lines of a batch */
+  Parser* parser_;
+  /* The lines are libffm data */
+  bool ffm_;
+  /* The feature ids are raw keys */
+  bool hashed_;
+  /* Requests waiting for a batch */
+  std::deque<Request> queue_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  /* Number of streams being read */
+  int num_stream_;
+  /* Set by Stop() */
+  std::atomic<bool> stop_;
+  /* Histogram of the latency (us) since the last report */
+  uint64 latency_hist_[kNumLatencyBucket];
+  /* Counters since the last report */
+  uint64 num_request_;
+  uint64 num_batch_;
+  std::chrono::steady_clock::time_point last_report_;
+  /* Counters since start */
+  uint64 total_request_;
+  uint64 total_batch_;
+  /* Re-used buffers of a batch */
+  std::vector<char> text_;
+  DMatrix matrix_;
+  std::vector<uint64> indptr_;
+  std::vector<index_t> indices_;
+  std::vector<index_t> fields_;
+  std::vector<real_t> values_;
+  std::vector<real_t> score_;
+  std::vector<real_t> out_;
+
+  // Start a thread to read the requests of a stream.
+  void add_stream(int in_fd, int out_fd, bool owned);
+
+  // Split the data of a stream into lines and queue them.
+  void read_stream(std::shared_ptr<Connection> conn);
+
+  // Take the batches from the queue and score them, until all
+  // of the streams are closed (if wait_streams) or Stop().
+  void batch_loop(bool wait_streams);
+
+  // Score a batch and write the scores.
+  void score_batch(std::vector<Request>& batch);
+
+  // Print the latency and throughput since the last report.
+  void report(bool final);
+
+  // Bucket of a latency (us) in the histogram.
+  static int latency_bucket(uint64 us);
+
+  // The latency (us) at the end of a bucket.
+  static uint64 bucket_end(int bucket);
+
+  // The latency (ms) of the given percentile (in [0, 1])
+  // of the requests since the last report.
+  real_t percentile(real_t p) const;
+
+  // Wait until all of the reader threads have exited.
+  void wait_streams();
+
+ private:
+  DISALLOW_COPY_AND_ASSIGN(Server);
+};
+
+}  // namespace xLearn
+
+#endif  // XLEARN_SOLVER_SERVER_H_
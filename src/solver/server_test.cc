@@ -0,0 +1,277 @@
+//------------------------------------------------------------------------------
+// Copyright (c) 2018 by contributors. All Rights Reserved.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+//------------------------------------------------------------------------------
+
+
+/*
+This file tests server.h file.
+*/
+
+#include "gtest/gtest.h"
+
+#include <math.h>
+#include <poll.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "src/base/common.h"
+#include "src/base/file_util.h"
+#include "src/base/stringprintf.h"
+#include "src/data/model_parameters.h"
+#include "src/solver/server.h"
+
+namespace xLearn {
+
+const std::string kTestModel = "./test_server.model";
+const index_t kNumFeature = 10;
+
+// Exposes the counters of the Server.
+class TestServer : public Server {
+ public:
+  uint64 GetTotalRequest() { return total_request_; }
+  uint64 GetTotalBatch() { return total_batch_; }
+  using Server::latency_bucket;
+  using Server::bucket_end;
+  void AddLatency(uint64 us) { latency_hist_[latency_bucket(us)]++; }
+  real_t Percentile(real_t p) { return percentile(p); }
+};
+
+// The score of feature i is (i+1) * value, and the bias is 0.
+void write_model(const std::string& score_func) {
+  Model model;
+  model.Initialize(score_func, "squared", kNumFeature, 2, 4, 1, 0.66);
+  real_t* w = model.GetParameter_w();
+  for (index_t i = 0; i < kNumFeature; ++i) {
+    w[i] = i + 1;
+  }
+  model.GetParameter_b()[0] = 0;
+  model.Serialize(kTestModel);
+}
+
+// Read n lines from fd, or until fd is closed.
+std::vector<std::string> read_lines(int fd, size_t n) {
+  std::vector<std::string> lines;
+  std::string pending;
+  char buf[1024];
+  while (lines.size() < n) {
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    if (poll(&pfd, 1, 5000) <= 0) { break; }
+    ssize_t size = read(fd, buf, sizeof(buf));
+    if (size <= 0) { break; }
+    for (ssize_t i = 0; i < size; ++i) {
+      if (buf[i] == '\n') {
+        lines.push_back(pending);
+        pending.clear();
+      } else {
+        pending.push_back(buf[i]);
+      }
+    }
+  }
+  return lines;
+}
+
+void write_text(int fd, const std::string& text) {
+  ASSERT_EQ(write(fd, text.data(), text.size()), (ssize_t)text.size());
+}
+
+// Serves a pipe in another thread.
+class ServerTest {
+ public:
+  ServerTest(const std::string& score_func,
+             index_t max_batch,
+             real_t max_delay) {
+    write_model(score_func);
+    server.Initialize(2, false, false, false, max_batch, max_delay, 0);
+    EXPECT_TRUE(server.Load(kTestModel));
+    RemoveFile(kTestModel.c_str());
+    EXPECT_EQ(pipe(in), 0);
+    EXPECT_EQ(pipe(out), 0);
+  }
+
+  ~ServerTest() {
+    close(out[0]);
+  }
+
+  void Start() {
+    thread = std::thread(&Server::ServeStream, &server, in[0], out[1]);
+  }
+
+  // Close the input and wait for the server.
+  std::vector<std::string> Finish() {
+    close(in[1]);
+    thread.join();
+    close(in[0]);
+    close(out[1]);
+    return read_lines(out[0], 1000);
+  }
+
+  TestServer server;
+  int in[2];
+  int out[2];
+  std::thread thread;
+};
+
+TEST(SERVER_TEST, Reply_in_order) {
+  ServerTest test("linear", 3, 1.0);
+  test.Start();
+  std::string text;
+  for (index_t i = 0; i < 20; ++i) {
+    // With or without the label
+    if (i % 2 == 0) { text += "1 "; }
+    text += StringPrintf("%u:2\n", i % kNumFeature);
+  }
+  write_text(test.in[1], text);
+  std::vector<std::string> lines = test.Finish();
+  ASSERT_EQ(lines.size(), 20);
+  for (index_t i = 0; i < 20; ++i) {
+    EXPECT_FLOAT_EQ(atof(lines[i].c_str()), (i % kNumFeature + 1) * 2);
+  }
+  EXPECT_EQ(test.server.GetTotalRequest(), 20);
+}
+
+TEST(SERVER_TEST, Batch_by_size) {
+  ServerTest test("linear", 4, 10000.0);
+  // All of the lines are queued at once
+  std::string text;
+  for (index_t i = 0; i < 10; ++i) {
+    text += StringPrintf("0 %u:1\n", i);
+  }
+  write_text(test.in[1], text);
+  test.Start();
+  std::vector<std::string> lines = test.Finish();
+  ASSERT_EQ(lines.size(), 10);
+  for (index_t i = 0; i < 10; ++i) {
+    EXPECT_FLOAT_EQ(atof(lines[i].c_str()), i + 1);
+  }
+  EXPECT_EQ(test.server.GetTotalRequest(), 10);
+  EXPECT_EQ(test.server.GetTotalBatch(), 3);
+}
+
+TEST(SERVER_TEST, Batch_by_delay) {
+  ServerTest test("linear", 100, 50.0);
+  test.Start();
+  write_text(test.in[1], "0 1:1\n0 2:1\n");
+  // The scores are written at the deadline, before the stream is closed
+  std::vector<std::string> lines = read_lines(test.out[0], 2);
+  ASSERT_EQ(lines.size(), 2);
+  EXPECT_FLOAT_EQ(atof(lines[0].c_str()), 2);
+  EXPECT_FLOAT_EQ(atof(lines[1].c_str()), 3);
+  std::this_thread::sleep_for(std::chrono::milliseconds(200));
+  write_text(test.in[1], "0 3:1\n");
+  lines = test.Finish();
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_FLOAT_EQ(atof(lines[0].c_str()), 4);
+  EXPECT_EQ(test.server.GetTotalRequest(), 3);
+  EXPECT_EQ(test.server.GetTotalBatch(), 2);
+}
+
+TEST(SERVER_TEST, Blank_line) {
+  ServerTest test("linear", 8, 1.0);
+  test.Start();
+  write_text(test.in[1], "\n0 1:1\n  \t\n\r\n2:1\r\n\n");
+  // The last line without '\n'
+  write_text(test.in[1], "0 3:1");
+  std::vector<std::string> lines = test.Finish();
+  ASSERT_EQ(lines.size(), 3);
+  EXPECT_FLOAT_EQ(atof(lines[0].c_str()), 2);
+  EXPECT_FLOAT_EQ(atof(lines[1].c_str()), 3);
+  EXPECT_FLOAT_EQ(atof(lines[2].c_str()), 4);
+  EXPECT_EQ(test.server.GetTotalRequest(), 3);
+}
+
+TEST(SERVER_TEST, Malformed_libsvm_line) {
+  ServerTest test("linear", 8, 1.0);
+  test.Start();
+  write_text(test.in[1],
+             "0 1:1\n"
+             "0 1:\n"
+             "0 1\n"
+             "x 1:1\n"
+             "0 a:1\n"
+             "0 1:1:1\n"
+             "0 1:1 2:b\n"
+             "0 -1:1\n"
+             "0 2:1 3:0.5\n");
+  std::vector<std::string> lines = test.Finish();
+  ASSERT_EQ(lines.size(), 9);
+  EXPECT_FLOAT_EQ(atof(lines[0].c_str()), 2);
+  for (index_t i = 1; i < 8; ++i) {
+    EXPECT_EQ(lines[i], "nan");
+  }
+  EXPECT_FLOAT_EQ(atof(lines[8].c_str()), 5);
+}
+
+TEST(SERVER_TEST, Malformed_ffm_line) {
+  ServerTest test("ffm", 8, 1.0);
+  test.Start();
+  // Only the malformed lines of a batch get nan
+  write_text(test.in[1],
+             "0 1:2\n"
+             "0 0:1:1\n"
+             "0 1:x:\n"
+             "1:2:1\n"
+             "0 1::1\n"
+             "0 0:1:1 1:2:1:1\n");
+  std::vector<std::string> lines = test.Finish();
+  ASSERT_EQ(lines.size(), 6);
+  EXPECT_EQ(lines[0], "nan");
+  EXPECT_FALSE(isnan(atof(lines[1].c_str())));
+  EXPECT_EQ(lines[2], "nan");
+  EXPECT_FALSE(isnan(atof(lines[3].c_str())));
+  EXPECT_EQ(lines[4], "nan");
+  EXPECT_EQ(lines[5], "nan");
+  // A batch of malformed lines only
+  ServerTest test_2("ffm", 8, 1.0);
+  test_2.Start();
+  write_text(test_2.in[1], "0 1:2\n");
+  lines = test_2.Finish();
+  ASSERT_EQ(lines.size(), 1);
+  EXPECT_EQ(lines[0], "nan");
+}
+
+TEST(SERVER_TEST, Latency_histogram) {
+  // Each value is in its bucket, and the buckets are in order
+  int last = -1;
+  for (uint64 us = 0; us < 100000; us += 1 + us / 50) {
+    int b = TestServer::latency_bucket(us);
+    EXPECT_GE(b, last);
+    EXPECT_LT(b, kNumLatencyBucket);
+    EXPECT_GT(TestServer::bucket_end(b), us);
+    EXPECT_LE(TestServer::bucket_end(b), us + us / 8 + 1);
+    if (b > 0) {
+      EXPECT_LE(TestServer::bucket_end(b - 1), us);
+    }
+    last = b;
+  }
+  EXPECT_LT(TestServer::latency_bucket(~0ULL), kNumLatencyBucket);
+  TestServer server;
+  EXPECT_FLOAT_EQ(server.Percentile(0.5), 0);
+  // 1, 2, ..., 1000 ms
+  for (uint64 i = 1; i <= 1000; ++i) {
+    server.AddLatency(i * 1000);
+  }
+  EXPECT_NEAR(server.Percentile(0.5), 501, 501 / 8.0);
+  EXPECT_NEAR(server.Percentile(0.99), 991, 991 / 8.0);
+  EXPECT_GE(server.Percentile(0.99), 991);
+}
+
+}  // namespace xLearn
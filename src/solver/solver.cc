@@ -26,11 +26,16 @@ This file is the implementation of the Solver class.
 #include <stdexcept>
 #include <cstdio>
 #include <thread>
+#include <cmath>
+#include <limits>
 
 #include "src/base/stringprintf.h"
 #include "src/base/split_string.h"
 #include "src/base/timer.h"
 #include "src/base/system.h"
+#include "src/base/memory_tracker.h"
+#include "src/data/sparse_table.h"
+#include "src/data/count_min_sketch.h"
 
 namespace xLearn {
 
@@ -179,6 +184,7 @@ void Solver::init_log() {
   } else {
     prefix += "_predict";
   }
+  log_prefix_ = prefix;
   InitializeLogger(StringPrintf("%s.INFO", prefix.c_str()),
               StringPrintf("%s.WARN", prefix.c_str()),
               StringPrintf("%s.ERROR", prefix.c_str()));
@@ -193,11 +199,59 @@ void Solver::init_train() {
   if (hyper_param_.thread_number != 0) {
     threadNumber = hyper_param_.thread_number;
   }
-  pool_ = new ThreadPool(threadNumber);
+  // The pipelined validation uses a subset of the threads
+  size_t validThreadNumber = 0;
+  if (hyper_param_.pipeline_valid) {
+    validThreadNumber = hyper_param_.valid_thread_number != 0 ?
+      hyper_param_.valid_thread_number : 
+      std::max(threadNumber / 4, (size_t)1);
+    if (validThreadNumber >= threadNumber) {
+      Color::print_warning(
+        StringPrintf("The number of thread (%zu) is too small for "
+                     "pipelined validation (%zu), xLearn has already "
+                     "disable the --pipeline option.",
+                     threadNumber, validThreadNumber)
+      );
+      hyper_param_.pipeline_valid = false;
+      validThreadNumber = 0;
+    }
+  }
+  // The parallel cross-validation shares the threads equally
+  // by the workers, and the first worker uses the pool_.
+  size_t cvWorkerNumber = 1;
+  if (hyper_param_.cross_validation) {
+    cvWorkerNumber = std::min((size_t)hyper_param_.cv_parallel,
+                              (size_t)hyper_param_.num_folds);
+    cvWorkerNumber = std::min(cvWorkerNumber, threadNumber);
+  }
+  size_t trainThreadNumber = threadNumber - validThreadNumber;
+  if (cvWorkerNumber > 1) {
+    trainThreadNumber = get_cv_thread_number(threadNumber, 
+                                             cvWorkerNumber, 0);
+  }
+  pool_ = new ThreadPool(trainThreadNumber);
   Color::print_info(
-    StringPrintf("xLearn uses %i threads for training task.",
-             threadNumber)
+    StringPrintf("xLearn uses %zu threads for training task.",
+             trainThreadNumber)
   );
+  if (cvWorkerNumber > 1) {
+    cv_pool_.push_back(pool_);
+    for (size_t i = 1; i < cvWorkerNumber; ++i) {
+      cv_pool_.push_back(new ThreadPool(
+        get_cv_thread_number(threadNumber, cvWorkerNumber, i)));
+    }
+    Color::print_info(
+      StringPrintf("xLearn trains %zu folds concurrently.",
+               cvWorkerNumber)
+    );
+  }
+  if (hyper_param_.pipeline_valid) {
+    valid_pool_ = new ThreadPool(validThreadNumber);
+    Color::print_info(
+      StringPrintf("xLearn uses %zu threads for pipelined validation.",
+               validThreadNumber)
+    );
+  }
   /*********************************************************
    *  Initialize Reader                                    *
    *********************************************************/
@@ -246,6 +300,10 @@ void Solver::init_train() {
       if (hyper_param_.bin_out == false) {
         reader_[i]->SetNoBin();
       }
+      if (hyper_param_.hash_buckets > 0) {
+        reader_[i]->SetFeatureHash(hyper_param_.hash_buckets,
+                                   hyper_param_.hash_field);
+      }
       reader_[i]->Initialize(file_list[i]);
       if (!hyper_param_.on_disk) {
         reader_[i]->SetShuffle(true);
@@ -293,9 +351,13 @@ void Solver::init_train() {
    *********************************************************/
   DMatrix* matrix = nullptr;
   index_t max_feat = 0, max_field = 0;
+  bool is_hash = hyper_param_.hash_buckets > 0;
+  bool is_sparse = hyper_param_.sparse_model;
   for (int i = 0; i < num_reader; ++i) {
     while(reader_[i]->Samples(matrix)) {
-      int tmp = matrix->MaxFeat();
+      // The hashed feature ids are bounded by hash_buckets, and
+      // the sparse model does not need the number of feature.
+      int tmp = (is_hash || is_sparse) ? 0 : matrix->MaxFeat();
       if (tmp > max_feat) { max_feat = tmp; }
       if (hyper_param_.score_func.compare("ffm") == 0) {
         tmp = matrix->MaxField();
@@ -305,18 +367,25 @@ void Solver::init_train() {
     // Return to the begining of target file.
     reader_[i]->Reset();
   }
-  hyper_param_.num_feature = max_feat + 1;
-  // Check overflow:
-  // INT_MAX +  = 0
-  if (hyper_param_.num_feature == 0) {
-    Color::print_error("Feature index is too large (overflow).");
-    LOG(FATAL) << "Feature index is too large (overflow).";
+  hyper_param_.num_feature = is_hash ?
+      hyper_param_.hash_buckets : max_feat + 1;
+  if (is_sparse && !is_hash) {
+    hyper_param_.num_feature = 0;  // no bound
+    Color::print_info("Number of Feature: created on the first touch "
+                      "(--sparse-model)");
+  } else {
+    // Check overflow:
+    // INT_MAX +  = 0
+    if (hyper_param_.num_feature == 0) {
+      Color::print_error("Feature index is too large (overflow).");
+      LOG(FATAL) << "Feature index is too large (overflow).";
+    }
+    Color::print_info(
+      StringPrintf("Number of Feature: %d", 
+                   hyper_param_.num_feature)
+    );
   }
   LOG(INFO) << "Number of feature: " << hyper_param_.num_feature;
-  Color::print_info(
-    StringPrintf("Number of Feature: %d", 
-                 hyper_param_.num_feature)
-  );
   if (hyper_param_.score_func.compare("ffm") == 0) {
     hyper_param_.num_field = max_field + 1;
     LOG(INFO) << "Number of field: " << hyper_param_.num_field;
@@ -345,23 +414,106 @@ void Solver::init_train() {
     } else if (hyper_param_.opt_type.compare("ftrl") == 0) {
       hyper_param_.auxiliary_size = 3;
     }
-    model_->Initialize(hyper_param_.score_func,
-                     hyper_param_.loss_func,
-                     hyper_param_.num_feature,
-                     hyper_param_.num_field,
-                     hyper_param_.num_K,
-                     hyper_param_.auxiliary_size,
-                     hyper_param_.model_scale);
+    if (!is_sparse) {
+      check_memory(threadNumber, cvWorkerNumber);
+    }
+    if (is_sparse) {
+      model_->InitializeSparse(hyper_param_.score_func,
+                               hyper_param_.loss_func,
+                               hyper_param_.num_feature,
+                               hyper_param_.num_field,
+                               hyper_param_.num_K,
+                               hyper_param_.auxiliary_size,
+                               hyper_param_.model_scale);
+    } else {
+      model_->Initialize(hyper_param_.score_func,
+                       hyper_param_.loss_func,
+                       hyper_param_.num_feature,
+                       hyper_param_.num_field,
+                       hyper_param_.num_K,
+                       hyper_param_.auxiliary_size,
+                       hyper_param_.model_scale);
+    }
+    model_->SetFeatureHash(is_hash, hyper_param_.hash_field);
   } else { // Initialize parameter from pre-trained model
     model_ = new Model(hyper_param_.pre_model_file);
+    // The mapped model has no gradient cache and is read-only
+    if (model_->IsMapped() || model_->IsPruned()) {
+      Color::print_error(
+        StringPrintf("The pre-trained model is an inference-only model "
+                     "(%s), which cannot be trained: %s",
+                     model_->IsMapped() ? "-infer" : "-prune",
+                     hyper_param_.pre_model_file.c_str())
+      );
+      exit(0);
+    }
+    // The data must be hashed in the same way as the pre-trained model
+    if (model_->IsHashed() != is_hash ||
+        (is_hash && (model_->GetNumFeature() != hyper_param_.hash_buckets ||
+                     model_->IsFieldHashed() != hyper_param_.hash_field))) {
+      Color::print_error(
+        StringPrintf("The feature hashing (-hash %d%s) is different from "
+                     "the pre-trained model (-hash %d%s).",
+                     hyper_param_.hash_buckets,
+                     hyper_param_.hash_field ? " --hash-field" : "",
+                     model_->IsHashed() ? model_->GetNumFeature() : 0,
+                     model_->IsFieldHashed() ? " --hash-field" : "")
+      );
+      exit(0);
+    }
+    // The new features can only be learned by a sparse model
+    if (is_sparse && !model_->IsSparse()) {
+      model_->ConvertToSparse();
+      Color::print_info("Convert the pre-trained model to sparse model.");
+    }
+  }
+  // Feature admission and eviction of sparse model. A pre-trained
+  // model keeps its own setting unless -admit or -evict is given.
+  if (model_->IsSparse()) {
+    index_t admit = hyper_param_.admit_count;
+    bool shared = hyper_param_.admit_fallback.compare("shared") == 0;
+    index_t evict = hyper_param_.evict_epoch;
+    if (!hyper_param_.pre_model_file.empty()) {
+      if (admit == 0) {
+        admit = model_->GetAdmitCount();
+        shared = model_->IsSharedFallback();
+      }
+      if (evict == 0) {
+        evict = model_->GetEvictEpoch();
+      }
+    }
+    model_->SetAdmission(admit, shared, evict);
+    if (model_->IsAdmission()) {
+      Color::print_info(
+        StringPrintf("Feature admission: latent factor after %u "
+                     "occurrences (%s fallback), sketch size: %s",
+             admit, shared ? "shared" : "linear",
+             PrintSize(model_->GetSketch()->MemoryBytes()).c_str())
+      );
+    }
+    if (evict > 0) {
+      Color::print_info(
+        StringPrintf("Feature eviction: not updated in the last %u epochs",
+             evict)
+      );
+    }
   }
   index_t num_param = model_->GetNumParameter();
   hyper_param_.num_param = num_param;
   LOG(INFO) << "Number parameters: " << num_param;
-  Color::print_info(
-    StringPrintf("Model size: %s", 
-         PrintSize(num_param*sizeof(real_t)).c_str())
-  );
+  if (model_->IsSparse()) {
+    SparseTable* table = model_->GetSparseTable();
+    Color::print_info(
+      StringPrintf("Model size: %s (sparse model with %zu features)",
+           PrintSize(table->MemoryBytes()).c_str(),
+           table->Size())
+    );
+  } else {
+    Color::print_info(
+      StringPrintf("Model size: %s", 
+           PrintSize(num_param*sizeof(real_t)).c_str())
+    );
+  }
   Color::print_info(
     StringPrintf("Time cost for model initial: %.2f (sec)",
          timer.toc())
@@ -391,9 +543,244 @@ void Solver::init_train() {
    *********************************************************/
   metric_ = create_metric();
   if (metric_ != nullptr) {
-    metric_->Initialize(pool_);
+    metric_->Initialize(pool_, hyper_param_.auc_bucket);
   }
   LOG(INFO) << "Initialize evaluation metric.";
+  /*********************************************************
+   *  Init loss and metric for pipelined validation        *
+   *********************************************************/
+  if (hyper_param_.pipeline_valid) {
+    valid_loss_ = create_loss();
+    valid_loss_->Initialize(score_, valid_pool_,
+           hyper_param_.norm,
+           hyper_param_.lock_free);
+    valid_metric_ = create_metric();
+    if (valid_metric_ != nullptr) {
+      valid_metric_->Initialize(valid_pool_, hyper_param_.auc_bucket);
+    }
+    LOG(INFO) << "Initialize pipelined validation.";
+  }
+  /*********************************************************
+   *  Init workers for parallel cross-validation           *
+   *********************************************************/
+  if (!cv_pool_.empty()) {
+    init_cv_worker();
+    LOG(INFO) << "Initialize " << cv_worker_.size() 
+              << " workers for parallel cross-validation.";
+  }
+  /*********************************************************
+   *  Init parameter server and distributed workers        *
+   *********************************************************/
+  if (hyper_param_.num_worker > 0) {
+    init_dist_worker(trainThreadNumber);
+    LOG(INFO) << "Initialize " << dist_loss_.size()
+              << " workers and " << store_->ServerNum()
+              << " servers for distributed training.";
+  }
+  Color::print_info(
+    StringPrintf("Memory: %s", MemoryTracker::Report().c_str())
+  );
+  LOG(INFO) << "Memory: " << MemoryTracker::Report();
+}
+
+// Estimate the memory of the dense models and the AUC buckets
+// before we allocate them, and stop at once if the job cannot
+// fit in the available memory, instead of being killed by the
+// OOM killer after reading the data.
+void Solver::check_memory(size_t thread_number, size_t cv_worker_number) {
+  uint64 model = Model::EstimateBytes(hyper_param_.score_func,
+                                      hyper_param_.num_feature,
+                                      hyper_param_.num_field,
+                                      hyper_param_.num_K,
+                                      hyper_param_.auxiliary_size);
+  // The number of parameters is index_t
+  if (model / sizeof(real_t) >
+      (uint64)std::numeric_limits<index_t>::max()) {
+    Color::print_error(
+      StringPrintf("The model has too many parameters (%llu) for a "
+                   "dense model. Please use a smaller -k, a smaller "
+                   "-hash, or --sparse-model.",
+                   (unsigned long long)(model / sizeof(real_t)))
+    );
+    exit(0);
+  }
+  // The model, the best model of early-stopping, the snapshot
+  // of checkpoint, and the models of the workers of parallel
+  // cross-validation.
+  uint64 num_model = 1;
+  if (hyper_param_.early_stop && !hyper_param_.cross_validation &&
+      !hyper_param_.validate_set_file.empty() && !hyper_param_.quiet) {
+    num_model++;
+  }
+  // The snapshot of pipelined validation has no gradient cache
+  uint64 snapshot = 0;
+  if (hyper_param_.pipeline_valid) {
+    snapshot = Model::EstimateBytes(hyper_param_.score_func,
+                                    hyper_param_.num_feature,
+                                    hyper_param_.num_field,
+                                    hyper_param_.num_K,
+                                    1);
+  }
+  if (!hyper_param_.cross_validation &&
+      hyper_param_.model_file.compare("none") != 0 &&
+      (hyper_param_.checkpoint_epoch > 0 ||
+       hyper_param_.checkpoint_time > 0)) {
+    num_model++;
+  }
+  if (cv_worker_number > 1) {
+    num_model += cv_worker_number;
+  }
+  // Each AUC metric has two histograms for each thread and the sum
+  uint64 metric = 0;
+  if (hyper_param_.metric.compare("auc") == 0) {
+    uint64 num_hist = thread_number + cv_worker_number +
+                      (hyper_param_.pipeline_valid ? 1 : 0);
+    metric = num_hist * 2 * hyper_param_.auc_bucket * sizeof(index_t);
+  }
+  uint64 need = model * num_model + snapshot + metric;
+  uint64 available = MemoryTracker::AvailableBytes();
+  std::string breakdown =
+    StringPrintf("model: %s x %llu, snapshot: %s, metric: %s, data: %s",
+                 PrintSize(model).c_str(),
+                 (unsigned long long)num_model,
+                 PrintSize(snapshot).c_str(),
+                 PrintSize(metric).c_str(),
+                 PrintSize(MemoryTracker::Current(kMemData) +
+                           MemoryTracker::Current(kMemBuffer)).c_str());
+  LOG(INFO) << "Estimated memory: " << PrintSize(need)
+            << " (" << breakdown << "), available: "
+            << PrintSize(available);
+  if (hyper_param_.mem_check && available > 0 && need > available) {
+    Color::print_error(
+      StringPrintf("xLearn needs about %s for the model and metric "
+                   "(%s), but only %s is available. Please use a smaller "
+                   "-k, a smaller -hash, --sparse-model, --disk or a "
+                   "smaller -block, or use --no-mem-check to skip it.",
+                   PrintSize(need).c_str(),
+                   breakdown.c_str(),
+                   PrintSize(available).c_str())
+    );
+    exit(0);
+  }
+  Color::print_info(
+    StringPrintf("Estimated memory of model and metric: %s (%s)",
+                 PrintSize(need).c_str(),
+                 breakdown.c_str())
+  );
+}
+
+// Print the peak of the tracked memory and of the process.
+void Solver::print_peak_memory() {
+  std::string rss = "unknown";
+  if (MemoryTracker::PeakRSS() > 0) {
+    rss = PrintSize(MemoryTracker::PeakRSS());
+  }
+  Color::print_info(
+    StringPrintf("Peak memory: %s (tracked), %s (process RSS)",
+                 PrintSize(MemoryTracker::PeakTotal()).c_str(),
+                 rss.c_str())
+  );
+}
+
+// Number of thread used by the i-th worker of
+// parallel cross-validation.
+size_t Solver::get_cv_thread_number(size_t thread_number,
+                                    size_t worker_number,
+                                    size_t i) {
+  size_t num = thread_number / worker_number;
+  if (i < thread_number % worker_number) { num++; }
+  return num;
+}
+
+// The workers of parallel cross-validation share the data
+// of the fold readers, but use their own Reader cursors, model, 
+// loss and metric. The first worker uses the loss_ and the metric_.
+void Solver::init_cv_worker() {
+  cv_worker_.resize(cv_pool_.size());
+  for (size_t w = 0; w < cv_worker_.size(); ++w) {
+    CVWorker& worker = cv_worker_[w];
+    for (size_t i = 0; i < reader_.size(); ++i) {
+      DMatrix* matrix = 
+        static_cast<InmemReader*>(reader_[i])->GetMatrix();
+      Reader* cursor = CREATE_READER("dmatrix");
+      CHECK_NOTNULL(cursor);
+      cursor->SetSeed(hyper_param_.seed);
+      cursor->Initialize(matrix);
+      cursor->SetShuffle(true);
+      worker.reader_list.push_back(cursor);
+    }
+    worker.model = new Model();
+    worker.model->CopyFrom(*model_);
+    if (w == 0) {
+      worker.loss = loss_;
+      worker.metric = metric_;
+    } else {
+      worker.loss = create_loss();
+      worker.loss->Initialize(score_, cv_pool_[w],
+             hyper_param_.norm,
+             hyper_param_.lock_free);
+      worker.metric = create_metric();
+      if (worker.metric != nullptr) {
+        worker.metric->Initialize(cv_pool_[w], hyper_param_.auc_bucket);
+      }
+    }
+  }
+}
+
+// The workers of distributed training share the threads equally.
+// Each worker trains its local mini-model by 'sgd', and the
+// configured optimization method runs on the parameter server.
+void Solver::init_dist_worker(size_t thread_number) {
+  size_t worker_number = std::min((size_t)hyper_param_.num_worker,
+                                  thread_number);
+  real_t init_scale = hyper_param_.model_scale;
+  if (hyper_param_.score_func.compare("linear") != 0) {
+    init_scale /= sqrt(hyper_param_.num_K);
+  }
+  size_t server_number = std::max(hyper_param_.num_server, 1);
+  store_ = new KVStore();
+  store_->SetCodec(hyper_param_.push_codec,
+                   hyper_param_.pull_codec,
+                   hyper_param_.topk_ratio);
+  store_->Initialize(server_number,
+                     hyper_param_.opt_type,
+                     hyper_param_.learning_rate,
+                     hyper_param_.regu_lambda,
+                     hyper_param_.alpha,
+                     hyper_param_.beta,
+                     hyper_param_.lambda_1,
+                     hyper_param_.lambda_2,
+                     init_scale);
+  dist_score_ = create_score();
+  std::string opt_type("sgd");
+  dist_score_->Initialize(hyper_param_.learning_rate,
+                          0,  /* regularization runs on servers */
+                          hyper_param_.alpha,
+                          hyper_param_.beta,
+                          hyper_param_.lambda_1,
+                          hyper_param_.lambda_2,
+                          opt_type);
+  for (size_t w = 0; w < worker_number; ++w) {
+    ThreadPool* pool = new ThreadPool(
+      get_cv_thread_number(thread_number, worker_number, w));
+    Loss* loss = create_loss();
+    loss->Initialize(dist_score_, pool,
+           hyper_param_.norm,
+           hyper_param_.lock_free,
+           hyper_param_.batch_size);
+    loss->InitDist(store_,
+                   hyper_param_.learning_rate,
+                   hyper_param_.score_func,
+                   hyper_param_.num_field,
+                   hyper_param_.num_K);
+    dist_pool_.push_back(pool);
+    dist_loss_.push_back(loss);
+  }
+  Color::print_info(
+    StringPrintf("xLearn uses %zu workers and %zu servers for "
+                 "distributed training.",
+                 worker_number, server_number)
+  );
 }
 
 // Initialize predict task
@@ -425,6 +812,9 @@ void Solver::init_predict() {
   hyper_param_.score_func = model_->GetScoreFunction();
   hyper_param_.loss_func = model_->GetLossFunction();
   hyper_param_.num_feature = model_->GetNumFeature();
+  if (model_->IsSparse()) {
+    hyper_param_.num_feature = model_->GetSparseTable()->Size();
+  }
   if (hyper_param_.score_func.compare("fm") == 0 ||
        hyper_param_.score_func.compare("ffm") == 0) {
     hyper_param_.num_K = model_->GetNumK();
@@ -473,6 +863,10 @@ void Solver::init_predict() {
   if (hyper_param_.from_file) {
     CHECK_NE(hyper_param_.test_set_file.empty(), true);
     reader_[0]->SetBlockSize(hyper_param_.block_size);
+    if (model_->IsHashed()) {
+      reader_[0]->SetFeatureHash(model_->GetNumFeature(),
+                                 model_->IsFieldHashed());
+    }
     reader_[0]->Initialize(hyper_param_.test_set_file);
     reader_[0]->SetShuffle(false);
     if (reader_[0] == nullptr) {
@@ -538,6 +932,8 @@ void Solver::start_train_work() {
               !hyper_param_.cross_validation;
   bool save_model = true;
   bool save_txt_model = true;
+  bool save_infer_model = true;
+  bool save_prune_model = true;
   if (hyper_param_.model_file.compare("none") == 0 ||
       hyper_param_.cross_validation) {
     save_model = false;
@@ -546,6 +942,19 @@ void Solver::start_train_work() {
       hyper_param_.cross_validation) {
     save_txt_model = false;
   }
+  if (hyper_param_.infer_model_file.compare("none") == 0 ||
+      hyper_param_.cross_validation) {
+    save_infer_model = false;
+  }
+  if (hyper_param_.prune_model_file.compare("none") == 0 ||
+      hyper_param_.cross_validation) {
+    save_prune_model = false;
+  }
+  if (save_infer_model && model_->IsSparse()) {
+    Color::print_warning("The inference model (-infer) does not support "
+                         "the sparse model, and xLearn will not dump it.");
+    save_infer_model = false;
+  }
   Trainer trainer;
   trainer.Initialize(reader_,  /* Reader list */
                      epoch,
@@ -555,12 +964,59 @@ void Solver::start_train_work() {
                      early_stop,
                      stop_window,
                      quiet);
+  if (hyper_param_.pipeline_valid) {
+    trainer.InitPipeline(valid_loss_, valid_metric_);
+  }
+  if (!cv_worker_.empty()) {
+    trainer.InitParallelCV(cv_worker_);
+  }
+  if (!dist_loss_.empty()) {
+    trainer.InitDist(dist_loss_);
+  }
+  Checkpoint checkpoint;
+  if (!hyper_param_.cross_validation && save_model &&
+      (hyper_param_.checkpoint_epoch > 0 ||
+       hyper_param_.checkpoint_time > 0)) {
+    std::string ckpt_file = hyper_param_.model_file + ".ckpt";
+    checkpoint.Initialize(ckpt_file,
+                          hyper_param_.checkpoint_epoch,
+                          hyper_param_.checkpoint_time);
+    trainer.InitCheckpoint(&checkpoint);
+    Color::print_info(
+      StringPrintf("Checkpoint file: %s", ckpt_file.c_str())
+    );
+  }
+  if (hyper_param_.profile) {
+    if (hyper_param_.cross_validation) {
+      Color::print_warning("The --profile option does not support "
+                           "cross-validation, and xLearn will ignore it.");
+    } else {
+      std::string profile_file = log_prefix_ + ".profile.json";
+      trainer.InitProfile(profile_file);
+      Color::print_info(
+        StringPrintf("Profile file: %s", profile_file.c_str())
+      );
+    }
+  }
+  if (hyper_param_.trace) {
+    if (hyper_param_.cross_validation) {
+      Color::print_warning("The --trace option does not support "
+                           "cross-validation, and xLearn will ignore it.");
+    } else {
+      std::string trace_file = log_prefix_ + ".trace.json";
+      trainer.InitTrace(trace_file);
+      Color::print_info(
+        StringPrintf("Trace file: %s", trace_file.c_str())
+      );
+    }
+  }
   Color::print_action("Start to train ...");
 /******************************************************************************
  * Training under cross-validation                                            *
  ******************************************************************************/
   if (hyper_param_.cross_validation) {
     trainer.CVTrain();
+    print_peak_memory();
     Color::print_action("Finish Cross-Validation");
   } 
 /******************************************************************************
@@ -569,25 +1025,42 @@ void Solver::start_train_work() {
   else {
     // The training process
     trainer.Train();
-    // Save binary model
-    if (save_model) {
-      Timer timer;
-      timer.tic();
-      Color::print_action("Start to save model ...");
-      trainer.SaveModel(hyper_param_.model_file);
+    if (model_->IsSparse()) {
+      SparseTable* table = model_->GetSparseTable();
       Color::print_info(
-        StringPrintf("Model file: %s", hyper_param_.model_file.c_str())
-      );
-      Color::print_info(
-        StringPrintf("Time cost for saving model: %.2f (sec)", timer.toc())
+        StringPrintf("Sparse model has %zu features (%s)",
+             table->Size(),
+             PrintSize(table->MemoryBytes()).c_str())
       );
+      SparseTable* linear = model_->GetLinearTable();
+      if (linear != nullptr) {
+        Color::print_info(
+          StringPrintf("Linear-only features not admitted: %zu (%s)",
+               linear->Size(),
+               PrintSize(linear->MemoryBytes()).c_str())
+        );
+      }
+    }
+    print_peak_memory();
+    // The binary model is written in background, while
+    // the TXT model is formatted by the thread pool.
+    std::thread bin_writer;
+    Timer bin_timer;
+    real_t bin_time = 0;
+    if (save_model) {
+      Color::print_action("Start to save model ...");
+      bin_writer = std::thread([&]() {
+        bin_timer.tic();
+        trainer.SaveModel(hyper_param_.model_file);
+        bin_time = bin_timer.toc();
+      });
     }
     // Save TXT model 
     if (save_txt_model) {
       Timer timer;
       timer.tic();
       Color::print_action("Start to save txt model ...");
-      trainer.SaveTxtModel(hyper_param_.txt_model_file);
+      trainer.SaveTxtModel(hyper_param_.txt_model_file, pool_);
       Color::print_info(
         StringPrintf("TXT Model file: %s", hyper_param_.txt_model_file.c_str())
       );
@@ -595,6 +1068,51 @@ void Solver::start_train_work() {
         StringPrintf("Time cost for saving txt model: %.2f (sec)", timer.toc())
       );
     }
+    // Save inference model
+    if (save_infer_model) {
+      Timer timer;
+      timer.tic();
+      Color::print_action(hyper_param_.quantize ?
+                          "Start to save int8 inference model ..." :
+                          "Start to save inference model ...");
+      trainer.SaveInferenceModel(hyper_param_.infer_model_file,
+                                 hyper_param_.quantize);
+      Color::print_info(
+        StringPrintf("Inference model file: %s",
+             hyper_param_.infer_model_file.c_str())
+      );
+      Color::print_info(
+        StringPrintf("Time cost for saving inference model: %.2f (sec)",
+             timer.toc())
+      );
+    }
+    // Save pruned model
+    if (save_prune_model) {
+      Timer timer;
+      timer.tic();
+      Color::print_action("Start to save pruned model ...");
+      index_t num_kept =
+        trainer.SavePrunedModel(hyper_param_.prune_model_file);
+      Color::print_info(
+        StringPrintf("Pruned model file: %s (%u non-zero features)",
+             hyper_param_.prune_model_file.c_str(),
+             num_kept)
+      );
+      Color::print_info(
+        StringPrintf("Time cost for saving pruned model: %.2f (sec)",
+             timer.toc())
+      );
+    }
+    // Save binary model
+    if (save_model) {
+      bin_writer.join();
+      Color::print_info(
+        StringPrintf("Model file: %s", hyper_param_.model_file.c_str())
+      );
+      Color::print_info(
+        StringPrintf("Time cost for saving model: %.2f (sec)", bin_time)
+      );
+    }
     Color::print_action("Finish training");
   }
 }
@@ -609,8 +1127,11 @@ void Solver::start_prediction_work() {
                  hyper_param_.output_file,
                  hyper_param_.sign,
                  hyper_param_.sigmoid,
-                 hyper_param_.res_out);
-  // Predict and write output
+                 hyper_param_.res_out,
+                 hyper_param_.binary_out,
+                 !hyper_param_.res_out);
+  // Predict and write output. The results are kept
+  // in memory only if they are not written to file.
   pdc.Predict();
   this->out_ = pdc.GetResult();
 }
@@ -632,6 +1153,31 @@ void Solver::Clear() {
     }
   }
   reader_.clear();
+  // Clear the workers of parallel cross-validation
+  for (size_t w = 0; w < cv_worker_.size(); ++w) {
+    for (size_t i = 0; i < cv_worker_[w].reader_list.size(); ++i) {
+      delete cv_worker_[w].reader_list[i];
+    }
+    delete cv_worker_[w].model;
+    if (w != 0) {
+      delete cv_worker_[w].loss;
+      delete cv_worker_[w].metric;
+      delete cv_pool_[w];
+    }
+  }
+  cv_worker_.clear();
+  cv_pool_.clear();
+  // Clear the distributed workers
+  for (size_t w = 0; w < dist_loss_.size(); ++w) {
+    delete dist_loss_[w];
+    delete dist_pool_[w];
+  }
+  dist_loss_.clear();
+  dist_pool_.clear();
+  delete dist_score_;
+  dist_score_ = nullptr;
+  delete store_;
+  store_ = nullptr;
 }
 
 } // namespace xLearn
@@ -32,6 +32,7 @@ This file defines the Solver class, which is the entry of the xLearn.
 #include "src/score/score_function.h"
 #include "src/loss/loss.h"
 #include "src/loss/metric.h"
+#include "src/distributed/parameter_server.h"
 #include "src/solver/checker.h"
 #include "src/solver/trainer.h"
 #include "src/solver/inference.h"
@@ -56,7 +57,12 @@ class Solver {
   Solver() 
     : score_(nullptr),
       loss_(nullptr),
-      metric_(nullptr) { }
+      metric_(nullptr),
+      valid_loss_(nullptr),
+      valid_metric_(nullptr),
+      valid_pool_(nullptr),
+      store_(nullptr),
+      dist_score_(nullptr) { }
   ~Solver() { }
 
   // Ser train or predict
@@ -102,8 +108,27 @@ class Solver {
   xLearn::Metric* metric_;
   /* ThreadPool for multi-thread training */
   ThreadPool* pool_;
+  /* Loss and metric used by pipelined validation */
+  xLearn::Loss* valid_loss_;
+  xLearn::Metric* valid_metric_;
+  /* ThreadPool for pipelined validation */
+  ThreadPool* valid_pool_;
+  /* Workers for parallel cross-validation */
+  std::vector<xLearn::CVWorker> cv_worker_;
+  /* ThreadPool of each worker, and cv_pool_[0] is the pool_ */
+  std::vector<ThreadPool*> cv_pool_;
+  /* Parameter server for distributed training */
+  xLearn::KVStore* store_;
+  /* The 'sgd' score function used by distributed workers */
+  xLearn::Score* dist_score_;
+  /* Loss function of each distributed worker */
+  std::vector<xLearn::Loss*> dist_loss_;
+  /* ThreadPool of each distributed worker */
+  std::vector<ThreadPool*> dist_pool_;
   /* predict results */
   std::vector<real_t> out_;
+  /* Prefix of the log files */
+  std::string log_prefix_;
 
   // Create object by name
   xLearn::Reader* create_reader();
@@ -111,6 +136,22 @@ class Solver {
   xLearn::Loss* create_loss();
   xLearn::Metric* create_metric();
 
+  // Initialize the parallel cross-validation
+  size_t get_cv_thread_number(size_t thread_number,
+                              size_t worker_number,
+                              size_t i);
+  void init_cv_worker();
+
+  // Estimate the memory of a new dense model and stop
+  // if it cannot fit in the available memory
+  void check_memory(size_t thread_number, size_t cv_worker_number);
+
+  // Print the peak memory after training
+  void print_peak_memory();
+
+  // Initialize the parameter server and distributed workers
+  void init_dist_worker(size_t thread_number);
+
   // xLearn command line logo
   void print_logo() const;
 
@@ -21,10 +21,15 @@ This file is the implementation of the Trainer class.
 #include <stdio.h>
 #include <vector>
 #include <string>
+#include <thread>
+#include <mutex>
+#include <atomic>
 
 #include "src/solver/trainer.h"
 #include "src/data/data_structure.h"
+#include "src/data/sparse_table.h"
 #include "src/base/timer.h"
+#include "src/base/memory_tracker.h"
 
 namespace xLearn {
 
@@ -106,6 +111,11 @@ void Trainer::Train() {
  *  Cross-Validation                                     *
  *********************************************************/
 void Trainer::CVTrain() {
+  // Train the folds concurrently
+  if (!cv_worker_.empty()) {
+    this->cv_train_parallel();
+    return;
+  }
   // Use the i-th reader as validation Reader
   for (int i = 0; i < reader_list_.size(); ++i) {
     Color::print_action(
@@ -130,6 +140,85 @@ void Trainer::CVTrain() {
   show_average_metric();
 }
 
+/*********************************************************
+ *  Parallel Cross-Validation                            *
+ *********************************************************/
+//------------------------------------------------------------------------------
+// Each worker picks the next untrained fold until all of the folds
+// have been trained, e.g., 5 folds on 3 workers:
+//
+//   worker 0:  | fold 1 | fold 4 |
+//   worker 1:  | fold 2 | fold 5 |
+//   worker 2:  | fold 3 |
+//
+// We do not print the evaluation info of each epoch, because the
+// output of different folds would be mixed up. Instead, we only
+// evaluate the model after the last epoch, which is the same
+// metric stored by the sequential cross-validation.
+//------------------------------------------------------------------------------
+void Trainer::cv_train_parallel() {
+  int num_folds = reader_list_.size();
+  std::vector<MetricInfo> fold_info(num_folds);
+  std::atomic<int> next_fold(0);
+  std::mutex print_mutex;
+  Color::print_action(
+    StringPrintf("Cross-validation: %d folds on %lu workers",
+      num_folds, cv_worker_.size())
+  );
+  std::vector<std::thread> threads;
+  for (size_t w = 0; w < cv_worker_.size(); ++w) {
+    threads.push_back(std::thread([&, w]() {
+      for (;;) {
+        int i = next_fold++;
+        if (i >= num_folds) { break; }
+        Timer timer;
+        timer.tic();
+        fold_info[i] = this->train_fold(cv_worker_[w], i);
+        std::lock_guard<std::mutex> lock(print_mutex);
+        std::string info = StringPrintf(
+          "Fold %d/%d: Test %s: %.6f", i+1, num_folds,
+          loss_->loss_type().c_str(), fold_info[i].loss_val);
+        if (metric_ != nullptr) {
+          info += StringPrintf(", Test %s: %.6f",
+            metric_->metric_type().c_str(), 
+            fold_info[i].metric_val);
+        }
+        info += StringPrintf(", Time cost: %.2f (sec)", timer.toc());
+        Color::print_info(info);
+      }
+    }));
+  }
+  for (size_t w = 0; w < threads.size(); ++w) {
+    threads[w].join();
+  }
+  // Store the metric info in the order of folds
+  for (int i = 0; i < num_folds; ++i) {
+    metric_info_.push_back(fold_info[i]);
+  }
+  // Average metric for cross-validation
+  show_average_metric();
+}
+
+MetricInfo Trainer::train_fold(CVWorker& worker, int fold) {
+  // Get the train Reader and test Reader
+  std::vector<Reader*> tr_reader;
+  for (int j = 0; j < worker.reader_list.size(); ++j) {
+    if (j == fold) { continue; }
+    tr_reader.push_back(worker.reader_list[j]);
+  }
+  std::vector<Reader*> te_reader;
+  te_reader.push_back(worker.reader_list[fold]);
+  // Every fold starts from the same initial model
+  worker.model->CopyFrom(*model_);
+  for (int n = 1; n <= epoch_; ++n) {
+    calc_gradient(tr_reader, worker.model, worker.loss);
+  }
+  return calc_metric(te_reader, 
+                     worker.model, 
+                     worker.loss, 
+                     worker.metric);
+}
+
 /*********************************************************
  *  Calc average evaluation metric for CV                *
  *********************************************************/
@@ -157,17 +246,49 @@ void Trainer::show_average_metric() {
 }
 
 /*********************************************************
- *  Basic train function                                 *
+ *  Save inference model                                 *
  *********************************************************/
-void Trainer::train(std::vector<Reader*>& train_reader,
-                    std::vector<Reader*>& test_reader) {
-  int best_epoch = 0;
-  int stop_window = 0;
-  real_t best_result = 0;
-  real_t prev_result = 0;
+// Save the inference-only model to disk file
+void Trainer::SaveInferenceModel(const std::string& filename,
+                                 bool quantize) {
+  CHECK_NE(filename.empty(), true);
+  CHECK_NE(filename.compare("none"), 0);
+  model_->SerializeInference(filename, quantize);
+  if (!quantize || reader_list_.size() != 2) { return; }
+  // Accuracy of the int8 model
+  std::vector<Reader*> te_reader(1, reader_list_[1]);
+  Model int8_model(filename);
+  MetricInfo fp32_info = calc_metric(te_reader);
+  MetricInfo int8_info = calc_metric(te_reader, &int8_model, loss_, metric_);
+  Color::print_info(
+    StringPrintf("Int8 model %s: %.6f (fp32: %.6f, delta: %+.6f)",
+         loss_->loss_type().c_str(),
+         int8_info.loss_val,
+         fp32_info.loss_val,
+         int8_info.loss_val - fp32_info.loss_val)
+  );
+  if (metric_ != nullptr) {
+    Color::print_info(
+      StringPrintf("Int8 model %s: %.6f (fp32: %.6f, delta: %+.6f)",
+           metric_->metric_type().c_str(),
+           int8_info.metric_val,
+           fp32_info.metric_val,
+           int8_info.metric_val - fp32_info.metric_val)
+    );
+  }
+}
+
+/*********************************************************
+ *  Early-stopping                                       *
+ *********************************************************/
+void Trainer::init_early_stop() {
+  best_epoch_ = 0;
+  stop_count_ = 0;
+  best_result_ = 0;
+  prev_result_ = 0;
   if (metric_ == nullptr) {
-    best_result = kFloatMax;
-    prev_result = kFloatMin;
+    best_result_ = kFloatMax;
+    prev_result_ = kFloatMin;
   } else {
     std::string metric_type = metric_->metric_type();
     // Classification
@@ -175,122 +296,371 @@ void Trainer::train(std::vector<Reader*>& train_reader,
         metric_type.compare("Precision") == 0 ||
         metric_type.compare("Recall") == 0 ||
         metric_type.compare("F1") == 0 ||
-        metric_type.compare("AUC") == 0) {
-      best_result = kFloatMin;
-      prev_result = kFloatMax;
+        metric_type.compare("AUC") == 0 ||
+        metric_type.compare("GAUC") == 0) {
+      best_result_ = kFloatMin;
+      prev_result_ = kFloatMax;
     } else if (metric_type.compare("MAE") == 0 ||
                metric_type.compare("MAPE") == 0 ||
                metric_type.compare("RMSD") == 0) {  // regression
-      best_result = kFloatMax;
-      prev_result = kFloatMin;
+      best_result_ = kFloatMax;
+      prev_result_ = kFloatMin;
     }
   }
+}
+
+bool Trainer::check_early_stop(const MetricInfo& te_info,
+                               int epoch,
+                               Model* model) {
+  if ((metric_ == nullptr && te_info.loss_val <= best_result_) ||
+      (metric_ != nullptr && metric_->cmp(te_info.metric_val, 
+                                          best_result_))) {
+    best_result_ = metric_ == nullptr ? 
+      te_info.loss_val : te_info.metric_val;
+    best_epoch_ = epoch;
+    if (model == model_) {
+      model_->SetBestModel();
+    } else {
+      model_->SetBestModel(*model);
+    }
+  }
+  bool stop = false;
+  if ((metric_ == nullptr && te_info.loss_val > prev_result_) ||
+      (metric_ != nullptr && !metric_->cmp(te_info.metric_val, 
+                                           prev_result_))) {
+    // If the validation loss goes up conntinuously
+    // in stop_window epoch, we stop training
+    if (stop_count_ == stop_window_) { 
+      stop = true; 
+    } else {
+      stop_count_++;
+    }
+  } else {
+    stop_count_ = 0;
+  }
+  if (!stop) {
+    prev_result_ = metric_ == nullptr ? 
+      te_info.loss_val : te_info.metric_val;
+  }
+  return stop;
+}
+
+void Trainer::save_checkpoint(int epoch) {
+  if (checkpoint_ != nullptr) {
+    checkpoint_->Save(*model_, epoch);
+  }
+}
+
+void Trainer::record_epoch(int epoch, real_t time_cost, real_t tr_loss) {
+  // The sparse model grows by itself
+  if (model_->IsSparse()) {
+    uint64 bytes = model_->GetSparseTable()->MemoryBytes();
+    if (model_->GetLinearTable() != nullptr) {
+      bytes += model_->GetLinearTable()->MemoryBytes();
+    }
+    MemoryTracker::Set(kMemSparseModel, bytes);
+  }
+  LOG(INFO) << "Memory of epoch " << epoch << ": "
+            << MemoryTracker::Report();
+  if (trace_file_ != nullptr) {
+    ThreadPool::WriteTrace(trace_file_);
+    fflush(trace_file_);
+  }
+  if (profile_file_ == nullptr) { return; }
+  ProfileStat stat = Profiler::Collect();
+  std::vector<PoolStat> pool_stat = ThreadPool::CollectStat();
+  for (size_t i = 0; i < pool_stat.size(); ++i) {
+    LOG(INFO) << StringPrintf("Thread pool %d of epoch %d: %llu tasks, "
+                              "utilization %.1f%%, imbalance %.2f, "
+                              "lock contention %llu",
+                              pool_stat[i].id, epoch,
+                              (unsigned long long)pool_stat[i].num_task,
+                              pool_stat[i].Utilization() * 100,
+                              pool_stat[i].Imbalance(),
+                              (unsigned long long)pool_stat[i].contention);
+  }
+  std::string line = StringPrintf(
+    "{\"epoch\":%d,\"wall_sec\":%.3f,\"train_loss\":%.6f,"
+    "\"profile\":%s,\"memory\":%s,\"pools\":%s}\n",
+    epoch, time_cost, tr_loss, Profiler::ToJSON(stat).c_str(),
+    MemoryTracker::ToJSON().c_str(),
+    ThreadPool::StatToJSON(pool_stat).c_str());
+  WriteDataToDisk(profile_file_, line.data(), line.size());
+  fflush(profile_file_);
+}
+
+void Trainer::finish_train(const MetricInfo& te_info) {
+  // The final model will be saved by the caller
+  if (checkpoint_ != nullptr) {
+    checkpoint_->Wait();
+  }
+  if (early_stop_ && best_epoch_ != epoch_) {  // not for cv
+    std::string metric_name = metric_ == nullptr ? 
+      "loss" : metric_->metric_type();
+    Color::print_action(
+      StringPrintf("Early-stopping at epoch %d, best %s: %f", 
+        best_epoch_, metric_name.c_str(), best_result_)
+    );
+    model_->Shrink();
+  } else {  // for cv
+    metric_info_.push_back(te_info);
+  }
+}
+
+/*********************************************************
+ *  Basic train function                                 *
+ *********************************************************/
+void Trainer::train(std::vector<Reader*>& train_reader,
+                    std::vector<Reader*>& test_reader) {
+  // Validation overlaps with the training of next epoch
+  if (valid_loss_ != nullptr && !quiet_ && !test_reader.empty()) {
+    this->train_pipeline(train_reader, test_reader);
+    return;
+  }
+  init_early_stop();
   MetricInfo te_info;
   // Show header info
   if (!quiet_) { 
     show_head_info(!test_reader.empty()); 
   }
+  // Drop the records of loading the data
+  Profiler::Collect();
+  ThreadPool::CollectStat();
   for (int n = 1; n <= epoch_; ++n) {
     Timer timer;
     timer.tic();
     // Calc grad and update model
     real_t tr_loss = calc_gradient(train_reader);
+    save_checkpoint(n);
     // we don't do any evaluation in a quiet model
+    if (!quiet_ && !test_reader.empty()) {
+      te_info = calc_metric(test_reader);
+    }
+    real_t time_cost = timer.toc();
+    record_epoch(n, time_cost, tr_loss);
     if (!quiet_) {
-      if (!test_reader.empty()) { 
-        te_info = calc_metric(test_reader); 
-      }
       // show evaludation metric info
       show_train_info(tr_loss, 
                       te_info.loss_val,
                       te_info.metric_val,
-                      timer.toc(), 
+                      time_cost, 
                       !test_reader.empty(), 
                       n);
       // Early-stopping
-      if (early_stop_) {
-        if ((metric_ == nullptr && te_info.loss_val <= best_result) ||
-            (metric_ != nullptr && metric_->cmp(te_info.metric_val, 
-                                                best_result))) {
-          best_result = metric_ == nullptr ? 
-            te_info.loss_val : te_info.metric_val;
-          best_epoch = n;
-          model_->SetBestModel();
-        }
-        if ((metric_ == nullptr && te_info.loss_val > prev_result) ||
-            (metric_ != nullptr && !metric_->cmp(te_info.metric_val, 
-                                                 prev_result))) {
-          // If the validation loss goes up conntinuously
-          // in stop_window epoch, we stop training
-          if (stop_window == stop_window_) { break; }
-          stop_window++;
-        } else {
-          stop_window = 0;
-        }
-        prev_result = metric_ == nullptr ? 
-          te_info.loss_val : te_info.metric_val;
+      if (early_stop_ && check_early_stop(te_info, n, model_)) {
+        break;
       }
     }
   }
-  if (early_stop_ && best_epoch != epoch_) {  // not for cv
-    std::string metric_name = metric_ == nullptr ? 
-      "loss" : metric_->metric_type();
-    Color::print_action(
-      StringPrintf("Early-stopping at epoch %d, best %s: %f", 
-        best_epoch, metric_name.c_str(), best_result)
-    );
-    model_->Shrink();
-  } else {  // for cv
-    metric_info_.push_back(te_info);
+  finish_train(te_info);
+}
+
+/*********************************************************
+ *  Train function using pipelined validation            *
+ *********************************************************/
+//------------------------------------------------------------------------------
+// The validation of epoch n runs on a snapshot of the model,
+// concurrently with the training of epoch n+1:
+//
+//   train:  | epoch 1 | epoch 2 | epoch 3 | ...
+//   valid:            | snap 1  | snap 2  | snap 3 ...
+//
+// The early-stopping decision of epoch n is made after epoch n+1,
+// and we roll back to the best snapshot by using Shrink().
+//------------------------------------------------------------------------------
+void Trainer::train_pipeline(std::vector<Reader*>& train_reader,
+                             std::vector<Reader*>& test_reader) {
+  init_early_stop();
+  MetricInfo te_info;
+  show_head_info(true);
+  std::thread valid;
+  bool pending = false;
+  real_t pending_loss = 0;
+  real_t pending_time = 0;
+  bool stop = false;
+  Profiler::Collect();
+  ThreadPool::CollectStat();
+  for (int n = 1; n <= epoch_; ++n) {
+    Timer timer;
+    timer.tic();
+    // Calc grad and update model
+    real_t tr_loss = calc_gradient(train_reader);
+    real_t time_cost = timer.toc();
+    save_checkpoint(n);
+    // Wait the validation of the last epoch, and the
+    // record of epoch n contains the validation of n-1
+    bool last = pending;
+    if (pending) {
+      valid.join();
+      pending = false;
+    }
+    record_epoch(n, time_cost, tr_loss);
+    if (last) {
+      show_train_info(pending_loss,
+                      te_info.loss_val,
+                      te_info.metric_val,
+                      pending_time,
+                      true,
+                      n-1);
+      if (early_stop_ && check_early_stop(te_info, n-1, &snapshot_)) {
+        stop = true;
+        break;
+      }
+    }
+    // Take a snapshot and evaluate it in background. The
+    // snapshot has no gradient cache of adagrad and ftrl.
+    snapshot_.CopyValueFrom(*model_);
+    pending_loss = tr_loss;
+    pending_time = time_cost;
+    pending = true;
+    valid = std::thread([this, &test_reader, &te_info]() {
+      te_info = this->calc_metric(test_reader,
+                                  &snapshot_,
+                                  valid_loss_,
+                                  valid_metric_);
+    });
   }
+  // The validation of the last epoch
+  if (pending) {
+    valid.join();
+    show_train_info(pending_loss,
+                    te_info.loss_val,
+                    te_info.metric_val,
+                    pending_time,
+                    true,
+                    epoch_);
+    if (early_stop_ && !stop) {
+      check_early_stop(te_info, epoch_, &snapshot_);
+    }
+  }
+  finish_train(te_info);
 }
 
 /*********************************************************
  *  Calc gradient and update model                       *
  *********************************************************/
 real_t Trainer::calc_gradient(std::vector<Reader*>& reader) {
+  if (!dist_loss_.empty()) {
+    return calc_gradient_dist(reader);
+  }
+  return calc_gradient(reader, model_, loss_);
+}
+
+real_t Trainer::calc_gradient(std::vector<Reader*>& reader,
+                              Model* model,
+                              Loss* loss) {
   CHECK_NE(reader.empty(), true);
-  loss_->Reset();
+  loss->Reset();
   for (int i = 0; i < reader.size(); ++i) {
     reader[i]->Reset();
     DMatrix* matrix = nullptr;
     for (;;) {
-      index_t tmp = reader[i]->Samples(matrix);
+      index_t tmp = 0;
+      {
+        ProfileScope scope(kPhaseRead);
+        tmp = reader[i]->Samples(matrix);
+      }
       if (tmp == 0) { break; }
-      loss_->CalcGrad(matrix, *model_);
+      Profiler::AddCount(kCountRow, tmp);
+      loss->CalcGrad(matrix, *model);
     }
   }
-  return loss_->GetLoss();
+  // Stop the feature counting and evict the stale rows
+  if (model->IsSparse()) {
+    model->EndEpoch();
+  }
+  return loss->GetLoss();
+}
+
+/*********************************************************
+ *  Calc gradient by distributed workers                 *
+ *********************************************************/
+real_t Trainer::calc_gradient_dist(std::vector<Reader*>& reader) {
+  CHECK_NE(reader.empty(), true);
+  size_t worker_num = dist_loss_.size();
+  std::vector<index_t> count(worker_num, 0);
+  for (size_t w = 0; w < worker_num; ++w) {
+    dist_loss_[w]->Reset();
+  }
+  for (int i = 0; i < reader.size(); ++i) {
+    reader[i]->Reset();
+    DMatrix* matrix = nullptr;
+    for (;;) {
+      index_t tmp = 0;
+      {
+        ProfileScope scope(kPhaseRead);
+        tmp = reader[i]->Samples(matrix);
+      }
+      if (tmp == 0) { break; }
+      Profiler::AddCount(kCountRow, tmp);
+      // Each worker gets a continuous part of the rows
+      index_t part = (tmp + worker_num - 1) / worker_num;
+      matrix->pos = 0;
+      int num_task = 0;
+      for (size_t w = 0; w < worker_num; ++w) {
+        index_t len = matrix->GetMiniBatch(part, dist_part_[w]);
+        if (len == 0) { break; }
+        count[w] += len;
+        dist_pool_->enqueue(std::bind(&Loss::CalcGradDist,
+                                      dist_loss_[w],
+                                      &dist_part_[w]));
+        num_task++;
+      }
+      dist_pool_->Sync(num_task);
+    }
+  }
+  // Get the global model for validation and checkpoint
+  dist_loss_[0]->PullModel(*model_);
+  real_t loss_sum = 0;
+  index_t total = 0;
+  for (size_t w = 0; w < worker_num; ++w) {
+    if (count[w] == 0) { continue; }
+    loss_sum += dist_loss_[w]->GetLoss() * count[w];
+    total += count[w];
+  }
+  return loss_sum / total;
 }
 
 /*********************************************************
  *  Calc evaluation metric                               *
  *********************************************************/
 MetricInfo Trainer::calc_metric(std::vector<Reader*>& reader_list) {
+  return calc_metric(reader_list, model_, loss_, metric_);
+}
+
+MetricInfo Trainer::calc_metric(std::vector<Reader*>& reader_list,
+                                Model* model,
+                                Loss* loss,
+                                Metric* metric) {
   CHECK_NE(reader_list.empty(), true);
+  ProfileScope eval_scope(kPhaseEval);
   DMatrix* matrix = nullptr;
   std::vector<real_t> pred;
-  if (metric_ != nullptr) {
-    metric_->Reset();
+  if (metric != nullptr) {
+    metric->Reset();
   }
-  loss_->Reset();
+  loss->Reset();
   for (int i = 0; i < reader_list.size(); ++i) {
     reader_list[i]->Reset();
     for (;;) {
-      index_t tmp = reader_list[i]->Samples(matrix);
+      index_t tmp = 0;
+      {
+        ProfileScope scope(kPhaseRead);
+        tmp = reader_list[i]->Samples(matrix);
+      }
       if (tmp == 0) { break; }
       if (tmp != pred.size()) { pred.resize(tmp); }
-      loss_->Predict(matrix, *model_, pred);
-      loss_->Evalute(pred, matrix->Y);
-      if (metric_ != nullptr) {
-        metric_->Accumulate(matrix->Y, pred);
+      loss->Predict(matrix, *model, pred);
+      loss->Evalute(pred, matrix->Y);
+      if (metric != nullptr) {
+        metric->AccumulateMatrix(matrix, pred);
       }
     }
   }
   MetricInfo info;
-  info.loss_val = loss_->GetLoss();
-  if (metric_ != nullptr) {
-    info.metric_val = metric_->GetMetric();
+  info.loss_val = loss->GetLoss();
+  if (metric != nullptr) {
+    info.metric_val = metric->GetMetric();
   }
   return info;
 }
@@ -24,14 +24,35 @@ This file defines the Trainer class.
 #include <vector>
 
 #include "src/base/common.h"
+#include "src/base/file_util.h"
 #include "src/base/format_print.h"
+#include "src/base/profiler.h"
+#include "src/base/thread_pool.h"
 #include "src/reader/reader.h"
 #include "src/data/model_parameters.h"
 #include "src/loss/loss.h"
 #include "src/loss/metric.h"
+#include "src/solver/checkpoint.h"
 
 namespace xLearn {
 
+//------------------------------------------------------------------------------
+// CVWorker trains the folds of parallel cross-validation one by one.
+// Different workers own different model, loss, and metric, which
+// are bound to different thread pools, and each of them has its own
+// Reader cursors over the shared (read-only) fold data.
+//------------------------------------------------------------------------------
+struct CVWorker {
+  /* One Reader cursor for each fold */
+  std::vector<Reader*> reader_list;
+  /* Model trained by current worker */
+  Model* model = nullptr;
+  /* Loss function bound to the thread pool of current worker */
+  Loss* loss = nullptr;
+  /* Evaluation metric bound to the same thread pool */
+  Metric* metric = nullptr;
+};
+
 //------------------------------------------------------------------------------
 // Trainer is the core class of xLearn, which can perform
 // standard training process (training set and test set), as 
@@ -40,8 +61,26 @@ namespace xLearn {
 class Trainer {
  public:
   // Constructor and Destructor
-  Trainer() {}
-  ~Trainer() {}
+  Trainer()
+   : valid_loss_(nullptr),
+     valid_metric_(nullptr),
+     dist_pool_(nullptr),
+     checkpoint_(nullptr),
+     profile_file_(nullptr),
+     trace_file_(nullptr) { }
+  ~Trainer() {
+    delete dist_pool_;
+    if (profile_file_ != nullptr) {
+      Profiler::Enable(false);
+      Close(profile_file_);
+    }
+    if (trace_file_ != nullptr) {
+      ThreadPool::WriteTrace(trace_file_);
+      ThreadPool::FinishTrace(trace_file_);
+      ThreadPool::EnableTrace(false);
+      Close(trace_file_);
+    }
+  }
 
   // Invoke this function before we use this class
   void Initialize(std::vector<Reader*>& reader_list,
@@ -68,6 +107,75 @@ class Trainer {
     quiet_ = quiet;
   }
 
+  // Open the pipelined validation. The validation of each epoch
+  // runs on a snapshot of the model, concurrently with the training
+  // of the next epoch, and hence the early-stopping decision is made
+  // one epoch later. The valid_loss and valid_metric should be bound
+  // to a different thread pool from the one used by training.
+  void InitPipeline(Loss* valid_loss, Metric* valid_metric) {
+    CHECK_NOTNULL(valid_loss);
+    // Do not check valid_metric == nullptr
+    valid_loss_ = valid_loss;
+    valid_metric_ = valid_metric;
+  }
+
+  // Write checkpoints in background during the training.
+  void InitCheckpoint(Checkpoint* checkpoint) {
+    CHECK_NOTNULL(checkpoint);
+    checkpoint_ = checkpoint;
+  }
+
+  // Write the time of each phase (read, parse, grad, sync, eval and
+  // checkpoint) and the counters of each epoch to the given file, one
+  // JSON object per line. The profiling is turned on until the Trainer
+  // is destroyed. The parallel cross-validation is not profiled.
+  void InitProfile(const std::string& filename) {
+    CHECK_NE(filename.empty(), true);
+    profile_file_ = OpenFileOrDie(filename.c_str(), "w");
+    Profiler::Enable(true);
+  }
+
+  // Write the tasks of the thread pools and their Sync() to the
+  // given file in the Chrome-trace format, which can be opened by
+  // chrome://tracing or Perfetto. The events are written after each
+  // epoch, and the trace is turned on until the Trainer is destroyed.
+  void InitTrace(const std::string& filename) {
+    CHECK_NE(filename.empty(), true);
+    trace_file_ = OpenFileOrDie(filename.c_str(), "w");
+    WriteDataToDisk(trace_file_, "[\n", 2);
+    ThreadPool::EnableTrace(true);
+  }
+
+  // Open the parallel cross-validation. Each worker trains one fold
+  // at a time, and the folds are assigned to the idle workers until
+  // all of them have been trained. The model_ is used as the initial
+  // model of every fold and it will not be changed.
+  void InitParallelCV(const std::vector<CVWorker>& workers) {
+    CHECK_NE(workers.empty(), true);
+    for (size_t i = 0; i < workers.size(); ++i) {
+      CHECK_EQ(workers[i].reader_list.size(), reader_list_.size());
+      CHECK_NOTNULL(workers[i].model);
+      CHECK_NOTNULL(workers[i].loss);
+    }
+    cv_worker_ = workers;
+  }
+
+  // Open the distributed training. Each worker computes the gradient
+  // on a part of the training data by Loss::CalcGradDist(), and all
+  // of the workers share the global model on the parameter server.
+  // The model_ is pulled from the parameter server after each epoch.
+  void InitDist(const std::vector<Loss*>& workers) {
+    CHECK_NE(workers.empty(), true);
+    for (size_t i = 0; i < workers.size(); ++i) {
+      CHECK_NOTNULL(workers[i]);
+    }
+    dist_loss_ = workers;
+    dist_part_.resize(workers.size());
+    if (dist_pool_ == nullptr) {
+      dist_pool_ = new ThreadPool(workers.size());
+    }
+  }
+
   // Training without cross-validation
   void Train();
 
@@ -81,13 +189,29 @@ class Trainer {
     model_->Serialize(filename);
   }
 
-  // Save txt model to disk file
-  void SaveTxtModel(const std::string& filename) {
+  // Save txt model to disk file. The model
+  // can be formatted by the given thread pool.
+  void SaveTxtModel(const std::string& filename, 
+                    ThreadPool* pool = nullptr) {
     CHECK_NE(filename.empty(), true);
     CHECK_NE(filename.compare("none"), 0);
-    model_->SerializeToTXT(filename);
+    model_->SerializeToTXT(filename, pool);
   }
 
+  // Save the pruned inference model to disk file, and
+  // return the number of features kept in the file.
+  index_t SavePrunedModel(const std::string& filename) {
+    CHECK_NE(filename.empty(), true);
+    CHECK_NE(filename.compare("none"), 0);
+    return model_->SerializePruned(filename);
+  }
+
+  // Save the inference-only model to disk file. The int8 model
+  // is compared with the fp32 model on the validation set, and the
+  // loss and metric of both models are printed.
+  void SaveInferenceModel(const std::string& filename,
+                          bool quantize = false);
+
  protected:
   /* The reader_list_ contains both of the 
   training data and the validation data. */
@@ -108,17 +232,85 @@ class Trainer {
   Metric* metric_;
   /* Store each metric info of cross-validation */
   std::vector<MetricInfo> metric_info_;
+  /* Loss function used by pipelined validation */
+  Loss* valid_loss_;
+  /* Evaluation metric used by pipelined validation */
+  Metric* valid_metric_;
+  /* Model snapshot for pipelined validation, which has no gradient
+  cache, and is allocated once and re-used for each epoch */
+  Model snapshot_;
+  /* Workers for parallel cross-validation */
+  std::vector<CVWorker> cv_worker_;
+  /* Loss functions of the distributed workers */
+  std::vector<Loss*> dist_loss_;
+  /* Part of the training data for each distributed worker */
+  std::vector<DMatrix> dist_part_;
+  /* One thread for each distributed worker */
+  ThreadPool* dist_pool_;
+  /* Background checkpoint */
+  Checkpoint* checkpoint_;
+  /* JSON lines of the profiling */
+  FILE* profile_file_;
+  /* Chrome-trace timeline of the thread pools */
+  FILE* trace_file_;
+  /* The following variables are used for early-stopping */
+  int best_epoch_;
+  int stop_count_;
+  real_t best_result_;
+  real_t prev_result_;
 
   // Basic train function
   void train(std::vector<Reader*>& train_reader,
              std::vector<Reader*>& test_reader);
 
+  // Train function using pipelined validation
+  void train_pipeline(std::vector<Reader*>& train_reader,
+                      std::vector<Reader*>& test_reader);
+
+  // Cross-validation using the CVWorkers
+  void cv_train_parallel();
+
+  // Train one fold on the given worker and
+  // return the metric info of the last epoch.
+  MetricInfo train_fold(CVWorker& worker, int fold);
+
+  // Reset the early-stopping records.
+  void init_early_stop();
+
+  // Update the early-stopping records using the validation result of
+  // the given epoch, and record the model if it is the best one so far.
+  // Return true if we need to stop training.
+  bool check_early_stop(const MetricInfo& te_info, 
+                        int epoch, 
+                        Model* model);
+
+  // Write checkpoint after the given epoch.
+  void save_checkpoint(int epoch);
+
+  // Log the memory and the thread pools, and write the profiling
+  // record and the timeline of the given epoch.
+  void record_epoch(int epoch, real_t time_cost, real_t tr_loss);
+
+  // Shrink back to the best model or store the cv info.
+  void finish_train(const MetricInfo& te_info);
+
   // Caculate gradient and update model.
   // Return training loss.
   real_t calc_gradient(std::vector<Reader*>& reader_list);
+  real_t calc_gradient(std::vector<Reader*>& reader_list,
+                       Model* model,
+                       Loss* loss);
+
+  // Caculate gradient by the distributed workers.
+  // Return training loss.
+  real_t calc_gradient_dist(std::vector<Reader*>& reader_list);
 
   // Calculate loss value and evaluation metric.
   MetricInfo calc_metric(std::vector<Reader*>& reader_list);
+  MetricInfo calc_metric(std::vector<Reader*>& reader_list,
+                         Model* model,
+                         Loss* loss,
+                         Metric* metric);
 
   // Calculate average metric for cross-validation
   void show_average_metric();